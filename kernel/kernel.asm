@@ -1,10 +1,21 @@
 ; kernel.asm
 
+; флаги: выравнивание модулей (0x01), сведения о памяти (0x02),
+; видеорежим из полей заголовка (0x04)
+MULTIBOOT_FLAGS equ 0x01 | 0x02 | 0x04
+
 section .multiboot
 align 4
 dd 0x1BADB002 ; магическое число
-dd 0x01 ; флаги (только флаг 0x01 для поддержки памяти)
-dd - (0x1BADB002 + 0x01) ; контрольная сумма
+dd MULTIBOOT_FLAGS
+dd - (0x1BADB002 + MULTIBOOT_FLAGS) ; контрольная сумма
+dd 0, 0, 0, 0, 0 ; адреса загрузки (не используются без флага 0x10000)
+; Запрашиваемый видеорежим: линейный кадровый буфер 1024x768x32
+; (FB_REQUESTED_* в modules/framebuffer/framebuffer.h)
+dd 0 ; тип: графический
+dd 1024 ; ширина
+dd 768 ; высота
+dd 32 ; бит на пиксель
 
 section .text
 global start
@@ -13,7 +24,8 @@ extern kmain ; kmain определена во внешнем файле
 start:
     cli ; блокировка прерываний
     mov esp, stack_space ; указатель стека
-    push eax ; передаем multiboot_structure в kmain
+    push ebx ; адрес информации Multiboot - второй аргумент kmain
+    push eax ; магическое число - первый аргумент
     call kmain
     hlt ; остановка процессора
 
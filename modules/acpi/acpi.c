@@ -0,0 +1,206 @@
+#include "acpi.h"
+#include "../templates/kernel_api.h"
+#include <stddef.h>
+
+// Типы записей MADT
+#define MADT_ENTRY_LAPIC 0
+#define MADT_ENTRY_IOAPIC 1
+#define MADT_ENTRY_SOURCE_OVERRIDE 2
+#define MADT_ENTRY_LAPIC_OVERRIDE 5
+
+#define MADT_FLAG_PCAT_COMPAT 0x01
+#define MADT_LAPIC_ENABLED 0x01
+
+typedef struct {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct {
+    acpi_sdt_header_t header;
+    uint32_t lapic_address;
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed)) madt_entry_header_t;
+
+typedef struct {
+    madt_entry_header_t header;
+    uint8_t acpi_processor_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed)) madt_lapic_t;
+
+typedef struct {
+    madt_entry_header_t header;
+    uint8_t ioapic_id;
+    uint8_t reserved;
+    uint32_t address;
+    uint32_t gsi_base;
+} __attribute__((packed)) madt_ioapic_t;
+
+typedef struct {
+    madt_entry_header_t header;
+    uint8_t bus;                // 0 - ISA
+    uint8_t source;             // Линия IRQ шины
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed)) madt_source_override_t;
+
+typedef struct {
+    madt_entry_header_t header;
+    uint16_t reserved;
+    uint64_t address;
+} __attribute__((packed)) madt_lapic_override_t;
+
+acpi_madt_info_t acpi_madt;
+
+static acpi_sdt_header_t* rsdt = NULL;
+
+static bool checksum_ok(const void* data, uint32_t length) {
+    const uint8_t* bytes = data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+static bool signature_equals(const char* a, const char* b, int length) {
+    for (int i = 0; i < length; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// RSDP лежит на 16-байтной границе в первом КБ EBDA или в 0xE0000-0xFFFFF
+static acpi_rsdp_t* scan_rsdp(uint32_t start, uint32_t end) {
+    for (uint32_t addr = start; addr < end; addr += 16) {
+        acpi_rsdp_t* rsdp = (acpi_rsdp_t*)addr;
+        if (signature_equals(rsdp->signature, "RSD PTR ", 8) && checksum_ok(rsdp, 20)) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+static acpi_rsdp_t* find_rsdp(void) {
+    // Сегмент EBDA записан BIOS по адресу 0x40E
+    volatile uint16_t* ebda_segment = (volatile uint16_t*)0x40E;
+    asm ("" : "+r" (ebda_segment));
+    uint32_t ebda = (uint32_t)*ebda_segment << 4;
+    acpi_rsdp_t* rsdp = NULL;
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        rsdp = scan_rsdp(ebda, ebda + 1024);
+    }
+    if (rsdp == NULL) {
+        rsdp = scan_rsdp(0xE0000, 0x100000);
+    }
+    return rsdp;
+}
+
+acpi_sdt_header_t* acpi_find_table(const char* signature) {
+    if (rsdt == NULL) {
+        return NULL;
+    }
+    uint32_t entries = (rsdt->length - sizeof(acpi_sdt_header_t)) / 4;
+    uint32_t* pointers = (uint32_t*)(rsdt + 1);
+    for (uint32_t i = 0; i < entries; i++) {
+        acpi_sdt_header_t* table = (acpi_sdt_header_t*)pointers[i];
+        if (signature_equals(table->signature, signature, 4) &&
+            checksum_ok(table, table->length)) {
+            return table;
+        }
+    }
+    return NULL;
+}
+
+static void parse_madt(acpi_madt_t* madt) {
+    acpi_madt.lapic_address = madt->lapic_address;
+    acpi_madt.pic_present = (madt->flags & MADT_FLAG_PCAT_COMPAT) != 0;
+    acpi_madt.cpu_count = 0;
+    acpi_madt.ioapic_count = 0;
+    for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+        acpi_madt.isa_irqs[irq].gsi = irq;
+        acpi_madt.isa_irqs[irq].flags = 0;
+    }
+
+    uint8_t* entry = (uint8_t*)(madt + 1);
+    uint8_t* end = (uint8_t*)madt + madt->header.length;
+    while (entry + sizeof(madt_entry_header_t) <= end) {
+        madt_entry_header_t* header = (madt_entry_header_t*)entry;
+        if (header->length < sizeof(madt_entry_header_t)) {
+            break;
+        }
+
+        switch (header->type) {
+            case MADT_ENTRY_LAPIC: {
+                madt_lapic_t* lapic = (madt_lapic_t*)entry;
+                if ((lapic->flags & MADT_LAPIC_ENABLED) && acpi_madt.cpu_count < MAX_CPUS) {
+                    acpi_madt.lapic_ids[acpi_madt.cpu_count++] = lapic->apic_id;
+                }
+                break;
+            }
+            case MADT_ENTRY_IOAPIC: {
+                madt_ioapic_t* ioapic = (madt_ioapic_t*)entry;
+                if (acpi_madt.ioapic_count < ACPI_MAX_IOAPICS) {
+                    acpi_ioapic_t* info = &acpi_madt.ioapics[acpi_madt.ioapic_count++];
+                    info->id = ioapic->ioapic_id;
+                    info->address = ioapic->address;
+                    info->gsi_base = ioapic->gsi_base;
+                }
+                break;
+            }
+            case MADT_ENTRY_SOURCE_OVERRIDE: {
+                madt_source_override_t* override = (madt_source_override_t*)entry;
+                if (override->bus == 0 && override->source < ACPI_ISA_IRQS) {
+                    acpi_madt.isa_irqs[override->source].gsi = override->gsi;
+                    acpi_madt.isa_irqs[override->source].flags = override->flags;
+                }
+                break;
+            }
+            case MADT_ENTRY_LAPIC_OVERRIDE: {
+                madt_lapic_override_t* override = (madt_lapic_override_t*)entry;
+                if ((override->address >> 32) == 0) {
+                    acpi_madt.lapic_address = (uint32_t)override->address;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        entry += header->length;
+    }
+}
+
+bool acpi_init(void) {
+    acpi_rsdp_t* rsdp = find_rsdp();
+    if (rsdp == NULL) {
+        print_string("ACPI: RSDP not found\n", LIGHT_RED_ON_BLACK);
+        return false;
+    }
+
+    rsdt = (acpi_sdt_header_t*)rsdp->rsdt_address;
+    if (!signature_equals(rsdt->signature, "RSDT", 4) || !checksum_ok(rsdt, rsdt->length)) {
+        print_string("ACPI: invalid RSDT\n", LIGHT_RED_ON_BLACK);
+        rsdt = NULL;
+        return false;
+    }
+
+    acpi_madt_t* madt = (acpi_madt_t*)acpi_find_table("APIC");
+    if (madt == NULL) {
+        print_string("ACPI: MADT not found\n", LIGHT_RED_ON_BLACK);
+        return false;
+    }
+
+    parse_madt(madt);
+    return acpi_madt.cpu_count > 0;
+}
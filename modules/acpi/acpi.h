@@ -0,0 +1,64 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../cpu/cpu.h"
+
+// Заголовок системной таблицы ACPI
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+// Наибольшее число I/O APIC и линий ISA, описанных в MADT
+#define ACPI_MAX_IOAPICS 4
+#define ACPI_ISA_IRQS 16
+
+// Флаги MPS INTI записи переназначения (полярность и режим запуска).
+// «Как у шины» для ISA означает высокий уровень и запуск по фронту.
+#define ACPI_INTI_POLARITY_MASK 0x3
+#define ACPI_INTI_POLARITY_LOW 0x3
+#define ACPI_INTI_TRIGGER_MASK 0xC
+#define ACPI_INTI_TRIGGER_LEVEL 0xC
+
+// I/O APIC: линии с gsi_base по gsi_base + число входов - 1
+typedef struct {
+    uint8_t id;
+    uint32_t address;                   // Физический адрес регистров
+    uint32_t gsi_base;                  // Первое глобальное прерывание (GSI)
+} acpi_ioapic_t;
+
+// Куда приходит линия ISA (по умолчанию GSI = номер IRQ)
+typedef struct {
+    uint32_t gsi;
+    uint16_t flags;                     // ACPI_INTI_*
+} acpi_isa_irq_t;
+
+// Сведения, извлеченные из MADT
+typedef struct {
+    uint32_t lapic_address;             // Физический адрес локальных APIC
+    uint32_t cpu_count;                 // Количество включенных процессоров
+    uint8_t lapic_ids[MAX_CPUS];        // Идентификаторы их APIC
+    bool pic_present;                   // Присутствует пара 8259 (флаг PCAT_COMPAT)
+    uint32_t ioapic_count;
+    acpi_ioapic_t ioapics[ACPI_MAX_IOAPICS];
+    acpi_isa_irq_t isa_irqs[ACPI_ISA_IRQS]; // С учетом записей Interrupt Source Override
+} acpi_madt_info_t;
+
+extern acpi_madt_info_t acpi_madt;
+
+// Поиск RSDP и разбор MADT. Возвращает false, если таблицы не найдены.
+bool acpi_init(void);
+
+// Поиск таблицы по сигнатуре в RSDT
+acpi_sdt_header_t* acpi_find_table(const char* signature);
+
+#endif // ACPI_H
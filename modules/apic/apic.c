@@ -0,0 +1,320 @@
+#include "apic.h"
+#include "../templates/kernel_api.h"
+#include "../templates/io.h"
+#include "../interrupts/interrupts.h"
+#include "../timer/timer.h"
+#include "../acpi/acpi.h"
+#include "../cpu/cpu.h"
+#include <stddef.h>
+
+// Регистры локального APIC (смещения от базового адреса)
+#define LAPIC_ID 0x020
+#define LAPIC_TPR 0x080
+#define LAPIC_EOI 0x0B0
+#define LAPIC_SVR 0x0F0
+#define LAPIC_ICR_LOW 0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_LVT_ERROR 0x370
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE 0x3E0
+
+#define LAPIC_SVR_ENABLE 0x100
+#define LVT_MASKED 0x10000
+#define LVT_TIMER_ONESHOT 0x00000
+#define LVT_TIMER_PERIODIC 0x20000
+#define LVT_TIMER_TSC_DEADLINE 0x40000
+#define LVT_DELIVERY_EXTINT 0x700
+#define LVT_DELIVERY_NMI 0x400
+#define ICR_DELIVERY_INIT 0x500
+#define ICR_DELIVERY_STARTUP 0x600
+#define ICR_LEVEL_ASSERT 0x4000
+#define ICR_DELIVERY_PENDING 0x1000
+#define TIMER_DIVIDE_BY_16 0x3
+
+// Регистры I/O APIC: индекс пишется в IOREGSEL, значение читается из IOWIN
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WIN 0x10
+#define IOAPIC_REG_VER 0x01
+#define IOAPIC_REG_REDTBL 0x10
+#define IOAPIC_POLARITY_LOW (1 << 13)
+#define IOAPIC_TRIGGER_LEVEL (1 << 15)
+#define IOAPIC_MASKED (1 << 16)
+
+#define IA32_APIC_BASE_MSR 0x1B
+#define IA32_APIC_BASE_ENABLE 0x800
+#define IA32_TSC_DEADLINE_MSR 0x6E0
+#define CPUID_FEATURE_APIC (1 << 9)
+#define CPUID_FEATURE_TSC_DEADLINE (1 << 24)
+
+// Интервал калибровки таймера APIC по PIT
+#define APIC_CALIBRATION_MS 10
+
+bool apic_enabled = false;
+bool ioapic_enabled = false;
+
+static volatile uint32_t* lapic_base = NULL;
+static uint32_t lapic_timer_ticks_per_ms = 0;
+static uint32_t lapic_timer_ticks_per_tick = 0;
+// Таймер APIC умеет срабатывать по значению TSC (режим TSC-deadline)
+static bool tsc_deadline_supported = false;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_base[reg / 4] = value;
+    (void)lapic_base[LAPIC_ID / 4]; // Дожидаемся завершения записи
+}
+
+uint32_t lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+static void lapic_wait_icr(void) {
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVERY_PENDING) {
+        asm volatile ("pause");
+    }
+}
+
+static void lapic_send(uint32_t apic_id, uint32_t command) {
+    lapic_wait_icr();
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    lapic_wait_icr();
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector) {
+    lapic_send(apic_id, vector);
+}
+
+void lapic_send_init(uint32_t apic_id) {
+    lapic_send(apic_id, ICR_DELIVERY_INIT | ICR_LEVEL_ASSERT);
+}
+
+void lapic_send_startup(uint32_t apic_id, uint8_t page) {
+    lapic_send(apic_id, ICR_DELIVERY_STARTUP | page);
+}
+
+static void lapic_timer_interrupt(interrupt_frame_t* frame) {
+    (void)frame;
+    timer_tick();
+}
+
+static void lapic_reschedule_interrupt(interrupt_frame_t* frame) {
+    (void)frame;
+    this_cpu()->need_resched = true;
+}
+
+static void lapic_spurious_interrupt(interrupt_frame_t* frame) {
+    (void)frame;
+}
+
+// Общая настройка локального APIC текущего процессора
+static void lapic_setup(bool bsp) {
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    // Прерывания 8259 приходят на LINT0 загрузочного процессора
+    lapic_write(LAPIC_LVT_LINT0, bsp ? LVT_DELIVERY_EXTINT : LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, bsp ? LVT_DELIVERY_NMI : LVT_MASKED);
+    lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+}
+
+static void lapic_timer_start(void) {
+    lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_BY_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_TIMER_PERIODIC | APIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INITIAL, lapic_timer_ticks_per_tick);
+}
+
+void apic_timer_oneshot(uint32_t us) {
+    // Момент срабатывания известен: задержку пробуждения видно в irqstat
+    uint64_t deadline = rdtsc() + (uint64_t)us * (timer_tsc_per_ms() / 1000);
+    interrupt_expect(this_cpu()->index, APIC_TIMER_VECTOR, deadline);
+
+    if (tsc_deadline_supported) {
+        lapic_write(LAPIC_LVT_TIMER, LVT_TIMER_TSC_DEADLINE | APIC_TIMER_VECTOR);
+        // Запись LVT должна быть видна до записи MSR
+        asm volatile ("mfence" : : : "memory");
+        wrmsr(IA32_TSC_DEADLINE_MSR, deadline);
+        return;
+    }
+
+    uint64_t count = udiv64_32((uint64_t)us * lapic_timer_ticks_per_ms, 1000, NULL);
+    if (count == 0) {
+        count = 1;
+    } else if (count > 0xFFFFFFFF) {
+        count = 0xFFFFFFFF;
+    }
+    lapic_write(LAPIC_LVT_TIMER, LVT_TIMER_ONESHOT | APIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INITIAL, (uint32_t)count);
+}
+
+void apic_timer_periodic(void) {
+    interrupt_expect(this_cpu()->index, APIC_TIMER_VECTOR, 0);
+    if (tsc_deadline_supported) {
+        wrmsr(IA32_TSC_DEADLINE_MSR, 0);
+    }
+    lapic_timer_start();
+}
+
+// Измерение частоты таймера APIC по каналу 2 PIT
+static void lapic_timer_calibrate(void) {
+    lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_BY_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+    timer_pit_wait_ms(APIC_CALIBRATION_MS);
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+    lapic_write(LAPIC_TIMER_INITIAL, 0);
+
+    lapic_timer_ticks_per_ms = elapsed / APIC_CALIBRATION_MS;
+    lapic_timer_ticks_per_tick = lapic_timer_ticks_per_ms * (1000 / TIMER_HZ);
+}
+
+bool init_apic(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEATURE_APIC)) {
+        return false;
+    }
+    tsc_deadline_supported = (ecx & CPUID_FEATURE_TSC_DEADLINE) != 0;
+
+    uint64_t base = rdmsr(IA32_APIC_BASE_MSR);
+    if (acpi_madt.lapic_address != 0) {
+        lapic_base = (volatile uint32_t*)acpi_madt.lapic_address;
+    } else {
+        lapic_base = (volatile uint32_t*)(uint32_t)(base & 0xFFFFF000);
+    }
+    wrmsr(IA32_APIC_BASE_MSR, base | IA32_APIC_BASE_ENABLE);
+
+    register_interrupt_handler(APIC_TIMER_VECTOR, lapic_timer_interrupt);
+    register_interrupt_handler(APIC_RESCHEDULE_VECTOR, lapic_reschedule_interrupt);
+    register_interrupt_handler(APIC_SPURIOUS_VECTOR, lapic_spurious_interrupt);
+
+    lapic_setup(true);
+    lapic_timer_calibrate();
+    if (lapic_timer_ticks_per_tick == 0) {
+        return false;
+    }
+
+    // Тик планировщика переходит с PIT на таймер APIC
+    uint32_t flags = irq_save();
+    timer_stop_pit();
+    lapic_timer_start();
+    apic_enabled = true;
+    irq_restore(flags);
+
+    this_cpu()->apic_id = lapic_id();
+    return true;
+}
+
+// ============== I/O APIC ==============
+
+static uint32_t ioapic_read(uint32_t base, uint32_t reg) {
+    volatile uint32_t* regs = (volatile uint32_t*)base;
+    regs[IOAPIC_REGSEL / 4] = reg;
+    return regs[IOAPIC_WIN / 4];
+}
+
+static void ioapic_write(uint32_t base, uint32_t reg, uint32_t value) {
+    volatile uint32_t* regs = (volatile uint32_t*)base;
+    regs[IOAPIC_REGSEL / 4] = reg;
+    regs[IOAPIC_WIN / 4] = value;
+}
+
+// I/O APIC, к которому подключен глобальный номер прерывания; в pin -
+// номер его входа
+static const acpi_ioapic_t* ioapic_for_gsi(uint32_t gsi, uint32_t* pin) {
+    for (uint32_t i = 0; i < acpi_madt.ioapic_count; i++) {
+        const acpi_ioapic_t* ioapic = &acpi_madt.ioapics[i];
+        uint32_t entries = ((ioapic_read(ioapic->address, IOAPIC_REG_VER) >> 16) & 0xFF) + 1;
+        if (gsi >= ioapic->gsi_base && gsi < ioapic->gsi_base + entries) {
+            *pin = gsi - ioapic->gsi_base;
+            return ioapic;
+        }
+    }
+    return NULL;
+}
+
+// Запись элемента перенаправления для линии ISA: фиксированная доставка
+// на процессор dest (физический режим)
+static bool ioapic_route(uint8_t irq, uint8_t dest, bool masked) {
+    const acpi_isa_irq_t* isa = &acpi_madt.isa_irqs[irq];
+    uint32_t pin;
+    const acpi_ioapic_t* ioapic = ioapic_for_gsi(isa->gsi, &pin);
+    if (ioapic == NULL) {
+        return false;
+    }
+
+    uint32_t low = IRQ_BASE + irq;
+    if ((isa->flags & ACPI_INTI_POLARITY_MASK) == ACPI_INTI_POLARITY_LOW) {
+        low |= IOAPIC_POLARITY_LOW;
+    }
+    if ((isa->flags & ACPI_INTI_TRIGGER_MASK) == ACPI_INTI_TRIGGER_LEVEL) {
+        low |= IOAPIC_TRIGGER_LEVEL;
+    }
+    if (masked) {
+        low |= IOAPIC_MASKED;
+    }
+    // Сначала маскируем, затем пишем назначение и наконец младшее слово
+    ioapic_write(ioapic->address, IOAPIC_REG_REDTBL + pin * 2, IOAPIC_MASKED);
+    ioapic_write(ioapic->address, IOAPIC_REG_REDTBL + pin * 2 + 1, (uint32_t)dest << 24);
+    ioapic_write(ioapic->address, IOAPIC_REG_REDTBL + pin * 2, low);
+    return true;
+}
+
+void ioapic_set_masked(uint8_t irq, bool masked) {
+    if (irq >= ACPI_ISA_IRQS) {
+        return;
+    }
+    uint32_t pin;
+    const acpi_ioapic_t* ioapic = ioapic_for_gsi(acpi_madt.isa_irqs[irq].gsi, &pin);
+    if (ioapic == NULL) {
+        return;
+    }
+    uint32_t reg = IOAPIC_REG_REDTBL + pin * 2;
+    uint32_t low = ioapic_read(ioapic->address, reg);
+    low = masked ? (low | IOAPIC_MASKED) : (low & ~IOAPIC_MASKED);
+    ioapic_write(ioapic->address, reg, low);
+}
+
+bool init_ioapic(void) {
+    if (!apic_enabled || acpi_madt.ioapic_count == 0) {
+        return false;
+    }
+
+    uint32_t flags = irq_save();
+    uint8_t dest = (uint8_t)lapic_id();
+    // Маски 8259 переносятся в I/O APIC, после чего 8259 молчит
+    uint16_t pending;
+    uint16_t pic_mask = pic_disable(&pending);
+    for (uint8_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+        if (irq != IRQ_CASCADE) {
+            ioapic_route(irq, dest, (pic_mask & (1 << irq)) != 0);
+        }
+    }
+    // Сквозная доставка 8259 через LINT0 больше не нужна
+    lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+    ioapic_enabled = true;
+
+    // Фронт, который 8259 принял, но не успел доставить, через I/O APIC
+    // уже не придет: его обработчики вызываются здесь
+    irq_replay(pending & ~pic_mask & ~(1 << IRQ_CASCADE));
+    irq_restore(flags);
+    return true;
+}
+
+void apic_init_ap(void) {
+    uint64_t base = rdmsr(IA32_APIC_BASE_MSR);
+    wrmsr(IA32_APIC_BASE_MSR, base | IA32_APIC_BASE_ENABLE);
+    lapic_setup(false);
+    lapic_timer_start();
+    this_cpu()->apic_id = lapic_id();
+}
@@ -0,0 +1,51 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Векторы, обслуживаемые локальным APIC (после них нужен EOI в APIC)
+#define APIC_VECTOR_BASE 0xF0
+#define APIC_TIMER_VECTOR 0xF0
+#define APIC_RESCHEDULE_VECTOR 0xF1
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+// Локальный APIC включен на всех процессорах
+extern bool apic_enabled;
+
+// Линии ISA доставляются через I/O APIC (иначе - через 8259 и LINT0)
+extern bool ioapic_enabled;
+
+// Включение локального APIC загрузочного процессора и перевод тика на таймер APIC
+bool init_apic(void);
+
+// Включение локального APIC на дополнительном процессоре
+void apic_init_ap(void);
+
+// Перевод линий ISA с 8259 на I/O APIC из MADT. Линии, которые были
+// разрешены в 8259, остаются разрешенными; векторы не меняются
+// (IRQ_BASE + номер IRQ). Возвращает false, если I/O APIC нет.
+bool init_ioapic(void);
+
+// Маскирование линии ISA в I/O APIC
+void ioapic_set_masked(uint8_t irq, bool masked);
+
+// Идентификатор APIC текущего процессора
+uint32_t lapic_id(void);
+
+// Однократное срабатывание таймера APIC через us микросекунд
+// (TSC-deadline, если поддерживается). Используется простаивающим процессором.
+void apic_timer_oneshot(uint32_t us);
+
+// Возврат таймера APIC к периодическому тику
+void apic_timer_periodic(void);
+
+// Подтверждение обработки прерывания
+void lapic_eoi(void);
+
+// Межпроцессорные прерывания
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+void lapic_send_init(uint32_t apic_id);
+void lapic_send_startup(uint32_t apic_id, uint8_t page);
+
+#endif // APIC_H
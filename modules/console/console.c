@@ -0,0 +1,615 @@
+#include "console.h"
+#include "../templates/kernel_api.h"
+#include "../serial/serial.h"
+#include "../framebuffer/framebuffer.h"
+#include "../klog/klog.h"
+#include "../kprintf/kprintf.h"
+#include "../kstring/kstring.h"
+#include "../sync/sync.h"
+#include "../timer/timer.h"
+#include "../workqueue/workqueue.h"
+#include "../templates/io.h"
+#include "../shell/shell.h"
+
+extern int atoi(const char *str);
+
+// Регистры CRTC
+#define CRTC_INDEX 0x3D4
+#define CRTC_DATA 0x3D5
+#define CRTC_CURSOR_START 0x0A
+#define CRTC_CURSOR_END 0x0B
+#define CRTC_START_HIGH 0x0C
+#define CRTC_START_LOW 0x0D
+#define CRTC_CURSOR_HIGH 0x0E
+#define CRTC_CURSOR_LOW 0x0F
+
+#define CELL(c, attr) ((uint16_t)(uint8_t)(c) | ((uint16_t)(uint8_t)(attr) << 8))
+
+static volatile uint16_t* const vga = (volatile uint16_t*)CONSOLE_VGA_MEMORY;
+
+// Теневой буфер повторяет раскладку видеопамяти (все 32KB). Вывод меняет
+// только его, видеопамять обновляет console_flush_locked.
+static uint16_t shadow[CONSOLE_MAX_CELLS];
+
+// Ячейка, с которой начинается экран. Прокрутка сдвигает начало экрана
+// регистрами начального адреса CRTC, не копируя видеопамять; копирование
+// нужно, только когда экран доходит до конца окна 32KB.
+static int origin = 0;
+static int origin_shown = -1;   // Начало экрана, записанное в CRTC
+
+#define SCREEN_CELL(r, c) (origin + (r) * screen_width + (c))
+
+// Вывод в кадровый буфер вместо видеопамяти текстового режима
+static bool graphics = false;
+
+// Размеры текстового экрана
+static int screen_width = 80;
+static int screen_height = 25;
+
+// Координаты курсора на экране
+static int row = 0;
+static int col = 0;
+
+// Блокировка вывода на экран: теневой буфер, row/col, видеопамять и порты
+// CRTC. Вывод возможен из обработчиков прерываний, поэтому это
+// спин-блокировка с запретом прерываний.
+static spinlock_t console_lock = SPINLOCK_INIT;
+
+// Измененные участки строк: в строке r не сброшены ячейки
+// [dirty_lo[r], dirty_hi[r]), dirty_hi[r] == 0 - строка чистая. Строки с
+// изменениями - от dirty_first до dirty_last.
+static uint16_t dirty_lo[CONSOLE_MAX_ROWS];
+static uint16_t dirty_hi[CONSOLE_MAX_ROWS];
+static int dirty_first = CONSOLE_MAX_ROWS;
+static int dirty_last = -1;
+
+// Позиция курсора, записанная в CRTC (-1 - неизвестна)
+static int cursor_shown = -1;
+// Ячейка, в которой нарисован курсор (графический режим)
+static int cursor_row_drawn = -1;
+static int cursor_col_drawn = -1;
+
+// Наибольшая часть строки, выводимая print_string под одним захватом
+// console_lock
+#define CONSOLE_STRING_CHUNK 1024
+
+// Отложенный сброс для посимвольного вывода. Выполняется рабочим потоком
+// system_wq, а не в обработчике таймера: в графическом режиме сброс после
+// прокрутки перерисовывает весь экран.
+static uint64_t last_flush = 0;
+static delayed_work_t flush_work;
+static bool flush_work_ready = false;
+static bool flush_work_queued = false;
+
+// Режимы для console-bench: запись в видеопамять и курсор после каждого
+// символа (как до появления теневого буфера) и дублирование в COM1
+static bool write_through = false;
+static bool serial_mirror = true;
+
+static console_stats_t stats;
+
+static void mark_dirty(int r, int lo, int hi) {
+    if (dirty_hi[r] == 0) {
+        dirty_lo[r] = lo;
+        dirty_hi[r] = hi;
+    } else {
+        if (lo < dirty_lo[r]) {
+            dirty_lo[r] = lo;
+        }
+        if (hi > dirty_hi[r]) {
+            dirty_hi[r] = hi;
+        }
+    }
+    if (r < dirty_first) {
+        dirty_first = r;
+    }
+    if (r > dirty_last) {
+        dirty_last = r;
+    }
+}
+
+static void mark_all_dirty(void) {
+    for (int r = 0; r < screen_height; r++) {
+        mark_dirty(r, 0, screen_width);
+    }
+}
+
+// Экран сдвинулся на строку: несброшенные участки переезжают вместе со
+// своими строками
+static void shift_dirty_up(void) {
+    for (int r = 0; r < screen_height - 1; r++) {
+        dirty_lo[r] = dirty_lo[r + 1];
+        dirty_hi[r] = dirty_hi[r + 1];
+    }
+    dirty_hi[screen_height - 1] = 0;
+    if (dirty_last >= 0) {
+        dirty_first = dirty_first > 0 ? dirty_first - 1 : 0;
+        dirty_last--;
+        if (dirty_last < dirty_first) {
+            dirty_first = CONSOLE_MAX_ROWS;
+            dirty_last = -1;
+        }
+    }
+}
+
+// Перенос измененных ячеек в видеопамять и курсора в CRTC (под console_lock)
+static void console_flush_locked(void) {
+    int position = SCREEN_CELL(row, col);
+    if (dirty_last < 0 && position == cursor_shown && origin == origin_shown) {
+        return;
+    }
+
+    // В графическом режиме курсор нарисован в ячейке: перерисовываются
+    // старая и новая позиции
+    if (graphics && position != cursor_shown) {
+        if (cursor_row_drawn >= 0 && cursor_row_drawn < screen_height &&
+            cursor_col_drawn < screen_width) {
+            mark_dirty(cursor_row_drawn, cursor_col_drawn, cursor_col_drawn + 1);
+        }
+        mark_dirty(row, col, col + 1);
+        fb_set_cursor(row, col);
+        cursor_row_drawn = row;
+        cursor_col_drawn = col;
+    }
+
+    for (int r = dirty_first; r <= dirty_last; r++) {
+        int lo = dirty_lo[r];
+        int hi = dirty_hi[r];
+        if (hi == 0) {
+            continue;
+        }
+        const uint16_t* src = shadow + SCREEN_CELL(r, 0);
+        if (graphics) {
+            fb_draw_cells(r, lo, src + lo, hi - lo);
+        } else {
+            volatile uint16_t* dst = vga + SCREEN_CELL(r, 0);
+            for (int i = lo; i < hi; i++) {
+                dst[i] = src[i];
+            }
+        }
+        stats.cells_written += hi - lo;
+        dirty_hi[r] = 0;
+    }
+    dirty_first = CONSOLE_MAX_ROWS;
+    dirty_last = -1;
+
+    // Начало экрана защелкивается CRTC в начале обратного хода луча, так что
+    // строки, записанные выше, появятся вместе с ним
+    if (origin != origin_shown) {
+        if (!graphics) {
+            outb(CRTC_INDEX, CRTC_START_HIGH);
+            outb(CRTC_DATA, (uint8_t)((origin >> 8) & 0xFF));
+            outb(CRTC_INDEX, CRTC_START_LOW);
+            outb(CRTC_DATA, (uint8_t)(origin & 0xFF));
+        }
+        origin_shown = origin;
+        stats.scrolls++;
+    }
+
+    if (position != cursor_shown) {
+        if (!graphics) {
+            outb(CRTC_INDEX, CRTC_CURSOR_LOW);
+            outb(CRTC_DATA, (uint8_t)(position & 0xFF));
+            outb(CRTC_INDEX, CRTC_CURSOR_HIGH);
+            outb(CRTC_DATA, (uint8_t)((position >> 8) & 0xFF));
+        }
+        cursor_shown = position;
+        stats.cursor_updates++;
+    }
+    stats.flushes++;
+    last_flush = rdtsc();
+}
+
+static void flush_work_func(work_t* work) {
+    (void)work;
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    flush_work_queued = false;
+    console_flush_locked();
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+// Сброс после посимвольного вывода: сразу, если последний сброс был давно,
+// иначе заданием в system_wq. Возвращает true, если задание нужно поставить
+// в очередь (это делается после освобождения console_lock).
+static bool console_flush_or_defer(void) {
+    uint64_t interval = (uint64_t)timer_tsc_per_ms() * CONSOLE_FLUSH_MS;
+    // До калибровки таймера и до init_workqueues отложить нельзя
+    if (write_through || interval == 0 || system_wq == NULL ||
+        rdtsc() - last_flush >= interval) {
+        console_flush_locked();
+        return false;
+    }
+    if (flush_work_queued) {
+        return false;
+    }
+    if (!flush_work_ready) {
+        init_delayed_work(&flush_work, flush_work_func);
+        flush_work_ready = true;
+    }
+    flush_work_queued = true;
+    stats.deferred++;
+    return true;
+}
+
+// Форма курсора: видимый, в нижних строках знакоместа
+static void show_cursor(void) {
+    cursor_shown = -1;
+    if (graphics) {
+        return;
+    }
+    outb(CRTC_INDEX, CRTC_CURSOR_START);
+    outb(CRTC_DATA, (inb(CRTC_DATA) & 0xC0) | 0x0E);
+    outb(CRTC_INDEX, CRTC_CURSOR_END);
+    outb(CRTC_DATA, (inb(CRTC_DATA) & 0xE0) | 0x0F);
+}
+
+// Прокрутка на строку вверх сдвигом начала экрана. Видеопамять не
+// копируется: на экране меняется только новая нижняя строка. Когда экран
+// доходит до конца окна, он переносится в начало копированием из теневого
+// буфера (видеопамять при этом только пишется).
+static void scroll_screen(void) {
+    int cells = (screen_height - 1) * screen_width;
+    if (origin + screen_width + screen_height * screen_width > CONSOLE_MAX_CELLS) {
+        for (int i = 0; i < cells; i++) {
+            shadow[i] = shadow[origin + screen_width + i];
+        }
+        origin = 0;
+        mark_all_dirty();
+        stats.wraps++;
+    } else {
+        origin += screen_width;
+        shift_dirty_up();
+        mark_dirty(screen_height - 1, 0, screen_width);
+        // У кадрового буфера нет аппаратной прокрутки: перерисовывается
+        // весь экран из теневого буфера
+        if (graphics) {
+            mark_all_dirty();
+        }
+    }
+    for (int i = 0; i < screen_width; i++) {
+        shadow[origin + cells + i] = CELL(' ', CONSOLE_DEFAULT_ATTR);
+    }
+
+    row = screen_height - 1;
+    col = 0;
+}
+
+// Функция для очистки экрана
+void clear_screen() {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    origin = 0;
+    for (int i = 0; i < screen_width * screen_height; i++) {
+        shadow[i] = CELL(' ', CONSOLE_DEFAULT_ATTR);
+    }
+    mark_all_dirty();
+    row = 0;
+    col = 0;
+    show_cursor();
+    console_flush_locked();
+    // Терминал на последовательном порту очищается ANSI-последовательностью
+    if (serial_mirror) {
+        serial_write("\x1b[2J\x1b[H");
+    }
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+// Перемещение позиции вывода (для программ, перерисовывающих экран на месте)
+void console_goto(int new_row, int new_col) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    row = new_row < 0 ? 0 : (new_row >= screen_height ? screen_height - 1 : new_row);
+    col = new_col < 0 ? 0 : (new_col >= screen_width ? screen_width - 1 : new_col);
+    console_flush_locked();
+    if (serial_mirror && serial_present()) {
+        char seq[24];
+        ksnprintf(seq, sizeof(seq), "\x1b[%d;%dH", row + 1, col + 1);
+        serial_write(seq);
+    }
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+// Размеры текстового экрана
+int console_columns() {
+    return screen_width;
+}
+
+int console_rows() {
+    return screen_height;
+}
+
+// Функция изменения видеорежима
+void set_video_mode(int width, int height) {
+    // Проверка допустимых размеров
+    if (width < CONSOLE_MIN_WIDTH) width = CONSOLE_MIN_WIDTH;
+    if (height < CONSOLE_MIN_HEIGHT) height = CONSOLE_MIN_HEIGHT;
+
+    // Максимальный размер, помещающийся в видеопамять (32KB)
+    int max_size = CONSOLE_MAX_CELLS;
+
+    // Автоматическое масштабирование без использования sqrtf
+    if (width * height > max_size) {
+        // Рассчитываем коэффициент масштабирования
+        int scale = (width * height * 10) / max_size + 1;
+
+        // Применяем масштабирование
+        width = width * 10 / scale;
+        height = height * 10 / scale;
+
+        // Гарантируем минимальные размеры
+        if (width < CONSOLE_MIN_WIDTH) width = CONSOLE_MIN_WIDTH;
+        if (height < CONSOLE_MIN_HEIGHT) height = CONSOLE_MIN_HEIGHT;
+    }
+    // Подъем до минимума мог снова выйти за видеопамять
+    if (width > max_size / CONSOLE_MIN_HEIGHT) width = max_size / CONSOLE_MIN_HEIGHT;
+    if (width * height > max_size) height = max_size / width;
+
+    // В графическом режиме сетка не больше кадрового буфера
+    if (graphics) {
+        if (width > fb_columns()) width = fb_columns();
+        if (height > fb_rows()) height = fb_rows();
+    }
+
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    screen_width = width;
+    screen_height = height;
+
+    if (graphics) {
+        // Поля вне новой сетки тоже очищаются
+        fb_clear(CONSOLE_DEFAULT_ATTR);
+        cursor_row_drawn = -1;
+    } else {
+        // Перепрограммирование VGA контроллера
+        outb(CRTC_INDEX, 0x11);
+        outb(CRTC_DATA, 0x00);
+
+        // Горизонтальные параметры
+        outb(CRTC_INDEX, 0x00);
+        outb(CRTC_DATA, (width + 5) & 0xFF);
+
+        // Вертикальные параметры
+        outb(CRTC_INDEX, 0x06);
+        outb(CRTC_DATA, (height + 2) & 0xFF);
+
+        // Включение вертикальной ретрассировки
+        outb(CRTC_INDEX, 0x11);
+        outb(CRTC_DATA, 0x8E);
+    }
+
+    // Старые грязные участки относятся к прежней геометрии
+    for (int r = 0; r < CONSOLE_MAX_ROWS; r++) {
+        dirty_hi[r] = 0;
+    }
+    dirty_first = CONSOLE_MAX_ROWS;
+    dirty_last = -1;
+    spin_unlock_irqrestore(&console_lock, flags);
+
+    // Очистка экрана
+    clear_screen();
+}
+
+// Команды оболочки
+static const shell_command_t console_commands[] = {
+    { "console-bench", "[N]", "Screen output speed, write-through vs shadow buffer", run_console_bench },
+};
+
+void console_init(const multiboot_info_t* mbi) {
+    shell_register_all(console_commands, sizeof(console_commands) / sizeof(console_commands[0]));
+    if (!fb_init(mbi)) {
+        set_video_mode(80, 25);
+        return;
+    }
+    graphics = true;
+    set_video_mode(fb_columns(), fb_rows());
+    klog(KLOG_INFO, "console: %ux%u framebuffer, %dx%d text",
+         fb_width(), fb_height(), screen_width, screen_height);
+}
+
+// Вывод символа в теневой буфер (вызывается под console_lock)
+static void console_put_char(char c, uint8_t color) {
+    // Обработка управляющих символов
+    switch(c) {
+        case '\n': // Новая строка
+            col = 0;
+            row++;
+            if (row >= screen_height) {
+                scroll_screen();
+            }
+            return;
+
+        case '\r': // Возврат каретки
+            col = 0;
+            return;
+
+        case '\b': // Backspace
+            if (col > 0) {
+                col--;
+            } else if (row > 0) {
+                row--;
+                col = screen_width - 1;
+            }
+            // Стираем символ
+            shadow[SCREEN_CELL(row, col)] = CELL(' ', color);
+            mark_dirty(row, col, col + 1);
+            return;
+
+        case '\t': // Табуляция
+            for (int i = 0; i < 4; i++) {
+                console_put_char(' ', color);
+            }
+            return;
+
+        default: // Обычный символ
+            shadow[SCREEN_CELL(row, col)] = CELL(c, color);
+            mark_dirty(row, col, col + 1);
+            col++;
+    }
+
+    // Проверка переполнения строки
+    if (col >= screen_width) {
+        col = 0;
+        row++;
+        if (row >= screen_height) {
+            scroll_screen();
+        }
+    }
+}
+
+void console_flush(void) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    console_flush_locked();
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+// Функция для вывода символа на экран (и в последовательный порт).
+// Экран обновляется не чаще раза в CONSOLE_FLUSH_MS.
+void print_char(char c, uint8_t color) {
+    if (serial_mirror) {
+        serial_wait_room(2);
+    }
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    console_put_char(c, color);
+    if (serial_mirror) {
+        serial_putc(c);
+    }
+    bool defer = console_flush_or_defer();
+    spin_unlock_irqrestore(&console_lock, flags);
+    if (defer) {
+        queue_delayed_work(system_wq, &flush_work, CONSOLE_FLUSH_MS);
+    }
+}
+
+// Функция для вывода строки на экран с заданным цветом.
+// Строка выводится частями по CONSOLE_STRING_CHUNK символов; часть не
+// перемешивается с выводом других потоков, экран и курсор обновляются
+// один раз на часть. Место в буфере передачи COM1 ждется до захвата
+// console_lock, поэтому длинный вывод не держит прерывания запрещенными,
+// пока линия передает.
+void print_string(const char *str, uint8_t color) {
+    do {
+        uint32_t length = strnlen(str, CONSOLE_STRING_CHUNK);
+        if (serial_mirror) {
+            // '\n' передается двумя байтами
+            serial_wait_room(length * 2);
+        }
+        uint32_t flags = spin_lock_irqsave(&console_lock);
+        if (serial_mirror) {
+            serial_write_n(str, length);
+        }
+        for (uint32_t i = 0; i < length; i++) {
+            console_put_char(str[i], color);
+            if (write_through) {
+                console_flush_locked();
+            }
+        }
+        console_flush_locked();
+        spin_unlock_irqrestore(&console_lock, flags);
+        str += length;
+    } while (*str);
+}
+
+void console_get_stats(console_stats_t* out) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    *out = stats;
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+// ============== console-bench ==============
+
+typedef struct {
+    uint32_t string_rate;       // Символов в секунду через print_string
+    uint32_t char_rate;         // Символов в секунду через print_char
+    uint32_t cursor_updates;
+    uint32_t cells_written;
+} console_bench_result_t;
+
+static uint32_t chars_per_second(uint32_t chars, uint64_t cycles) {
+    uint64_t us = timer_cycles_to_us(cycles);
+    if (us == 0) {
+        us = 1;
+    }
+    if (us > UINT32_MAX) {
+        us = UINT32_MAX;
+    }
+    uint64_t rate = udiv64_32((uint64_t)chars * 1000000, (uint32_t)us, NULL);
+    return rate > INT32_MAX ? INT32_MAX : (uint32_t)rate;
+}
+
+static void console_bench_pass(int lines, console_bench_result_t* result) {
+    static const char text[] =
+        "The quick brown fox jumps over the lazy dog 0123456789 ABCDEFGHIJKLMNOPQRSTU\n";
+    static const char hex[] = "0123456789abcdef";
+    uint32_t string_chars = (sizeof(text) - 1) * lines;
+    uint32_t char_chars = 0;
+    console_stats_t before, after;
+
+    clear_screen();
+    console_get_stats(&before);
+
+    uint64_t start = rdtsc();
+    for (int i = 0; i < lines; i++) {
+        print_string(text, LIGHT_GRAY_ON_BLACK);
+    }
+    uint64_t string_cycles = rdtsc() - start;
+
+    // Шестнадцатеричный дамп по символу, как read-disk
+    start = rdtsc();
+    for (int i = 0; i < lines; i++) {
+        for (int j = 0; j < 16; j++) {
+            uint8_t byte = (uint8_t)(i * 16 + j);
+            print_char(hex[byte >> 4], LIGHT_GRAY_ON_BLACK);
+            print_char(hex[byte & 0x0F], LIGHT_GRAY_ON_BLACK);
+            print_char(' ', LIGHT_GRAY_ON_BLACK);
+            char_chars += 3;
+        }
+        print_char('\n', LIGHT_GRAY_ON_BLACK);
+        char_chars++;
+    }
+    console_flush();
+    uint64_t char_cycles = rdtsc() - start;
+
+    console_get_stats(&after);
+    result->string_rate = chars_per_second(string_chars, string_cycles);
+    result->char_rate = chars_per_second(char_chars, char_cycles);
+    result->cursor_updates = after.cursor_updates - before.cursor_updates;
+    result->cells_written = after.cells_written - before.cells_written;
+}
+
+static void print_bench_row(const char* name, const console_bench_result_t* result) {
+    kprintf("%-16s%-16u%-16u%-12u%u\n", name, result->string_rate, result->char_rate,
+            result->cursor_updates, result->cells_written);
+}
+
+static void print_speedup(const char* name, uint32_t before, uint32_t after) {
+    uint32_t ratio = before ? (uint32_t)udiv64_32((uint64_t)after * 10, before, NULL) : 0;
+    kprintf_color(LIGHT_CYAN_ON_BLACK, "%-22s%u.%ux\n", name, ratio / 10, ratio % 10);
+}
+
+void run_console_bench(int argc, char** argv) {
+    int lines = argc > 1 ? atoi(argv[1]) : 0;
+    if (lines <= 0) {
+        lines = 200;
+    }
+    if (timer_tsc_per_ms() == 0) {
+        print_string("Timer is not calibrated\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+
+    // Замеряется только экран: COM1 на время замера отключается, иначе
+    // скорость упрется в линию 115200 бод
+    console_bench_result_t direct, batched;
+    serial_mirror = false;
+    write_through = true;
+    console_bench_pass(lines, &direct);
+    write_through = false;
+    console_bench_pass(lines, &batched);
+    serial_mirror = true;
+
+    clear_screen();
+    kprintf_color(LIGHT_GREEN_ON_BLACK, "Console output, %d lines per test (serial mirror paused)\n",
+                  lines);
+    kprintf_color(LIGHT_GREEN_ON_BLACK, "%-16s%-16s%-16s%-12s%s\n",
+                  "Mode", "string ch/s", "char ch/s", "Cursor", "Cells");
+    print_bench_row("write-through", &direct);
+    print_bench_row("shadow buffer", &batched);
+    print_speedup("print_string speedup:", direct.string_rate, batched.string_rate);
+    print_speedup("print_char speedup:", direct.char_rate, batched.char_rate);
+}
@@ -0,0 +1,57 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../templates/multiboot.h"
+
+// Видеопамять текстового режима VGA и ее объем в ячейках (символ + атрибут)
+#define CONSOLE_VGA_MEMORY 0xB8000
+#define CONSOLE_MAX_CELLS (0x8000 / 2)
+#define CONSOLE_MIN_WIDTH 40
+#define CONSOLE_MIN_HEIGHT 10
+#define CONSOLE_MAX_ROWS (CONSOLE_MAX_CELLS / CONSOLE_MIN_WIDTH)
+
+// Атрибут пустой ячейки: серый на черном
+#define CONSOLE_DEFAULT_ATTR 0x07
+
+// Наибольшая задержка вывода print_char на экран: чаще этого посимвольный
+// вывод видеопамять не обновляет, остаток сбрасывает задание в system_wq
+#define CONSOLE_FLUSH_MS 10
+
+// Статистика вывода
+typedef struct {
+    uint32_t flushes;           // Сбросы теневого буфера в видеопамять
+    uint32_t cells_written;     // Ячейки, записанные в видеопамять
+    uint32_t cursor_updates;    // Перепрограммирования курсора (порты CRTC)
+    uint32_t deferred;          // Сбросы, отложенные в system_wq
+    uint32_t scrolls;           // Смены начального адреса экрана в CRTC
+    uint32_t wraps;             // Переносы экрана в начало видеопамяти
+} console_stats_t;
+
+// Вывод идет в теневой буфер в памяти; в видеопамять копируются только
+// измененные участки строк, а курсор перепрограммируется один раз на сброс.
+// Прокрутка сдвигает начальный адрес экрана в CRTC по окну видеопамяти.
+// В графическом режиме ячейки рисуются в кадровый буфер (modules/framebuffer),
+// грязные участки строк - прямоугольники перерисовки.
+// print_string сбрасывает буфер сразу, print_char - не чаще раза в
+// CONSOLE_FLUSH_MS.
+
+// Выбор экрана: кадровый буфер, если загрузчик его установил (текст
+// рисуется шрифтом 8x16), иначе текстовый режим VGA 80x25
+void console_init(const multiboot_info_t* mbi);
+
+// Смена размеров текстового экрана (с очисткой). В графическом режиме
+// размеры ограничены сеткой знакомест кадрового буфера.
+void set_video_mode(int width, int height);
+
+// Немедленный сброс теневого буфера и курсора на экран
+void console_flush(void);
+
+void console_get_stats(console_stats_t* stats);
+
+// Команда console-bench: скорость вывода посимвольной записью в видеопамять
+// и через теневой буфер
+void run_console_bench(int argc, char** argv);
+
+#endif // CONSOLE_H
@@ -0,0 +1,105 @@
+#include "cpu.h"
+#include <stddef.h>
+
+// Количество дескрипторов: null, код и данные ядра и пользователя, TSS и
+// сегменты данных процессоров
+#define GDT_ENTRIES (GDT_PERCPU_FIRST + MAX_CPUS)
+
+// Элемент GDT
+typedef struct {
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t base_mid;
+    uint8_t access;
+    uint8_t granularity;
+    uint8_t base_high;
+} __attribute__((packed)) gdt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) gdt_ptr_t;
+
+static gdt_entry_t gdt[GDT_ENTRIES] __attribute__((aligned(8)));
+static gdt_ptr_t gdt_ptr;
+static tss_t tss[MAX_CPUS] __attribute__((aligned(128)));
+
+cpu_t cpus[MAX_CPUS];
+
+static void gdt_set_entry(int index, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
+    gdt[index].limit_low = limit & 0xFFFF;
+    gdt[index].base_low = base & 0xFFFF;
+    gdt[index].base_mid = (base >> 16) & 0xFF;
+    gdt[index].access = access;
+    gdt[index].granularity = ((limit >> 16) & 0x0F) | (flags & 0xF0);
+    gdt[index].base_high = (base >> 24) & 0xFF;
+}
+
+// Загрузка сегмента GS с данными процессора и регистра задачи
+static void load_percpu_segment(uint32_t index) {
+    uint16_t selector = (GDT_PERCPU_FIRST + index) * 8;
+    uint16_t tss_selector = (GDT_TSS_FIRST + index) * 8;
+    asm volatile ("movw %0, %%gs" : : "r" (selector));
+    asm volatile ("ltr %0" : : "r" (tss_selector));
+}
+
+void init_cpu(void) {
+    gdt_set_entry(0, 0, 0, 0, 0);
+    gdt_set_entry(1, 0, 0xFFFFF, 0x9A, 0xC0); // Код ядра: 4 ГБ, 32 бита
+    gdt_set_entry(2, 0, 0xFFFFF, 0x92, 0xC0); // Данные ядра
+    // Сегменты кольца 3 покрывают ту же память: без страничной защиты
+    // пользовательский код отделен от ядра только уровнем привилегий
+    gdt_set_entry(3, 0, 0xFFFFF, 0xFA, 0xC0); // Код пользователя
+    gdt_set_entry(4, 0, 0xFFFFF, 0xF2, 0xC0); // Данные пользователя
+
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        cpus[i].self = &cpus[i];
+        cpus[i].index = i;
+        cpus[i].tss = &tss[i];
+        tss[i].ss0 = GDT_KERNEL_DATA_SELECTOR;
+        tss[i].iomap_base = sizeof(tss_t);
+        // Доступный 32-битный TSS, DPL 0
+        gdt_set_entry(GDT_TSS_FIRST + i, (uint32_t)&tss[i], sizeof(tss_t) - 1, 0x89, 0x00);
+        // Байтовая гранулярность, 32-битный сегмент данных
+        gdt_set_entry(GDT_PERCPU_FIRST + i, (uint32_t)&cpus[i], sizeof(cpu_t) - 1, 0x92, 0x40);
+    }
+
+    gdt_ptr.limit = sizeof(gdt) - 1;
+    gdt_ptr.base = (uint32_t)gdt;
+
+    asm volatile (
+        "lgdt %0\n\t"
+        "ljmp %1, $1f\n"
+        "1:\n\t"
+        "movw %2, %%ax\n\t"
+        "movw %%ax, %%ds\n\t"
+        "movw %%ax, %%es\n\t"
+        "movw %%ax, %%fs\n\t"
+        "movw %%ax, %%ss\n\t"
+        :
+        : "m" (gdt_ptr), "i" (GDT_KERNEL_CODE_SELECTOR), "i" (GDT_KERNEL_DATA_SELECTOR)
+        : "eax", "memory"
+    );
+
+    load_percpu_segment(0);
+    cpus[0].online = true;
+}
+
+void cpu_init_ap(uint32_t index) {
+    load_percpu_segment(index);
+}
+
+void cpu_get_gdt(uint32_t* base, uint16_t* limit) {
+    *base = gdt_ptr.base;
+    *limit = gdt_ptr.limit;
+}
+
+uint32_t cpu_online_count(void) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (cpus[i].online) {
+            count++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,98 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../sync/sync.h"
+
+// Максимальное количество процессоров
+#define MAX_CPUS 8
+
+// Селекторы сегментов GDT. Порядок код ядра - данные ядра - код
+// пользователя - данные пользователя задан инструкциями SYSENTER/SYSEXIT.
+#define GDT_KERNEL_CODE_SELECTOR 0x08
+#define GDT_KERNEL_DATA_SELECTOR 0x10
+#define GDT_USER_CODE_SELECTOR 0x1B     // Индекс 3, RPL 3
+#define GDT_USER_DATA_SELECTOR 0x23     // Индекс 4, RPL 3
+// Первый дескриптор TSS (по одному на CPU)
+#define GDT_TSS_FIRST 5
+// Первый дескриптор сегмента GS с данными процессора (по одному на CPU).
+// Селектор GS процессора = селектор его TSS + MAX_CPUS * 8.
+#define GDT_PERCPU_FIRST (GDT_TSS_FIRST + MAX_CPUS)
+
+struct thread;
+
+// Сегмент состояния задачи. Аппаратное переключение задач не
+// используется: из TSS берется только стек ядра (SS0:ESP0) при переходе
+// из кольца 3 в кольцо 0.
+typedef struct tss {
+    uint32_t prev_task;
+    uint32_t esp0, ss0;
+    uint32_t esp1, ss1;
+    uint32_t esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs, ldt;
+    uint16_t trap;
+    uint16_t iomap_base;            // За пределами TSS: порты из кольца 3 запрещены
+} __attribute__((packed)) tss_t;
+
+// Данные, принадлежащие одному процессору
+typedef struct cpu {
+    struct cpu* self;               // Указатель на себя (читается через %gs:0)
+    uint32_t index;                 // Логический номер процессора
+    uint32_t apic_id;               // Идентификатор локального APIC
+    volatile bool online;           // Процессор запущен и принимает потоки
+    struct thread* current_thread;  // Выполняющийся поток
+    struct thread* idle_thread;     // Поток бездействия этого процессора
+    struct thread* prev_thread;     // Поток, с которого только что переключились
+    volatile bool need_resched;     // Требуется перепланирование
+    bool tick_stopped;              // Периодический тик остановлен (простой)
+    struct thread* fpu_owner;       // Чье состояние FPU загружено в регистры
+    bool fpu_dirty;                 // Текущий поток менял FPU в этом кванте
+    tss_t* tss;                     // TSS этого процессора
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+
+// Данные текущего процессора
+static inline cpu_t* this_cpu(void) {
+    cpu_t* cpu;
+    asm volatile ("movl %%gs:0, %0" : "=r" (cpu));
+    return cpu;
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile ("cpuid"
+                  : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+                  : "a" (leaf), "c" (0));
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile ("rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile ("wrmsr" : : "c" (msr), "a" ((uint32_t)value), "d" ((uint32_t)(value >> 32)));
+}
+
+// Стек ядра, на который процессор переходит при входе из кольца 3
+static inline void cpu_set_kernel_stack(uint32_t esp0) {
+    this_cpu()->tss->esp0 = esp0;
+}
+
+// Загрузка GDT ядра и данных загрузочного процессора (вызывается первым в kmain)
+void init_cpu(void);
+
+// Загрузка сегментов на дополнительном процессоре
+void cpu_init_ap(uint32_t index);
+
+// Адрес и размер GDT (для трамплина запуска процессоров)
+void cpu_get_gdt(uint32_t* base, uint16_t* limit);
+
+// Количество запущенных процессоров
+uint32_t cpu_online_count(void);
+
+#endif // CPU_H
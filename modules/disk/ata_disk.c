@@ -1,8 +1,12 @@
 #include "ata_disk.h"
 #include <stdint.h>
 #include <stdbool.h>
-#include <string.h>
 #include "../templates/colors.h"
+#include "../sync/sync.h"
+#include "../templates/io.h"
+#include "../klog/klog.h"
+#include "../kprintf/kprintf.h"
+#include "../kstring/kstring.h"
 
 // Объявим внешние функции
 extern void print_string(const char *str, uint8_t color);
@@ -29,18 +33,25 @@ extern void read_string(char *buffer, int max_length);
 #define ATA_CMD_WRITE_SECTORS 0x30
 #define ATA_CMD_FLUSH_CACHE 0xE7
 
+// Наибольшее число секторов в одной команде чтения/записи (LBA28)
+#define ATA_MAX_SECTORS 256
+
 // Размер сектора
 #define SECTOR_SIZE 512
 
 // Тип раздела Linux
 #define MBR_PARTITION_TYPE 0x83
 
+// Последовательность команд в порты ATA не должна прерываться другим
+// потоком: один мьютекс на канал
+static mutex_t ata_mutex = MUTEX_INIT;
+
 // Прототипы внутренних функций
 void ata_read_sector(uint32_t sector, uint8_t *buffer);
 void ata_write_sector(uint32_t sector, uint8_t *buffer);
 bool check_partition_table(uint8_t *mbr);
 void create_partition_table(uint8_t *mbr, uint32_t total_sectors);
-static void ata_wait_drq(void);
+static bool ata_wait_drq(void);
 
 // Объявим внешние функции
 extern void print_string(const char *str, uint8_t color);
@@ -56,40 +67,6 @@ void write_disk(uint8_t *buffer, uint32_t sector) {
     ata_write_sector(sector, buffer);
 }
 
-// Вспомогательные функции для портов
-static inline uint8_t inb(uint16_t port) {
-    uint8_t ret;
-    asm volatile ("inb %1, %0" : "=a" (ret) : "dN" (port));
-    return ret;
-}
-
-static inline void outb(uint16_t port, uint8_t data) {
-    asm volatile ("outb %1, %0" : : "dN" (port), "a" (data));
-}
-
-static inline uint16_t inw(uint16_t port) {
-    uint16_t ret;
-    asm volatile ("inw %w1, %w0" : "=a" (ret) : "Nd" (port));
-    return ret;
-}
-
-static inline void outw(uint16_t port, uint16_t data) {
-    asm volatile ("outw %w0, %w1" : : "a" (data), "Nd" (port));
-}
-
-// Реализация memcmp
-int memcmp(const void *s1, const void *s2, size_t n) {
-    const unsigned char *p1 = s1;
-    const unsigned char *p2 = s2;
-    
-    for (size_t i = 0; i < n; i++) {
-        if (p1[i] != p2[i]) {
-            return p1[i] - p2[i];
-        }
-    }
-    return 0;
-}
-
 // Функция ожидания готовности диска
 void ata_wait_ready(uint16_t port) {
     int attempts = 0;
@@ -98,156 +75,146 @@ void ata_wait_ready(uint16_t port) {
     // Ожидание снятия флага BSY
     while (((status = inb(port + 7)) & ATA_SR_BSY)) {
         if (++attempts > 1000000) {
-            print_string("Disk busy timeout!\n", LIGHT_RED_ON_BLACK);
+            klog(KLOG_ERR, "ata: disk busy timeout");
             return;
         }
     }
     
     // Проверка на ошибки
     if (status & ATA_SR_ERR) {
-        print_string("Disk error detected!\n", LIGHT_RED_ON_BLACK);
+        klog(KLOG_ERR, "ata: disk error detected");
+    }
+}
+
+// Задержка ~400 нс (четыре чтения альтернативного статуса): после команды
+// или очередного сектора диск успевает выставить BSY
+static void ata_delay400(void) {
+    for (int i = 0; i < 4; i++) {
+        inb(ATA_PRIMARY_CTRL_PORT);
     }
 }
 
 // Ожидание готовности данных (DRQ)
-static void ata_wait_drq(void) {
+static bool ata_wait_drq(void) {
     int attempts = 0;
     uint8_t status;
     while (1) {
         status = inb(ATA_PRIMARY_CMD_PORT + 7);
         if (status & ATA_SR_ERR) {
-            print_string("ATA error in wait_drq.\n", LIGHT_RED_ON_BLACK);
-            return;
+            klog(KLOG_ERR, "ata: error 0x%x while waiting for DRQ", inb(ATA_PRIMARY_CMD_PORT + 1));
+            return false;
         }
         if (!(status & ATA_SR_BSY) && (status & ATA_SR_DRQ)) {
-            return; // Данные готовы
+            return true; // Данные готовы
         }
         if (++attempts > 1000000) {
-            print_string("Timeout waiting for DRQ.\n", LIGHT_RED_ON_BLACK);
-            return;
+            klog(KLOG_ERR, "ata: timeout waiting for DRQ");
+            return false;
         }
     }
 }
 
-// Простая реализация itoa
-static void itoa(int num, char *str, int base) {
-    int i = 0;
-    bool isNegative = false;
-
-    if (num == 0) {
-        str[i++] = '0';
-        str[i] = '\0';
-        return;
-    }
+// Команда над count секторами с sector (count <= ATA_MAX_SECTORS, 0 в
+// регистре счетчика означает 256)
+static void ata_issue(uint8_t command, uint32_t sector, uint32_t count) {
+    outb(ATA_PRIMARY_CMD_PORT + 6, 0xE0 | ((sector >> 24) & 0x0F));
+    outb(ATA_PRIMARY_CMD_PORT + 2, (uint8_t)count);
+    outb(ATA_PRIMARY_CMD_PORT + 3, sector & 0xFF);
+    outb(ATA_PRIMARY_CMD_PORT + 4, (sector >> 8) & 0xFF);
+    outb(ATA_PRIMARY_CMD_PORT + 5, (sector >> 16) & 0xFF);
+    outb(ATA_PRIMARY_CMD_PORT + 7, command);
+    ata_delay400();
+}
 
-    if (num < 0 && base == 10) {
-        isNegative = true;
-        num = -num;
+// Чтение count секторов подряд: одна команда на ATA_MAX_SECTORS секторов
+// вместо команды на каждый сектор
+bool read_disk_sectors(uint8_t *buffer, uint32_t sector, uint32_t count) {
+    bool ok = true;
+    mutex_lock(&ata_mutex);
+    while (count > 0 && ok) {
+        uint32_t chunk = count < ATA_MAX_SECTORS ? count : ATA_MAX_SECTORS;
+        ata_issue(ATA_CMD_READ_SECTORS, sector, chunk);
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (!ata_wait_drq()) {
+                klog(KLOG_ERR, "ata: read failed at sector %u", sector + i);
+                ok = false;
+                break;
+            }
+            uint16_t *buff = (uint16_t *)buffer;
+            for (int j = 0; j < SECTOR_SIZE / 2; j++) {
+                buff[j] = inw(ATA_PRIMARY_CMD_PORT);
+            }
+            buffer += SECTOR_SIZE;
+            ata_delay400();
+        }
+        sector += chunk;
+        count -= chunk;
     }
+    mutex_unlock(&ata_mutex);
+    return ok;
+}
 
-    while (num != 0) {
-        int rem = num % base;
-        str[i++] = (rem > 9) ? (rem - 10) + 'a' : rem + '0';
-        num = num / base;
+// Запись count секторов подряд. Кэш диска сбрасывается один раз на вызов.
+bool write_disk_sectors(const uint8_t *buffer, uint32_t sector, uint32_t count) {
+    uint32_t first_sector = sector;
+    bool ok = true;
+    mutex_lock(&ata_mutex);
+    while (count > 0 && ok) {
+        uint32_t chunk = count < ATA_MAX_SECTORS ? count : ATA_MAX_SECTORS;
+        ata_issue(ATA_CMD_WRITE_SECTORS, sector, chunk);
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (!ata_wait_drq()) {
+                klog(KLOG_ERR, "ata: write failed at sector %u", sector + i);
+                ok = false;
+                break;
+            }
+            const uint16_t *buff = (const uint16_t *)buffer;
+            for (int j = 0; j < SECTOR_SIZE / 2; j++) {
+                outw(ATA_PRIMARY_CMD_PORT, buff[j]);
+            }
+            buffer += SECTOR_SIZE;
+            ata_delay400();
+        }
+        sector += chunk;
+        count -= chunk;
     }
 
-    if (isNegative)
-        str[i++] = '-';
-
-    str[i] = '\0';
+    // Ожидание завершения записи и сброс кэша диска
+    ata_wait_ready(ATA_PRIMARY_CMD_PORT);
+    outb(ATA_PRIMARY_CMD_PORT + 7, ATA_CMD_FLUSH_CACHE);
+    ata_wait_ready(ATA_PRIMARY_CMD_PORT);
 
-    int start = 0;
-    int end = i - 1;
-    while (start < end) {
-        char temp = str[start];
-        str[start] = str[end];
-        str[end] = temp;
-        start++;
-        end--;
+    uint8_t status = inb(ATA_PRIMARY_CMD_PORT + 7);
+    if (status & ATA_SR_ERR) {
+        klog(KLOG_ERR, "ata: write error 0x%x in sectors %u-%u", inb(ATA_PRIMARY_CMD_PORT + 1),
+             first_sector, sector - 1);
+        ok = false;
     }
+    mutex_unlock(&ata_mutex);
+    return ok;
 }
 
 // Функция для чтения сектора
 void ata_read_sector(uint32_t sector, uint8_t *buffer) {
-    uint16_t *buff = (uint16_t *)buffer;
-
-    // Установка количества секторов (1)
-    outb(ATA_PRIMARY_CMD_PORT + 2, 1);
-    
-    // Отправка номера сектора в LBA
-    outb(ATA_PRIMARY_CMD_PORT + 3, sector & 0xFF);
-    outb(ATA_PRIMARY_CMD_PORT + 4, (sector >> 8) & 0xFF);
-    outb(ATA_PRIMARY_CMD_PORT + 5, (sector >> 16) & 0xFF);
-    outb(ATA_PRIMARY_CMD_PORT + 6, 0xE0 | ((sector >> 24) & 0x0F));
-    
-    // Отправка команды чтения
-    outb(ATA_PRIMARY_CMD_PORT + 7, ATA_CMD_READ_SECTORS);
-    
-    // Ожидание готовности данных
-    ata_wait_drq();
-    
-    // Чтение данных
-    for (int i = 0; i < SECTOR_SIZE / 2; i++) {
-        buff[i] = inw(ATA_PRIMARY_CMD_PORT);
-    }
-    
-    // Проверка на ошибки
-    uint8_t status = inb(ATA_PRIMARY_CMD_PORT + 7);
-    if (status & ATA_SR_ERR) {
-        uint8_t error = inb(ATA_PRIMARY_CMD_PORT + 1);
-        char error_msg[50];
-        itoa(error, error_msg, 16);
-        print_string("Read error: 0x", LIGHT_RED_ON_BLACK);
-        print_string(error_msg, LIGHT_RED_ON_BLACK);
-        print_char('\n', LIGHT_RED_ON_BLACK);
-    }
+    read_disk_sectors(buffer, sector, 1);
 }
 
 // Функция для записи сектора
 void ata_write_sector(uint32_t sector, uint8_t *buffer) {
-    uint16_t *buff = (uint16_t *)buffer;
-
-    // Установка количества секторов (1)
-    outb(ATA_PRIMARY_CMD_PORT + 2, 1);
-    
-    // Отправка номера сектора в LBA
-    outb(ATA_PRIMARY_CMD_PORT + 3, sector & 0xFF);
-    outb(ATA_PRIMARY_CMD_PORT + 4, (sector >> 8) & 0xFF);
-    outb(ATA_PRIMARY_CMD_PORT + 5, (sector >> 16) & 0xFF);
-    outb(ATA_PRIMARY_CMD_PORT + 6, 0xE0 | ((sector >> 24) & 0x0F));
-    
-    // Отправка команды записи
-    outb(ATA_PRIMARY_CMD_PORT + 7, ATA_CMD_WRITE_SECTORS);
-    
-    // Ожидание готовности данных
-    ata_wait_drq();
-    
-    // Запись данных
-    for (int i = 0; i < SECTOR_SIZE / 2; i++) {
-        outw(ATA_PRIMARY_CMD_PORT, buff[i]);
-    }
-    
-    // Ожидание завершения записи
-    ata_wait_ready(ATA_PRIMARY_CMD_PORT);
-    
-    // Сброс кэша диска
-    outb(ATA_PRIMARY_CMD_PORT + 7, ATA_CMD_FLUSH_CACHE);
-    ata_wait_ready(ATA_PRIMARY_CMD_PORT);
-    
-    // Проверка на ошибки
-    uint8_t status = inb(ATA_PRIMARY_CMD_PORT + 7);
-    if (status & ATA_SR_ERR) {
-        uint8_t error = inb(ATA_PRIMARY_CMD_PORT + 1);
-        char error_msg[50];
-        itoa(error, error_msg, 16);
-        print_string("Write error: 0x", LIGHT_RED_ON_BLACK);
-        print_string(error_msg, LIGHT_RED_ON_BLACK);
-        print_char('\n', LIGHT_RED_ON_BLACK);
-    }
+    write_disk_sectors(buffer, sector, 1);
 }
 
+static bool ata_identify_locked(uint32_t *total_sectors);
+
 // Функция для получения информации о диске
 bool ata_identify(uint32_t *total_sectors) {
+    mutex_lock(&ata_mutex);
+    bool result = ata_identify_locked(total_sectors);
+    mutex_unlock(&ata_mutex);
+    return result;
+}
+
+static bool ata_identify_locked(uint32_t *total_sectors) {
     // Выбираем диск 0
     outb(ATA_PRIMARY_CMD_PORT + 6, 0xA0);
     
@@ -347,12 +314,7 @@ bool initialize_disk() {
         return false;
     }
     
-    // Преобразование в строку для вывода
-    char size_str[20];
-    itoa(total_sectors, size_str, 10);
-    print_string("Total sectors: ", WHITE_ON_BLACK);
-    print_string(size_str, LIGHT_GREEN_ON_BLACK);
-    print_char('\n', WHITE_ON_BLACK);
+    kprintf("Total sectors: %u\n", total_sectors);
     
     // Чтение MBR
     print_string("Reading MBR...\n", WHITE_ON_BLACK);
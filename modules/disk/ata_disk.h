@@ -21,4 +21,9 @@ void read_disk(uint8_t *buffer, uint32_t sector);
 void write_disk(uint8_t *buffer, uint32_t sector);
 bool initialize_disk(void);
 
+// Чтение и запись count секторов подряд (блоками до 256 секторов на
+// команду). false - ошибка диска, подробности в журнале ядра.
+bool read_disk_sectors(uint8_t *buffer, uint32_t sector, uint32_t count);
+bool write_disk_sectors(const uint8_t *buffer, uint32_t sector, uint32_t count);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,1814 @@
+#include "ext2.h"
+#include "../disk/ata_disk.h"
+#include "../sync/sync.h"
+#include "../klog/klog.h"
+#include "../kprintf/kprintf.h"
+#include "../kstring/kstring.h"
+#include "../shell/shell.h"
+#include "../templates/kernel_api.h"
+#include "../templates/io.h"
+
+// Параметры mkfs: блок 4 КиБ на разделах от 512 МиБ (как у mke2fs),
+// один inode на четыре блока
+#define EXT2_FORMAT_LARGE_SECTORS (512u * 1024 * 1024 / SECTOR_SIZE)
+#define EXT2_FORMAT_BLOCKS_PER_INODE 4
+// Последняя группа меньше служебных блоков + этого запаса отбрасывается
+#define EXT2_FORMAT_MIN_GROUP_DATA 50
+
+#define EXT2_VALID_FS 1
+#define EXT2_ERRORS_CONTINUE 1
+
+// Буфер команд cat и cp: блоки файла читаются участками до 32 КиБ
+#define EXT2_SHELL_BUFFER 32768
+// Буфер обнуления таблиц inode при mkfs
+#define EXT2_ZERO_CHUNK 16384
+
+// Слово битовой карты: проверка 32 занятых битов за раз
+typedef uint32_t bitmap_word_t __attribute__((may_alias));
+
+// Геометрия смонтированной ФС
+static struct {
+    bool mounted;
+    bool read_only;
+    bool filetype;                  // В записях каталога есть тип файла
+    uint32_t lba_start;
+    uint32_t sector_count;
+    uint32_t block_size;
+    uint32_t block_shift;           // log2(block_size)
+    uint32_t sectors_per_block;
+    uint32_t addr_per_block;        // Ссылок в косвенном блоке
+    uint32_t groups;
+    uint32_t blocks_per_group;
+    uint32_t inodes_per_group;
+    uint32_t inode_size;
+    uint32_t first_ino;
+    uint32_t first_data_block;
+    uint32_t gdt_blocks;
+    bool sb_dirty;
+    uint32_t gdt_dirty;             // Маска измененных блоков таблицы групп
+    // Цель следующего выделения: блок за последним выделенным блоком того
+    // же файла - файл, который пишется подряд, ложится на диск подряд
+    uint32_t last_alloc_ino;
+    uint32_t last_alloc_block;
+} fs;
+
+// Первый раздел Linux из MBR (для монтирования и mkfs)
+static bool part_found = false;
+static uint32_t part_lba = 0;
+static uint32_t part_sectors = 0;
+
+static ext2_superblock_t sb;
+static ext2_group_desc_t gdt[EXT2_MAX_GROUPS];
+
+// Все операции над ФС последовательны
+static mutex_t ext2_mutex = MUTEX_INIT;
+
+static ext2_stats_t stats;
+
+// Битовая карта одной группы. Изменения копятся до конца операции.
+typedef struct {
+    bool valid;
+    bool dirty;
+    bool inodes;                    // Карта inode (иначе - карта блоков)
+    uint32_t group;
+    uint8_t data[EXT2_MAX_BLOCK_SIZE];
+} bitmap_buf_t;
+
+static bitmap_buf_t block_bitmap = { .inodes = false };
+static bitmap_buf_t inode_bitmap = { .inodes = true };
+
+// Последний прочитанный косвенный блок каждого уровня: при чтении файла
+// подряд блок ссылок читается с диска один раз на addr_per_block блоков,
+// при записи - пишется один раз за операцию, а не на каждый новый блок
+typedef struct {
+    uint32_t block;                 // 0 - пусто
+    bool dirty;
+    uint32_t table[EXT2_MAX_BLOCK_SIZE / 4];
+} indirect_buf_t;
+
+static indirect_buf_t indirect_cache[3];
+
+// Кэш inode. Запись сквозная: в кэше только копии того, что на диске.
+typedef struct {
+    uint32_t ino;                   // 0 - свободно
+    uint32_t last_use;
+    int16_t next;                   // Следующий в цепочке хэша (-1 - конец)
+    ext2_inode_t inode;
+} inode_cache_entry_t;
+
+static inode_cache_entry_t inode_cache[EXT2_INODE_CACHE_SIZE];
+static int16_t inode_hash[EXT2_INODE_HASH_SIZE];
+static uint32_t inode_clock = 0;
+
+// Кэш компонентов пути (только найденные имена)
+typedef struct {
+    uint32_t parent;
+    uint32_t ino;                   // 0 - пусто
+    uint8_t length;
+    char name[EXT2_DENTRY_NAME_LEN];
+} dentry_t;
+
+static dentry_t dentry_cache[EXT2_DENTRY_CACHE_SIZE];
+
+// Блок каталога или неполный блок файла
+static uint8_t block_buf[EXT2_MAX_BLOCK_SIZE];
+// Сектор с inode
+static uint8_t sector_buf[SECTOR_SIZE];
+// Косвенные блоки при освобождении дерева блоков (по одному на уровень)
+static uint32_t free_buf[3][EXT2_MAX_BLOCK_SIZE / 4];
+
+// Команды оболочки
+static const shell_command_t ext2_commands[] = {
+    { "ls", "[path]", "List an ext2 directory", run_ls },
+    { "cat", "<path>", "Print an ext2 file", run_cat },
+    { "write", "<path> <text>", "Write text to an ext2 file (replaces it)", run_write },
+    { "cp", "<src> <dst>", "Copy an ext2 file", run_cp },
+    { "mkfs", "[-f]", "Create an ext2 filesystem on the Linux partition", run_mkfs },
+    { "fs-info", NULL, "ext2 usage and cache statistics", run_fs_info },
+};
+
+// ============== Ввод-вывод ==============
+
+static bool read_blocks(uint32_t block, uint32_t count, void* buffer) {
+    return read_disk_sectors(buffer, fs.lba_start + block * fs.sectors_per_block,
+                             count * fs.sectors_per_block);
+}
+
+static bool write_blocks(uint32_t block, uint32_t count, const void* buffer) {
+    return write_disk_sectors(buffer, fs.lba_start + block * fs.sectors_per_block,
+                              count * fs.sectors_per_block);
+}
+
+static bool write_superblock(void) {
+    return write_disk_sectors((const uint8_t*)&sb,
+                              fs.lba_start + EXT2_SUPERBLOCK_OFFSET / SECTOR_SIZE,
+                              sizeof(sb) / SECTOR_SIZE);
+}
+
+static void mark_group_dirty(uint32_t group) {
+    fs.gdt_dirty |= 1u << ((group * sizeof(ext2_group_desc_t)) >> fs.block_shift);
+    fs.sb_dirty = true;
+}
+
+static int flush_bitmap(bitmap_buf_t* bitmap) {
+    if (!bitmap->valid || !bitmap->dirty) {
+        return EXT2_OK;
+    }
+    uint32_t block = bitmap->inodes ? gdt[bitmap->group].bg_inode_bitmap
+                                    : gdt[bitmap->group].bg_block_bitmap;
+    if (!write_blocks(block, 1, bitmap->data)) {
+        return EXT2_ERR_IO;
+    }
+    bitmap->dirty = false;
+    return EXT2_OK;
+}
+
+static int load_bitmap(bitmap_buf_t* bitmap, uint32_t group) {
+    if (bitmap->valid && bitmap->group == group) {
+        return EXT2_OK;
+    }
+    int err = flush_bitmap(bitmap);
+    if (err != EXT2_OK) {
+        return err;
+    }
+    uint32_t block = bitmap->inodes ? gdt[group].bg_inode_bitmap : gdt[group].bg_block_bitmap;
+    bitmap->valid = read_blocks(block, 1, bitmap->data);
+    bitmap->group = group;
+    bitmap->dirty = false;
+    return bitmap->valid ? EXT2_OK : EXT2_ERR_IO;
+}
+
+static int flush_indirect(indirect_buf_t* buf) {
+    if (buf->block == 0 || !buf->dirty) {
+        return EXT2_OK;
+    }
+    if (!write_blocks(buf->block, 1, buf->table)) {
+        return EXT2_ERR_IO;
+    }
+    buf->dirty = false;
+    return EXT2_OK;
+}
+
+// Запись измененных косвенных блоков, битовых карт, дескрипторов групп и
+// суперблока в конце каждой изменяющей операции
+static int flush_metadata(void) {
+    int err = EXT2_OK;
+    for (int level = 0; level < 3 && err == EXT2_OK; level++) {
+        err = flush_indirect(&indirect_cache[level]);
+    }
+    if (err == EXT2_OK) {
+        err = flush_bitmap(&block_bitmap);
+    }
+    if (err == EXT2_OK) {
+        err = flush_bitmap(&inode_bitmap);
+    }
+    for (uint32_t i = 0; i < fs.gdt_blocks && err == EXT2_OK; i++) {
+        if (fs.gdt_dirty & (1u << i)) {
+            if (!write_blocks(fs.first_data_block + 1 + i, 1,
+                              (const uint8_t*)gdt + (i << fs.block_shift))) {
+                err = EXT2_ERR_IO;
+            }
+        }
+    }
+    if (err == EXT2_OK) {
+        fs.gdt_dirty = 0;
+        if (fs.sb_dirty && !write_superblock()) {
+            err = EXT2_ERR_IO;
+        }
+        fs.sb_dirty = false;
+    }
+    return err;
+}
+
+// ============== Выделение блоков и inode ==============
+
+static uint32_t group_block_count(uint32_t group) {
+    if (group == fs.groups - 1) {
+        return sb.s_blocks_count - fs.first_data_block - group * fs.blocks_per_group;
+    }
+    return fs.blocks_per_group;
+}
+
+// Первый нулевой бит в [start, end) или -1
+static int32_t find_zero_bit(const uint8_t* map, uint32_t start, uint32_t end) {
+    uint32_t bit = start;
+    while (bit < end) {
+        if ((bit & 31) == 0 && bit + 32 <= end &&
+            *(const bitmap_word_t*)(map + (bit >> 3)) == 0xFFFFFFFF) {
+            bit += 32;
+            continue;
+        }
+        if (!(map[bit >> 3] & (1 << (bit & 7)))) {
+            return bit;
+        }
+        bit++;
+    }
+    return -1;
+}
+
+// Выделение блока как можно ближе к goal: сначала от goal до конца его
+// группы, затем с начала этой группы, затем в следующих группах
+static int alloc_block(uint32_t goal, uint32_t* block) {
+    if (goal < fs.first_data_block || goal >= sb.s_blocks_count) {
+        goal = fs.first_data_block;
+    }
+    uint32_t goal_group = (goal - fs.first_data_block) / fs.blocks_per_group;
+    uint32_t goal_bit = (goal - fs.first_data_block) % fs.blocks_per_group;
+
+    for (uint32_t i = 0; i < fs.groups; i++) {
+        uint32_t group = (goal_group + i) % fs.groups;
+        if (gdt[group].bg_free_blocks_count == 0) {
+            continue;
+        }
+        int err = load_bitmap(&block_bitmap, group);
+        if (err != EXT2_OK) {
+            return err;
+        }
+        uint32_t count = group_block_count(group);
+        uint32_t start = i == 0 ? goal_bit : 0;
+        int32_t bit = find_zero_bit(block_bitmap.data, start, count);
+        if (bit < 0 && start > 0) {
+            bit = find_zero_bit(block_bitmap.data, 0, start);
+        }
+        if (bit < 0) {
+            continue;
+        }
+        block_bitmap.data[bit >> 3] |= 1 << (bit & 7);
+        block_bitmap.dirty = true;
+        gdt[group].bg_free_blocks_count--;
+        if (sb.s_free_blocks_count > 0) {
+            sb.s_free_blocks_count--;
+        }
+        mark_group_dirty(group);
+        *block = fs.first_data_block + group * fs.blocks_per_group + bit;
+        return EXT2_OK;
+    }
+    return EXT2_ERR_NO_SPACE;
+}
+
+static int free_block(uint32_t block) {
+    if (block < fs.first_data_block || block >= sb.s_blocks_count) {
+        return EXT2_ERR_CORRUPT;
+    }
+    uint32_t group = (block - fs.first_data_block) / fs.blocks_per_group;
+    uint32_t bit = (block - fs.first_data_block) % fs.blocks_per_group;
+    int err = load_bitmap(&block_bitmap, group);
+    if (err != EXT2_OK) {
+        return err;
+    }
+    block_bitmap.data[bit >> 3] &= ~(1 << (bit & 7));
+    block_bitmap.dirty = true;
+    gdt[group].bg_free_blocks_count++;
+    sb.s_free_blocks_count++;
+    mark_group_dirty(group);
+
+    for (int level = 0; level < 3; level++) {
+        if (indirect_cache[level].block == block) {
+            indirect_cache[level].block = 0;
+            indirect_cache[level].dirty = false;
+        }
+    }
+    return EXT2_OK;
+}
+
+// Выделение inode: сначала в группе каталога, затем в следующих группах
+static int alloc_inode(uint32_t goal_group, uint32_t* ino) {
+    for (uint32_t i = 0; i < fs.groups; i++) {
+        uint32_t group = (goal_group + i) % fs.groups;
+        if (gdt[group].bg_free_inodes_count == 0) {
+            continue;
+        }
+        int err = load_bitmap(&inode_bitmap, group);
+        if (err != EXT2_OK) {
+            return err;
+        }
+        // Inode с номерами меньше first_ino зарезервированы
+        uint32_t start = group == 0 ? fs.first_ino - 1 : 0;
+        int32_t bit = find_zero_bit(inode_bitmap.data, start, fs.inodes_per_group);
+        if (bit < 0) {
+            continue;
+        }
+        inode_bitmap.data[bit >> 3] |= 1 << (bit & 7);
+        inode_bitmap.dirty = true;
+        gdt[group].bg_free_inodes_count--;
+        if (sb.s_free_inodes_count > 0) {
+            sb.s_free_inodes_count--;
+        }
+        mark_group_dirty(group);
+        *ino = group * fs.inodes_per_group + bit + 1;
+        return EXT2_OK;
+    }
+    return EXT2_ERR_NO_INODES;
+}
+
+static int free_inode(uint32_t ino) {
+    uint32_t group = (ino - 1) / fs.inodes_per_group;
+    uint32_t bit = (ino - 1) % fs.inodes_per_group;
+    int err = load_bitmap(&inode_bitmap, group);
+    if (err != EXT2_OK) {
+        return err;
+    }
+    inode_bitmap.data[bit >> 3] &= ~(1 << (bit & 7));
+    inode_bitmap.dirty = true;
+    gdt[group].bg_free_inodes_count++;
+    sb.s_free_inodes_count++;
+    mark_group_dirty(group);
+    return EXT2_OK;
+}
+
+// ============== Кэш inode ==============
+
+static void inode_cache_reset(void) {
+    for (int i = 0; i < EXT2_INODE_CACHE_SIZE; i++) {
+        inode_cache[i].ino = 0;
+    }
+    for (int i = 0; i < EXT2_INODE_HASH_SIZE; i++) {
+        inode_hash[i] = -1;
+    }
+}
+
+static inode_cache_entry_t* inode_cache_find(uint32_t ino) {
+    for (int i = inode_hash[ino & (EXT2_INODE_HASH_SIZE - 1)]; i >= 0; i = inode_cache[i].next) {
+        if (inode_cache[i].ino == ino) {
+            inode_cache[i].last_use = ++inode_clock;
+            return &inode_cache[i];
+        }
+    }
+    return NULL;
+}
+
+// Помещение inode в кэш на место свободной или самой давней записи
+static void inode_cache_insert(uint32_t ino, const ext2_inode_t* inode) {
+    int victim = 0;
+    for (int i = 0; i < EXT2_INODE_CACHE_SIZE; i++) {
+        if (inode_cache[i].ino == 0) {
+            victim = i;
+            break;
+        }
+        if (inode_cache[i].last_use < inode_cache[victim].last_use) {
+            victim = i;
+        }
+    }
+
+    inode_cache_entry_t* entry = &inode_cache[victim];
+    if (entry->ino != 0) {
+        int16_t* link = &inode_hash[entry->ino & (EXT2_INODE_HASH_SIZE - 1)];
+        while (*link != victim) {
+            link = &inode_cache[*link].next;
+        }
+        *link = entry->next;
+    }
+
+    int16_t* head = &inode_hash[ino & (EXT2_INODE_HASH_SIZE - 1)];
+    entry->ino = ino;
+    entry->last_use = ++inode_clock;
+    entry->inode = *inode;
+    entry->next = *head;
+    *head = victim;
+}
+
+// Сектор диска с inode и смещение inode в нем. Размер inode - степень
+// двойки не больше блока, поэтому первые 128 байт не пересекают сектор.
+static int inode_location(uint32_t ino, uint32_t* sector, uint32_t* offset) {
+    if (ino == 0 || ino > sb.s_inodes_count) {
+        return EXT2_ERR_CORRUPT;
+    }
+    uint32_t group = (ino - 1) / fs.inodes_per_group;
+    uint32_t byte = ((ino - 1) % fs.inodes_per_group) * fs.inode_size;
+    *sector = fs.lba_start + gdt[group].bg_inode_table * fs.sectors_per_block + byte / SECTOR_SIZE;
+    *offset = byte % SECTOR_SIZE;
+    return EXT2_OK;
+}
+
+static int get_inode(uint32_t ino, ext2_inode_t* inode) {
+    inode_cache_entry_t* entry = inode_cache_find(ino);
+    if (entry != NULL) {
+        stats.inode_hits++;
+        *inode = entry->inode;
+        return EXT2_OK;
+    }
+    stats.inode_misses++;
+
+    uint32_t sector, offset;
+    int err = inode_location(ino, &sector, &offset);
+    if (err != EXT2_OK) {
+        return err;
+    }
+    if (!read_disk_sectors(sector_buf, sector, 1)) {
+        return EXT2_ERR_IO;
+    }
+    memcpy(inode, sector_buf + offset, sizeof(*inode));
+    inode_cache_insert(ino, inode);
+    return EXT2_OK;
+}
+
+// Запись inode на диск и в кэш. fresh - новый inode: остаток слота за
+// 128 байтами обнуляется.
+static int put_inode(uint32_t ino, const ext2_inode_t* inode, bool fresh) {
+    uint32_t sector, offset;
+    int err = inode_location(ino, &sector, &offset);
+    if (err != EXT2_OK) {
+        return err;
+    }
+    if (!read_disk_sectors(sector_buf, sector, 1)) {
+        return EXT2_ERR_IO;
+    }
+    if (fresh) {
+        uint32_t slot = fs.inode_size < SECTOR_SIZE - offset ? fs.inode_size : SECTOR_SIZE - offset;
+        memset(sector_buf + offset, 0, slot);
+    }
+    memcpy(sector_buf + offset, inode, sizeof(*inode));
+    if (!write_disk_sectors(sector_buf, sector, 1)) {
+        return EXT2_ERR_IO;
+    }
+
+    inode_cache_entry_t* entry = inode_cache_find(ino);
+    if (entry != NULL) {
+        entry->inode = *inode;
+    } else {
+        inode_cache_insert(ino, inode);
+    }
+    return EXT2_OK;
+}
+
+// ============== Кэш компонентов пути ==============
+
+static dentry_t* dentry_slot(uint32_t parent, const char* name, uint32_t length) {
+    uint32_t hash = 2166136261u ^ parent;
+    for (uint32_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return &dentry_cache[hash & (EXT2_DENTRY_CACHE_SIZE - 1)];
+}
+
+static bool dentry_lookup(uint32_t parent, const char* name, uint32_t length, uint32_t* ino) {
+    dentry_t* dentry = dentry_slot(parent, name, length);
+    if (dentry->ino != 0 && dentry->parent == parent && dentry->length == length &&
+        memcmp(dentry->name, name, length) == 0) {
+        *ino = dentry->ino;
+        return true;
+    }
+    return false;
+}
+
+static void dentry_insert(uint32_t parent, const char* name, uint32_t length, uint32_t ino) {
+    if (length > EXT2_DENTRY_NAME_LEN) {
+        return;
+    }
+    dentry_t* dentry = dentry_slot(parent, name, length);
+    dentry->parent = parent;
+    dentry->ino = ino;
+    dentry->length = length;
+    memcpy(dentry->name, name, length);
+}
+
+static void reset_caches(void) {
+    inode_cache_reset();
+    memset(dentry_cache, 0, sizeof(dentry_cache));
+    for (int level = 0; level < 3; level++) {
+        indirect_cache[level].block = 0;
+        indirect_cache[level].dirty = false;
+    }
+    block_bitmap.valid = false;
+    inode_bitmap.valid = false;
+    fs.last_alloc_ino = 0;
+    fs.sb_dirty = false;
+    fs.gdt_dirty = 0;
+}
+
+// ============== Отображение блоков файла ==============
+
+static int load_indirect(int level, uint32_t block, uint32_t** table) {
+    indirect_buf_t* buf = &indirect_cache[level];
+    if (buf->block != block) {
+        int err = flush_indirect(buf);
+        if (err != EXT2_OK) {
+            return err;
+        }
+        if (!read_blocks(block, 1, buf->table)) {
+            buf->block = 0;
+            return EXT2_ERR_IO;
+        }
+        buf->block = block;
+    }
+    *table = buf->table;
+    return EXT2_OK;
+}
+
+// Выделение блока файлу ino: цель - следующий за последним выделенным
+// этому файлу, иначе начало группы inode
+static int alloc_file_block(uint32_t ino, ext2_inode_t* inode, uint32_t* block) {
+    uint32_t goal;
+    if (fs.last_alloc_ino == ino) {
+        goal = fs.last_alloc_block + 1;
+    } else {
+        goal = fs.first_data_block + ((ino - 1) / fs.inodes_per_group) * fs.blocks_per_group;
+    }
+    int err = alloc_block(goal, block);
+    if (err != EXT2_OK) {
+        return err;
+    }
+    fs.last_alloc_ino = ino;
+    fs.last_alloc_block = *block;
+    inode->i_blocks += fs.sectors_per_block;
+    return EXT2_OK;
+}
+
+// Новый косвенный блок уровня level: обнуляется прямо в кэше уровня
+static int alloc_indirect(uint32_t ino, ext2_inode_t* inode, int level, uint32_t* block) {
+    indirect_buf_t* buf = &indirect_cache[level];
+    int err = flush_indirect(buf);
+    if (err == EXT2_OK) {
+        err = alloc_file_block(ino, inode, block);
+    }
+    if (err != EXT2_OK) {
+        return err;
+    }
+    memset(buf->table, 0, fs.block_size);
+    buf->block = *block;
+    buf->dirty = true;
+    return EXT2_OK;
+}
+
+// Физический блок логического блока lblock (0 - дыра). create - выделять
+// недостающие блоки данных и ссылок; *allocated - блок данных новый.
+// Изменения inode (i_block, i_blocks) записывает вызывающий, косвенные
+// блоки пишет flush_metadata.
+static int map_block(uint32_t ino, ext2_inode_t* inode, uint32_t lblock, bool create,
+                     uint32_t* phys, bool* allocated) {
+    uint32_t apb = fs.addr_per_block;
+    uint32_t offsets[3];
+    int depth;
+    *phys = 0;
+    if (allocated != NULL) {
+        *allocated = false;
+    }
+
+    if (lblock < EXT2_NDIR_BLOCKS) {
+        depth = 0;
+    } else if ((lblock -= EXT2_NDIR_BLOCKS) < apb) {
+        depth = 1;
+        offsets[0] = lblock;
+    } else if ((lblock -= apb) < apb * apb) {
+        depth = 2;
+        offsets[0] = lblock / apb;
+        offsets[1] = lblock % apb;
+    } else if ((lblock -= apb * apb) < apb * apb * apb) {
+        depth = 3;
+        offsets[0] = lblock / (apb * apb);
+        offsets[1] = (lblock / apb) % apb;
+        offsets[2] = lblock % apb;
+    } else {
+        return EXT2_ERR_TOO_BIG;
+    }
+
+    uint32_t slot = depth == 0 ? lblock : (uint32_t)(EXT2_IND_BLOCK + depth - 1);
+    uint32_t block = inode->i_block[slot];
+    int err;
+    if (block == 0) {
+        if (!create) {
+            return EXT2_OK;
+        }
+        err = depth == 0 ? alloc_file_block(ino, inode, &block)
+                         : alloc_indirect(ino, inode, 0, &block);
+        if (err != EXT2_OK) {
+            return err;
+        }
+        inode->i_block[slot] = block;
+        if (depth == 0 && allocated != NULL) {
+            *allocated = true;
+        }
+    }
+
+    for (int level = 0; level < depth; level++) {
+        uint32_t* table;
+        err = load_indirect(level, block, &table);
+        if (err != EXT2_OK) {
+            return err;
+        }
+        uint32_t next = table[offsets[level]];
+        if (next == 0) {
+            if (!create) {
+                return EXT2_OK;
+            }
+            bool leaf = level == depth - 1;
+            err = leaf ? alloc_file_block(ino, inode, &next)
+                       : alloc_indirect(ino, inode, level + 1, &next);
+            if (err != EXT2_OK) {
+                return err;
+            }
+            table[offsets[level]] = next;
+            indirect_cache[level].dirty = true;
+            if (leaf && allocated != NULL) {
+                *allocated = true;
+            }
+        }
+        block = next;
+    }
+    *phys = block;
+    return EXT2_OK;
+}
+
+// Освобождение блока и (depth > 0) всех блоков, на которые он ссылается
+static int free_tree(uint32_t block, int depth) {
+    if (depth > 0) {
+        uint32_t* table = free_buf[depth - 1];
+        if (!read_blocks(block, 1, table)) {
+            return EXT2_ERR_IO;
+        }
+        for (uint32_t i = 0; i < fs.addr_per_block; i++) {
+            if (table[i] != 0) {
+                int err = free_tree(table[i], depth - 1);
+                if (err != EXT2_OK) {
+                    return err;
+                }
+            }
+        }
+    }
+    return free_block(block);
+}
+
+// Усечение файла до нуля с освобождением всех блоков данных и ссылок
+static int truncate_inode(uint32_t ino, ext2_inode_t* inode) {
+    // Дерево читается с диска: кэш ссылок должен быть записан
+    int err = EXT2_OK;
+    for (int level = 0; level < 3 && err == EXT2_OK; level++) {
+        err = flush_indirect(&indirect_cache[level]);
+    }
+    for (int i = 0; i < EXT2_N_BLOCKS && err == EXT2_OK; i++) {
+        if (inode->i_block[i] != 0) {
+            int depth = i < EXT2_NDIR_BLOCKS ? 0 : i - EXT2_IND_BLOCK + 1;
+            err = free_tree(inode->i_block[i], depth);
+        }
+    }
+    if (err != EXT2_OK) {
+        return err;
+    }
+    memset(inode->i_block, 0, sizeof(inode->i_block));
+    inode->i_size = 0;
+    inode->i_size_high = 0;
+    // Блок расширенных атрибутов остается за файлом
+    inode->i_blocks = inode->i_file_acl != 0 ? fs.sectors_per_block : 0;
+    if (fs.last_alloc_ino == ino) {
+        fs.last_alloc_ino = 0;
+    }
+    return put_inode(ino, inode, false);
+}
+
+// ============== Данные файлов ==============
+
+static uint32_t inode_size_bytes(const ext2_inode_t* inode) {
+    // Файлы больше 4 ГиБ читаются до 4 ГиБ
+    return inode->i_size_high != 0 && (inode->i_mode & EXT2_S_IFMT) == EXT2_S_IFREG
+           ? 0xFFFFFFFF : inode->i_size;
+}
+
+static int read_data(uint32_t ino, ext2_inode_t* inode, uint32_t offset,
+                     uint8_t* out, uint32_t length) {
+    uint32_t size = inode_size_bytes(inode);
+    if (offset >= size) {
+        return 0;
+    }
+    if (length > size - offset) {
+        length = size - offset;
+    }
+    if (length > 0x7FFFFFFF) {
+        length = 0x7FFFFFFF;
+    }
+
+    uint32_t done = 0;
+    while (done < length) {
+        uint32_t pos = offset + done;
+        uint32_t lblock = pos >> fs.block_shift;
+        uint32_t in_block = pos & (fs.block_size - 1);
+        uint32_t phys;
+        int err = map_block(ino, inode, lblock, false, &phys, NULL);
+        if (err != EXT2_OK) {
+            return err;
+        }
+
+        // Неполный блок - через буфер
+        if (in_block != 0 || length - done < fs.block_size) {
+            uint32_t chunk = fs.block_size - in_block;
+            if (chunk > length - done) {
+                chunk = length - done;
+            }
+            if (phys == 0) {
+                memset(out + done, 0, chunk);
+            } else {
+                if (!read_blocks(phys, 1, block_buf)) {
+                    return EXT2_ERR_IO;
+                }
+                stats.block_runs++;
+                stats.blocks_read++;
+                memcpy(out + done, block_buf + in_block, chunk);
+            }
+            done += chunk;
+            continue;
+        }
+
+        // Целые блоки: непрерывный на диске участок (или дыра) читается
+        // одной командой прямо в буфер вызывающего
+        uint32_t max_run = (length - done) >> fs.block_shift;
+        uint32_t run = 1;
+        while (run < max_run) {
+            uint32_t next;
+            err = map_block(ino, inode, lblock + run, false, &next, NULL);
+            if (err != EXT2_OK) {
+                return err;
+            }
+            if (phys == 0 ? next != 0 : next != phys + run) {
+                break;
+            }
+            run++;
+        }
+        if (phys == 0) {
+            memset(out + done, 0, run << fs.block_shift);
+        } else {
+            if (!read_blocks(phys, run, out + done)) {
+                return EXT2_ERR_IO;
+            }
+            stats.block_runs++;
+            stats.blocks_read += run;
+        }
+        done += run << fs.block_shift;
+    }
+    return done;
+}
+
+static int write_data(uint32_t ino, ext2_inode_t* inode, uint32_t offset,
+                      const uint8_t* in, uint32_t length) {
+    if (length > 0x7FFFFFFF || offset > 0xFFFFFFFF - length) {
+        return EXT2_ERR_TOO_BIG;
+    }
+
+    uint32_t done = 0;
+    int err = EXT2_OK;
+    while (done < length) {
+        uint32_t pos = offset + done;
+        uint32_t lblock = pos >> fs.block_shift;
+        uint32_t in_block = pos & (fs.block_size - 1);
+        uint32_t phys;
+        bool allocated;
+
+        // Неполный блок: чтение, изменение, запись (новый блок - с нулей)
+        if (in_block != 0 || length - done < fs.block_size) {
+            uint32_t chunk = fs.block_size - in_block;
+            if (chunk > length - done) {
+                chunk = length - done;
+            }
+            err = map_block(ino, inode, lblock, true, &phys, &allocated);
+            if (err != EXT2_OK) {
+                break;
+            }
+            if (allocated) {
+                memset(block_buf, 0, fs.block_size);
+            } else if (!read_blocks(phys, 1, block_buf)) {
+                err = EXT2_ERR_IO;
+                break;
+            }
+            memcpy(block_buf + in_block, in + done, chunk);
+            if (!write_blocks(phys, 1, block_buf)) {
+                err = EXT2_ERR_IO;
+                break;
+            }
+            stats.blocks_written++;
+            done += chunk;
+            continue;
+        }
+
+        // Целые блоки: выделяются подряд и пишутся одной командой
+        err = map_block(ino, inode, lblock, true, &phys, NULL);
+        if (err != EXT2_OK) {
+            break;
+        }
+        uint32_t max_run = (length - done) >> fs.block_shift;
+        uint32_t run = 1;
+        while (run < max_run) {
+            uint32_t next;
+            err = map_block(ino, inode, lblock + run, true, &next, NULL);
+            if (err != EXT2_OK || next != phys + run) {
+                break;
+            }
+            run++;
+        }
+        if (!write_blocks(phys, run, in + done)) {
+            err = EXT2_ERR_IO;
+            break;
+        }
+        stats.blocks_written += run;
+        done += run << fs.block_shift;
+        if (err != EXT2_OK) {
+            break;
+        }
+    }
+
+    if (offset + done > inode->i_size) {
+        inode->i_size = offset + done;
+    }
+    int put_err = put_inode(ino, inode, false);
+    if (err == EXT2_OK) {
+        err = put_err;
+    }
+    return err == EXT2_OK || done > 0 ? (int)done : err;
+}
+
+// ============== Каталоги ==============
+
+static uint32_t dirent_size(uint32_t name_len) {
+    return (8 + name_len + 3) & ~3u;
+}
+
+static bool is_dir(const ext2_inode_t* inode) {
+    return (inode->i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+}
+
+// Чтение блока index каталога в block_buf
+static int read_dir_block(uint32_t ino, ext2_inode_t* dir, uint32_t index, uint32_t* phys) {
+    int err = map_block(ino, dir, index, false, phys, NULL);
+    if (err != EXT2_OK) {
+        return err;
+    }
+    if (*phys == 0) {
+        return EXT2_ERR_CORRUPT;
+    }
+    return read_blocks(*phys, 1, block_buf) ? EXT2_OK : EXT2_ERR_IO;
+}
+
+// Запись каталога по смещению offset в block_buf или NULL, если запись
+// выходит за блок
+static ext2_dirent_t* dirent_at(uint32_t offset) {
+    ext2_dirent_t* dirent = (ext2_dirent_t*)(block_buf + offset);
+    if (offset + 8 > fs.block_size || dirent->rec_len < 8 || (dirent->rec_len & 3) != 0 ||
+        offset + dirent->rec_len > fs.block_size || dirent_size(dirent->name_len) > dirent->rec_len) {
+        klog(KLOG_ERR, "ext2: corrupt directory entry at offset %u", offset);
+        return NULL;
+    }
+    return dirent;
+}
+
+// Поиск имени в каталоге dir_ino (сначала в кэше компонентов пути)
+static int dir_find(uint32_t dir_ino, const char* name, uint32_t length, uint32_t* ino) {
+    if (dentry_lookup(dir_ino, name, length, ino)) {
+        stats.dentry_hits++;
+        return EXT2_OK;
+    }
+    stats.dentry_misses++;
+
+    ext2_inode_t dir;
+    int err = get_inode(dir_ino, &dir);
+    if (err != EXT2_OK) {
+        return err;
+    }
+    if (!is_dir(&dir)) {
+        return EXT2_ERR_NOT_DIR;
+    }
+
+    uint32_t blocks = dir.i_size >> fs.block_shift;
+    for (uint32_t index = 0; index < blocks; index++) {
+        uint32_t phys;
+        err = read_dir_block(dir_ino, &dir, index, &phys);
+        if (err != EXT2_OK) {
+            return err;
+        }
+        for (uint32_t offset = 0; offset < fs.block_size; ) {
+            ext2_dirent_t* dirent = dirent_at(offset);
+            if (dirent == NULL) {
+                return EXT2_ERR_CORRUPT;
+            }
+            if (dirent->inode != 0 && dirent->name_len == length &&
+                memcmp(dirent->name, name, length) == 0) {
+                *ino = dirent->inode;
+                dentry_insert(dir_ino, name, length, *ino);
+                return EXT2_OK;
+            }
+            offset += dirent->rec_len;
+        }
+    }
+    return EXT2_ERR_NOT_FOUND;
+}
+
+// Добавление записи: в свободное место за существующей записью или в
+// новый блок в конце каталога
+static int dir_add(uint32_t dir_ino, ext2_inode_t* dir, const char* name, uint32_t length,
+                   uint32_t ino, uint8_t file_type) {
+    uint32_t need = dirent_size(length);
+    uint32_t blocks = dir->i_size >> fs.block_shift;
+    ext2_dirent_t* slot = NULL;
+    uint32_t phys = 0;
+    int err;
+
+    for (uint32_t index = 0; index < blocks && slot == NULL; index++) {
+        err = read_dir_block(dir_ino, dir, index, &phys);
+        if (err != EXT2_OK) {
+            return err;
+        }
+        for (uint32_t offset = 0; offset < fs.block_size; ) {
+            ext2_dirent_t* dirent = dirent_at(offset);
+            if (dirent == NULL) {
+                return EXT2_ERR_CORRUPT;
+            }
+            uint32_t used = dirent->inode != 0 ? dirent_size(dirent->name_len) : 0;
+            if (dirent->rec_len - used >= need) {
+                if (used == 0) {
+                    slot = dirent;
+                } else {
+                    slot = (ext2_dirent_t*)((uint8_t*)dirent + used);
+                    slot->rec_len = dirent->rec_len - used;
+                    dirent->rec_len = used;
+                }
+                break;
+            }
+            offset += dirent->rec_len;
+        }
+    }
+
+    if (slot == NULL) {
+        err = map_block(dir_ino, dir, blocks, true, &phys, NULL);
+        if (err != EXT2_OK) {
+            return err;
+        }
+        memset(block_buf, 0, fs.block_size);
+        slot = (ext2_dirent_t*)block_buf;
+        slot->rec_len = fs.block_size;
+        dir->i_size += fs.block_size;
+    }
+
+    slot->inode = ino;
+    slot->name_len = length;
+    slot->file_type = fs.filetype ? file_type : 0;
+    memcpy(slot->name, name, length);
+    if (!write_blocks(phys, 1, block_buf)) {
+        return EXT2_ERR_IO;
+    }
+
+    // Хэш-индекс каталога больше не соответствует записям
+    dir->i_flags &= ~EXT2_INDEX_FL;
+    err = put_inode(dir_ino, dir, false);
+    if (err == EXT2_OK) {
+        dentry_insert(dir_ino, name, length, ino);
+    }
+    return err;
+}
+
+// ============== Пути ==============
+
+// Разбор первых length символов пути от корня
+static int walk_path(const char* path, uint32_t length, uint32_t* ino) {
+    uint32_t current = EXT2_ROOT_INO;
+    uint32_t i = 0;
+    while (i < length) {
+        while (i < length && path[i] == '/') {
+            i++;
+        }
+        uint32_t start = i;
+        while (i < length && path[i] != '/') {
+            i++;
+        }
+        uint32_t name_len = i - start;
+        if (name_len == 0) {
+            break;
+        }
+        if (name_len > EXT2_NAME_LEN) {
+            return EXT2_ERR_NAME_TOO_LONG;
+        }
+        if (name_len == 1 && path[start] == '.') {
+            continue;
+        }
+        int err = dir_find(current, path + start, name_len, &current);
+        if (err != EXT2_OK) {
+            return err;
+        }
+    }
+    *ino = current;
+    return EXT2_OK;
+}
+
+// Каталог, в котором лежит последний компонент пути, и сам компонент
+static int split_path(const char* path, uint32_t* dir_ino, const char** name, uint32_t* name_len) {
+    uint32_t end = strlen(path);
+    while (end > 0 && path[end - 1] == '/') {
+        end--;
+    }
+    uint32_t start = end;
+    while (start > 0 && path[start - 1] != '/') {
+        start--;
+    }
+    uint32_t length = end - start;
+    if (length == 0 || (length == 1 && path[start] == '.') ||
+        (length == 2 && path[start] == '.' && path[start + 1] == '.')) {
+        return EXT2_ERR_INVALID;
+    }
+    if (length > EXT2_NAME_LEN) {
+        return EXT2_ERR_NAME_TOO_LONG;
+    }
+    *name = path + start;
+    *name_len = length;
+    return walk_path(path, start, dir_ino);
+}
+
+// ============== Монтирование ==============
+
+// Геометрия ФС из суперблока
+static int setup_geometry(uint32_t lba_start, uint32_t sector_count) {
+    if (sb.s_magic != EXT2_SUPER_MAGIC) {
+        return EXT2_ERR_NO_FS;
+    }
+    if (sb.s_log_block_size > 2) {
+        return EXT2_ERR_UNSUPPORTED;
+    }
+    fs.lba_start = lba_start;
+    fs.sector_count = sector_count;
+    fs.block_shift = 10 + sb.s_log_block_size;
+    fs.block_size = 1u << fs.block_shift;
+    fs.sectors_per_block = fs.block_size / SECTOR_SIZE;
+    fs.addr_per_block = fs.block_size / 4;
+    fs.first_data_block = sb.s_first_data_block;
+    fs.blocks_per_group = sb.s_blocks_per_group;
+    fs.inodes_per_group = sb.s_inodes_per_group;
+
+    if (sb.s_rev_level == 0) {
+        fs.inode_size = EXT2_GOOD_OLD_INODE_SIZE;
+        fs.first_ino = EXT2_GOOD_OLD_FIRST_INO;
+        fs.filetype = false;
+    } else {
+        if (sb.s_feature_incompat & ~EXT2_SUPPORTED_INCOMPAT) {
+            klog(KLOG_ERR, "ext2: unsupported incompatible features 0x%x",
+                 sb.s_feature_incompat & ~EXT2_SUPPORTED_INCOMPAT);
+            return EXT2_ERR_UNSUPPORTED;
+        }
+        fs.inode_size = sb.s_inode_size;
+        fs.first_ino = sb.s_first_ino;
+        fs.filetype = (sb.s_feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE) != 0;
+    }
+    fs.read_only = (sb.s_feature_ro_compat & ~EXT2_SUPPORTED_RO_COMPAT) != 0;
+
+    if (fs.inode_size < EXT2_GOOD_OLD_INODE_SIZE || fs.inode_size > fs.block_size ||
+        (fs.inode_size & (fs.inode_size - 1)) != 0 ||
+        fs.blocks_per_group == 0 || fs.blocks_per_group > fs.block_size * 8 ||
+        fs.inodes_per_group == 0 || fs.inodes_per_group > fs.block_size * 8 ||
+        fs.first_ino < EXT2_ROOT_INO + 1 || fs.first_ino > fs.inodes_per_group ||
+        sb.s_blocks_count <= fs.first_data_block ||
+        (uint64_t)sb.s_blocks_count * fs.sectors_per_block > sector_count) {
+        return EXT2_ERR_CORRUPT;
+    }
+
+    fs.groups = (sb.s_blocks_count - fs.first_data_block + fs.blocks_per_group - 1) /
+                fs.blocks_per_group;
+    if (fs.groups > EXT2_MAX_GROUPS) {
+        return EXT2_ERR_UNSUPPORTED;
+    }
+    fs.gdt_blocks = (fs.groups * sizeof(ext2_group_desc_t) + fs.block_size - 1) >> fs.block_shift;
+    return EXT2_OK;
+}
+
+static int mount_locked(uint32_t lba_start, uint32_t sector_count) {
+    fs.mounted = false;
+    reset_caches();
+
+    if (sector_count < (EXT2_SUPERBLOCK_OFFSET + sizeof(sb)) / SECTOR_SIZE) {
+        return EXT2_ERR_NO_FS;
+    }
+    if (!read_disk_sectors((uint8_t*)&sb, lba_start + EXT2_SUPERBLOCK_OFFSET / SECTOR_SIZE,
+                           sizeof(sb) / SECTOR_SIZE)) {
+        return EXT2_ERR_IO;
+    }
+    int err = setup_geometry(lba_start, sector_count);
+    if (err != EXT2_OK) {
+        return err;
+    }
+    if (!read_blocks(fs.first_data_block + 1, fs.gdt_blocks, gdt)) {
+        return EXT2_ERR_IO;
+    }
+
+    fs.mounted = true;
+    klog(KLOG_INFO, "ext2: mounted at LBA %u: %u blocks of %u bytes, %u groups%s",
+         lba_start, sb.s_blocks_count, fs.block_size, fs.groups,
+         fs.read_only ? ", read-only" : "");
+    return EXT2_OK;
+}
+
+int ext2_mount(uint32_t lba_start, uint32_t sector_count) {
+    mutex_lock(&ext2_mutex);
+    int err = mount_locked(lba_start, sector_count);
+    mutex_unlock(&ext2_mutex);
+    return err;
+}
+
+bool ext2_is_mounted(void) {
+    return fs.mounted;
+}
+
+// ============== Создание ФС ==============
+
+// Копии суперблока и таблицы групп (sparse_super): группы 0, 1 и степени 3, 5, 7
+static bool group_has_super(uint32_t group) {
+    if (group <= 1) {
+        return true;
+    }
+    for (uint32_t base = 3; base <= 7; base += 2) {
+        uint32_t n = group;
+        while (n % base == 0) {
+            n /= base;
+        }
+        if (n == 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Блоки одной группы перед данными: копия суперблока и таблицы групп,
+// две битовые карты, таблица inode
+static uint32_t group_overhead(uint32_t group, uint32_t gdt_blocks, uint32_t table_blocks) {
+    return (group_has_super(group) ? 1 + gdt_blocks : 0) + 2 + table_blocks;
+}
+
+static void set_bits(uint8_t* map, uint32_t start, uint32_t end) {
+    for (uint32_t bit = start; bit < end; bit++) {
+        map[bit >> 3] |= 1 << (bit & 7);
+    }
+}
+
+static void make_dirent(uint32_t offset, uint32_t ino, uint32_t rec_len, const char* name) {
+    ext2_dirent_t* dirent = (ext2_dirent_t*)(block_buf + offset);
+    dirent->inode = ino;
+    dirent->rec_len = rec_len;
+    dirent->name_len = strlen(name);
+    dirent->file_type = EXT2_FT_DIR;
+    memcpy(dirent->name, name, dirent->name_len);
+}
+
+// Каталог из одного блока с записями "." и ".." (и lost+found в корне)
+static int make_dir(uint32_t ino, uint32_t parent, uint32_t block, uint16_t mode, uint16_t links) {
+    memset(block_buf, 0, fs.block_size);
+    make_dirent(0, ino, 12, ".");
+    if (ino == EXT2_ROOT_INO) {
+        make_dirent(12, parent, 12, "..");
+        make_dirent(24, EXT2_GOOD_OLD_FIRST_INO, fs.block_size - 24, "lost+found");
+    } else {
+        make_dirent(12, parent, fs.block_size - 12, "..");
+    }
+    if (!write_blocks(block, 1, block_buf)) {
+        return EXT2_ERR_IO;
+    }
+
+    ext2_inode_t inode;
+    memset(&inode, 0, sizeof(inode));
+    inode.i_mode = EXT2_S_IFDIR | mode;
+    inode.i_size = fs.block_size;
+    inode.i_links_count = links;
+    inode.i_blocks = fs.sectors_per_block;
+    inode.i_block[0] = block;
+    return put_inode(ino, &inode, true);
+}
+
+static int format_locked(uint32_t lba_start, uint32_t sector_count) {
+    static uint8_t zero[EXT2_ZERO_CHUNK];
+
+    fs.mounted = false;
+    reset_caches();
+
+    uint32_t block_size = sector_count >= EXT2_FORMAT_LARGE_SECTORS ? 4096 : 1024;
+    uint32_t blocks = sector_count / (block_size / SECTOR_SIZE);
+    uint32_t first_data = block_size == 1024 ? 1 : 0;
+    uint32_t per_group = block_size * 8;
+    if (blocks > first_data + EXT2_MAX_GROUPS * per_group) {
+        blocks = first_data + EXT2_MAX_GROUPS * per_group;
+    }
+    if (blocks <= first_data) {
+        return EXT2_ERR_NO_SPACE;
+    }
+    uint32_t groups = (blocks - first_data + per_group - 1) / per_group;
+
+    // Inode на группу: кратно числу inode в блоке, не больше битов карты
+    uint32_t per_block = block_size / EXT2_GOOD_OLD_INODE_SIZE;
+    uint32_t inodes = (blocks / EXT2_FORMAT_BLOCKS_PER_INODE + groups - 1) / groups;
+    inodes = (inodes + per_block - 1) / per_block * per_block;
+    if (inodes < 2 * per_block) {
+        inodes = 2 * per_block;
+    }
+    if (inodes > per_group) {
+        inodes = per_group;
+    }
+    uint32_t table_blocks = inodes / per_block;
+    uint32_t gdt_blocks = (groups * sizeof(ext2_group_desc_t) + block_size - 1) / block_size;
+
+    // Слишком маленькая последняя группа отбрасывается
+    uint32_t last = blocks - first_data - (groups - 1) * per_group;
+    if (last < group_overhead(groups - 1, gdt_blocks, table_blocks) + EXT2_FORMAT_MIN_GROUP_DATA) {
+        if (groups == 1) {
+            return EXT2_ERR_NO_SPACE;
+        }
+        blocks -= last;
+        groups--;
+        gdt_blocks = (groups * sizeof(ext2_group_desc_t) + block_size - 1) / block_size;
+    }
+
+    memset(&sb, 0, sizeof(sb));
+    sb.s_inodes_count = inodes * groups;
+    sb.s_blocks_count = blocks;
+    sb.s_r_blocks_count = blocks / 20;
+    sb.s_first_data_block = first_data;
+    sb.s_log_block_size = block_size == 1024 ? 0 : 2;
+    sb.s_log_frag_size = sb.s_log_block_size;
+    sb.s_blocks_per_group = per_group;
+    sb.s_frags_per_group = per_group;
+    sb.s_inodes_per_group = inodes;
+    sb.s_max_mnt_count = 0xFFFF;
+    sb.s_magic = EXT2_SUPER_MAGIC;
+    sb.s_state = EXT2_VALID_FS;
+    sb.s_errors = EXT2_ERRORS_CONTINUE;
+    sb.s_rev_level = 1;
+    sb.s_first_ino = EXT2_GOOD_OLD_FIRST_INO;
+    sb.s_inode_size = EXT2_GOOD_OLD_INODE_SIZE;
+    sb.s_feature_incompat = EXT2_FEATURE_INCOMPAT_FILETYPE;
+    sb.s_feature_ro_compat = EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER;
+    // UUID: часов реального времени нет, источник - счетчик тактов
+    uint64_t seed = rdtsc() | 1;
+    for (int i = 0; i < 16; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        sb.s_uuid[i] = (uint8_t)(seed >> 24);
+    }
+    memcpy(sb.s_volume_name, "quartzos", 8);
+
+    int err = setup_geometry(lba_start, sector_count);
+    if (err != EXT2_OK) {
+        return err;
+    }
+
+    // Раскладка групп, битовые карты и таблицы inode
+    memset(gdt, 0, sizeof(gdt));
+    uint32_t root_block = 0;
+    for (uint32_t group = 0; group < groups; group++) {
+        uint32_t start = first_data + group * per_group;
+        uint32_t meta = group_has_super(group) ? 1 + gdt_blocks : 0;
+        uint32_t used = group_overhead(group, gdt_blocks, table_blocks);
+        uint32_t used_inodes = 0;
+        gdt[group].bg_block_bitmap = start + meta;
+        gdt[group].bg_inode_bitmap = start + meta + 1;
+        gdt[group].bg_inode_table = start + meta + 2;
+        if (group == 0) {
+            // Блоки корня и lost+found - сразу за таблицей inode
+            root_block = start + used;
+            used += 2;
+            used_inodes = EXT2_GOOD_OLD_FIRST_INO;
+            gdt[group].bg_used_dirs_count = 2;
+        }
+        gdt[group].bg_free_blocks_count = group_block_count(group) - used;
+        gdt[group].bg_free_inodes_count = inodes - used_inodes;
+        sb.s_free_blocks_count += gdt[group].bg_free_blocks_count;
+        sb.s_free_inodes_count += gdt[group].bg_free_inodes_count;
+
+        // Биты за концом группы заняты
+        memset(block_bitmap.data, 0, block_size);
+        set_bits(block_bitmap.data, 0, used);
+        set_bits(block_bitmap.data, group_block_count(group), block_size * 8);
+        memset(inode_bitmap.data, 0, block_size);
+        set_bits(inode_bitmap.data, 0, used_inodes);
+        set_bits(inode_bitmap.data, inodes, block_size * 8);
+        if (!write_blocks(gdt[group].bg_block_bitmap, 1, block_bitmap.data) ||
+            !write_blocks(gdt[group].bg_inode_bitmap, 1, inode_bitmap.data)) {
+            return EXT2_ERR_IO;
+        }
+
+        for (uint32_t done = 0; done < table_blocks; ) {
+            uint32_t count = table_blocks - done;
+            if (count > EXT2_ZERO_CHUNK / block_size) {
+                count = EXT2_ZERO_CHUNK / block_size;
+            }
+            if (!write_blocks(gdt[group].bg_inode_table + done, count, zero)) {
+                return EXT2_ERR_IO;
+            }
+            done += count;
+        }
+    }
+
+    err = make_dir(EXT2_ROOT_INO, EXT2_ROOT_INO, root_block, 0755, 3);
+    if (err == EXT2_OK) {
+        err = make_dir(EXT2_GOOD_OLD_FIRST_INO, EXT2_ROOT_INO, root_block + 1, 0700, 2);
+    }
+    if (err != EXT2_OK) {
+        return err;
+    }
+
+    // Суперблок и таблица групп: основные и резервные копии
+    for (uint32_t group = 1; group < groups; group++) {
+        if (!group_has_super(group)) {
+            continue;
+        }
+        uint32_t start = first_data + group * per_group;
+        memset(block_buf, 0, block_size);
+        memcpy(block_buf, &sb, sizeof(sb));
+        ((ext2_superblock_t*)block_buf)->s_block_group_nr = group;
+        if (!write_blocks(start, 1, block_buf) || !write_blocks(start + 1, gdt_blocks, gdt)) {
+            return EXT2_ERR_IO;
+        }
+    }
+    if (!write_blocks(first_data + 1, gdt_blocks, gdt) || !write_superblock()) {
+        return EXT2_ERR_IO;
+    }
+
+    return mount_locked(lba_start, sector_count);
+}
+
+int ext2_format(uint32_t lba_start, uint32_t sector_count) {
+    mutex_lock(&ext2_mutex);
+    int err = format_locked(lba_start, sector_count);
+    mutex_unlock(&ext2_mutex);
+    return err;
+}
+
+// ============== Интерфейс ==============
+
+int ext2_lookup(const char* path, uint32_t* ino) {
+    mutex_lock(&ext2_mutex);
+    int err = fs.mounted ? walk_path(path, strlen(path), ino) : EXT2_ERR_NOT_MOUNTED;
+    mutex_unlock(&ext2_mutex);
+    return err;
+}
+
+int ext2_stat(uint32_t ino, ext2_inode_t* inode) {
+    mutex_lock(&ext2_mutex);
+    int err = fs.mounted ? get_inode(ino, inode) : EXT2_ERR_NOT_MOUNTED;
+    mutex_unlock(&ext2_mutex);
+    return err;
+}
+
+int ext2_read(uint32_t ino, uint32_t offset, void* buffer, uint32_t length) {
+    mutex_lock(&ext2_mutex);
+    ext2_inode_t inode;
+    int result = fs.mounted ? get_inode(ino, &inode) : EXT2_ERR_NOT_MOUNTED;
+    if (result == EXT2_OK) {
+        result = read_data(ino, &inode, offset, buffer, length);
+    }
+    mutex_unlock(&ext2_mutex);
+    return result;
+}
+
+int ext2_write(uint32_t ino, uint32_t offset, const void* buffer, uint32_t length) {
+    mutex_lock(&ext2_mutex);
+    ext2_inode_t inode;
+    int result = !fs.mounted ? EXT2_ERR_NOT_MOUNTED
+               : fs.read_only ? EXT2_ERR_READ_ONLY : get_inode(ino, &inode);
+    if (result == EXT2_OK) {
+        if (is_dir(&inode)) {
+            result = EXT2_ERR_IS_DIR;
+        } else {
+            result = write_data(ino, &inode, offset, buffer, length);
+            int err = flush_metadata();
+            if (err != EXT2_OK) {
+                result = err;
+            }
+        }
+    }
+    mutex_unlock(&ext2_mutex);
+    return result;
+}
+
+static int create_locked(const char* path, uint32_t* ino) {
+    uint32_t dir_ino;
+    const char* name;
+    uint32_t length;
+    int err = split_path(path, &dir_ino, &name, &length);
+    if (err != EXT2_OK) {
+        return err;
+    }
+
+    ext2_inode_t inode;
+    err = dir_find(dir_ino, name, length, ino);
+    if (err == EXT2_OK) {
+        err = get_inode(*ino, &inode);
+        if (err != EXT2_OK) {
+            return err;
+        }
+        if ((inode.i_mode & EXT2_S_IFMT) != EXT2_S_IFREG) {
+            return is_dir(&inode) ? EXT2_ERR_IS_DIR : EXT2_ERR_EXISTS;
+        }
+        return truncate_inode(*ino, &inode);
+    }
+    if (err != EXT2_ERR_NOT_FOUND) {
+        return err;
+    }
+
+    ext2_inode_t dir;
+    err = get_inode(dir_ino, &dir);
+    if (err != EXT2_OK) {
+        return err;
+    }
+    err = alloc_inode((dir_ino - 1) / fs.inodes_per_group, ino);
+    if (err != EXT2_OK) {
+        return err;
+    }
+    memset(&inode, 0, sizeof(inode));
+    inode.i_mode = EXT2_S_IFREG | 0644;
+    inode.i_links_count = 1;
+    err = put_inode(*ino, &inode, true);
+    if (err == EXT2_OK) {
+        err = dir_add(dir_ino, &dir, name, length, *ino, EXT2_FT_REG_FILE);
+    }
+    if (err != EXT2_OK) {
+        free_inode(*ino);
+    }
+    return err;
+}
+
+int ext2_create(const char* path, uint32_t* ino) {
+    mutex_lock(&ext2_mutex);
+    int err = !fs.mounted ? EXT2_ERR_NOT_MOUNTED
+            : fs.read_only ? EXT2_ERR_READ_ONLY : create_locked(path, ino);
+    if (fs.mounted) {
+        int flush_err = flush_metadata();
+        if (err == EXT2_OK) {
+            err = flush_err;
+        }
+    }
+    mutex_unlock(&ext2_mutex);
+    return err;
+}
+
+static int readdir_locked(uint32_t ino, ext2_dir_iter_t iter, void* ctx) {
+    ext2_inode_t dir;
+    int err = get_inode(ino, &dir);
+    if (err != EXT2_OK) {
+        return err;
+    }
+    if (!is_dir(&dir)) {
+        return EXT2_ERR_NOT_DIR;
+    }
+
+    ext2_dir_entry_t entry;
+    uint32_t blocks = dir.i_size >> fs.block_shift;
+    for (uint32_t index = 0; index < blocks; index++) {
+        uint32_t phys;
+        err = read_dir_block(ino, &dir, index, &phys);
+        if (err != EXT2_OK) {
+            return err;
+        }
+        for (uint32_t offset = 0; offset < fs.block_size; ) {
+            ext2_dirent_t* dirent = dirent_at(offset);
+            if (dirent == NULL) {
+                return EXT2_ERR_CORRUPT;
+            }
+            offset += dirent->rec_len;
+            if (dirent->inode == 0) {
+                continue;
+            }
+            ext2_inode_t child;
+            err = get_inode(dirent->inode, &child);
+            if (err != EXT2_OK) {
+                return err;
+            }
+            entry.ino = dirent->inode;
+            entry.mode = child.i_mode;
+            entry.size = inode_size_bytes(&child);
+            memcpy(entry.name, dirent->name, dirent->name_len);
+            entry.name[dirent->name_len] = '\0';
+            if (!iter(&entry, ctx)) {
+                return EXT2_OK;
+            }
+        }
+    }
+    return EXT2_OK;
+}
+
+int ext2_readdir(uint32_t ino, ext2_dir_iter_t iter, void* ctx) {
+    mutex_lock(&ext2_mutex);
+    int err = fs.mounted ? readdir_locked(ino, iter, ctx) : EXT2_ERR_NOT_MOUNTED;
+    mutex_unlock(&ext2_mutex);
+    return err;
+}
+
+const char* ext2_strerror(int error) {
+    switch (error) {
+        case EXT2_OK: return "success";
+        case EXT2_ERR_IO: return "disk I/O error";
+        case EXT2_ERR_NOT_MOUNTED: return "no filesystem mounted";
+        case EXT2_ERR_NOT_FOUND: return "no such file or directory";
+        case EXT2_ERR_NOT_DIR: return "not a directory";
+        case EXT2_ERR_IS_DIR: return "is a directory";
+        case EXT2_ERR_EXISTS: return "file exists";
+        case EXT2_ERR_NO_SPACE: return "no space left on device";
+        case EXT2_ERR_NO_INODES: return "no free inodes";
+        case EXT2_ERR_NAME_TOO_LONG: return "file name too long";
+        case EXT2_ERR_TOO_BIG: return "file too large";
+        case EXT2_ERR_READ_ONLY: return "read-only filesystem";
+        case EXT2_ERR_CORRUPT: return "filesystem corrupted";
+        case EXT2_ERR_UNSUPPORTED: return "unsupported ext2 features";
+        case EXT2_ERR_INVALID: return "invalid argument";
+        case EXT2_ERR_NO_FS: return "no ext2 filesystem";
+        default: return "unknown error";
+    }
+}
+
+void ext2_get_stats(ext2_stats_t* out) {
+    mutex_lock(&ext2_mutex);
+    *out = stats;
+    mutex_unlock(&ext2_mutex);
+}
+
+// Поиск первого раздела Linux в MBR и монтирование
+static void mount_first_partition(void) {
+    uint8_t mbr[SECTOR_SIZE];
+    if (!read_disk_sectors(mbr, 0, 1) || mbr[510] != 0x55 || mbr[511] != 0xAA) {
+        print_string("ext2: no partition table\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+    struct partition_entry* partitions = (struct partition_entry*)&mbr[446];
+    for (int i = 0; i < 4 && !part_found; i++) {
+        if (partitions[i].type == MBR_PARTITION_TYPE) {
+            part_found = true;
+            part_lba = partitions[i].lba_start;
+            part_sectors = partitions[i].sector_count;
+        }
+    }
+    if (!part_found) {
+        print_string("ext2: no Linux partition\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+
+    int err = ext2_mount(part_lba, part_sectors);
+    if (err == EXT2_OK) {
+        kprintf_color(LIGHT_GREEN_ON_BLACK, "ext2: mounted partition at LBA %u (%u blocks of %u bytes%s)\n",
+                      part_lba, sb.s_blocks_count, fs.block_size, fs.read_only ? ", read-only" : "");
+    } else {
+        kprintf_color(YELLOW_ON_BLACK, "ext2: partition at LBA %u not mounted: %s (use 'mkfs')\n",
+                      part_lba, ext2_strerror(err));
+    }
+}
+
+void init_ext2(void) {
+    shell_register_all(ext2_commands, sizeof(ext2_commands) / sizeof(ext2_commands[0]));
+    mount_first_partition();
+}
+
+// ============== Команды оболочки ==============
+
+static uint8_t shell_buf[EXT2_SHELL_BUFFER + 1];
+
+static void print_error(const char* command, const char* path, int err) {
+    kprintf_color(LIGHT_RED_ON_BLACK, "%s: %s: %s\n", command, path, ext2_strerror(err));
+}
+
+static char file_type_char(uint16_t mode) {
+    switch (mode & EXT2_S_IFMT) {
+        case EXT2_S_IFDIR: return 'd';
+        case EXT2_S_IFLNK: return 'l';
+        case EXT2_S_IFREG: return '-';
+        default: return '?';
+    }
+}
+
+static bool ls_entry(const ext2_dir_entry_t* entry, void* ctx) {
+    (void)ctx;
+    kprintf_color((entry->mode & EXT2_S_IFMT) == EXT2_S_IFDIR ? LIGHT_CYAN_ON_BLACK : WHITE_ON_BLACK,
+                  "  %c %10u  %s\n", file_type_char(entry->mode), entry->size, entry->name);
+    return true;
+}
+
+void run_ls(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "/";
+    uint32_t ino;
+    ext2_inode_t inode;
+    int err = ext2_lookup(path, &ino);
+    if (err == EXT2_OK) {
+        err = ext2_stat(ino, &inode);
+    }
+    if (err != EXT2_OK) {
+        print_error("ls", path, err);
+        return;
+    }
+    if (!is_dir(&inode)) {
+        ext2_dir_entry_t entry = { ino, inode.i_mode, inode_size_bytes(&inode), "" };
+        strncpy(entry.name, path, EXT2_NAME_LEN);
+        ls_entry(&entry, NULL);
+        return;
+    }
+    err = ext2_readdir(ino, ls_entry, NULL);
+    if (err != EXT2_OK) {
+        print_error("ls", path, err);
+    }
+}
+
+void run_cat(int argc, char** argv) {
+    if (argc < 2) {
+        print_string("Usage: cat <path>\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+    uint32_t ino;
+    ext2_inode_t inode;
+    int err = ext2_lookup(argv[1], &ino);
+    if (err == EXT2_OK) {
+        err = ext2_stat(ino, &inode);
+    }
+    if (err == EXT2_OK && is_dir(&inode)) {
+        err = EXT2_ERR_IS_DIR;
+    }
+    if (err != EXT2_OK) {
+        print_error("cat", argv[1], err);
+        return;
+    }
+
+    char last = '\n';
+    for (uint32_t offset = 0; ; ) {
+        int count = ext2_read(ino, offset, shell_buf, EXT2_SHELL_BUFFER);
+        if (count < 0) {
+            print_error("cat", argv[1], count);
+            return;
+        }
+        if (count == 0) {
+            break;
+        }
+        shell_buf[count] = '\0';
+        print_string((const char*)shell_buf, WHITE_ON_BLACK);
+        last = shell_buf[count - 1];
+        offset += count;
+    }
+    if (last != '\n') {
+        print_char('\n', WHITE_ON_BLACK);
+    }
+}
+
+void run_write(int argc, char** argv) {
+    if (argc < 3) {
+        print_string("Usage: write <path> <text>\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+    // Слова текста через пробел и перевод строки в конце. ksnprintf
+    // возвращает длину без усечения: длина ограничивается буфером.
+    uint32_t length = 0;
+    for (int i = 2; i < argc && length < EXT2_SHELL_BUFFER - 1; i++) {
+        length += ksnprintf((char*)shell_buf + length, EXT2_SHELL_BUFFER - length,
+                            i + 1 < argc ? "%s " : "%s\n", argv[i]);
+        if (length > EXT2_SHELL_BUFFER - 1) {
+            length = EXT2_SHELL_BUFFER - 1;
+        }
+    }
+
+    uint32_t ino;
+    int err = ext2_create(argv[1], &ino);
+    int written = err == EXT2_OK ? ext2_write(ino, 0, shell_buf, length) : err;
+    if (written < 0) {
+        print_error("write", argv[1], written);
+        return;
+    }
+    kprintf_color(LIGHT_GREEN_ON_BLACK, "%d bytes written\n", written);
+}
+
+void run_cp(int argc, char** argv) {
+    if (argc < 3) {
+        print_string("Usage: cp <src> <dst>\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+    uint32_t src;
+    ext2_inode_t inode;
+    int err = ext2_lookup(argv[1], &src);
+    if (err == EXT2_OK) {
+        err = ext2_stat(src, &inode);
+    }
+    if (err == EXT2_OK && is_dir(&inode)) {
+        err = EXT2_ERR_IS_DIR;
+    }
+    if (err != EXT2_OK) {
+        print_error("cp", argv[1], err);
+        return;
+    }
+
+    // Копирование в каталог - под тем же именем
+    char path[EXT2_NAME_LEN + 64];
+    const char* dst_path = argv[2];
+    uint32_t dst = 0;
+    ext2_inode_t dst_inode;
+    if (ext2_lookup(argv[2], &dst) == EXT2_OK && ext2_stat(dst, &dst_inode) == EXT2_OK &&
+        is_dir(&dst_inode)) {
+        const char* base = argv[1];
+        for (const char* p = argv[1]; *p; p++) {
+            if (*p == '/' && p[1] != '\0') {
+                base = p + 1;
+            }
+        }
+        ksnprintf(path, sizeof(path), "%s/%s", argv[2], base);
+        dst_path = path;
+        if (ext2_lookup(dst_path, &dst) != EXT2_OK) {
+            dst = 0;
+        }
+    }
+    if (dst == src) {
+        kprintf_color(LIGHT_RED_ON_BLACK, "cp: '%s' and '%s' are the same file\n", argv[1], dst_path);
+        return;
+    }
+
+    err = ext2_create(dst_path, &dst);
+    if (err != EXT2_OK) {
+        print_error("cp", dst_path, err);
+        return;
+    }
+    uint32_t offset = 0;
+    while (1) {
+        int count = ext2_read(src, offset, shell_buf, EXT2_SHELL_BUFFER);
+        if (count < 0) {
+            print_error("cp", argv[1], count);
+            return;
+        }
+        if (count == 0) {
+            break;
+        }
+        int written = ext2_write(dst, offset, shell_buf, count);
+        if (written != count) {
+            print_error("cp", dst_path, written < 0 ? written : EXT2_ERR_NO_SPACE);
+            return;
+        }
+        offset += count;
+    }
+    kprintf_color(LIGHT_GREEN_ON_BLACK, "%u bytes copied\n", offset);
+}
+
+void run_mkfs(int argc, char** argv) {
+    if (!part_found) {
+        print_string("mkfs: no Linux partition\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+    bool force = argc > 1 && strcmp(argv[1], "-f") == 0;
+    if (ext2_is_mounted() && !force) {
+        print_string("mkfs: partition holds a mounted ext2 filesystem, use 'mkfs -f' to erase it\n",
+                     LIGHT_RED_ON_BLACK);
+        return;
+    }
+
+    kprintf("Formatting partition at LBA %u (%u sectors)...\n", part_lba, part_sectors);
+    int err = ext2_format(part_lba, part_sectors);
+    if (err != EXT2_OK) {
+        kprintf_color(LIGHT_RED_ON_BLACK, "mkfs: %s\n", ext2_strerror(err));
+        return;
+    }
+    kprintf_color(LIGHT_GREEN_ON_BLACK, "ext2: %u blocks of %u bytes, %u inodes, %u groups\n",
+                  sb.s_blocks_count, fs.block_size, sb.s_inodes_count, fs.groups);
+}
+
+void run_fs_info(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    mutex_lock(&ext2_mutex);
+    if (!fs.mounted) {
+        mutex_unlock(&ext2_mutex);
+        print_string("fs-info: no filesystem mounted\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+    kprintf("\next2 at LBA %u%s\n", fs.lba_start, fs.read_only ? " (read-only)" : "");
+    kprintf("  Blocks: %u of %u bytes, %u free\n", sb.s_blocks_count, fs.block_size, sb.s_free_blocks_count);
+    kprintf("  Inodes: %u (%u bytes), %u free\n", sb.s_inodes_count, fs.inode_size, sb.s_free_inodes_count);
+    kprintf("  Groups: %u (%u blocks, %u inodes each)\n", fs.groups, fs.blocks_per_group, fs.inodes_per_group);
+    kprintf("  Features: compat 0x%x, incompat 0x%x, ro_compat 0x%x\n",
+            sb.s_feature_compat, sb.s_feature_incompat, sb.s_feature_ro_compat);
+    ext2_stats_t snapshot = stats;
+    mutex_unlock(&ext2_mutex);
+
+    kprintf("  Inode cache:  %u hits, %u misses\n", snapshot.inode_hits, snapshot.inode_misses);
+    kprintf("  Dentry cache: %u hits, %u misses\n", snapshot.dentry_hits, snapshot.dentry_misses);
+    kprintf("  Data reads:   %u blocks in %u disk requests\n", snapshot.blocks_read, snapshot.block_runs);
+    kprintf("  Data writes:  %u blocks\n", snapshot.blocks_written);
+}
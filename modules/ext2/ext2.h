@@ -0,0 +1,238 @@
+#ifndef EXT2_H
+#define EXT2_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EXT2_SUPER_MAGIC 0xEF53
+#define EXT2_ROOT_INO 2
+#define EXT2_GOOD_OLD_FIRST_INO 11
+#define EXT2_GOOD_OLD_INODE_SIZE 128
+
+// Смещение суперблока от начала раздела (в байтах)
+#define EXT2_SUPERBLOCK_OFFSET 1024
+
+// Поддерживаемые размеры блока: 1-4 КиБ
+#define EXT2_MIN_BLOCK_SIZE 1024
+#define EXT2_MAX_BLOCK_SIZE 4096
+
+// Наибольшее число групп блоков (дескрипторы групп держатся в памяти
+// целиком: 256 групп - 2 ГиБ при блоке 1 КиБ, 32 ГиБ при блоке 4 КиБ)
+#define EXT2_MAX_GROUPS 256
+
+#define EXT2_NAME_LEN 255
+
+// Прямые и косвенные ссылки на блоки в inode
+#define EXT2_NDIR_BLOCKS 12
+#define EXT2_IND_BLOCK 12
+#define EXT2_DIND_BLOCK 13
+#define EXT2_TIND_BLOCK 14
+#define EXT2_N_BLOCKS 15
+
+// Кэш inode: хэш по номеру, вытеснение самого давнего (LRU)
+#define EXT2_INODE_CACHE_SIZE 32
+#define EXT2_INODE_HASH_SIZE 64
+
+// Кэш компонентов пути: (каталог, имя) -> inode. Прямое отображение,
+// имена длиннее EXT2_DENTRY_NAME_LEN не кэшируются.
+#define EXT2_DENTRY_CACHE_SIZE 128
+#define EXT2_DENTRY_NAME_LEN 32
+
+// Свойства ФС (s_feature_*)
+#define EXT2_FEATURE_COMPAT_DIR_INDEX 0x0020
+#define EXT2_FEATURE_INCOMPAT_FILETYPE 0x0002
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE 0x0002
+
+// Свойства, с которыми драйвер умеет работать. С неизвестными incompat
+// раздел не монтируется, с неизвестными ro_compat - только для чтения.
+#define EXT2_SUPPORTED_INCOMPAT EXT2_FEATURE_INCOMPAT_FILETYPE
+#define EXT2_SUPPORTED_RO_COMPAT (EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER | \
+                                  EXT2_FEATURE_RO_COMPAT_LARGE_FILE)
+
+// Тип файла в i_mode
+#define EXT2_S_IFMT 0xF000
+#define EXT2_S_IFREG 0x8000
+#define EXT2_S_IFDIR 0x4000
+#define EXT2_S_IFLNK 0xA000
+
+// Флаг inode: каталог с хэш-индексом (htree). Драйвер читает такие
+// каталоги линейно и снимает флаг, когда меняет каталог.
+#define EXT2_INDEX_FL 0x00001000
+
+// Тип файла в записи каталога
+#define EXT2_FT_UNKNOWN 0
+#define EXT2_FT_REG_FILE 1
+#define EXT2_FT_DIR 2
+#define EXT2_FT_SYMLINK 7
+
+// Коды ошибок (функции возвращают EXT2_OK или отрицательный код)
+#define EXT2_OK 0
+#define EXT2_ERR_IO (-1)
+#define EXT2_ERR_NOT_MOUNTED (-2)
+#define EXT2_ERR_NOT_FOUND (-3)
+#define EXT2_ERR_NOT_DIR (-4)
+#define EXT2_ERR_IS_DIR (-5)
+#define EXT2_ERR_EXISTS (-6)
+#define EXT2_ERR_NO_SPACE (-7)
+#define EXT2_ERR_NO_INODES (-8)
+#define EXT2_ERR_NAME_TOO_LONG (-9)
+#define EXT2_ERR_TOO_BIG (-10)
+#define EXT2_ERR_READ_ONLY (-11)
+#define EXT2_ERR_CORRUPT (-12)
+#define EXT2_ERR_UNSUPPORTED (-13)
+#define EXT2_ERR_INVALID (-14)
+#define EXT2_ERR_NO_FS (-15)
+
+// Суперблок (ревизия 1)
+typedef struct {
+    uint32_t s_inodes_count;
+    uint32_t s_blocks_count;
+    uint32_t s_r_blocks_count;
+    uint32_t s_free_blocks_count;
+    uint32_t s_free_inodes_count;
+    uint32_t s_first_data_block;
+    uint32_t s_log_block_size;
+    uint32_t s_log_frag_size;
+    uint32_t s_blocks_per_group;
+    uint32_t s_frags_per_group;
+    uint32_t s_inodes_per_group;
+    uint32_t s_mtime;
+    uint32_t s_wtime;
+    uint16_t s_mnt_count;
+    uint16_t s_max_mnt_count;
+    uint16_t s_magic;
+    uint16_t s_state;
+    uint16_t s_errors;
+    uint16_t s_minor_rev_level;
+    uint32_t s_lastcheck;
+    uint32_t s_checkinterval;
+    uint32_t s_creator_os;
+    uint32_t s_rev_level;
+    uint16_t s_def_resuid;
+    uint16_t s_def_resgid;
+    // Поля ревизии 1
+    uint32_t s_first_ino;
+    uint16_t s_inode_size;
+    uint16_t s_block_group_nr;
+    uint32_t s_feature_compat;
+    uint32_t s_feature_incompat;
+    uint32_t s_feature_ro_compat;
+    uint8_t s_uuid[16];
+    char s_volume_name[16];
+    char s_last_mounted[64];
+    uint32_t s_algorithm_usage_bitmap;
+    uint8_t s_prealloc_blocks;
+    uint8_t s_prealloc_dir_blocks;
+    uint16_t s_reserved_gdt_blocks;
+    uint8_t s_reserved[816];
+} __attribute__((packed)) ext2_superblock_t;
+
+// Дескриптор группы блоков
+typedef struct {
+    uint32_t bg_block_bitmap;
+    uint32_t bg_inode_bitmap;
+    uint32_t bg_inode_table;
+    uint16_t bg_free_blocks_count;
+    uint16_t bg_free_inodes_count;
+    uint16_t bg_used_dirs_count;
+    uint16_t bg_pad;
+    uint8_t bg_reserved[12];
+} __attribute__((packed)) ext2_group_desc_t;
+
+// Inode (первые 128 байт; остаток большего inode драйвер не трогает)
+typedef struct {
+    uint16_t i_mode;
+    uint16_t i_uid;
+    uint32_t i_size;
+    uint32_t i_atime;
+    uint32_t i_ctime;
+    uint32_t i_mtime;
+    uint32_t i_dtime;
+    uint16_t i_gid;
+    uint16_t i_links_count;
+    uint32_t i_blocks;          // В секторах по 512 байт
+    uint32_t i_flags;
+    uint32_t i_osd1;
+    uint32_t i_block[EXT2_N_BLOCKS];
+    uint32_t i_generation;
+    uint32_t i_file_acl;
+    uint32_t i_size_high;       // Старшие 32 бита размера файла (LARGE_FILE)
+    uint32_t i_faddr;
+    uint8_t i_osd2[12];
+} __attribute__((packed)) ext2_inode_t;
+
+// Запись каталога
+typedef struct {
+    uint32_t inode;
+    uint16_t rec_len;
+    uint8_t name_len;
+    uint8_t file_type;
+    char name[];
+} __attribute__((packed)) ext2_dirent_t;
+
+// Запись каталога для ext2_readdir
+typedef struct {
+    uint32_t ino;
+    uint16_t mode;
+    uint32_t size;
+    char name[EXT2_NAME_LEN + 1];
+} ext2_dir_entry_t;
+
+// Обработчик записи каталога. Вызывается под блокировкой ФС и не должен
+// вызывать функции ext2. false - прекратить обход.
+typedef bool (*ext2_dir_iter_t)(const ext2_dir_entry_t* entry, void* ctx);
+
+// Статистика драйвера
+typedef struct {
+    uint32_t inode_hits;
+    uint32_t inode_misses;
+    uint32_t dentry_hits;
+    uint32_t dentry_misses;
+    uint32_t block_runs;        // Обращений к диску за данными файлов
+    uint32_t blocks_read;       // Блоков данных прочитано
+    uint32_t blocks_written;    // Блоков данных записано
+} ext2_stats_t;
+
+// Монтирование раздела [lba_start, lba_start + sector_count)
+int ext2_mount(uint32_t lba_start, uint32_t sector_count);
+
+// Создание пустой ФС ext2 на разделе и ее монтирование. Создаются корневой
+// каталог и lost+found; e2fsck принимает результат без исправлений.
+int ext2_format(uint32_t lba_start, uint32_t sector_count);
+
+bool ext2_is_mounted(void);
+
+// Пути отсчитываются от корня ("/a/b" и "a/b" - одно и то же)
+int ext2_lookup(const char* path, uint32_t* ino);
+
+// Копия inode (из кэша)
+int ext2_stat(uint32_t ino, ext2_inode_t* inode);
+
+// Чтение и запись данных файла. Возвращают число байт или код ошибки.
+// Непрерывные участки файла читаются и пишутся одной командой диска.
+int ext2_read(uint32_t ino, uint32_t offset, void* buffer, uint32_t length);
+int ext2_write(uint32_t ino, uint32_t offset, const void* buffer, uint32_t length);
+
+// Создание обычного файла. Существующий обычный файл усекается до нуля.
+int ext2_create(const char* path, uint32_t* ino);
+
+// Обход записей каталога
+int ext2_readdir(uint32_t ino, ext2_dir_iter_t iter, void* ctx);
+
+const char* ext2_strerror(int error);
+
+void ext2_get_stats(ext2_stats_t* stats);
+
+// Регистрация команд и монтирование первого раздела Linux (0x83) из MBR
+void init_ext2(void);
+
+// Команды оболочки: ls, cat, write, cp, mkfs, fs-info
+void run_ls(int argc, char** argv);
+void run_cat(int argc, char** argv);
+void run_write(int argc, char** argv);
+void run_cp(int argc, char** argv);
+void run_mkfs(int argc, char** argv);
+void run_fs_info(int argc, char** argv);
+
+#endif // EXT2_H
@@ -0,0 +1,268 @@
+#include "fpu.h"
+#include "../templates/kernel_api.h"
+#include "../interrupts/interrupts.h"
+#include "../threads_and_processes/threads_and_processes.h"
+#include "../cpu/cpu.h"
+#include "../shell/shell.h"
+#include "../kprintf/kprintf.h"
+#include <stddef.h>
+
+// Исключение «устройство недоступно»
+#define FPU_VECTOR_NM 7
+
+#define CR0_MP (1 << 1)
+#define CR0_EM (1 << 2)
+#define CR0_TS (1 << 3)
+#define CR0_NE (1 << 5)
+#define CR4_OSFXSR (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+
+#define CPUID_FEATURE_FPU (1 << 0)
+#define CPUID_FEATURE_FXSR (1 << 24)
+#define CPUID_FEATURE_SSE (1 << 25)
+
+// Значение MXCSR после сброса: все исключения SSE замаскированы
+#define MXCSR_DEFAULT 0x1F80
+// Поток еще ни разу не загружал состояние ни на одном процессоре
+#define FPU_NO_CPU 0xFFFFFFFF
+
+static bool fpu_present = false;
+static bool fxsr_supported = false;
+static bool sse_supported = false;
+
+static volatile uint32_t traps = 0;
+static volatile uint32_t saves = 0;
+static volatile uint32_t restores = 0;
+
+static inline uint32_t read_cr0(void) {
+    uint32_t value;
+    asm volatile ("movl %%cr0, %0" : "=r" (value));
+    return value;
+}
+
+static inline void write_cr0(uint32_t value) {
+    asm volatile ("movl %0, %%cr0" : : "r" (value) : "memory");
+}
+
+static inline void stts(void) {
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+static inline void clts(void) {
+    asm volatile ("clts" : : : "memory");
+}
+
+static void fpu_save(struct thread* thread) {
+    if (fxsr_supported) {
+        asm volatile ("fxsave %0" : "=m" (thread->fpu_state));
+    } else {
+        // FNSAVE сбрасывает FPU, но состояние уже в памяти
+        asm volatile ("fnsave %0" : "=m" (thread->fpu_state));
+    }
+    asm volatile ("lock incl %0" : "+m" (saves));
+}
+
+static void fpu_restore(struct thread* thread) {
+    if (fxsr_supported) {
+        asm volatile ("fxrstor %0" : : "m" (thread->fpu_state));
+    } else {
+        asm volatile ("frstor %0" : : "m" (thread->fpu_state));
+    }
+    asm volatile ("lock incl %0" : "+m" (restores));
+}
+
+// Первое обращение к FPU после переключения
+static void fpu_nm_handler(interrupt_frame_t* frame) {
+    (void)frame;
+    cpu_t* cpu = this_cpu();
+    thread_t* current = cpu->current_thread;
+
+    clts();
+    asm volatile ("lock incl %0" : "+m" (traps));
+    if (current == NULL) {
+        return;
+    }
+
+    // Регистры этого процессора уже содержат состояние потока, если он
+    // последним загружал FPU здесь и с тех пор не загружал его в другом месте
+    if (cpu->fpu_owner != current || current->fpu_cpu != cpu->index) {
+        if (current->fpu_used) {
+            fpu_restore(current);
+        } else {
+            uint32_t mxcsr = MXCSR_DEFAULT;
+            asm volatile ("fninit");
+            if (sse_supported) {
+                asm volatile ("ldmxcsr %0" : : "m" (mxcsr));
+            }
+            current->fpu_used = true;
+        }
+        cpu->fpu_owner = current;
+        current->fpu_cpu = cpu->index;
+    }
+    cpu->fpu_dirty = true;
+}
+
+// Настройка CR0/CR4 текущего процессора
+static void fpu_setup_cpu(void) {
+    uint32_t cr0 = read_cr0();
+    cr0 &= ~CR0_EM;
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+    asm volatile ("fninit");
+
+    if (fxsr_supported) {
+        uint32_t cr4;
+        asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+        cr4 |= CR4_OSFXSR;
+        if (sse_supported) {
+            cr4 |= CR4_OSXMMEXCPT;
+        }
+        asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+    }
+
+    cpu_t* cpu = this_cpu();
+    cpu->fpu_owner = NULL;
+    cpu->fpu_dirty = false;
+    stts();
+}
+
+// Команды оболочки
+static const shell_command_t fpu_commands[] = {
+    { "fpu-test", NULL, "Check lazy FPU/SSE context switching", run_fpu_test },
+};
+
+void init_fpu(void) {
+    shell_register_all(fpu_commands, sizeof(fpu_commands) / sizeof(fpu_commands[0]));
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    fpu_present = (edx & CPUID_FEATURE_FPU) != 0;
+    if (!fpu_present) {
+        print_string("No FPU present\n", YELLOW_ON_BLACK);
+        return;
+    }
+    fxsr_supported = (edx & CPUID_FEATURE_FXSR) != 0;
+    sse_supported = fxsr_supported && (edx & CPUID_FEATURE_SSE) != 0;
+
+    register_interrupt_handler(FPU_VECTOR_NM, fpu_nm_handler);
+    fpu_setup_cpu();
+
+    print_string(sse_supported ? "FPU/SSE initialized (lazy switching)\n"
+                               : "FPU initialized (lazy switching)\n", LIGHT_GREEN_ON_BLACK);
+}
+
+void fpu_init_ap(void) {
+    if (fpu_present) {
+        fpu_setup_cpu();
+    }
+}
+
+void fpu_thread_init(struct thread* thread) {
+    thread->fpu_used = false;
+    thread->fpu_cpu = FPU_NO_CPU;
+}
+
+void fpu_switch_out(struct thread* prev) {
+    cpu_t* cpu = this_cpu();
+    // Поток без FPU-инструкций в этом кванте ничего не платит
+    if (!cpu->fpu_dirty) {
+        return;
+    }
+    // Состояние сохраняется сразу: поток может продолжить работу на
+    // другом процессоре. Регистры остаются загруженными, и при возврате
+    // на этот же процессор восстанавливать их не придется.
+    fpu_save(prev);
+    if (!fxsr_supported) {
+        // FNSAVE сбросил регистры
+        cpu->fpu_owner = NULL;
+    }
+    cpu->fpu_dirty = false;
+    stts();
+}
+
+// ============== Проверка переключения ==============
+
+#define FPU_TEST_THREADS 4
+#define FPU_TEST_ROUNDS 200
+#define FPU_TEST_PRIORITY 5
+
+static volatile uint32_t fpu_test_next_id;
+static volatile uint32_t fpu_test_errors;
+static volatile uint32_t fpu_test_done;
+
+// Поток загружает свой номер в ST(0) и XMM0 и проверяет, что значения
+// переживают переключения на другие потоки, которые делают то же самое
+static void fpu_test_worker() {
+    uint32_t id;
+    asm volatile ("lock xaddl %0, %1" : "=r" (id), "+m" (fpu_test_next_id) : "0" (1) : "memory");
+    int32_t value = (int32_t)(id + 1) * 1000;
+    int32_t check;
+
+    // Ядро собирается с -mgeneral-regs-only: компилятор сам не трогает
+    // регистры FPU/SSE, поэтому объявлять их затираемыми не нужно
+    asm volatile ("fildl %0" : : "m" (value));
+    if (sse_supported) {
+        asm volatile ("movd %0, %%xmm0" : : "r" (value));
+    }
+
+    for (int round = 0; round < FPU_TEST_ROUNDS; round++) {
+        thread_yield();
+        asm volatile ("fistl %0" : "=m" (check));
+        if (check != value) {
+            asm volatile ("lock incl %0" : "+m" (fpu_test_errors));
+        }
+        if (sse_supported) {
+            asm volatile ("movd %%xmm0, %0" : "=r" (check));
+            if (check != value) {
+                asm volatile ("lock incl %0" : "+m" (fpu_test_errors));
+            }
+        }
+    }
+
+    asm volatile ("fstp %st(0)");
+    asm volatile ("lock incl %0" : "+m" (fpu_test_done));
+}
+
+static void print_counter(const char* name, uint32_t value) {
+    kprintf("%-15s ", name);
+    kprintf_color(LIGHT_BLUE_ON_BLACK, "%u\n", value);
+}
+
+void run_fpu_test(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    if (!fpu_present) {
+        print_string("\nNo FPU present\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+
+    print_string("\nFPU switching test: ", WHITE_ON_BLACK);
+    print_string(sse_supported ? "x87 + SSE\n" : "x87\n", WHITE_ON_BLACK);
+
+    fpu_test_next_id = 0;
+    fpu_test_errors = 0;
+    fpu_test_done = 0;
+    uint32_t traps_before = traps;
+    uint32_t saves_before = saves;
+    uint32_t restores_before = restores;
+
+    process_t* proc = create_process(fpu_test_worker, FPU_TEST_PRIORITY);
+    uint32_t started = proc != NULL ? 1 : 0;
+    while (proc != NULL && started < FPU_TEST_THREADS &&
+           create_thread(proc, fpu_test_worker, FPU_TEST_PRIORITY) != NULL) {
+        started++;
+    }
+    while (fpu_test_done < started) {
+        thread_sleep(10);
+    }
+
+    print_counter("Threads:", started);
+    print_counter("#NM traps:", traps - traps_before);
+    print_counter("State saves:", saves - saves_before);
+    print_counter("State restores:", restores - restores_before);
+    if (fpu_test_errors == 0 && started != 0) {
+        print_string("Result: OK\n", LIGHT_GREEN_ON_BLACK);
+    } else {
+        print_counter("Corrupted values:", fpu_test_errors);
+        print_string("Result: FAIL\n", LIGHT_RED_ON_BLACK);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct thread;
+
+// Размер области FXSAVE (FNSAVE занимает меньше и помещается в нее же)
+#define FPU_STATE_SIZE 512
+
+// Включение FPU/SSE на загрузочном процессоре и установка обработчика #NM.
+// Состояние FPU переключается лениво: после переключения потоков CR0.TS
+// установлен, и первая FPU/SSE-инструкция потока вызывает #NM.
+void init_fpu(void);
+
+// Включение FPU/SSE на дополнительном процессоре
+void fpu_init_ap(void);
+
+// Сброс состояния FPU нового потока
+void fpu_thread_init(struct thread* thread);
+
+// Вызывается планировщиком перед переключением с потока prev: если поток
+// пользовался FPU в этом кванте, его регистры сохраняются
+void fpu_switch_out(struct thread* prev);
+
+// Команда fpu-test: потоки держат разные значения в регистрах x87/SSE и
+// постоянно уступают процессор; значения не должны смешиваться
+void run_fpu_test(int argc, char** argv);
+
+#endif // FPU_H
@@ -0,0 +1,197 @@
+#include "framebuffer.h"
+#include "font8x8.h"
+
+// Палитра текстового режима VGA (RGB)
+static const uint32_t vga_palette[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+static bool present = false;
+static volatile uint32_t* fb = NULL;
+static uint32_t pitch_pixels = 0;   // Длина строки буфера в пикселях
+static uint32_t width = 0;
+static uint32_t height = 0;
+static int columns = 0;
+static int rows = 0;
+
+// Палитра в формате пикселей буфера
+static uint32_t pixel_colors[16];
+
+// Кэш строк глифов для цветовой пары: для каждой из 256 возможных строк
+// шрифта (8 бит - 8 пикселей) - готовые 8 пикселей. Рисование строки
+// глифа - копирование 8 слов без ветвлений по битам.
+typedef struct {
+    uint8_t attr;
+    bool valid;
+    uint32_t last_used;
+    uint32_t rows[256][FB_GLYPH_WIDTH];
+} color_slot_t;
+
+static color_slot_t color_cache[FB_COLOR_CACHE_SLOTS];
+static uint32_t cache_clock = 0;
+
+static int cursor_row = -1;
+static int cursor_col = -1;
+
+static fb_stats_t stats;
+
+static uint32_t pack_component(uint32_t value, uint8_t position, uint8_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    if (size < 8) {
+        value >>= 8 - size;
+    }
+    return value << position;
+}
+
+bool fb_init(const multiboot_info_t* mbi) {
+    if (!(mbi->flags & MULTIBOOT_INFO_FRAMEBUFFER) ||
+        mbi->framebuffer_type != MULTIBOOT_FRAMEBUFFER_RGB ||
+        mbi->framebuffer_bpp != 32 ||
+        (mbi->framebuffer_addr >> 32) != 0) {
+        return false;
+    }
+
+    fb = (volatile uint32_t*)(uint32_t)mbi->framebuffer_addr;
+    pitch_pixels = mbi->framebuffer_pitch / 4;
+    width = mbi->framebuffer_width;
+    height = mbi->framebuffer_height;
+    columns = width / FB_GLYPH_WIDTH;
+    rows = height / FB_GLYPH_HEIGHT;
+    if (columns == 0 || rows == 0) {
+        return false;
+    }
+
+    for (int i = 0; i < 16; i++) {
+        uint32_t rgb = vga_palette[i];
+        pixel_colors[i] =
+            pack_component((rgb >> 16) & 0xFF, mbi->red_field_position, mbi->red_mask_size) |
+            pack_component((rgb >> 8) & 0xFF, mbi->green_field_position, mbi->green_mask_size) |
+            pack_component(rgb & 0xFF, mbi->blue_field_position, mbi->blue_mask_size);
+    }
+    present = true;
+    return true;
+}
+
+bool fb_present(void) {
+    return present;
+}
+
+int fb_columns(void) {
+    return columns;
+}
+
+int fb_rows(void) {
+    return rows;
+}
+
+uint32_t fb_width(void) {
+    return width;
+}
+
+uint32_t fb_height(void) {
+    return height;
+}
+
+// Строки глифов для атрибута attr: из кэша или отрисованные заново на
+// место давно не использованной пары
+static const color_slot_t* color_slot(uint8_t attr) {
+    color_slot_t* victim = &color_cache[0];
+    cache_clock++;
+    for (int i = 0; i < FB_COLOR_CACHE_SLOTS; i++) {
+        color_slot_t* slot = &color_cache[i];
+        if (slot->valid && slot->attr == attr) {
+            slot->last_used = cache_clock;
+            return slot;
+        }
+        if (!slot->valid || (victim->valid && slot->last_used < victim->last_used)) {
+            victim = slot;
+        }
+    }
+
+    uint32_t fg = pixel_colors[attr & 0x0F];
+    uint32_t bg = pixel_colors[(attr >> 4) & 0x0F];
+    for (int bits = 0; bits < 256; bits++) {
+        for (int x = 0; x < FB_GLYPH_WIDTH; x++) {
+            victim->rows[bits][x] = (bits & (1 << x)) ? fg : bg;
+        }
+    }
+    victim->attr = attr;
+    victim->valid = true;
+    victim->last_used = cache_clock;
+    stats.cache_fills++;
+    return victim;
+}
+
+static const uint8_t* glyph_bitmap(uint8_t c) {
+    if (c < FONT_FIRST_CHAR || c > FONT_LAST_CHAR) {
+        return font8x8_unknown;
+    }
+    return font8x8[c - FONT_FIRST_CHAR];
+}
+
+void fb_draw_cells(int row, int col, const uint16_t* cells, int count) {
+    if (!present || row < 0 || row >= rows || col < 0) {
+        return;
+    }
+    if (col + count > columns) {
+        count = columns - col;
+    }
+
+    const color_slot_t* slot = NULL;
+    volatile uint32_t* line = fb + (uint32_t)row * FB_GLYPH_HEIGHT * pitch_pixels
+                                 + (uint32_t)col * FB_GLYPH_WIDTH;
+    for (int i = 0; i < count; i++, line += FB_GLYPH_WIDTH) {
+        uint8_t ch = cells[i] & 0xFF;
+        uint8_t attr = cells[i] >> 8;
+        // Соседние ячейки обычно одного цвета: пара ищется только при смене
+        if (slot == NULL || slot->attr != attr) {
+            slot = color_slot(attr);
+        }
+        const uint8_t* bitmap = glyph_bitmap(ch);
+        bool cursor = row == cursor_row && col + i == cursor_col;
+
+        volatile uint32_t* dst = line;
+        for (int y = 0; y < FB_GLYPH_HEIGHT; y++, dst += pitch_pixels) {
+            uint8_t bits = bitmap[y / 2];
+            // Курсор - две нижние строки знакоместа цветом символа
+            if (cursor && y >= FB_GLYPH_HEIGHT - 2) {
+                bits = 0xFF;
+            }
+            const uint32_t* src = slot->rows[bits];
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = src[3];
+            dst[4] = src[4];
+            dst[5] = src[5];
+            dst[6] = src[6];
+            dst[7] = src[7];
+        }
+    }
+    stats.glyphs += count;
+}
+
+void fb_set_cursor(int row, int col) {
+    cursor_row = row;
+    cursor_col = col;
+}
+
+void fb_clear(uint8_t attr) {
+    if (!present) {
+        return;
+    }
+    uint32_t color = pixel_colors[(attr >> 4) & 0x0F];
+    for (uint32_t y = 0; y < height; y++) {
+        volatile uint32_t* dst = fb + y * pitch_pixels;
+        for (uint32_t x = 0; x < width; x++) {
+            dst[x] = color;
+        }
+    }
+}
+
+void fb_get_stats(fb_stats_t* out) {
+    *out = stats;
+}
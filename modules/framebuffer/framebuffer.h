@@ -0,0 +1,55 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../templates/multiboot.h"
+
+// Видеорежим, который ядро запрашивает у загрузчика (заголовок Multiboot
+// в kernel.asm)
+#define FB_REQUESTED_WIDTH 1024
+#define FB_REQUESTED_HEIGHT 768
+#define FB_REQUESTED_BPP 32
+
+// Знакоместо текстовой консоли в пикселях
+#define FB_GLYPH_WIDTH 8
+#define FB_GLYPH_HEIGHT 16
+
+// Кэш отрисованных строк глифов: число одновременно используемых цветовых
+// пар (атрибутов VGA)
+#define FB_COLOR_CACHE_SLOTS 16
+
+// Статистика отрисовки
+typedef struct {
+    uint32_t glyphs;        // Нарисовано знакомест
+    uint32_t cache_fills;   // Цветовая пара отрисована в кэш заново
+} fb_stats_t;
+
+// Проверка кадрового буфера, установленного загрузчиком. Поддерживается
+// линейный буфер RGB с 32 битами на пиксель; иначе возвращает false и
+// консоль остается в текстовом режиме VGA.
+bool fb_init(const multiboot_info_t* mbi);
+
+bool fb_present(void);
+
+// Размеры текстовой сетки и экрана в пикселях
+int fb_columns(void);
+int fb_rows(void);
+uint32_t fb_width(void);
+uint32_t fb_height(void);
+
+// Отрисовка count ячеек текстовой строки row начиная со столбца col.
+// Ячейка - символ и атрибут VGA, как в видеопамяти текстового режима.
+void fb_draw_cells(int row, int col, const uint16_t* cells, int count);
+
+// Позиция курсора (подчеркивание). Ячейку под курсором рисует
+// fb_draw_cells: старую и новую позиции нужно перерисовать.
+void fb_set_cursor(int row, int col);
+
+// Заливка всего экрана цветом фона атрибута attr
+void fb_clear(uint8_t attr);
+
+void fb_get_stats(fb_stats_t* stats);
+
+#endif // FRAMEBUFFER_H
@@ -0,0 +1,512 @@
+#include "interrupts.h"
+#include "../templates/kernel_api.h"
+#include "../templates/io.h"
+#include "../threads_and_processes/threads_and_processes.h"
+#include "../apic/apic.h"
+#include "../cpu/cpu.h"
+#include "../timer/timer.h"
+#include "../klog/klog.h"
+#include "../shell/shell.h"
+#include "../kprintf/kprintf.h"
+#include "../kstring/kstring.h"
+#include <stddef.h>
+
+extern int atoi(const char *str);
+
+// Порты контроллеров 8259
+#define PIC1_CMD 0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD 0xA0
+#define PIC2_DATA 0xA1
+#define PIC_EOI 0x20
+#define PIC_READ_IRR 0x0A
+#define PIC_READ_ISR 0x0B
+
+// Атрибуты шлюза: присутствует, DPL=0, 32-битный шлюз прерывания
+#define IDT_GATE_INTERRUPT 0x8E
+// То же с DPL=3: вектор доступен команде int из кольца 3
+#define IDT_GATE_USER_INTERRUPT 0xEE
+
+#define STR_HELPER(x) #x
+#define STR(x) STR_HELPER(x)
+
+// Размер заглушки в таблице isr_stub_table
+#define ISR_STUB_SIZE 16
+
+// Интервал irqstat по умолчанию
+#define IRQSTAT_DEFAULT_INTERVAL_MS 1000
+
+// Элемент IDT
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t zero;
+    uint8_t type_attr;
+    uint16_t offset_high;
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) idt_ptr_t;
+
+static idt_entry_t idt[IDT_ENTRIES] __attribute__((aligned(8)));
+static idt_ptr_t idt_ptr;
+static interrupt_handler_t interrupt_handlers[IDT_ENTRIES];
+// Счетчики прерываний: строку процессора увеличивает только он сам
+static uint32_t interrupt_counts[MAX_CPUS][IDT_ENTRIES];
+// Гистограммы общие для процессоров (корзины увеличиваются атомарно)
+static irq_histogram_t irq_histograms[IDT_ENTRIES];
+// Ожидаемое время прихода вектора (см. interrupt_expect)
+static uint64_t interrupt_expected[MAX_CPUS][IDT_ENTRIES];
+
+static const char* exception_names[32] = {
+    "Divide error", "Debug", "NMI", "Breakpoint",
+    "Overflow", "BOUND range exceeded", "Invalid opcode", "Device not available",
+    "Double fault", "Coprocessor segment overrun", "Invalid TSS", "Segment not present",
+    "Stack-segment fault", "General protection fault", "Page fault", "Reserved",
+    "x87 floating-point error", "Alignment check", "Machine check", "SIMD floating-point error",
+    "Virtualization exception", "Control protection", "Reserved", "Reserved",
+    "Reserved", "Reserved", "Reserved", "Reserved",
+    "Reserved", "Reserved", "Security exception", "Reserved"
+};
+
+// Заглушки для всех 256 векторов. Для исключений без кода ошибки
+// кладем 0, чтобы кадр на стеке всегда имел одинаковый вид.
+// При входе из кольца 3 сегментные регистры пользовательские (GS сброшен
+// процессором при переходе в кольцо 3), поэтому загружаем сегменты ядра;
+// сегмент данных процессора находим по его TSS (команда str).
+asm (
+    ".section .text\n"
+    ".global isr_stub_table\n"
+    ".align 16\n"
+    "isr_stub_table:\n"
+    ".set isr_vec, 0\n"
+    ".rept 256\n"
+    "    .align 16\n"
+    "    .if !(isr_vec == 8 || (isr_vec >= 10 && isr_vec <= 14) || isr_vec == 17 || isr_vec == 21 || isr_vec == 29 || isr_vec == 30)\n"
+    "    pushl $0\n"
+    "    .endif\n"
+    "    pushl $isr_vec\n"
+    "    jmp isr_common\n"
+    "    .set isr_vec, isr_vec + 1\n"
+    ".endr\n"
+    "isr_common:\n"
+    "    pushal\n"
+    "    pushl %ds\n"
+    "    pushl %es\n"
+    "    pushl %fs\n"
+    "    pushl %gs\n"
+    "    testl $3, 60(%esp)\n"         // CS прерванного кода
+    "    jz 1f\n"
+    "    movw $" STR(GDT_KERNEL_DATA_SELECTOR) ", %ax\n"
+    "    movw %ax, %ds\n"
+    "    movw %ax, %es\n"
+    "    str %ax\n"
+    "    addw $(" STR(MAX_CPUS) " * 8), %ax\n"
+    "    movw %ax, %gs\n"
+    "1:  cld\n"
+    "    pushl %esp\n"
+    "    call interrupt_dispatch\n"
+    "    addl $4, %esp\n"
+    "    popl %gs\n"
+    "    popl %fs\n"
+    "    popl %es\n"
+    "    popl %ds\n"
+    "    popal\n"
+    "    addl $8, %esp\n"
+    "    iret\n"
+);
+
+extern char isr_stub_table[];
+
+void interrupt_dispatch(interrupt_frame_t* frame);
+
+static void idt_set_gate(uint8_t vector, uint32_t handler, uint16_t selector, uint8_t attr) {
+    idt[vector].offset_low = handler & 0xFFFF;
+    idt[vector].selector = selector;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = attr;
+    idt[vector].offset_high = (handler >> 16) & 0xFFFF;
+}
+
+// Перенастройка PIC: IRQ 0-7 -> 32-39, IRQ 8-15 -> 40-47
+static void pic_remap(void) {
+    outb(PIC1_CMD, 0x11); io_wait();   // ICW1: инициализация, ожидается ICW4
+    outb(PIC2_CMD, 0x11); io_wait();
+    outb(PIC1_DATA, IRQ_BASE); io_wait();       // ICW2: базовый вектор
+    outb(PIC2_DATA, IRQ_BASE + 8); io_wait();
+    outb(PIC1_DATA, 0x04); io_wait();  // ICW3: ведомый PIC на IRQ2
+    outb(PIC2_DATA, 0x02); io_wait();
+    outb(PIC1_DATA, 0x01); io_wait();  // ICW4: режим 8086
+    outb(PIC2_DATA, 0x01); io_wait();
+
+    // Маскируем все линии, кроме каскада
+    outb(PIC1_DATA, (uint8_t)~(1 << IRQ_CASCADE));
+    outb(PIC2_DATA, 0xFF);
+}
+
+static uint16_t pic_read_isr(void) {
+    outb(PIC1_CMD, PIC_READ_ISR);
+    outb(PIC2_CMD, PIC_READ_ISR);
+    return ((uint16_t)inb(PIC2_CMD) << 8) | inb(PIC1_CMD);
+}
+
+static uint16_t pic_read_irr(void) {
+    outb(PIC1_CMD, PIC_READ_IRR);
+    outb(PIC2_CMD, PIC_READ_IRR);
+    uint16_t irr = ((uint16_t)inb(PIC2_CMD) << 8) | inb(PIC1_CMD);
+    // По умолчанию чтение команды возвращает ISR (см. pic_read_isr)
+    outb(PIC1_CMD, PIC_READ_ISR);
+    outb(PIC2_CMD, PIC_READ_ISR);
+    return irr;
+}
+
+uint16_t pic_disable(uint16_t* pending) {
+    uint16_t mask = ((uint16_t)inb(PIC2_DATA) << 8) | inb(PIC1_DATA);
+    *pending = pic_read_irr();
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+    return mask;
+}
+
+void irq_replay(uint16_t irqs) {
+    interrupt_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    for (uint8_t irq = 0; irq < 16; irq++) {
+        if ((irqs & (1 << irq)) && interrupt_handlers[IRQ_BASE + irq] != NULL) {
+            frame.vector = IRQ_BASE + irq;
+            interrupt_handlers[IRQ_BASE + irq](&frame);
+        }
+    }
+}
+
+static void pic_send_eoi(uint8_t irq) {
+    if (irq >= 8) {
+        outb(PIC2_CMD, PIC_EOI);
+    }
+    outb(PIC1_CMD, PIC_EOI);
+}
+
+void irq_mask(uint8_t irq) {
+    if (ioapic_enabled) {
+        ioapic_set_masked(irq, true);
+        return;
+    }
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) | (1 << (irq & 7)));
+}
+
+void irq_unmask(uint8_t irq) {
+    if (ioapic_enabled) {
+        ioapic_set_masked(irq, false);
+        return;
+    }
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) & ~(1 << (irq & 7)));
+}
+
+void register_interrupt_handler(uint8_t vector, interrupt_handler_t handler) {
+    interrupt_handlers[vector] = handler;
+}
+
+void interrupt_allow_user(uint8_t vector) {
+    idt[vector].type_attr = IDT_GATE_USER_INTERRUPT;
+}
+
+// Необработанное исключение: выводим информацию и останавливаем процессор
+static void unhandled_exception(interrupt_frame_t* frame) {
+    // Сообщения журнала, которые поток вывода уже не напечатает
+    klog_flush();
+    kprintf_color(LIGHT_RED_ON_BLACK,
+                  "\nKernel exception: %s (vector %u, error 0x%x, eip 0x%x)\nSystem halted.\n",
+                  exception_names[frame->vector], frame->vector, frame->error_code, frame->eip);
+    while (1) {
+        asm volatile("cli; hlt");
+    }
+}
+
+// Исключение в кольце 3 завершает процесс, а не останавливает систему
+static void user_exception(interrupt_frame_t* frame) {
+    process_t* process = get_current_process();
+    klog(KLOG_WARN, "Process %u killed: %s at eip 0x%x",
+         process != NULL ? process->id : 0, exception_names[frame->vector], frame->eip);
+    process_exit(process);
+}
+
+// Корзина log2-гистограммы для значения в тактах
+static uint32_t irq_hist_bucket(uint64_t cycles) {
+    if (cycles == 0) {
+        return 0;
+    }
+    uint32_t value = cycles > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)cycles;
+    uint32_t bucket = 31 - __builtin_clz(value);
+    return bucket < IRQ_HIST_BUCKETS ? bucket : IRQ_HIST_BUCKETS - 1;
+}
+
+// Учет времени обработки вектора (и задержки входа, если он ожидался)
+static void irq_account(uint32_t cpu_index, uint32_t vector, uint64_t entry) {
+    irq_histogram_t* hist = &irq_histograms[vector];
+    uint64_t duration = rdtsc() - entry;
+    __atomic_fetch_add(&hist->duration[irq_hist_bucket(duration)], 1, __ATOMIC_RELAXED);
+    if (duration > hist->max_duration) {
+        hist->max_duration = duration > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)duration;
+    }
+
+    uint64_t expected = interrupt_expected[cpu_index][vector];
+    if (expected != 0) {
+        interrupt_expected[cpu_index][vector] = 0;
+        if (entry >= expected) {
+            __atomic_fetch_add(&hist->latency[irq_hist_bucket(entry - expected)], 1,
+                               __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void interrupt_expect(uint32_t cpu_index, uint8_t vector, uint64_t tsc) {
+    if (cpu_index < MAX_CPUS) {
+        interrupt_expected[cpu_index][vector] = tsc;
+    }
+}
+
+// Общая точка входа из isr_common
+void interrupt_dispatch(interrupt_frame_t* frame) {
+    uint64_t entry = rdtsc();
+    uint32_t vector = frame->vector;
+    uint32_t cpu_index = this_cpu()->index;
+    interrupt_counts[cpu_index][vector]++;
+
+    if (vector >= IRQ_BASE && vector < IRQ_BASE + 16 && ioapic_enabled) {
+        // Линии ISA через I/O APIC подтверждаются в локальном APIC
+        if (interrupt_handlers[vector] != NULL) {
+            interrupt_handlers[vector](frame);
+        }
+        lapic_eoi();
+    } else if (vector >= IRQ_BASE && vector < IRQ_BASE + 16) {
+        uint8_t irq = vector - IRQ_BASE;
+        // Ложные прерывания IRQ7/IRQ15 не подтверждаются в ISR
+        if ((irq == 7 || irq == 15) && !(pic_read_isr() & (1 << irq))) {
+            if (irq == 15) {
+                outb(PIC1_CMD, PIC_EOI);
+            }
+            return;
+        }
+        if (interrupt_handlers[vector] != NULL) {
+            interrupt_handlers[vector](frame);
+        }
+        pic_send_eoi(irq);
+    } else if (vector >= APIC_VECTOR_BASE) {
+        if (interrupt_handlers[vector] != NULL) {
+            interrupt_handlers[vector](frame);
+        }
+        // На ложное прерывание APIC EOI не отправляется
+        if (vector != APIC_SPURIOUS_VECTOR) {
+            lapic_eoi();
+        }
+    } else if (interrupt_handlers[vector] != NULL) {
+        interrupt_handlers[vector](frame);
+    } else if (vector < 32 && interrupt_from_user(frame)) {
+        user_exception(frame);
+    } else if (vector < 32) {
+        unhandled_exception(frame);
+    }
+    irq_account(cpu_index, vector, entry);
+
+    // Вытеснение выполняется только после EOI, иначе контроллер заблокирует
+    // следующие прерывания до возврата в этот поток
+    preempt_if_needed();
+}
+
+// Загрузка IDT на дополнительном процессоре
+void interrupts_init_ap(void) {
+    asm volatile ("lidt %0" : : "m" (idt_ptr));
+}
+
+// Команды оболочки
+static const shell_command_t interrupt_commands[] = {
+    { "interrupts", NULL, "Per-vector interrupt counts on each CPU", run_interrupt_stats },
+    { "irqstat", "[MS]", "Interrupt rates and handler time percentiles", run_irqstat },
+};
+
+void init_interrupts(void) {
+    shell_register_all(interrupt_commands, sizeof(interrupt_commands) / sizeof(interrupt_commands[0]));
+    uint16_t code_selector;
+    asm volatile ("mov %%cs, %0" : "=r" (code_selector));
+
+    for (int i = 0; i < IDT_ENTRIES; i++) {
+        idt_set_gate(i, (uint32_t)isr_stub_table + i * ISR_STUB_SIZE,
+                     code_selector, IDT_GATE_INTERRUPT);
+    }
+
+    idt_ptr.limit = sizeof(idt) - 1;
+    idt_ptr.base = (uint32_t)idt;
+    asm volatile ("lidt %0" : : "m" (idt_ptr));
+
+    pic_remap();
+
+    print_string("Interrupts initialized\n", LIGHT_GREEN_ON_BLACK);
+}
+
+uint32_t interrupt_count(uint32_t cpu_index, uint8_t vector) {
+    return cpu_index < MAX_CPUS ? interrupt_counts[cpu_index][vector] : 0;
+}
+
+// ============== interrupts ==============
+
+// Назначение вектора для таблицы
+static void print_vector_name(uint32_t vector) {
+    if (vector < 32) {
+        print_string(exception_names[vector], WHITE_ON_BLACK);
+    } else if (vector < IRQ_BASE + 16) {
+        kprintf("IRQ%u %s", vector - IRQ_BASE, ioapic_enabled ? "IO-APIC" : "XT-PIC");
+    } else if (vector == APIC_TIMER_VECTOR) {
+        print_string("LAPIC timer", WHITE_ON_BLACK);
+    } else if (vector == APIC_RESCHEDULE_VECTOR) {
+        print_string("Reschedule IPI", WHITE_ON_BLACK);
+    } else if (vector == APIC_SPURIOUS_VECTOR) {
+        print_string("Spurious", WHITE_ON_BLACK);
+    } else {
+        print_string("Software", WHITE_ON_BLACK);
+    }
+}
+
+void run_interrupt_stats(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    print_string("\nVector  ", LIGHT_GREEN_ON_BLACK);
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        if (cpus[c].online) {
+            kprintf_color(LIGHT_GREEN_ON_BLACK, "CPU%-9u", c);
+        }
+    }
+    print_string("Source\n", LIGHT_GREEN_ON_BLACK);
+
+    for (uint32_t vector = 0; vector < IDT_ENTRIES; vector++) {
+        uint32_t total = 0;
+        for (uint32_t c = 0; c < MAX_CPUS; c++) {
+            total += interrupt_counts[c][vector];
+        }
+        if (total == 0) {
+            continue;
+        }
+
+        kprintf_color(LIGHT_BLUE_ON_BLACK, "%-8u", vector);
+        for (uint32_t c = 0; c < MAX_CPUS; c++) {
+            if (cpus[c].online) {
+                kprintf("%-12u", interrupt_counts[c][vector]);
+            }
+        }
+        print_vector_name(vector);
+        print_char('\n', WHITE_ON_BLACK);
+    }
+
+    print_string("\nLegacy IRQs routed via ", WHITE_ON_BLACK);
+    print_string(ioapic_enabled ? "I/O APIC\n" : "8259 PIC\n", WHITE_ON_BLACK);
+}
+
+// ============== irqstat ==============
+// Частота считается по разнице счетчиков за интервал, перцентили - по
+// накопленным с загрузки гистограммам. Значение перцентиля - верхняя
+// граница корзины, то есть оценка сверху с точностью до двух раз.
+
+// Длительность в тактах -> «850ns», «12us» или «3ms»
+static void format_cycles(uint64_t cycles, char* buf, size_t size) {
+    uint32_t tsc_per_ms = timer_tsc_per_ms();
+    uint64_t ns = tsc_per_ms != 0 ? udiv64_32(cycles * 1000000, tsc_per_ms, NULL) : 0;
+    const char* unit = "ns";
+    if (ns >= 10000000) {
+        ns = udiv64_32(ns, 1000000, NULL);
+        unit = "ms";
+    } else if (ns >= 10000) {
+        ns = udiv64_32(ns, 1000, NULL);
+        unit = "us";
+    }
+    ksnprintf(buf, size, "%u%s", (uint32_t)ns, unit);
+}
+
+// Перцентиль percent гистограммы (в тактах); false - пустая гистограмма
+static bool hist_percentile(const uint32_t* hist, uint32_t percent, uint64_t* cycles) {
+    uint64_t total = 0;
+    for (uint32_t b = 0; b < IRQ_HIST_BUCKETS; b++) {
+        total += hist[b];
+    }
+    if (total == 0) {
+        return false;
+    }
+    // Наименьшая корзина, до которой включительно набирается percent% значений
+    uint64_t target = udiv64_32(total * percent + 99, 100, NULL);
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < IRQ_HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen >= target) {
+            *cycles = 2ull << b;
+            return true;
+        }
+    }
+    *cycles = 2ull << (IRQ_HIST_BUCKETS - 1);
+    return true;
+}
+
+static void print_percentile(const uint32_t* hist, uint32_t percent) {
+    char buf[16];
+    uint64_t cycles;
+    if (hist_percentile(hist, percent, &cycles)) {
+        format_cycles(cycles, buf, sizeof(buf));
+        kprintf("%-8s", buf);
+    } else {
+        kprintf("%-8s", "-");
+    }
+}
+
+static uint32_t interrupt_total(uint32_t vector) {
+    uint32_t total = 0;
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        total += interrupt_counts[c][vector];
+    }
+    return total;
+}
+
+void run_irqstat(int argc, char** argv) {
+    static uint32_t before[IDT_ENTRIES];
+    char num_str[16];
+    uint32_t interval = IRQSTAT_DEFAULT_INTERVAL_MS;
+    if (argc > 1) {
+        int value = atoi(argv[1]);
+        if (value > 0) {
+            interval = value;
+        }
+    }
+
+    for (uint32_t vector = 0; vector < IDT_ENTRIES; vector++) {
+        before[vector] = interrupt_total(vector);
+    }
+    thread_sleep(interval);
+
+    kprintf("\nInterrupts over %u ms (durations and latencies since boot, log2 buckets)\n",
+            interval);
+    print_string("Vector  Count     Rate/s  Dur50   Dur99   DurMax  Lat50   Lat99   Source\n",
+                 LIGHT_GREEN_ON_BLACK);
+
+    for (uint32_t vector = 0; vector < IDT_ENTRIES; vector++) {
+        uint32_t total = interrupt_total(vector);
+        if (total == 0) {
+            continue;
+        }
+        const irq_histogram_t* hist = &irq_histograms[vector];
+        uint32_t rate = (uint32_t)udiv64_32((uint64_t)(total - before[vector]) * 1000,
+                                            interval, NULL);
+
+        kprintf_color(LIGHT_BLUE_ON_BLACK, "%-8u", vector);
+        kprintf("%-10u", total);
+        kprintf_color(rate >= 1000 ? LIGHT_RED_ON_BLACK : WHITE_ON_BLACK, "%-8u", rate);
+        print_percentile(hist->duration, 50);
+        print_percentile(hist->duration, 99);
+        format_cycles(hist->max_duration, num_str, sizeof(num_str));
+        kprintf("%-8s", num_str);
+        print_percentile(hist->latency, 50);
+        print_percentile(hist->latency, 99);
+        print_vector_name(vector);
+        print_char('\n', WHITE_ON_BLACK);
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Количество векторов в IDT
+#define IDT_ENTRIES 256
+// Первый вектор аппаратных прерываний после перенастройки PIC
+#define IRQ_BASE 32
+
+// Линии IRQ контроллера 8259
+#define IRQ_TIMER 0
+#define IRQ_KEYBOARD 1
+#define IRQ_CASCADE 2
+#define IRQ_COM1 4
+
+// Состояние процессора, сохраняемое обработчиком прерывания на стеке
+typedef struct {
+    uint32_t gs, fs, es, ds;
+    uint32_t edi, esi, ebp, esp_dummy, ebx, edx, ecx, eax; // pushal
+    uint32_t vector;            // Номер вектора
+    uint32_t error_code;        // Код ошибки (или 0)
+    uint32_t eip, cs, eflags;   // Сохранено процессором
+    uint32_t user_esp, user_ss; // Только при входе из кольца 3
+} interrupt_frame_t;
+
+// Прерывание пришло из пользовательского режима
+static inline bool interrupt_from_user(const interrupt_frame_t* frame) {
+    return (frame->cs & 3) == 3;
+}
+
+typedef void (*interrupt_handler_t)(interrupt_frame_t* frame);
+
+// Установка IDT, перенастройка PIC (IRQ 0-15 -> векторы 32-47)
+void init_interrupts(void);
+
+// Загрузка IDT на дополнительном процессоре
+void interrupts_init_ap(void);
+
+// Регистрация обработчика для вектора
+void register_interrupt_handler(uint8_t vector, interrupt_handler_t handler);
+
+// Разрешение вызова вектора командой int из кольца 3
+void interrupt_allow_user(uint8_t vector);
+
+// Маскирование/демаскирование линии IRQ (в I/O APIC, если линии
+// переведены на него, иначе в PIC)
+void irq_mask(uint8_t irq);
+void irq_unmask(uint8_t irq);
+
+// Маскирование всех линий 8259 при переходе на I/O APIC. Возвращает
+// прежнюю маску; в pending - запросы, принятые, но еще не доставленные.
+uint16_t pic_disable(uint16_t* pending);
+
+// Вызов обработчиков линий из маски irqs вне прерывания (с запрещенными
+// прерываниями): запросы, потерянные при смене контроллера
+void irq_replay(uint16_t irqs);
+
+// Гистограммы времени обработки и задержки входа: корзина b содержит
+// значения от 2^b до 2^(b+1) - 1 тактов TSC, последняя - все большие
+#define IRQ_HIST_BUCKETS 24
+
+typedef struct {
+    uint32_t duration[IRQ_HIST_BUCKETS];    // Обработчик и EOI
+    uint32_t latency[IRQ_HIST_BUCKETS];     // От ожидаемого прихода до входа
+    uint32_t max_duration;                  // Такты TSC (приблизительно)
+} irq_histogram_t;
+
+// Число прерываний по вектору на процессоре
+uint32_t interrupt_count(uint32_t cpu_index, uint8_t vector);
+
+// Вектор ожидается на процессоре к моменту tsc (0 - отмена): при его
+// приходе задержка входа попадает в гистограмму. Источник, который знает
+// время события (таймер, отправитель IPI), сообщает его заранее.
+void interrupt_expect(uint32_t cpu_index, uint8_t vector, uint64_t tsc);
+
+// Команда irqstat: частота прерываний за interval_ms и перцентили времени
+void run_irqstat(int argc, char** argv);
+
+// Команда interrupts: ненулевые счетчики прерываний по векторам и процессорам
+void run_interrupt_stats(int argc, char** argv);
+
+#endif // INTERRUPTS_H
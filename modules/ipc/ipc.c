@@ -0,0 +1,366 @@
+#include "ipc.h"
+#include "../templates/kernel_api.h"
+#include "../templates/io.h"
+#include "../cpu/cpu.h"
+#include "../timer/timer.h"
+#include "../threads_and_processes/threads_and_processes.h"
+#include "../kprintf/kprintf.h"
+#include <stddef.h>
+
+extern int atoi(const char *str);
+
+// Параметры ipc-bench
+#define IPC_BENCH_DEFAULT_MESSAGES 200000
+#define IPC_BENCH_CAPACITY 256
+#define IPC_BENCH_BATCH 32
+#define IPC_BENCH_PRODUCERS 2
+#define IPC_BENCH_PRIORITY 10
+
+bool ipc_channel_init(ipc_channel_t* ch, ipc_kind_t kind, ipc_slot_t* slots, uint32_t capacity) {
+    if (ch == NULL || slots == NULL || capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return false;
+    }
+    ch->tail = 0;
+    ch->head_cache = 0;
+    ch->receiver_wakeups = 0;
+    ch->head = 0;
+    ch->tail_cache = 0;
+    ch->receiver_sleeps = 0;
+    ch->slots = slots;
+    ch->mask = capacity - 1;
+    ch->kind = kind;
+    ch->receiver = NULL;
+    ch->senders_waiting = 0;
+    ch->sender_sleeps = 0;
+    wait_queue_init(&ch->senders);
+    // MPSC: ячейка i свободна для отправителя с позицией i
+    for (uint32_t i = 0; i < capacity; i++) {
+        slots[i].seq = i;
+    }
+    return true;
+}
+
+// ============== Кольцевой буфер ==============
+// На x86 записи не переупорядочиваются с записями, а чтения с чтениями,
+// поэтому для публикации сообщения достаточно барьера компилятора.
+
+static inline void compiler_barrier(void) {
+    asm volatile ("" : : : "memory");
+}
+
+static bool spsc_push(ipc_channel_t* ch, const ipc_msg_t* msg) {
+    uint32_t tail = ch->tail;
+    if (tail - ch->head_cache > ch->mask) {
+        ch->head_cache = ch->head;
+        if (tail - ch->head_cache > ch->mask) {
+            return false;
+        }
+    }
+    ch->slots[tail & ch->mask].msg = *msg;
+    compiler_barrier();
+    ch->tail = tail + 1;
+    return true;
+}
+
+static bool spsc_pop(ipc_channel_t* ch, ipc_msg_t* msg) {
+    uint32_t head = ch->head;
+    if (head == ch->tail_cache) {
+        ch->tail_cache = ch->tail;
+        if (head == ch->tail_cache) {
+            return false;
+        }
+    }
+    compiler_barrier();
+    *msg = ch->slots[head & ch->mask].msg;
+    compiler_barrier();
+    ch->head = head + 1;
+    return true;
+}
+
+// Ограниченная очередь с номерами последовательности в ячейках: отправитель
+// захватывает позицию CAS-ом по tail и публикует ячейку записью seq
+static bool mpsc_push(ipc_channel_t* ch, const ipc_msg_t* msg) {
+    uint32_t pos = ch->tail;
+    ipc_slot_t* slot;
+    while (1) {
+        slot = &ch->slots[pos & ch->mask];
+        int32_t diff = (int32_t)(slot->seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ch->tail, &pos, pos + 1, false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;   // Получатель еще не освободил ячейку: буфер полон
+        } else {
+            pos = ch->tail;
+        }
+    }
+    slot->msg = *msg;
+    compiler_barrier();
+    slot->seq = pos + 1;
+    return true;
+}
+
+static bool mpsc_pop(ipc_channel_t* ch, ipc_msg_t* msg) {
+    uint32_t head = ch->head;
+    ipc_slot_t* slot = &ch->slots[head & ch->mask];
+    if (slot->seq != head + 1) {
+        return false;
+    }
+    compiler_barrier();
+    *msg = slot->msg;
+    compiler_barrier();
+    slot->seq = head + ch->mask + 1;
+    ch->head = head + 1;
+    return true;
+}
+
+static inline bool channel_push(ipc_channel_t* ch, const ipc_msg_t* msg) {
+    return ch->kind == IPC_SPSC ? spsc_push(ch, msg) : mpsc_push(ch, msg);
+}
+
+static inline bool channel_pop(ipc_channel_t* ch, ipc_msg_t* msg) {
+    return ch->kind == IPC_SPSC ? spsc_pop(ch, msg) : mpsc_pop(ch, msg);
+}
+
+static bool channel_empty(ipc_channel_t* ch) {
+    uint32_t head = ch->head;
+    if (ch->kind == IPC_SPSC) {
+        return head == ch->tail;
+    }
+    return ch->slots[head & ch->mask].seq != head + 1;
+}
+
+static bool channel_full(ipc_channel_t* ch) {
+    uint32_t tail = ch->tail;
+    if (ch->kind == IPC_SPSC) {
+        return tail - ch->head > ch->mask;
+    }
+    return (int32_t)(ch->slots[tail & ch->mask].seq - tail) < 0;
+}
+
+// ============== Пробуждения ==============
+// Ожидающий сначала объявляет себя, затем (после полного барьера) еще раз
+// проверяет буфер; другая сторона сначала меняет буфер, затем (после
+// барьера) смотрит, есть ли ожидающие. Хотя бы одна из сторон увидит
+// изменение другой, поэтому пробуждение не теряется.
+
+static void wake_receiver(ipc_channel_t* ch) {
+    smp_mb();
+    if (ch->receiver == NULL) {
+        return;
+    }
+    struct thread* receiver = __atomic_exchange_n(&ch->receiver, NULL, __ATOMIC_ACQ_REL);
+    if (receiver != NULL) {
+        __atomic_fetch_add(&ch->receiver_wakeups, 1, __ATOMIC_RELAXED);
+        unblock_thread(receiver);
+    }
+}
+
+static void wake_senders(ipc_channel_t* ch) {
+    smp_mb();
+    if (ch->senders_waiting != 0) {
+        wait_queue_wake_all(&ch->senders);
+    }
+}
+
+// Ожидание сообщения получателем (одна попытка; возможны ложные пробуждения)
+static bool wait_for_messages(ipc_channel_t* ch, uint32_t timeout_ms) {
+    uint32_t flags = irq_save();
+    thread_t* current = this_cpu()->current_thread;
+    thread_prepare_block();
+    ch->receiver = current;
+    smp_mb();
+    if (!channel_empty(ch)) {
+        // Сообщение пришло до объявления ожидания: отменяем блокировку
+        (void)__atomic_exchange_n(&ch->receiver, NULL, __ATOMIC_ACQ_REL);
+        unblock_thread(current);
+    } else {
+        ch->receiver_sleeps++;
+    }
+    bool woken = thread_wait(timeout_ms);
+    if (!woken) {
+        (void)__atomic_exchange_n(&ch->receiver, NULL, __ATOMIC_ACQ_REL);
+    }
+    irq_restore(flags);
+    return woken;
+}
+
+// Ожидание места в буфере отправителем
+static bool wait_for_space(ipc_channel_t* ch, uint32_t timeout_ms) {
+    uint32_t flags = spin_lock_irqsave(&ch->senders.lock);
+    // lock xadd - полный барьер
+    __atomic_fetch_add(&ch->senders_waiting, 1, __ATOMIC_SEQ_CST);
+    if (!channel_full(ch)) {
+        __atomic_fetch_sub(&ch->senders_waiting, 1, __ATOMIC_SEQ_CST);
+        spin_unlock_irqrestore(&ch->senders.lock, flags);
+        return true;
+    }
+    __atomic_fetch_add(&ch->sender_sleeps, 1, __ATOMIC_RELAXED);
+    wait_queue_add_locked(&ch->senders);
+    spin_unlock(&ch->senders.lock);
+    bool woken = wait_queue_sleep(&ch->senders, timeout_ms);
+    __atomic_fetch_sub(&ch->senders_waiting, 1, __ATOMIC_SEQ_CST);
+    irq_restore(flags);
+    return woken;
+}
+
+// Оставшееся время ожидания в мс; false - срок истек
+static bool remaining_ms(uint32_t timeout_ms, uint32_t deadline, uint32_t* wait_ms) {
+    *wait_ms = 0;
+    if (timeout_ms == 0) {
+        return true;
+    }
+    int32_t remaining = (int32_t)(deadline - get_ticks());
+    if (remaining <= 0) {
+        return false;
+    }
+    *wait_ms = remaining * (1000 / TIMER_HZ);
+    return true;
+}
+
+// ============== Операции ==============
+
+bool ipc_try_send(ipc_channel_t* ch, const ipc_msg_t* msg) {
+    if (!channel_push(ch, msg)) {
+        return false;
+    }
+    wake_receiver(ch);
+    return true;
+}
+
+bool ipc_try_recv(ipc_channel_t* ch, ipc_msg_t* msg) {
+    if (!channel_pop(ch, msg)) {
+        return false;
+    }
+    wake_senders(ch);
+    return true;
+}
+
+bool ipc_send(ipc_channel_t* ch, const ipc_msg_t* msg, uint32_t timeout_ms) {
+    uint32_t deadline = get_ticks() + timer_ms_to_ticks(timeout_ms);
+    while (!channel_push(ch, msg)) {
+        uint32_t wait_ms;
+        if (!remaining_ms(timeout_ms, deadline, &wait_ms)) {
+            return false;
+        }
+        if (get_current_thread() == NULL) {
+            cpu_relax();
+        } else {
+            wait_for_space(ch, wait_ms);
+        }
+    }
+    wake_receiver(ch);
+    return true;
+}
+
+bool ipc_recv(ipc_channel_t* ch, ipc_msg_t* msg, uint32_t timeout_ms) {
+    return ipc_recv_batch(ch, msg, 1, timeout_ms) == 1;
+}
+
+uint32_t ipc_recv_batch(ipc_channel_t* ch, ipc_msg_t* msgs, uint32_t max, uint32_t timeout_ms) {
+    if (max == 0) {
+        return 0;
+    }
+    uint32_t deadline = get_ticks() + timer_ms_to_ticks(timeout_ms);
+    while (!channel_pop(ch, &msgs[0])) {
+        uint32_t wait_ms;
+        if (!remaining_ms(timeout_ms, deadline, &wait_ms)) {
+            return 0;
+        }
+        if (get_current_thread() == NULL) {
+            cpu_relax();
+        } else {
+            wait_for_messages(ch, wait_ms);
+        }
+    }
+    uint32_t count = 1;
+    while (count < max && channel_pop(ch, &msgs[count])) {
+        count++;
+    }
+    wake_senders(ch);
+    return count;
+}
+
+// ============== ipc-bench ==============
+// Отправители - потоки отдельных процессов, получатель - поток оболочки.
+// Каждый отправитель шлет номера по порядку; получатель проверяет, что
+// сообщения одного отправителя не теряются и не переставляются.
+
+static ipc_slot_t bench_slots[IPC_BENCH_CAPACITY] __attribute__((aligned(IPC_CACHE_LINE)));
+static ipc_channel_t bench_channel;
+static volatile uint32_t bench_messages;        // На одного отправителя
+static volatile uint32_t bench_next_producer;
+
+static void ipc_bench_producer() {
+    uint32_t id = __atomic_fetch_add(&bench_next_producer, 1, __ATOMIC_RELAXED);
+    ipc_msg_t msg;
+    msg.type = id;
+    msg.data[1] = 0;
+    for (uint32_t i = 0; i < bench_messages; i++) {
+        msg.data[0] = i;
+        ipc_send(&bench_channel, &msg, 0);
+    }
+}
+
+static void ipc_bench_run(const char* name, ipc_kind_t kind, uint32_t producers,
+                          uint32_t batch, uint32_t messages) {
+    ipc_msg_t msgs[IPC_BENCH_BATCH];
+    uint32_t expected[IPC_BENCH_PRODUCERS] = { 0 };
+    bool ok = true;
+
+    ipc_channel_init(&bench_channel, kind, bench_slots, IPC_BENCH_CAPACITY);
+    bench_messages = messages;
+    bench_next_producer = 0;
+
+    uint64_t start = rdtsc();
+    uint32_t started = 0;
+    for (uint32_t i = 0; i < producers; i++) {
+        if (create_process(ipc_bench_producer, IPC_BENCH_PRIORITY) != NULL) {
+            started++;
+        }
+    }
+    uint32_t total = started * messages;
+    uint32_t received = 0;
+    while (received < total) {
+        uint32_t count = ipc_recv_batch(&bench_channel, msgs, batch, 0);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t id = msgs[i].type;
+            if (id >= IPC_BENCH_PRODUCERS || msgs[i].data[0] != expected[id]) {
+                ok = false;
+            } else {
+                expected[id]++;
+            }
+        }
+        received += count;
+    }
+    uint32_t us = (uint32_t)timer_cycles_to_us(rdtsc() - start);
+
+    uint32_t rate = us != 0 ? (uint32_t)udiv64_32((uint64_t)received * 1000000, us, NULL) : 0;
+    kprintf("%-18s", name);
+    kprintf_color(LIGHT_BLUE_ON_BLACK, "%9u", rate);
+    kprintf(" msg/s  wakeups=%u full=%u", bench_channel.receiver_wakeups,
+            bench_channel.sender_sleeps);
+    if (ok && started == producers) {
+        print_string("  OK\n", LIGHT_GREEN_ON_BLACK);
+    } else {
+        print_string("  FAIL\n", LIGHT_RED_ON_BLACK);
+    }
+}
+
+void run_ipc_bench(int argc, char** argv) {
+    uint32_t messages = IPC_BENCH_DEFAULT_MESSAGES;
+    if (argc > 1) {
+        int value = atoi(argv[1]);
+        if (value > 0) {
+            messages = value;
+        }
+    }
+
+    kprintf("\nIPC channel throughput: %u messages per sender\n", messages);
+
+    ipc_bench_run("SPSC recv:", IPC_SPSC, 1, 1, messages);
+    ipc_bench_run("SPSC batch recv:", IPC_SPSC, 1, IPC_BENCH_BATCH, messages);
+    ipc_bench_run("MPSC x2 batch:", IPC_MPSC, IPC_BENCH_PRODUCERS, IPC_BENCH_BATCH, messages);
+}
@@ -0,0 +1,73 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../sync/sync.h"
+
+// Размер строки кэша: счетчики отправителя и получателя лежат в разных
+// строках, чтобы процессоры не перебрасывали их друг другу
+#define IPC_CACHE_LINE 64
+
+// Сообщение канала (копируется целиком)
+typedef struct {
+    uint32_t type;
+    uint32_t data[2];
+} ipc_msg_t;
+
+// Ячейка кольцевого буфера. seq используется только в канале MPSC.
+typedef struct {
+    volatile uint32_t seq;
+    ipc_msg_t msg;
+} ipc_slot_t;
+
+typedef enum {
+    IPC_SPSC,   // Один отправитель, один получатель (канал-труба)
+    IPC_MPSC    // Много отправителей, один получатель (входящие сервиса)
+} ipc_kind_t;
+
+// Канал на кольцевом буфере без блокировок. Получатель всегда один;
+// заблокированный получатель будится отправителем, заблокированные
+// отправители (буфер полон) - получателем.
+typedef struct {
+    // Сторона отправителей
+    volatile uint32_t tail __attribute__((aligned(IPC_CACHE_LINE)));
+    uint32_t head_cache;                // SPSC: последний виденный head
+    volatile uint32_t receiver_wakeups; // Сколько раз будили получателя
+
+    // Сторона получателя
+    volatile uint32_t head __attribute__((aligned(IPC_CACHE_LINE)));
+    uint32_t tail_cache;                // SPSC: последний виденный tail
+    uint32_t receiver_sleeps;           // Сколько раз получатель засыпал
+
+    // Общие поля, которые меняются редко
+    ipc_slot_t* slots __attribute__((aligned(IPC_CACHE_LINE)));
+    uint32_t mask;                      // Емкость - 1 (емкость - степень двойки)
+    ipc_kind_t kind;
+    struct thread* volatile receiver;   // Ждущий получатель
+    volatile uint32_t senders_waiting;  // Отправители, ждущие места
+    volatile uint32_t sender_sleeps;
+    wait_queue_t senders;
+} ipc_channel_t;
+
+// Инициализация канала над буфером slots из capacity ячеек. Емкость
+// должна быть степенью двойки; иначе возвращается false.
+bool ipc_channel_init(ipc_channel_t* ch, ipc_kind_t kind, ipc_slot_t* slots, uint32_t capacity);
+
+// Неблокирующие операции: false - буфер полон / пуст
+bool ipc_try_send(ipc_channel_t* ch, const ipc_msg_t* msg);
+bool ipc_try_recv(ipc_channel_t* ch, ipc_msg_t* msg);
+
+// Блокирующие операции. timeout_ms = 0 - без ограничения; false - таймаут.
+bool ipc_send(ipc_channel_t* ch, const ipc_msg_t* msg, uint32_t timeout_ms);
+bool ipc_recv(ipc_channel_t* ch, ipc_msg_t* msg, uint32_t timeout_ms);
+
+// Пакетное получение: ждет хотя бы одно сообщение (не дольше timeout_ms),
+// затем забирает все накопившиеся, но не больше max. Отправители будятся
+// один раз на пакет. Возвращает число полученных сообщений.
+uint32_t ipc_recv_batch(ipc_channel_t* ch, ipc_msg_t* msgs, uint32_t max, uint32_t timeout_ms);
+
+// Команда ipc-bench: пропускная способность каналов между потоками
+void run_ipc_bench(int argc, char** argv);
+
+#endif // IPC_H
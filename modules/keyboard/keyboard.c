@@ -0,0 +1,154 @@
+#include "keyboard.h"
+#include "../interrupts/interrupts.h"
+#include "../sync/sync.h"
+#include "../threads_and_processes/threads_and_processes.h"
+#include "../templates/io.h"
+
+// Префикс расширенных скан-кодов (стрелки, правые Ctrl/Alt и т.п.)
+#define SCANCODE_EXTENDED 0xE0
+#define SCANCODE_RELEASE 0x80
+
+// Таблица преобразования скан-кодов в ASCII
+static const char scancode_map[] = {
+    0, 0, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b', 0,
+    'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n', 0, 'a', 's',
+    'd', 'f', 'g', 'h', 'j', 'k', 'l', ';', '\'', '`', 0, '\\', 'z', 'x', 'c', 'v',
+    'b', 'n', 'm', ',', '.', '/', 0, '*', 0, ' ', 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, '7', '8', '9', '-', '4', '5', '6', '+', '1',
+    '2', '3', '0', '.'
+};
+
+// Кольцевой буфер ввода: символы клавиатуры (скан-коды переводятся в
+// обработчике IRQ1) и последовательного порта. Писатели - обработчики
+// прерываний - упорядочены producer_lock; читателей может быть несколько,
+// они забирают символ сравнением с обменом head без блокировки.
+static char buffer[KEYBOARD_BUFFER_SIZE];
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+static spinlock_t producer_lock = SPINLOCK_INIT;
+static bool extended = false;
+
+// Потоки, ждущие ввода
+static wait_queue_t readers = WAIT_QUEUE_INIT;
+static keyboard_stats_t stats;
+
+// Скан-код -> символ (0 для отпусканий и клавиш без символа)
+static char translate(uint8_t scancode);
+
+// Постановка символа в буфер (из обработчика прерывания)
+static void buffer_push(char c) {
+    spin_lock(&producer_lock);
+    uint32_t t = tail;
+    if (t - __atomic_load_n(&head, __ATOMIC_ACQUIRE) >= KEYBOARD_BUFFER_SIZE) {
+        stats.dropped++;
+    } else {
+        buffer[t & (KEYBOARD_BUFFER_SIZE - 1)] = c;
+        __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+    }
+    spin_unlock(&producer_lock);
+}
+
+static void keyboard_interrupt(interrupt_frame_t* frame) {
+    (void)frame;
+    stats.interrupts++;
+
+    while (inb(KEYBOARD_STATUS_PORT) & 0x01) {
+        char c = translate(inb(KEYBOARD_DATA_PORT));
+        if (c != 0) {
+            buffer_push(c);
+        }
+    }
+
+    // Будим под блокировкой очереди: читатель проверяет буфер под ней же,
+    // поэтому пробуждение не теряется
+    wait_queue_wake_all(&readers);
+}
+
+void keyboard_push_char(char c) {
+    buffer_push(c);
+    wait_queue_wake_all(&readers);
+}
+
+static bool buffer_pop(char* c) {
+    uint32_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    while (h != __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) {
+        char value = buffer[h & (KEYBOARD_BUFFER_SIZE - 1)];
+        if (__atomic_compare_exchange_n(&head, &h, h + 1, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *c = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool buffer_empty(void) {
+    return __atomic_load_n(&head, __ATOMIC_ACQUIRE) == __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+}
+
+// Состояние префикса 0xE0 меняет только обработчик IRQ1
+static char translate(uint8_t scancode) {
+    if (scancode == SCANCODE_EXTENDED) {
+        extended = true;
+        return 0;
+    }
+    // Расширенные клавиши совпадают по кодам с цифровым блоком: пропускаем
+    if (extended) {
+        extended = false;
+        return 0;
+    }
+    if ((scancode & SCANCODE_RELEASE) || scancode >= sizeof(scancode_map)) {
+        return 0;
+    }
+    return scancode_map[scancode];
+}
+
+void init_keyboard(void) {
+    // Сбрасываем то, что накопилось в контроллере до установки обработчика
+    while (inb(KEYBOARD_STATUS_PORT) & 0x01) {
+        inb(KEYBOARD_DATA_PORT);
+    }
+    register_interrupt_handler(IRQ_BASE + IRQ_KEYBOARD, keyboard_interrupt);
+    irq_unmask(IRQ_KEYBOARD);
+}
+
+char keyboard_try_char(void) {
+    char c;
+    return buffer_pop(&c) ? c : 0;
+}
+
+char keyboard_read_char(void) {
+    while (1) {
+        char c = keyboard_try_char();
+        if (c != 0) {
+            return c;
+        }
+
+        // Планировщик еще не запущен: ждем прерывания на hlt. Проверка и
+        // hlt идут с запрещенными прерываниями, «sti; hlt» атомарны.
+        if (get_current_thread() == NULL) {
+            irq_disable();
+            if (buffer_empty()) {
+                asm volatile("sti; hlt");
+            } else {
+                irq_enable();
+            }
+            continue;
+        }
+
+        uint32_t flags = spin_lock_irqsave(&readers.lock);
+        if (!buffer_empty()) {
+            spin_unlock_irqrestore(&readers.lock, flags);
+            continue;
+        }
+        wait_queue_add_locked(&readers);
+        spin_unlock(&readers.lock);
+        __atomic_fetch_add(&stats.sleeps, 1, __ATOMIC_RELAXED);
+        wait_queue_sleep(&readers, 0);
+        irq_restore(flags);
+    }
+}
+
+void keyboard_get_stats(keyboard_stats_t* out) {
+    *out = stats;
+}
@@ -0,0 +1,38 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Порты контроллера клавиатуры i8042
+#define KEYBOARD_DATA_PORT 0x60
+#define KEYBOARD_STATUS_PORT 0x64
+
+// Емкость кольцевого буфера ввода (степень двойки)
+#define KEYBOARD_BUFFER_SIZE 128
+
+// Статистика драйвера
+typedef struct {
+    uint32_t interrupts;    // Прерывания IRQ1
+    uint32_t dropped;       // Символы, потерянные из-за переполнения буфера
+    uint32_t sleeps;        // Сколько раз читатель засыпал в ожидании ввода
+} keyboard_stats_t;
+
+// Регистрация обработчика IRQ1 и демаскирование линии
+void init_keyboard(void);
+
+// Символ с клавиатуры. Вызывающий поток спит, пока нет ввода (до запуска
+// планировщика процессор ждет на hlt). Отпускания клавиш и клавиши без
+// символа пропускаются.
+char keyboard_read_char(void);
+
+// Символ без ожидания (0, если буфер пуст)
+char keyboard_try_char(void);
+
+// Символ из другого источника ввода консоли (последовательный порт).
+// Вызывается из обработчика прерывания.
+void keyboard_push_char(char c);
+
+void keyboard_get_stats(keyboard_stats_t* stats);
+
+#endif // KEYBOARD_H
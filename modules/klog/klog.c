@@ -0,0 +1,257 @@
+#include "klog.h"
+#include "../templates/kernel_api.h"
+#include "../cpu/cpu.h"
+#include "../sync/sync.h"
+#include "../timer/timer.h"
+#include "../threads_and_processes/threads_and_processes.h"
+#include "../templates/io.h"
+#include "../kprintf/kprintf.h"
+#include "../kstring/kstring.h"
+#include "../shell/shell.h"
+
+extern int atoi(const char *str);
+
+// Кольцевой буфер записей. Писатель занимает позицию атомарным инкрементом
+// head и помечает запись KLOG_WRITING; заполнив ее, публикует позицию в
+// committed. Читатель копирует запись и повторно сверяет committed: если
+// запись за это время начали перезаписывать, копия отбрасывается.
+static klog_record_t ring[KLOG_RING_SIZE];
+static volatile uint32_t head = 0;
+
+// Позиция следующей записи для консоли. Читатель один - тот, кто держит
+// drain_lock (поток вывода или, до его запуска, сам klog).
+static uint32_t tail = 0;
+static spinlock_t drain_lock = SPINLOCK_INIT;
+static volatile bool drain_started = false;
+
+static volatile int console_level = KLOG_INFO;
+static klog_stats_t stats;
+
+static const char* const level_names[] = { "err", "warn", "info", "debug" };
+
+// ============== Запись ==============
+
+void vklog(int level, const char* fmt, va_list args) {
+    if (level < KLOG_ERR) {
+        level = KLOG_ERR;
+    }
+    if (level > KLOG_DEBUG) {
+        level = KLOG_DEBUG;
+    }
+
+    // Запись заполняется с запрещенными прерываниями, чтобы писателя не
+    // вытеснили посередине и читатель не ждал его
+    uint32_t flags = irq_save();
+    uint32_t pos = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+    klog_record_t* record = &ring[pos & (KLOG_RING_SIZE - 1)];
+    __atomic_store_n(&record->committed, KLOG_WRITING, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    record->level = level;
+    record->cpu = this_cpu()->index;
+    record->tsc = rdtsc();
+    size_t length = kvsnprintf(record->text, KLOG_TEXT_SIZE, fmt, args);
+    if (length >= KLOG_TEXT_SIZE) {
+        length = KLOG_TEXT_SIZE - 1;
+        __atomic_fetch_add(&stats.truncated, 1, __ATOMIC_RELAXED);
+    }
+    // Перевод строки в конце не нужен: его добавляет вывод
+    while (length > 0 && record->text[length - 1] == '\n') {
+        record->text[--length] = '\0';
+    }
+    record->length = length;
+
+    __atomic_store_n(&record->committed, pos + 1, __ATOMIC_RELEASE);
+    irq_restore(flags);
+    __atomic_fetch_add(&stats.written, 1, __ATOMIC_RELAXED);
+
+    // Пока нет потока вывода, сообщения печатаются сразу
+    if (!drain_started) {
+        klog_flush();
+    }
+}
+
+void klog(int level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vklog(level, fmt, args);
+    va_end(args);
+}
+
+// ============== Чтение ==============
+
+typedef enum {
+    RECORD_OK,
+    RECORD_PENDING,     // Писатель еще заполняет запись
+    RECORD_LOST         // Запись уже перезаписана
+} record_state_t;
+
+static record_state_t read_record(uint32_t pos, klog_record_t* out) {
+    const klog_record_t* record = &ring[pos & (KLOG_RING_SIZE - 1)];
+    if (__atomic_load_n(&record->committed, __ATOMIC_ACQUIRE) != pos + 1) {
+        return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - pos > KLOG_RING_SIZE
+                   ? RECORD_LOST : RECORD_PENDING;
+    }
+
+    out->level = record->level;
+    out->cpu = record->cpu;
+    out->tsc = record->tsc;
+    uint32_t length = record->length;
+    if (length >= KLOG_TEXT_SIZE) {
+        length = KLOG_TEXT_SIZE - 1;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        out->text[i] = record->text[i];
+    }
+    out->text[length] = '\0';
+    out->length = length;
+
+    // Копия годна, только если запись не начали перезаписывать
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&record->committed, __ATOMIC_RELAXED) != pos + 1) {
+        return RECORD_LOST;
+    }
+    return RECORD_OK;
+}
+
+static void print_record(const klog_record_t* record) {
+    static const uint8_t level_colors[] = {
+        LIGHT_RED_ON_BLACK, YELLOW_ON_BLACK, LIGHT_GRAY_ON_BLACK, DARK_GRAY_ON_BLACK
+    };
+    uint64_t boot = timer_boot_tsc();
+    uint64_t us = record->tsc > boot ? timer_cycles_to_us(record->tsc - boot) : 0;
+    uint32_t usec;
+    uint32_t sec = (uint32_t)udiv64_32(us, 1000000, &usec);
+
+    char line[KLOG_TEXT_SIZE + 24];
+    ksnprintf(line, sizeof(line), "[%5u.%06u] %s\n", sec, usec, record->text);
+    print_string(line, level_colors[record->level]);
+}
+
+void klog_flush(void) {
+    if (!spin_trylock(&drain_lock)) {
+        return;
+    }
+    klog_record_t record;
+    while (1) {
+        uint32_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        if (tail == h) {
+            break;
+        }
+        // Писатели обогнали вывод на целый буфер
+        if (h - tail > KLOG_RING_SIZE) {
+            stats.lost += h - tail - KLOG_RING_SIZE;
+            tail = h - KLOG_RING_SIZE;
+        }
+        record_state_t state = read_record(tail, &record);
+        if (state == RECORD_PENDING) {
+            break;
+        }
+        if (state == RECORD_LOST) {
+            stats.lost++;
+        } else if (record.level > console_level) {
+            stats.filtered++;
+        } else {
+            print_record(&record);
+            stats.printed++;
+        }
+        tail++;
+    }
+    spin_unlock(&drain_lock);
+}
+
+// Поток вывода. Писатели его не будят (klog вызывается и под блокировками
+// планировщика), поэтому он опрашивает буфер раз в KLOG_DRAIN_MS.
+static void klog_drain_main(void) {
+    while (1) {
+        klog_flush();
+        thread_sleep(KLOG_DRAIN_MS);
+    }
+}
+
+// Команды оболочки
+static const shell_command_t klog_commands[] = {
+    { "dmesg", "[N | -n LEVEL]", "Kernel log / console log level", run_dmesg },
+};
+
+void init_klog(void) {
+    shell_register_all(klog_commands, sizeof(klog_commands) / sizeof(klog_commands[0]));
+    if (create_process(klog_drain_main, KLOG_DRAIN_PRIORITY) == NULL) {
+        klog(KLOG_ERR, "klog: cannot create drain thread");
+        return;
+    }
+    drain_started = true;
+}
+
+void klog_set_console_level(int level) {
+    if (level < KLOG_ERR) {
+        level = KLOG_ERR;
+    }
+    if (level > KLOG_DEBUG) {
+        level = KLOG_DEBUG;
+    }
+    console_level = level;
+}
+
+int klog_get_console_level(void) {
+    return console_level;
+}
+
+void klog_get_stats(klog_stats_t* out) {
+    *out = stats;
+}
+
+// ============== dmesg ==============
+
+static int parse_level(const char* str) {
+    for (int level = KLOG_ERR; level <= KLOG_DEBUG; level++) {
+        if (strcmp(str, level_names[level]) == 0) {
+            return level;
+        }
+    }
+    if (*str >= '0' && *str <= '9') {
+        return atoi(str);
+    }
+    return -1;
+}
+
+void run_dmesg(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "-n") == 0) {
+        int level = argc > 2 ? parse_level(argv[2]) : -1;
+        if (level < 0) {
+            print_string("Usage: dmesg [-n err|warn|info|debug] [N]\n", LIGHT_RED_ON_BLACK);
+            return;
+        }
+        klog_set_console_level(level);
+        char line[48];
+        ksnprintf(line, sizeof(line), "Console log level: %s\n",
+                    level_names[klog_get_console_level()]);
+        print_string(line, LIGHT_GREEN_ON_BLACK);
+        return;
+    }
+
+    // Последние count записей (по умолчанию весь буфер)
+    uint32_t count = KLOG_RING_SIZE;
+    if (argc > 1) {
+        int n = atoi(argv[1]);
+        if (n > 0 && n < KLOG_RING_SIZE) {
+            count = n;
+        }
+    }
+    uint32_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    uint32_t start = h > count ? h - count : 0;
+    klog_record_t record;
+    for (uint32_t pos = start; pos != h; pos++) {
+        if (read_record(pos, &record) == RECORD_OK) {
+            print_record(&record);
+        }
+    }
+
+    klog_stats_t s;
+    klog_get_stats(&s);
+    char line[96];
+    ksnprintf(line, sizeof(line),
+                "-- %u written, %u lost, %u truncated, console level %s\n",
+                s.written, s.lost, s.truncated, level_names[klog_get_console_level()]);
+    print_string(line, LIGHT_CYAN_ON_BLACK);
+}
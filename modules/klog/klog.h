@@ -0,0 +1,69 @@
+#ifndef KLOG_H
+#define KLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+// Уровни сообщений (меньше - важнее)
+#define KLOG_ERR 0
+#define KLOG_WARN 1
+#define KLOG_INFO 2
+#define KLOG_DEBUG 3
+
+// Записей в кольцевом буфере (степень двойки)
+#define KLOG_RING_SIZE 256
+// Наибольшая длина текста записи (с завершающим нулем)
+#define KLOG_TEXT_SIZE 112
+// Отметка записи, которую заполняет писатель
+#define KLOG_WRITING 0xFFFFFFFF
+
+// Поток вывода: приоритет и период опроса буфера
+#define KLOG_DRAIN_PRIORITY 1
+#define KLOG_DRAIN_MS 20
+
+// Запись журнала
+typedef struct {
+    volatile uint32_t committed;    // Позиция в журнале + 1; 0 - пусто, KLOG_WRITING - пишется
+    uint8_t level;
+    uint8_t cpu;
+    uint16_t length;
+    uint64_t tsc;                   // Время записи
+    char text[KLOG_TEXT_SIZE];
+} klog_record_t;
+
+// Статистика журнала
+typedef struct {
+    uint32_t written;       // Записей добавлено
+    uint32_t printed;       // Выведено на консоль
+    uint32_t filtered;      // Не выведено из-за уровня консоли
+    uint32_t lost;          // Перезаписаны раньше, чем их вывели
+    uint32_t truncated;     // Текст не поместился в запись
+} klog_stats_t;
+
+// Добавление сообщения в журнал. Не блокируется и не ждет консоль: запись
+// занимает место в кольцевом буфере атомарной операцией, на экран и в COM1
+// ее выводит отдельный поток. Можно вызывать из обработчиков прерываний и
+// под любыми блокировками. При переполнении затираются самые старые
+// записи. Формат: %s %c %d %i %u %x %X %p %%, ширина, '0', 'l', 'll'.
+void klog(int level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+void vklog(int level, const char* fmt, va_list args);
+
+// Запуск потока вывода (после init_process_manager). До этого записи
+// выводятся сразу в klog.
+void init_klog(void);
+
+// Вывод накопленных записей в вызывающем потоке
+void klog_flush(void);
+
+// Уровень, начиная с которого сообщения выводятся на консоль (в журнале
+// остаются все)
+void klog_set_console_level(int level);
+int klog_get_console_level(void);
+
+void klog_get_stats(klog_stats_t* stats);
+
+// Команда dmesg: содержимое журнала; "dmesg -n LEVEL" - уровень консоли
+void run_dmesg(int argc, char** argv);
+
+#endif // KLOG_H
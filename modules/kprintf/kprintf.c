@@ -0,0 +1,192 @@
+#include "kprintf.h"
+#include <stdbool.h>
+#include "../templates/kernel_api.h"
+#include "../templates/io.h"
+
+// Приемник вывода: пишет не больше size - 1 символов, но считает все
+typedef struct {
+    char* buf;
+    size_t size;
+    size_t length;
+} format_out_t;
+
+static void out_char(format_out_t* out, char c) {
+    if (out->length + 1 < out->size) {
+        out->buf[out->length] = c;
+    }
+    out->length++;
+}
+
+static void out_padding(format_out_t* out, char c, int count) {
+    while (count-- > 0) {
+        out_char(out, c);
+    }
+}
+
+static void out_number(format_out_t* out, uint64_t value, uint32_t base, bool upper,
+                       bool negative, int width, bool zero, bool left) {
+    const char* set = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char digits[24];
+    int count = 0;
+    // Деление 32-битным делителем: без __udivdi3 из libgcc
+    do {
+        uint32_t rem;
+        value = udiv64_32(value, base, &rem);
+        digits[count++] = set[rem];
+    } while (value != 0);
+
+    int pad = width - count - (negative ? 1 : 0);
+    if (!left && !zero) {
+        out_padding(out, ' ', pad);
+    }
+    if (negative) {
+        out_char(out, '-');
+    }
+    if (!left && zero) {
+        out_padding(out, '0', pad);
+    }
+    while (count > 0) {
+        out_char(out, digits[--count]);
+    }
+    if (left) {
+        out_padding(out, ' ', pad);
+    }
+}
+
+int kvsnprintf(char* buf, size_t size, const char* fmt, va_list args) {
+    format_out_t out = { buf, size, 0 };
+    while (*fmt) {
+        if (*fmt != '%') {
+            out_char(&out, *fmt++);
+            continue;
+        }
+        fmt++;
+
+        bool zero = false;
+        bool left = false;
+        while (*fmt == '0' || *fmt == '-') {
+            if (*fmt == '0') {
+                zero = true;
+            } else {
+                left = true;
+            }
+            fmt++;
+        }
+        int width = 0;
+        while (*fmt >= '0' && *fmt <= '9') {
+            width = width * 10 + (*fmt++ - '0');
+        }
+        int longs = 0;
+        while (*fmt == 'l') {
+            longs++;
+            fmt++;
+        }
+
+        switch (*fmt) {
+            case 'd':
+            case 'i': {
+                int64_t value = longs >= 2 ? va_arg(args, long long)
+                              : longs == 1 ? va_arg(args, long) : va_arg(args, int);
+                bool negative = value < 0;
+                out_number(&out, negative ? -(uint64_t)value : (uint64_t)value, 10, false,
+                           negative, width, zero, left);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X': {
+                uint64_t value = longs >= 2 ? va_arg(args, unsigned long long)
+                               : longs == 1 ? va_arg(args, unsigned long)
+                               : va_arg(args, unsigned int);
+                out_number(&out, value, *fmt == 'u' ? 10 : 16, *fmt == 'X', false,
+                           width, zero, left);
+                break;
+            }
+            case 'p':
+                out_char(&out, '0');
+                out_char(&out, 'x');
+                out_number(&out, (uintptr_t)va_arg(args, void*), 16, false, false, 8, true, false);
+                break;
+            case 's': {
+                const char* str = va_arg(args, const char*);
+                if (str == NULL) {
+                    str = "(null)";
+                }
+                int length = 0;
+                while (str[length]) {
+                    length++;
+                }
+                if (!left) {
+                    out_padding(&out, ' ', width - length);
+                }
+                while (*str) {
+                    out_char(&out, *str++);
+                }
+                if (left) {
+                    out_padding(&out, ' ', width - length);
+                }
+                break;
+            }
+            case 'c':
+                out_char(&out, (char)va_arg(args, int));
+                break;
+            case '%':
+                out_char(&out, '%');
+                break;
+            case '\0':
+                continue;
+            default:
+                out_char(&out, '%');
+                out_char(&out, *fmt);
+                break;
+        }
+        fmt++;
+    }
+    if (size > 0) {
+        buf[out.length < size ? out.length : size - 1] = '\0';
+    }
+    return out.length;
+}
+
+int ksnprintf(char* buf, size_t size, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int length = kvsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return length;
+}
+
+static int kvprintf_color(uint8_t color, const char* fmt, va_list args) {
+    char buf[KPRINTF_BUFFER_SIZE];
+    int length = kvsnprintf(buf, sizeof(buf), fmt, args);
+    print_string(buf, color);
+    return length;
+}
+
+int kprintf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int length = kvprintf_color(WHITE_ON_BLACK, fmt, args);
+    va_end(args);
+    return length;
+}
+
+int kprintf_color(uint8_t color, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int length = kvprintf_color(color, fmt, args);
+    va_end(args);
+    return length;
+}
+
+// Функция itoa (целое число в массив). Размер буфера не передается:
+// вызывающий отводит место под все цифры.
+void itoa(int num, char* str, int base) {
+    format_out_t out = { str, (size_t)-1, 0 };
+    if (base == 10 && num < 0) {
+        out_number(&out, -(uint64_t)(int64_t)num, 10, false, true, 0, false, false);
+    } else {
+        out_number(&out, (uint32_t)num, base, false, false, 0, false, false);
+    }
+    str[out.length] = '\0';
+}
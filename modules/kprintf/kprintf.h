@@ -0,0 +1,27 @@
+#ifndef KPRINTF_H
+#define KPRINTF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+// Наибольшая длина вывода одного вызова kprintf (длиннее - обрезается)
+#define KPRINTF_BUFFER_SIZE 256
+
+// Форматирование за один проход в buf (не более size байт с нулем).
+// Возвращает длину полного результата, как snprintf.
+// Спецификаторы: %d %i %u %x %X %c %s %p %%; флаги '-' (влево) и '0';
+// ширина; модификаторы 'l' и 'll' (64 бита).
+int kvsnprintf(char* buf, size_t size, const char* fmt, va_list args);
+int ksnprintf(char* buf, size_t size, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Форматирование и вывод на консоль одной записью (строка не смешивается
+// с выводом других потоков)
+int kprintf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+int kprintf_color(uint8_t color, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Целое число в строку (для base != 10 - как беззнаковое)
+void itoa(int num, char* str, int base);
+
+#endif // KPRINTF_H
@@ -0,0 +1,668 @@
+#include "kstring.h"
+#include "../templates/kernel_api.h"
+#include "../templates/io.h"
+#include "../cpu/cpu.h"
+#include "../timer/timer.h"
+#include "../kprintf/kprintf.h"
+#include "../shell/shell.h"
+
+extern int atoi(const char *str);
+
+// Побайтовые циклы ниже GCC распознает как memcpy/memset и заменяет
+// вызовами - функции вызывали бы сами себя
+#pragma GCC optimize("no-tree-loop-distribute-patterns")
+
+// CPUID.(EAX=7,ECX=0):EBX бит 9 - Enhanced REP MOVSB/STOSB
+#define CPUID_EXT_FEATURE_ERMSB (1u << 9)
+
+// Слово по произвольному адресу: x86 допускает невыровненный доступ
+typedef uint32_t unaligned_u32 __attribute__((aligned(1), may_alias));
+
+static bool ermsb = false;
+
+// Команды оболочки
+static const shell_command_t kstring_commands[] = {
+    { "mem-bench", "[A]", "memset/memcpy/memmove/memcmp speed, 8 B - 1 MiB", run_mem_bench },
+    { "string-test", NULL, "Check and time the word-at-a-time string routines", run_string_test },
+};
+
+void init_kstring(void) {
+    shell_register_all(kstring_commands, sizeof(kstring_commands) / sizeof(kstring_commands[0]));
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    if (eax >= 7) {
+        cpuid(7, &eax, &ebx, &ecx, &edx);
+        ermsb = (ebx & CPUID_EXT_FEATURE_ERMSB) != 0;
+    }
+}
+
+bool kstring_has_ermsb(void) {
+    return ermsb;
+}
+
+// ============== Заполнение и копирование ==============
+
+void* memset(void* ptr, int value, size_t num) {
+    uint8_t* p = ptr;
+    uint8_t byte = (uint8_t)value;
+    uint32_t word = byte * 0x01010101u;
+
+    if (num < KSTRING_REP_THRESHOLD) {
+        while (num >= 4) {
+            *(unaligned_u32*)p = word;
+            p += 4;
+            num -= 4;
+        }
+        while (num--) {
+            *p++ = byte;
+        }
+        return ptr;
+    }
+
+    if (ermsb && num >= KSTRING_ERMSB_THRESHOLD) {
+        asm volatile ("rep stosb" : "+D" (p), "+c" (num) : "a" (byte) : "memory");
+        return ptr;
+    }
+
+    // Начало до границы слова, затем слова, затем остаток
+    while ((uintptr_t)p & 3) {
+        *p++ = byte;
+        num--;
+    }
+    size_t words = num >> 2;
+    asm volatile ("rep stosl" : "+D" (p), "+c" (words) : "a" (word) : "memory");
+    num &= 3;
+    while (num--) {
+        *p++ = byte;
+    }
+    return ptr;
+}
+
+// Копирование вперед словами; годится и для перекрытия с dest < src
+static inline void copy_forward_small(uint8_t* d, const uint8_t* s, size_t num) {
+    while (num >= 4) {
+        *(unaligned_u32*)d = *(const unaligned_u32*)s;
+        d += 4;
+        s += 4;
+        num -= 4;
+    }
+    while (num--) {
+        *d++ = *s++;
+    }
+}
+
+void* memcpy(void* dest, const void* src, size_t num) {
+    uint8_t* d = dest;
+    const uint8_t* s = src;
+
+    if (num < KSTRING_REP_THRESHOLD) {
+        copy_forward_small(d, s, num);
+        return dest;
+    }
+
+    if (ermsb && num >= KSTRING_ERMSB_THRESHOLD) {
+        asm volatile ("rep movsb" : "+D" (d), "+S" (s), "+c" (num) : : "memory");
+        return dest;
+    }
+
+    // Выравнивается приемник: невыровненная запись дороже невыровненного чтения
+    while ((uintptr_t)d & 3) {
+        *d++ = *s++;
+        num--;
+    }
+    size_t words = num >> 2;
+    asm volatile ("rep movsl" : "+D" (d), "+S" (s), "+c" (words) : : "memory");
+    num &= 3;
+    while (num--) {
+        *d++ = *s++;
+    }
+    return dest;
+}
+
+void* memmove(void* dest, const void* src, size_t num) {
+    uint8_t* d = dest;
+    const uint8_t* s = src;
+
+    // Копирование вперед портит источник, только если приемник правее
+    // него и области перекрываются
+    if (d <= s || d >= s + num) {
+        return memcpy(dest, src, num);
+    }
+
+    d += num;
+    s += num;
+    if (num < KSTRING_REP_THRESHOLD) {
+        while (num >= 4) {
+            d -= 4;
+            s -= 4;
+            num -= 4;
+            *(unaligned_u32*)d = *(const unaligned_u32*)s;
+        }
+        while (num--) {
+            *--d = *--s;
+        }
+        return dest;
+    }
+
+    // Сначала хвост, затем слова от конца к началу (DF=1). Обработчики
+    // прерываний сбрасывают DF на входе, а iret восстанавливает его.
+    size_t tail = num & 3;
+    while (tail--) {
+        *--d = *--s;
+    }
+    size_t words = num >> 2;
+    d -= 4;
+    s -= 4;
+    asm volatile ("std\n\t"
+                  "rep movsl\n\t"
+                  "cld"
+                  : "+D" (d), "+S" (s), "+c" (words) : : "memory");
+    return dest;
+}
+
+int memcmp(const void* s1, const void* s2, size_t num) {
+    const uint8_t* a = s1;
+    const uint8_t* b = s2;
+
+    while (num >= 4) {
+        uint32_t x = *(const unaligned_u32*)a;
+        uint32_t y = *(const unaligned_u32*)b;
+        if (x != y) {
+            // Первый по адресу байт - младший в слове: после перестановки
+            // байтов слова сравниваются как числа
+            return __builtin_bswap32(x) < __builtin_bswap32(y) ? -1 : 1;
+        }
+        a += 4;
+        b += 4;
+        num -= 4;
+    }
+    while (num--) {
+        if (*a != *b) {
+            return *a - *b;
+        }
+        a++;
+        b++;
+    }
+    return 0;
+}
+
+// ============== Строки ==============
+
+// Проверка слова на нулевой байт: результат не ноль, если он есть
+#define KSTRING_ONES 0x01010101u
+#define KSTRING_HIGHS 0x80808080u
+#define HAS_ZERO(v) (((v) - KSTRING_ONES) & ~(v) & KSTRING_HIGHS)
+
+#define KSTRING_PAGE_SIZE 4096
+
+// Выровненное слово внутри строки (доступ в обход правил алиасинга)
+typedef uint32_t aliased_u32 __attribute__((may_alias));
+
+// Невыровненное слово с адреса p не заходит на следующую страницу
+static inline bool word_in_page(const uint8_t* p) {
+    return ((uintptr_t)p & (KSTRING_PAGE_SIZE - 1)) <= KSTRING_PAGE_SIZE - 4;
+}
+
+size_t strlen(const char* str) {
+    const char* p = str;
+    while ((uintptr_t)p & 3) {
+        if (*p == '\0') {
+            return p - str;
+        }
+        p++;
+    }
+    while (!HAS_ZERO(*(const aliased_u32*)p)) {
+        p += 4;
+    }
+    while (*p) {
+        p++;
+    }
+    return p - str;
+}
+
+size_t strnlen(const char* str, size_t max) {
+    const char* p = str;
+    while (max && ((uintptr_t)p & 3)) {
+        if (*p == '\0') {
+            return p - str;
+        }
+        p++;
+        max--;
+    }
+    while (max >= 4 && !HAS_ZERO(*(const aliased_u32*)p)) {
+        p += 4;
+        max -= 4;
+    }
+    while (max && *p) {
+        p++;
+        max--;
+    }
+    return p - str;
+}
+
+char* strchr(const char* s, int c) {
+    char ch = (char)c;
+    while ((uintptr_t)s & 3) {
+        if (*s == ch) {
+            return (char*)s;
+        }
+        if (*s == '\0') {
+            return NULL;
+        }
+        s++;
+    }
+    // Слово пропускается, если в нем нет ни терминатора, ни искомого байта
+    uint32_t pattern = (uint8_t)ch * KSTRING_ONES;
+    for (;;) {
+        uint32_t word = *(const aliased_u32*)s;
+        if (HAS_ZERO(word) || HAS_ZERO(word ^ pattern)) {
+            break;
+        }
+        s += 4;
+    }
+    for (;; s++) {
+        if (*s == ch) {
+            return (char*)s;
+        }
+        if (*s == '\0') {
+            return NULL;
+        }
+    }
+}
+
+int strncmp(const char* s1, const char* s2, size_t n) {
+    const uint8_t* a = (const uint8_t*)s1;
+    const uint8_t* b = (const uint8_t*)s2;
+
+    // s1 читается выровненными словами, s2 - как придется; слово s2 на
+    // стыке страниц сравнивается по байту
+    while (n && ((uintptr_t)a & 3)) {
+        if (*a != *b || *a == '\0') {
+            return *a - *b;
+        }
+        a++;
+        b++;
+        n--;
+    }
+    while (n >= 4) {
+        if (word_in_page(b)) {
+            uint32_t x = *(const aliased_u32*)a;
+            uint32_t y = *(const unaligned_u32*)b;
+            if (x != y || HAS_ZERO(x)) {
+                break;
+            }
+            a += 4;
+            b += 4;
+            n -= 4;
+        } else {
+            for (int i = 0; i < 4; i++, a++, b++, n--) {
+                if (*a != *b || *a == '\0') {
+                    return *a - *b;
+                }
+            }
+        }
+    }
+    while (n) {
+        if (*a != *b || *a == '\0') {
+            return *a - *b;
+        }
+        a++;
+        b++;
+        n--;
+    }
+    return 0;
+}
+
+int strcmp(const char* s1, const char* s2) {
+    return strncmp(s1, s2, (size_t)-1);
+}
+
+char* strncpy(char* dest, const char* src, size_t n) {
+    size_t length = strnlen(src, n);
+    memcpy(dest, src, length);
+    memset(dest + length, 0, n - length);
+    return dest;
+}
+
+char* strncat(char* dest, const char* src, size_t n) {
+    char* end = dest + strlen(dest);
+    size_t length = strnlen(src, n);
+    memcpy(end, src, length);
+    end[length] = '\0';
+    return dest;
+}
+
+// ============== Команда mem-bench ==============
+
+#define MEM_BENCH_MIN_SIZE 8
+#define MEM_BENCH_MAX_SIZE (1024 * 1024)
+#define MEM_BENCH_BYTES (4 * 1024 * 1024)   // Объем данных на один замер
+#define MEM_BENCH_MIN_CALLS 4
+#define MEM_BENCH_PASSES 3                  // Берется лучший из проходов
+#define MEM_BENCH_SLACK 64                  // Запас под сдвиг и перекрытие
+
+static uint8_t bench_src[MEM_BENCH_MAX_SIZE + MEM_BENCH_SLACK] __attribute__((aligned(64)));
+static uint8_t bench_dst[MEM_BENCH_MAX_SIZE + MEM_BENCH_SLACK] __attribute__((aligned(64)));
+static volatile int bench_sink;
+
+typedef void (*mem_bench_fn_t)(uint8_t* dst, uint8_t* src, size_t size);
+
+static void bench_memset(uint8_t* dst, uint8_t* src, size_t size) {
+    (void)src;
+    memset(dst, 0x5A, size);
+}
+
+static void bench_memcpy(uint8_t* dst, uint8_t* src, size_t size) {
+    memcpy(dst, src, size);
+}
+
+// Буферы равны после memcpy: сравнение проходит блок целиком
+static void bench_memcmp(uint8_t* dst, uint8_t* src, size_t size) {
+    bench_sink += memcmp(dst, src, size);
+}
+
+// Перекрывающийся сдвиг вправо - копирование от конца к началу
+static void bench_memmove(uint8_t* dst, uint8_t* src, size_t size) {
+    (void)src;
+    memmove(dst + 8, dst, size);
+}
+
+// Прежняя реализация: по байту за итерацию
+static void bench_bytewise(uint8_t* dst, uint8_t* src, size_t size) {
+    while (size--) {
+        *dst++ = *src++;
+    }
+}
+
+typedef struct {
+    const char* name;
+    mem_bench_fn_t fn;
+} mem_bench_op_t;
+
+// Порядок важен: memcmp идет после memcpy, memmove портит приемник последним
+static const mem_bench_op_t bench_ops[] = {
+    { "memset", bench_memset },
+    { "memcpy", bench_memcpy },
+    { "memcmp", bench_memcmp },
+    { "memmove", bench_memmove },
+    { "bytewise", bench_bytewise },
+};
+
+#define MEM_BENCH_OPS (sizeof(bench_ops) / sizeof(bench_ops[0]))
+
+static uint64_t bench_cycles(mem_bench_fn_t fn, uint8_t* dst, uint8_t* src,
+                             size_t size, uint32_t calls) {
+    uint64_t best = ~0ULL;
+    for (int pass = 0; pass < MEM_BENCH_PASSES; pass++) {
+        uint64_t start = rdtsc();
+        for (uint32_t i = 0; i < calls; i++) {
+            fn(dst, src, size);
+        }
+        uint64_t cycles = rdtsc() - start;
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+    return best;
+}
+
+// Скорость в МБ/с (10^6 байт) по числу тактов TSC
+static uint32_t rate_mb_per_s(uint64_t bytes, uint64_t cycles) {
+    // Делитель udiv64_32 - 32-битный
+    while (cycles > 0xFFFFFFFFULL) {
+        cycles >>= 1;
+        bytes >>= 1;
+    }
+    if (cycles == 0) {
+        return 0;
+    }
+    uint32_t rem;
+    uint64_t bytes_per_ms = udiv64_32(bytes * timer_tsc_per_ms(), (uint32_t)cycles, &rem);
+    return (uint32_t)udiv64_32(bytes_per_ms, 1000, &rem);
+}
+
+static void format_size(char* buf, size_t buf_size, uint32_t size) {
+    if (size >= 1024 * 1024) {
+        ksnprintf(buf, buf_size, "%u MiB", size >> 20);
+    } else if (size >= 1024) {
+        ksnprintf(buf, buf_size, "%u KiB", size >> 10);
+    } else {
+        ksnprintf(buf, buf_size, "%u B", size);
+    }
+}
+
+void run_mem_bench(int argc, char** argv) {
+    // Необязательный сдвиг приемника от границы слова (0-3)
+    int misalign = argc > 1 ? atoi(argv[1]) & 3 : 0;
+    if (timer_tsc_per_ms() == 0) {
+        print_string("Timer is not calibrated\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+
+    uint8_t* dst = bench_dst + misalign;
+    uint8_t* src = bench_src;
+    for (uint32_t i = 0; i < sizeof(bench_src); i++) {
+        bench_src[i] = (uint8_t)(i * 7 + 1);
+    }
+
+    kprintf_color(LIGHT_GREEN_ON_BLACK,
+                  "Memory routines, MB/s (ERMSB: %s, rep from %u B, dst misalign %d)\n",
+                  ermsb ? "yes" : "no", KSTRING_REP_THRESHOLD, misalign);
+    kprintf_color(LIGHT_GREEN_ON_BLACK, "%-9s", "Size");
+    for (uint32_t op = 0; op < MEM_BENCH_OPS; op++) {
+        kprintf_color(LIGHT_GREEN_ON_BLACK, "%10s", bench_ops[op].name);
+    }
+    print_string("\n", LIGHT_GREEN_ON_BLACK);
+
+    for (uint32_t size = MEM_BENCH_MIN_SIZE; size <= MEM_BENCH_MAX_SIZE; size <<= 1) {
+        uint32_t calls = MEM_BENCH_BYTES / size;
+        if (calls < MEM_BENCH_MIN_CALLS) {
+            calls = MEM_BENCH_MIN_CALLS;
+        }
+
+        // Строка собирается целиком и выводится одной записью
+        char line[96];
+        char size_str[16];
+        format_size(size_str, sizeof(size_str), size);
+        int length = ksnprintf(line, sizeof(line), "%-9s", size_str);
+        for (uint32_t op = 0; op < MEM_BENCH_OPS; op++) {
+            uint64_t cycles = bench_cycles(bench_ops[op].fn, dst, src, size, calls);
+            uint32_t rate = rate_mb_per_s((uint64_t)size * calls, cycles);
+            length += ksnprintf(line + length, sizeof(line) - length, "%10u", rate);
+        }
+        ksnprintf(line + length, sizeof(line) - length, "\n");
+        print_string(line, WHITE_ON_BLACK);
+    }
+}
+
+// ============== Команда string-test ==============
+
+#define STRING_TEST_MAX_LENGTH 40
+#define STRING_TEST_SPEED_LENGTH 1023
+#define STRING_TEST_SPEED_CALLS 1000
+
+// Две страницы: строки кладутся вплотную к концу первой, чтобы слова
+// доходили до границы страницы
+static char test_pages[2 * KSTRING_PAGE_SIZE] __attribute__((aligned(KSTRING_PAGE_SIZE)));
+
+static uint32_t test_checks;
+static uint32_t test_failures;
+
+static void test_check(bool ok, const char* what, int a, int b) {
+    test_checks++;
+    if (!ok) {
+        // Подробно выводятся только первые ошибки
+        if (test_failures < 8) {
+            kprintf_color(LIGHT_RED_ON_BLACK, "  FAIL %s (%d, %d)\n", what, a, b);
+        }
+        test_failures++;
+    }
+}
+
+// Побайтовые эталоны
+static size_t ref_strlen(const char* s) {
+    size_t length = 0;
+    while (s[length]) {
+        length++;
+    }
+    return length;
+}
+
+static const char* ref_strchr(const char* s, char c) {
+    for (;; s++) {
+        if (*s == c) {
+            return s;
+        }
+        if (*s == '\0') {
+            return NULL;
+        }
+    }
+}
+
+static int ref_strncmp(const char* s1, const char* s2, size_t n) {
+    const uint8_t* a = (const uint8_t*)s1;
+    const uint8_t* b = (const uint8_t*)s2;
+    for (; n; a++, b++, n--) {
+        if (*a != *b || *a == '\0') {
+            return *a - *b;
+        }
+    }
+    return 0;
+}
+
+static int sign(int value) {
+    return (value > 0) - (value < 0);
+}
+
+// Строка длины length в буфере: в начале второй страницы со сдвигом align
+// или вплотную к концу первой (терминатор - последний байт страницы)
+static char* place_string(int length, int align, bool at_page_end) {
+    char* s = at_page_end ? test_pages + KSTRING_PAGE_SIZE - 1 - length
+                          : test_pages + KSTRING_PAGE_SIZE + align;
+    for (int i = 0; i < length; i++) {
+        // Есть байты со старшим битом: сравнение должно быть беззнаковым
+        s[i] = (char)(0x61 + (i * 13) % 0x90);
+    }
+    s[length] = '\0';
+    return s;
+}
+
+static void test_lengths(void) {
+    for (int placement = 0; placement < 2; placement++) {
+        for (int align = 0; align < 8; align++) {
+            for (int length = 0; length <= STRING_TEST_MAX_LENGTH; length++) {
+                char* s = place_string(length, align, placement == 1);
+                test_check(strlen(s) == (size_t)length, "strlen", length, align);
+                size_t limits[] = { 0, length / 2, length, length + 5 };
+                for (int i = 0; i < 4; i++) {
+                    size_t expected = limits[i] < (size_t)length ? limits[i] : (size_t)length;
+                    test_check(strnlen(s, limits[i]) == expected, "strnlen", length, (int)limits[i]);
+                }
+            }
+        }
+    }
+}
+
+static void test_strchr(void) {
+    for (int placement = 0; placement < 2; placement++) {
+        for (int align = 0; align < 8; align++) {
+            for (int length = 0; length <= STRING_TEST_MAX_LENGTH; length++) {
+                char* s = place_string(length, align, placement == 1);
+                for (int i = 0; i < length; i++) {
+                    test_check(strchr(s, s[i]) == ref_strchr(s, s[i]), "strchr", length, i);
+                }
+                test_check(strchr(s, '\0') == s + length, "strchr nul", length, align);
+                test_check(strchr(s, '#') == NULL, "strchr absent", length, align);
+            }
+        }
+    }
+}
+
+static void test_compare(void) {
+    for (int align = 0; align < 4; align++) {
+        for (int length = 0; length <= STRING_TEST_MAX_LENGTH / 2; length++) {
+            // s2 у конца страницы (невыровненные слова на стыке), s1 - с
+            // разными сдвигами во второй странице
+            char* s2 = place_string(length, 0, true);
+            char* s1 = test_pages + KSTRING_PAGE_SIZE + align;
+            for (int diff = 0; diff <= length; diff++) {
+                memcpy(s1, s2, length + 1);
+                if (diff < length) {
+                    // 0x7F против байта со старшим битом и наоборот
+                    s1[diff] = (uint8_t)s2[diff] >= 0x80 ? 0x7F : (char)0xE0;
+                }
+                test_check(sign(strcmp(s1, s2)) == sign(ref_strncmp(s1, s2, (size_t)-1)),
+                           "strcmp", length, diff);
+                test_check(sign(strcmp(s2, s1)) == sign(ref_strncmp(s2, s1, (size_t)-1)),
+                           "strcmp swapped", length, diff);
+                size_t limits[] = { 0, diff, diff + 1, length + 1 };
+                for (int i = 0; i < 4; i++) {
+                    test_check(sign(strncmp(s1, s2, limits[i])) ==
+                               sign(ref_strncmp(s1, s2, limits[i])), "strncmp", length, (int)limits[i]);
+                }
+            }
+        }
+    }
+}
+
+static void test_copy(void) {
+    char buf[32];
+    for (int align = 0; align < 4; align++) {
+        char* s = place_string(10, align, false);
+
+        memset(buf, 'x', sizeof(buf));
+        strncpy(buf, s, 16);
+        bool padded = true;
+        for (int i = 10; i < 16; i++) {
+            padded = padded && buf[i] == '\0';
+        }
+        test_check(strncmp(buf, s, 11) == 0 && padded && buf[16] == 'x', "strncpy pad", align, 16);
+
+        memset(buf, 'x', sizeof(buf));
+        strncpy(buf, s, 4);
+        test_check(memcmp(buf, s, 4) == 0 && buf[4] == 'x', "strncpy cut", align, 4);
+
+        strncpy(buf, "ab", sizeof(buf));
+        strncat(buf, s, 5);
+        test_check(strlen(buf) == 7 && memcmp(buf + 2, s, 5) == 0, "strncat cut", align, 5);
+        strncat(buf, "", 3);
+        strncat(buf, "yz", 10);
+        test_check(strlen(buf) == 9 && strcmp(buf + 7, "yz") == 0, "strncat", align, 10);
+    }
+}
+
+static uint64_t string_cycles(int which, const char* s1, const char* s2) {
+    uint64_t start = rdtsc();
+    for (int i = 0; i < STRING_TEST_SPEED_CALLS; i++) {
+        switch (which) {
+            case 0: bench_sink += strlen(s1); break;
+            case 1: bench_sink += ref_strlen(s1); break;
+            case 2: bench_sink += strcmp(s1, s2); break;
+            default: bench_sink += ref_strncmp(s1, s2, (size_t)-1); break;
+        }
+    }
+    uint32_t rem;
+    return udiv64_32(rdtsc() - start, STRING_TEST_SPEED_CALLS, &rem);
+}
+
+void run_string_test(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    test_checks = 0;
+    test_failures = 0;
+    test_lengths();
+    test_strchr();
+    test_compare();
+    test_copy();
+    kprintf_color(test_failures ? LIGHT_RED_ON_BLACK : LIGHT_GREEN_ON_BLACK,
+                  "string-test: %u checks, %u failed\n", test_checks, test_failures);
+
+    // Скорость на длинной строке: сравниваемые строки с разным выравниванием
+    char* s1 = place_string(STRING_TEST_SPEED_LENGTH, 0, false);
+    char* s2 = test_pages + 1;
+    memcpy(s2, s1, STRING_TEST_SPEED_LENGTH + 1);
+    kprintf("strlen %u B: %u cycles (bytewise %u)\n", STRING_TEST_SPEED_LENGTH,
+            (uint32_t)string_cycles(0, s1, s2), (uint32_t)string_cycles(1, s1, s2));
+    kprintf("strcmp %u B: %u cycles (bytewise %u)\n", STRING_TEST_SPEED_LENGTH,
+            (uint32_t)string_cycles(2, s1, s2), (uint32_t)string_cycles(3, s1, s2));
+}
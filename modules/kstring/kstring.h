@@ -0,0 +1,49 @@
+#ifndef KSTRING_H
+#define KSTRING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Размер, начиная с которого копирование и заполнение идут строковыми
+// инструкциями (rep movs/stos): меньшие блоки быстрее обычными словами,
+// чем с накладными расходами запуска rep
+#define KSTRING_REP_THRESHOLD 64
+
+// С ERMSB (Enhanced REP MOVSB/STOSB) побайтовые rep movsb/stosb быстрее
+// rep movsd/stosd на блоках от этого размера
+#define KSTRING_ERMSB_THRESHOLD 512
+
+// Стандартные функции работы с памятью. GCC при -O2 сам вставляет вызовы
+// memcpy/memset (копирование структур, обнуление массивов).
+void* memset(void* ptr, int value, size_t num);
+void* memcpy(void* dest, const void* src, size_t num);
+void* memmove(void* dest, const void* src, size_t num);
+int memcmp(const void* s1, const void* s2, size_t num);
+
+// Строковые функции. Строки просматриваются выровненными 32-битными
+// словами: выровненное слово не пересекает границу страницы, поэтому
+// чтение за терминатором не выходит за страницу, где лежит строка.
+size_t strlen(const char* str);
+size_t strnlen(const char* str, size_t max);
+char* strchr(const char* s, int c);
+int strcmp(const char* s1, const char* s2);
+int strncmp(const char* s1, const char* s2, size_t n);
+char* strncpy(char* dest, const char* src, size_t n);
+char* strncat(char* dest, const char* src, size_t n);
+
+// Определение возможностей процессора (ERMSB). До вызова используются
+// rep movsd/stosd, которые есть на любом процессоре.
+void init_kstring(void);
+
+bool kstring_has_ermsb(void);
+
+// Команда mem-bench: скорость memset/memcpy/memmove/memcmp и побайтового
+// копирования на блоках от 8 байт до 1 МиБ
+void run_mem_bench(int argc, char** argv);
+
+// Команда string-test: проверка строковых функций по побайтовым эталонам
+// на всех выравниваниях и у границы страницы, и их скорость
+void run_string_test(int argc, char** argv);
+
+#endif // KSTRING_H
@@ -0,0 +1,248 @@
+#include "serial.h"
+#include "../interrupts/interrupts.h"
+#include "../keyboard/keyboard.h"
+#include "../sync/sync.h"
+#include "../cpu/cpu.h"
+#include "../threads_and_processes/threads_and_processes.h"
+#include "../templates/io.h"
+
+// Регистры 16550 (смещения от базового порта)
+#define UART_DATA 0         // RBR/THR (DLAB=0), младший байт делителя (DLAB=1)
+#define UART_IER 1          // Разрешение прерываний, старший байт делителя (DLAB=1)
+#define UART_IIR 2          // Идентификация прерывания (чтение)
+#define UART_FCR 2          // Управление FIFO (запись)
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+#define UART_MSR 6
+
+#define IER_RX_AVAILABLE 0x01
+#define IER_TX_EMPTY 0x02
+#define IER_LINE_STATUS 0x04
+
+#define IIR_NO_INTERRUPT 0x01
+#define IIR_ID_MASK 0x0E
+#define IIR_MODEM_STATUS 0x00
+#define IIR_TX_EMPTY 0x02
+#define IIR_RX_AVAILABLE 0x04
+#define IIR_LINE_STATUS 0x06
+#define IIR_RX_TIMEOUT 0x0C
+
+#define FCR_ENABLE_CLEAR_14 0xC7    // FIFO включены и очищены, порог приема 14 байт
+#define LCR_DLAB 0x80
+#define LCR_8N1 0x03
+#define MCR_DTR_RTS_OUT2 0x0B       // OUT2 пропускает прерывания UART на контроллер
+#define MCR_LOOPBACK 0x1E
+
+#define LSR_DATA_READY 0x01
+#define LSR_OVERRUN 0x02
+#define LSR_THR_EMPTY 0x20
+
+#define PORT(reg) (SERIAL_COM1 + (reg))
+
+#define EFLAGS_IF 0x200
+
+static bool present = false;
+
+// Кольцевой буфер передачи. Пишут потоки и обработчики под tx_lock,
+// опустошает его обработчик прерывания THRE (или сам писатель, если
+// передатчик простаивает).
+static spinlock_t tx_lock = SPINLOCK_INIT;
+static char tx_buffer[SERIAL_TX_BUFFER_SIZE];
+static uint32_t tx_head = 0;
+static uint32_t tx_tail = 0;
+// В FIFO передатчика есть байты: следующую порцию загрузит прерывание THRE
+static bool tx_busy = false;
+
+// Потоки, ждущие места в буфере. Прерывание THRE будит их, когда
+// освобождается половина буфера.
+static wait_queue_t tx_space = WAIT_QUEUE_INIT;
+static volatile uint32_t tx_waiters = 0;
+
+static serial_stats_t stats;
+
+// Загрузка в пустой FIFO передатчика до SERIAL_FIFO_SIZE байт (под tx_lock)
+static void tx_fill_fifo(void) {
+    if (!(inb(PORT(UART_LSR)) & LSR_THR_EMPTY)) {
+        return;
+    }
+    uint32_t count = 0;
+    while (count < SERIAL_FIFO_SIZE && tx_head != tx_tail) {
+        outb(PORT(UART_DATA), tx_buffer[tx_head & (SERIAL_TX_BUFFER_SIZE - 1)]);
+        tx_head++;
+        count++;
+    }
+    stats.tx_bytes += count;
+    tx_busy = count != 0;
+}
+
+static uint32_t tx_room(void) {
+    return SERIAL_TX_BUFFER_SIZE - (tx_tail - tx_head);
+}
+
+// Вывод не ждет линию никогда: место заранее ждет serial_wait_room, а
+// байты, которым его все же не хватило, отбрасываются
+static void tx_push(char c) {
+    if (tx_room() == 0) {
+        stats.tx_dropped++;
+        return;
+    }
+    tx_buffer[tx_tail & (SERIAL_TX_BUFFER_SIZE - 1)] = c;
+    tx_tail++;
+}
+
+static void serial_interrupt(interrupt_frame_t* frame) {
+    (void)frame;
+    while (1) {
+        uint8_t iir = inb(PORT(UART_IIR));
+        if (iir & IIR_NO_INTERRUPT) {
+            break;
+        }
+        switch (iir & IIR_ID_MASK) {
+            case IIR_LINE_STATUS:
+                if (inb(PORT(UART_LSR)) & LSR_OVERRUN) {
+                    stats.rx_overruns++;
+                }
+                break;
+            case IIR_RX_AVAILABLE:
+            case IIR_RX_TIMEOUT:
+                // Принятые символы идут в общий буфер ввода консоли
+                while (inb(PORT(UART_LSR)) & LSR_DATA_READY) {
+                    char c = inb(PORT(UART_DATA));
+                    stats.rx_bytes++;
+                    if (c == '\r') {
+                        c = '\n';
+                    } else if (c == 0x7F) {
+                        c = '\b';
+                    }
+                    keyboard_push_char(c);
+                }
+                break;
+            case IIR_TX_EMPTY:
+                spin_lock(&tx_lock);
+                tx_fill_fifo();
+                spin_unlock(&tx_lock);
+                smp_mb();
+                if (tx_waiters != 0 && tx_room() >= SERIAL_TX_BUFFER_SIZE / 2) {
+                    wait_queue_wake_all(&tx_space);
+                }
+                break;
+            default:
+                (void)inb(PORT(UART_MSR));
+                break;
+        }
+    }
+}
+
+bool init_serial(void) {
+    outb(PORT(UART_IER), 0);
+    outb(PORT(UART_LCR), LCR_DLAB);
+    outb(PORT(UART_DATA), SERIAL_DIVISOR & 0xFF);
+    outb(PORT(UART_IER), SERIAL_DIVISOR >> 8);
+    outb(PORT(UART_LCR), LCR_8N1);
+    outb(PORT(UART_FCR), FCR_ENABLE_CLEAR_14);
+
+    // Проверка в режиме петли: отправленный байт должен вернуться
+    outb(PORT(UART_MCR), MCR_LOOPBACK);
+    outb(PORT(UART_DATA), 0xAE);
+    if (inb(PORT(UART_DATA)) != 0xAE) {
+        return false;
+    }
+    outb(PORT(UART_MCR), MCR_DTR_RTS_OUT2);
+
+    register_interrupt_handler(IRQ_BASE + IRQ_COM1, serial_interrupt);
+    outb(PORT(UART_IER), IER_RX_AVAILABLE | IER_TX_EMPTY | IER_LINE_STATUS);
+    irq_unmask(IRQ_COM1);
+    present = true;
+    return true;
+}
+
+bool serial_present(void) {
+    return present;
+}
+
+void serial_putc(char c) {
+    if (!present) {
+        return;
+    }
+    uint32_t flags = spin_lock_irqsave(&tx_lock);
+    if (c == '\n') {
+        tx_push('\r');
+    }
+    tx_push(c);
+    // Передатчик простаивает - прерывания THRE не будет, запускаем сами
+    if (!tx_busy) {
+        tx_fill_fifo();
+    }
+    spin_unlock_irqrestore(&tx_lock, flags);
+}
+
+void serial_write(const char* str) {
+    serial_write_n(str, (uint32_t)-1);
+}
+
+void serial_write_n(const char* str, uint32_t length) {
+    if (!present) {
+        return;
+    }
+    uint32_t flags = spin_lock_irqsave(&tx_lock);
+    for (uint32_t i = 0; i < length && str[i] != '\0'; i++) {
+        if (str[i] == '\n') {
+            tx_push('\r');
+        }
+        tx_push(str[i]);
+    }
+    if (!tx_busy) {
+        tx_fill_fifo();
+    }
+    spin_unlock_irqrestore(&tx_lock, flags);
+}
+
+// Спать можно в обычном потоке с разрешенными прерываниями
+static bool serial_can_sleep(void) {
+    uint32_t flags = irq_save();
+    bool can_sleep = false;
+    if (flags & EFLAGS_IF) {
+        cpu_t* cpu = this_cpu();
+        can_sleep = cpu->current_thread != NULL && cpu->current_thread != cpu->idle_thread;
+    }
+    irq_restore(flags);
+    return can_sleep;
+}
+
+void serial_wait_room(uint32_t length) {
+    if (length > SERIAL_TX_BUFFER_SIZE / 2) {
+        length = SERIAL_TX_BUFFER_SIZE / 2;
+    }
+    if (!present || tx_room() >= length || !serial_can_sleep()) {
+        return;
+    }
+    while (1) {
+        uint32_t flags = spin_lock_irqsave(&tx_space.lock);
+        // lock xadd - полный барьер: проверка места идет после объявления
+        // ожидания, и пробуждение из THRE не теряется
+        __atomic_fetch_add(&tx_waiters, 1, __ATOMIC_SEQ_CST);
+        if (tx_room() >= length) {
+            __atomic_fetch_sub(&tx_waiters, 1, __ATOMIC_SEQ_CST);
+            spin_unlock_irqrestore(&tx_space.lock, flags);
+            return;
+        }
+        stats.tx_waits++;
+        wait_queue_add_locked(&tx_space);
+        spin_unlock(&tx_space.lock);
+        bool woken = wait_queue_sleep(&tx_space, SERIAL_TX_WAIT_MS);
+        __atomic_fetch_sub(&tx_waiters, 1, __ATOMIC_SEQ_CST);
+        if (!woken) {
+            // Прерывание THRE потерялось: перезапускаем передатчик, если
+            // FIFO уже пуст (одно чтение LSR, без ожидания)
+            spin_lock(&tx_lock);
+            tx_fill_fifo();
+            spin_unlock(&tx_lock);
+        }
+        irq_restore(flags);
+    }
+}
+
+void serial_get_stats(serial_stats_t* out) {
+    *out = stats;
+}
@@ -0,0 +1,51 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Базовый порт COM1
+#define SERIAL_COM1 0x3F8
+// Скорость: 115200 / делитель
+#define SERIAL_DIVISOR 1
+// Глубина FIFO передатчика 16550
+#define SERIAL_FIFO_SIZE 16
+// Буфер передачи (степень двойки)
+#define SERIAL_TX_BUFFER_SIZE 16384
+// Наибольшее ожидание места в буфере за один сон (если прерывание THRE
+// потерялось, передатчик перезапускается и ожидание повторяется)
+#define SERIAL_TX_WAIT_MS 100
+
+// Статистика драйвера
+typedef struct {
+    uint32_t tx_bytes;
+    uint32_t rx_bytes;
+    uint32_t tx_waits;      // Писатель спал, ожидая места в буфере
+    uint32_t tx_dropped;    // Байты, не поместившиеся в полный буфер
+    uint32_t rx_overruns;   // Потери приема, замеченные UART
+} serial_stats_t;
+
+// Поиск и настройка COM1 (8N1, FIFO, прерывания приема и передачи).
+// Возвращает false, если порта нет.
+bool init_serial(void);
+
+// Порт найден и вывод дублируется в него
+bool serial_present(void);
+
+// Постановка символа в буфер передачи. Не ждет линию: байты уходят из
+// обработчика прерывания по мере освобождения FIFO. '\n' передается как
+// "\r\n". Можно вызывать с запрещенными прерываниями; что не поместилось
+// в полный буфер, отбрасывается.
+void serial_putc(char c);
+void serial_write(const char* str);
+void serial_write_n(const char* str, uint32_t length);
+
+// Ожидание места в буфере передачи под length байт (не больше половины
+// буфера). Поток спит, пока его не разбудит прерывание THRE. В обработчиках,
+// с запрещенными прерываниями и до запуска потоков возвращается сразу.
+// Вызывается без блокировок, перед serial_write.
+void serial_wait_room(uint32_t length);
+
+void serial_get_stats(serial_stats_t* stats);
+
+#endif // SERIAL_H
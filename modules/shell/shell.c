@@ -0,0 +1,170 @@
+#include "shell.h"
+#include "../templates/kernel_api.h"
+#include "../templates/io.h"
+#include "../timer/timer.h"
+#include "../klog/klog.h"
+#include "../kprintf/kprintf.h"
+#include "../kstring/kstring.h"
+
+// Команды в порядке регистрации
+static const shell_command_t* commands[SHELL_MAX_COMMANDS];
+static int command_count = 0;
+
+// Хэш-таблица с открытой адресацией: хэш хранится рядом с указателем,
+// имена сравниваются только при совпадении хэша
+typedef struct {
+    uint32_t hash;
+    const shell_command_t* command;
+} shell_slot_t;
+
+static shell_slot_t table[SHELL_HASH_SIZE];
+
+// FNV-1a
+static uint32_t hash_name(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Слот команды name или пустой слот, куда ее можно вставить
+static shell_slot_t* find_slot(const char* name, uint32_t hash) {
+    uint32_t index = hash & (SHELL_HASH_SIZE - 1);
+    while (table[index].command != NULL) {
+        if (table[index].hash == hash && strcmp(table[index].command->name, name) == 0) {
+            break;
+        }
+        index = (index + 1) & (SHELL_HASH_SIZE - 1);
+    }
+    return &table[index];
+}
+
+bool shell_register(const shell_command_t* command) {
+    if (command_count >= SHELL_MAX_COMMANDS) {
+        klog(KLOG_ERR, "shell: command table full, '%s' not registered", command->name);
+        return false;
+    }
+    uint32_t hash = hash_name(command->name);
+    shell_slot_t* slot = find_slot(command->name, hash);
+    if (slot->command != NULL) {
+        klog(KLOG_WARN, "shell: command '%s' already registered", command->name);
+        return false;
+    }
+    slot->hash = hash;
+    slot->command = command;
+    commands[command_count++] = command;
+    return true;
+}
+
+void shell_register_all(const shell_command_t* list, int count) {
+    for (int i = 0; i < count; i++) {
+        shell_register(&list[i]);
+    }
+}
+
+const shell_command_t* shell_find(const char* name) {
+    return find_slot(name, hash_name(name))->command;
+}
+
+int shell_tokenize(char* line, char** argv, int max_args) {
+    int argc = 0;
+    char* p = line;
+    while (argc < max_args) {
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (*p == '"') {
+            argv[argc++] = ++p;
+            while (*p && *p != '"') {
+                p++;
+            }
+        } else {
+            argv[argc++] = p;
+            while (*p && *p != ' ' && *p != '\t') {
+                p++;
+            }
+        }
+        if (*p == '\0') {
+            break;
+        }
+        *p++ = '\0';
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+void shell_execute(char* line) {
+    char* argv[SHELL_MAX_ARGS + 1];
+    int argc = shell_tokenize(line, argv, SHELL_MAX_ARGS);
+    if (argc == 0) {
+        return;
+    }
+    const shell_command_t* command = shell_find(argv[0]);
+    if (command == NULL) {
+        print_string("Unknown command! Type 'help' for available commands\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+    command->handler(argc, argv);
+}
+
+// ============== Встроенные команды ==============
+
+static void shell_help(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    // Список по алфавиту (вставками: команд немного)
+    const shell_command_t* sorted[SHELL_MAX_COMMANDS];
+    for (int i = 0; i < command_count; i++) {
+        int j = i;
+        while (j > 0 && strcmp(sorted[j - 1]->name, commands[i]->name) > 0) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = commands[i];
+    }
+
+    print_string("\nAvailable commands:\n", WHITE_ON_BLACK);
+    for (int i = 0; i < command_count; i++) {
+        char usage[32];
+        ksnprintf(usage, sizeof(usage), "%s %s", sorted[i]->name,
+                  sorted[i]->args ? sorted[i]->args : "");
+        kprintf_color(LIGHT_CYAN_ON_BLACK, "  %-20s - %s\n", usage, sorted[i]->help);
+    }
+}
+
+// Время выполнения любой команды: такты TSC и миллисекунды
+static void shell_time(int argc, char** argv) {
+    if (argc < 2) {
+        print_string("Usage: time <command> [args]\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+    const shell_command_t* command = shell_find(argv[1]);
+    if (command == NULL) {
+        kprintf_color(LIGHT_RED_ON_BLACK, "time: unknown command '%s'\n", argv[1]);
+        return;
+    }
+
+    uint64_t start = rdtsc();
+    command->handler(argc - 1, argv + 1);
+    uint64_t cycles = rdtsc() - start;
+
+    uint32_t us;
+    uint32_t ms = (uint32_t)udiv64_32(timer_cycles_to_us(cycles), 1000, &us);
+    kprintf_color(LIGHT_GREEN_ON_BLACK, "time: %llu cycles, %u.%03u ms\n",
+                  (unsigned long long)cycles, ms, us);
+}
+
+static const shell_command_t shell_commands[] = {
+    { "help", NULL, "Show this help", shell_help },
+    { "time", "<command>", "Run a command and report TSC cycles and wall time", shell_time },
+};
+
+void init_shell(void) {
+    shell_register_all(shell_commands, sizeof(shell_commands) / sizeof(shell_commands[0]));
+}
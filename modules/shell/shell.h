@@ -0,0 +1,49 @@
+#ifndef SHELL_H
+#define SHELL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Наибольшее число команд и размер хэш-таблицы (степень двойки; таблица
+// заполнена не больше чем наполовину - цепочки проб короткие)
+#define SHELL_MAX_COMMANDS 64
+#define SHELL_HASH_SIZE 128
+
+// Наибольшее число слов в строке команды (вместе с именем)
+#define SHELL_MAX_ARGS 16
+
+#define SHELL_PROMPT "QuartzOS> "
+
+// Обработчик команды: argv[0] - имя команды, argv[argc] == NULL. Строки
+// argv указывают в буфер строки и действительны до возврата.
+typedef void (*shell_handler_t)(int argc, char** argv);
+
+// Описание команды. Регистрируется указатель: описание должно жить все
+// время работы ядра (обычно static const массив в модуле).
+typedef struct {
+    const char* name;
+    const char* args;           // Синтаксис аргументов для help (или NULL)
+    const char* help;
+    shell_handler_t handler;
+} shell_command_t;
+
+// Регистрация команд. Модули регистрируют свои команды в функциях
+// инициализации (на загрузочном процессоре, до запуска оболочки).
+// Повтор имени или переполнение таблицы пишутся в журнал ядра.
+bool shell_register(const shell_command_t* command);
+void shell_register_all(const shell_command_t* commands, int count);
+
+// Поиск команды по имени (NULL, если нет)
+const shell_command_t* shell_find(const char* name);
+
+// Разбиение строки на слова на месте: разделители - пробелы и табуляции,
+// слово в двойных кавычках может содержать пробелы. Возвращает argc.
+int shell_tokenize(char* line, char** argv, int max_args);
+
+// Разбор и выполнение строки команды
+void shell_execute(char* line);
+
+// Встроенные команды оболочки: help, time
+void init_shell(void);
+
+#endif // SHELL_H
@@ -0,0 +1,279 @@
+#include "smp.h"
+#include "../templates/kernel_api.h"
+#include "../templates/io.h"
+#include "../cpu/cpu.h"
+#include "../acpi/acpi.h"
+#include "../apic/apic.h"
+#include "../interrupts/interrupts.h"
+#include "../timer/timer.h"
+#include "../threads_and_processes/threads_and_processes.h"
+#include "../fpu/fpu.h"
+#include "../syscall/syscall.h"
+#include "../shell/shell.h"
+#include "../sync/sync.h"
+#include "../kprintf/kprintf.h"
+#include <stddef.h>
+
+extern int atoi(const char *str);
+
+// Трамплин копируется в нижнюю память: SIPI запускает процессор в
+// реальном режиме с адреса (вектор * 4096)
+#define AP_TRAMPOLINE_ADDRESS 0x8000
+#define AP_STACK_SIZE 4096
+// Ожидание запуска процессора
+#define AP_START_TIMEOUT_US 100000
+
+// Трамплин: реальный режим -> защищенный режим с GDT ядра. Код
+// выполняется по адресу AP_TRAMPOLINE_ADDRESS, поэтому данные адресуются
+// относительно него.
+asm (
+    ".section .text\n"
+    ".global smp_trampoline_start\n"
+    ".global smp_trampoline_gdtr\n"
+    ".global smp_trampoline_stack\n"
+    ".global smp_trampoline_end\n"
+    ".code16\n"
+    "smp_trampoline_start:\n"
+    "    cli\n"
+    "    cld\n"
+    "    xorw %ax, %ax\n"
+    "    movw %ax, %ds\n"
+    "    lgdtl 0x8000 + (smp_trampoline_gdtr - smp_trampoline_start)\n"
+    "    movl %cr0, %eax\n"
+    "    andl $0x9FFFFFFF, %eax\n"      // Включаем кэш (CD=0, NW=0)
+    "    orl $0x21, %eax\n"             // PE и NE
+    "    movl %eax, %cr0\n"
+    "    ljmpl $0x08, $ap_protected_entry\n"
+    ".align 4\n"
+    "smp_trampoline_gdtr:\n"
+    "    .word 0\n"
+    "    .long 0\n"
+    ".align 4\n"
+    "smp_trampoline_stack:\n"
+    "    .long 0\n"
+    "smp_trampoline_end:\n"
+    ".code32\n"
+    "ap_protected_entry:\n"
+    "    movw $0x10, %ax\n"
+    "    movw %ax, %ds\n"
+    "    movw %ax, %es\n"
+    "    movw %ax, %fs\n"
+    "    movw %ax, %ss\n"
+    "    movl 0x8000 + (smp_trampoline_stack - smp_trampoline_start), %esp\n"
+    "    call ap_main\n"
+    "1:  cli\n"
+    "    hlt\n"
+    "    jmp 1b\n"
+);
+
+extern char smp_trampoline_start[];
+extern char smp_trampoline_gdtr[];
+extern char smp_trampoline_stack[];
+extern char smp_trampoline_end[];
+
+void ap_main(void);
+
+static uint8_t ap_boot_stacks[MAX_CPUS][AP_STACK_SIZE] __attribute__((aligned(16)));
+static volatile uint32_t ap_booting_index = 0;
+
+// Точка входа дополнительного процессора в C
+void ap_main(void) {
+    uint32_t index = ap_booting_index;
+    cpu_init_ap(index);
+    interrupts_init_ap();
+    apic_init_ap();
+    fpu_init_ap();
+    syscall_init_ap();
+    // Процессор помечается запущенным и уходит в свой поток бездействия
+    scheduler_start_cpu();
+}
+
+static void copy_trampoline(void) {
+    uint8_t* dst = (uint8_t*)AP_TRAMPOLINE_ADDRESS;
+    for (char* src = smp_trampoline_start; src < smp_trampoline_end; src++) {
+        *dst++ = (uint8_t)*src;
+    }
+
+    uint32_t gdt_base;
+    uint16_t gdt_limit;
+    cpu_get_gdt(&gdt_base, &gdt_limit);
+    uint8_t* gdtr = (uint8_t*)AP_TRAMPOLINE_ADDRESS + (smp_trampoline_gdtr - smp_trampoline_start);
+    *(volatile uint16_t*)gdtr = gdt_limit;
+    *(volatile uint32_t*)(gdtr + 2) = gdt_base;
+}
+
+// Запуск одного процессора последовательностью INIT-SIPI-SIPI
+static bool start_ap(uint32_t index, uint8_t apic_id) {
+    if (!scheduler_prepare_cpu(index)) {
+        return false;
+    }
+
+    cpus[index].apic_id = apic_id;
+    ap_booting_index = index;
+    volatile uint32_t* stack = (volatile uint32_t*)((uint8_t*)AP_TRAMPOLINE_ADDRESS +
+                               (smp_trampoline_stack - smp_trampoline_start));
+    *stack = (uint32_t)&ap_boot_stacks[index][AP_STACK_SIZE];
+
+    lapic_send_init(apic_id);
+    timer_udelay(10000);
+    for (int i = 0; i < 2 && !cpus[index].online; i++) {
+        lapic_send_startup(apic_id, AP_TRAMPOLINE_ADDRESS >> 12);
+        timer_udelay(200);
+    }
+
+    for (uint32_t waited = 0; waited < AP_START_TIMEOUT_US && !cpus[index].online; waited += 100) {
+        timer_udelay(100);
+    }
+    return cpus[index].online;
+}
+
+// Команды оболочки
+static const shell_command_t smp_commands[] = {
+    { "smp-bench", "[M]", "Compare 1 thread with all CPUs (M million iterations)", run_smp_bench },
+};
+
+void init_smp(void) {
+    shell_register_all(smp_commands, sizeof(smp_commands) / sizeof(smp_commands[0]));
+
+    bool have_madt = acpi_init();
+    if (!init_apic()) {
+        print_string("Local APIC not available, using PIT and one CPU\n", YELLOW_ON_BLACK);
+        return;
+    }
+    if (!have_madt) {
+        print_string("ACPI MADT not found, running on one CPU\n", YELLOW_ON_BLACK);
+        return;
+    }
+
+    // Линии ISA (клавиатура, PIT, ATA) - через I/O APIC, если он описан в MADT
+    if (init_ioapic()) {
+        print_string("I/O APIC: legacy IRQs routed to CPU0\n", LIGHT_GREEN_ON_BLACK);
+    } else {
+        print_string("No I/O APIC, keeping 8259 PIC\n", YELLOW_ON_BLACK);
+    }
+
+    copy_trampoline();
+
+    uint32_t bsp_id = lapic_id();
+    uint32_t next_index = 1;
+    for (uint32_t i = 0; i < acpi_madt.cpu_count && next_index < MAX_CPUS; i++) {
+        uint8_t apic_id = acpi_madt.lapic_ids[i];
+        if (apic_id == bsp_id) {
+            continue;
+        }
+        if (start_ap(next_index, apic_id)) {
+            next_index++;
+        } else {
+            kprintf_color(LIGHT_RED_ON_BLACK, "CPU with APIC ID %u did not start\n", apic_id);
+            break;
+        }
+    }
+
+    kprintf_color(LIGHT_GREEN_ON_BLACK, "SMP: %u CPU(s) online\n", cpu_online_count());
+}
+
+void smp_send_reschedule(uint32_t cpu_index) {
+    if (apic_enabled && cpus[cpu_index].online) {
+        interrupt_expect(cpu_index, APIC_RESCHEDULE_VECTOR, rdtsc());
+        lapic_send_ipi(cpus[cpu_index].apic_id, APIC_RESCHEDULE_VECTOR);
+    }
+}
+
+// ============== Тест масштабирования ==============
+// Одна и та же работа выполняется одним потоком, затем делится между
+// потоками по числу процессоров; выводится ускорение.
+
+#define SMP_BENCH_DEFAULT_MILLIONS 200
+#define SMP_BENCH_PRIORITY 5
+
+static volatile uint32_t bench_iterations = 0;
+static volatile uint32_t bench_workers = 0;
+static volatile uint32_t bench_finished = 0;
+// Не все потоки удалось создать: рабочие выходят, ничего не считая
+static volatile bool bench_aborted = false;
+// Рабочие ждут, пока созданы все потоки: до этого ни один не завершится,
+// и при ошибке оболочка не трогает слот процесса, который мог освободиться
+static semaphore_t bench_start = SEMAPHORE_INIT(0);
+// Поднимается последним завершившимся рабочим: оболочка ждет заблокированной
+// и не отнимает процессор у рабочих
+static semaphore_t bench_done = SEMAPHORE_INIT(0);
+
+static void smp_bench_worker() {
+    semaphore_down(&bench_start);
+    uint32_t x = 1;
+    for (uint32_t i = bench_aborted ? 0 : bench_iterations; i > 0; i--) {
+        x = x * 1664525 + 1013904223;
+        asm volatile ("" : "+r" (x));
+    }
+    uint32_t finished = 1;
+    asm volatile ("lock xaddl %0, %1" : "+r" (finished), "+m" (bench_finished) : : "memory");
+    if (finished + 1 == bench_workers) {
+        semaphore_up(&bench_done);
+    }
+}
+
+// Возвращает время выполнения в микросекундах или 0 при ошибке
+static uint32_t smp_bench_run(uint32_t workers, uint32_t total) {
+    bench_iterations = total / workers;
+    bench_finished = 0;
+    bench_aborted = false;
+    semaphore_init(&bench_start, 0);
+    semaphore_init(&bench_done, 0);
+
+    process_t* proc = create_process(smp_bench_worker, SMP_BENCH_PRIORITY);
+    if (proc == NULL) {
+        return 0;
+    }
+    uint32_t started = 1;
+    while (started < workers &&
+           create_thread(proc, smp_bench_worker, SMP_BENCH_PRIORITY) != NULL) {
+        started++;
+    }
+    // Созданные рабочие отпускаются в любом случае: при ошибке они сразу
+    // завершаются, и процесс уходит сам вместе с последним потоком
+    bench_workers = started;
+    bench_aborted = started < workers;
+
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < started; i++) {
+        semaphore_up(&bench_start);
+    }
+    semaphore_down(&bench_done);
+    if (bench_aborted) {
+        return 0;
+    }
+    return (uint32_t)timer_cycles_to_us(rdtsc() - start);
+}
+
+void run_smp_bench(int argc, char** argv) {
+    uint32_t millions = SMP_BENCH_DEFAULT_MILLIONS;
+    if (argc > 1) {
+        int value = atoi(argv[1]);
+        if (value > 0 && value <= 4000) {
+            millions = value;
+        }
+    }
+    uint32_t total = millions * 1000000;
+    uint32_t workers = cpu_online_count();
+    if (workers > MAX_THREADS_PER_PROCESS) {
+        workers = MAX_THREADS_PER_PROCESS;
+    }
+
+    kprintf("\nSMP benchmark: %uM iterations, %u CPU(s)\n", millions, workers);
+
+    uint32_t single = smp_bench_run(1, total);
+    uint32_t parallel = smp_bench_run(workers, total);
+    if (single == 0 || parallel == 0) {
+        print_string("Failed to create benchmark threads\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+
+    print_string("1 thread:   ", WHITE_ON_BLACK);
+    kprintf_color(LIGHT_BLUE_ON_BLACK, "%u.%03u ms\n", single / 1000, single % 1000);
+    kprintf("%u threads:  ", workers);
+    kprintf_color(LIGHT_BLUE_ON_BLACK, "%u.%03u ms\n", parallel / 1000, parallel % 1000);
+
+    uint32_t speedup = (uint32_t)udiv64_32((uint64_t)single * 100, parallel, NULL);
+    print_string("Speedup:    ", WHITE_ON_BLACK);
+    kprintf_color(LIGHT_GREEN_ON_BLACK, "%u.%02ux\n", speedup / 100, speedup % 100);
+}
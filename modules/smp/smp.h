@@ -0,0 +1,16 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+
+// Поиск процессоров в MADT, включение APIC и запуск дополнительных
+// процессоров (INIT-SIPI-SIPI). Вызывается после init_process_manager.
+void init_smp(void);
+
+// Межпроцессорное прерывание перепланирования
+void smp_send_reschedule(uint32_t cpu_index);
+
+// Команда smp-bench: ускорение счетной нагрузки на всех процессорах
+void run_smp_bench(int argc, char** argv);
+
+#endif // SMP_H
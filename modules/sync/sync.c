@@ -0,0 +1,479 @@
+#include "sync.h"
+#include "../templates/kernel_api.h"
+#include "../cpu/cpu.h"
+#include "../timer/timer.h"
+#include "../threads_and_processes/threads_and_processes.h"
+#include "../kprintf/kprintf.h"
+#include <stddef.h>
+
+extern int atoi(const char *str);
+
+// Сколько итераций мьютекс крутится, пока владелец выполняется
+#define MUTEX_SPIN_LIMIT 20000
+
+// Владелец мьютекса до запуска планировщика (потоков еще нет)
+#define MUTEX_BOOT_OWNER ((thread_t*)1)
+
+static inline void counter_inc(volatile uint32_t* counter) {
+    asm volatile ("lock incl %0" : "+m" (*counter));
+}
+
+static inline void counter_dec(volatile uint32_t* counter) {
+    asm volatile ("lock decl %0" : "+m" (*counter));
+}
+
+// ============== Очередь ожидания ==============
+
+void wait_queue_init(wait_queue_t* wq) {
+    wq->lock.locked = 0;
+    wq->lock.contended = 0;
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+static void wait_queue_unlink(wait_queue_t* wq, thread_t* thread) {
+    thread_t* prev = NULL;
+    for (thread_t* t = wq->head; t != NULL; prev = t, t = t->wait_next) {
+        if (t == thread) {
+            if (prev != NULL) {
+                prev->wait_next = t->wait_next;
+            } else {
+                wq->head = t->wait_next;
+            }
+            if (wq->tail == t) {
+                wq->tail = prev;
+            }
+            break;
+        }
+    }
+    thread->wait_next = NULL;
+    thread->wait_queue = NULL;
+}
+
+void wait_queue_add_locked(wait_queue_t* wq) {
+    thread_t* current = this_cpu()->current_thread;
+    current->wait_next = NULL;
+    current->wait_queue = wq;
+    if (wq->tail != NULL) {
+        wq->tail->wait_next = current;
+    } else {
+        wq->head = current;
+    }
+    wq->tail = current;
+    thread_prepare_block();
+}
+
+bool wait_queue_sleep(wait_queue_t* wq, uint32_t timeout_ms) {
+    // Между thread_prepare_block и thread_wait прерывания запрещены:
+    // вытеснение в этот момент усыпило бы поток без таймера
+    uint32_t flags = irq_save();
+    thread_t* current = this_cpu()->current_thread;
+    uint32_t deadline = get_ticks() + timer_ms_to_ticks(timeout_ms);
+    uint32_t wait_ms = timeout_ms;
+    bool woken;
+
+    while (1) {
+        bool timed_out = !thread_wait(wait_ms);
+
+        spin_lock(&wq->lock);
+        // wake уже убрал поток из очереди
+        if (current->wait_queue != wq) {
+            woken = true;
+            break;
+        }
+        int32_t remaining = (int32_t)(deadline - get_ticks());
+        if (timeout_ms != 0 && (timed_out || remaining <= 0)) {
+            wait_queue_unlink(wq, current);
+            woken = false;
+            break;
+        }
+        // Ложное пробуждение: продолжаем ждать, оставаясь в очереди
+        thread_prepare_block();
+        spin_unlock(&wq->lock);
+        if (timeout_ms != 0) {
+            wait_ms = remaining * (1000 / TIMER_HZ);
+        }
+    }
+    spin_unlock(&wq->lock);
+    irq_restore(flags);
+    return woken;
+}
+
+bool wait_queue_wake_one_locked(wait_queue_t* wq) {
+    thread_t* thread = wq->head;
+    if (thread == NULL) {
+        return false;
+    }
+    wq->head = thread->wait_next;
+    if (wq->head == NULL) {
+        wq->tail = NULL;
+    }
+    thread->wait_next = NULL;
+    thread->wait_queue = NULL;
+    unblock_thread(thread);
+    return true;
+}
+
+uint32_t wait_queue_wake_all_locked(wait_queue_t* wq) {
+    uint32_t count = 0;
+    while (wait_queue_wake_one_locked(wq)) {
+        count++;
+    }
+    return count;
+}
+
+bool wait_queue_wake_one(wait_queue_t* wq) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    bool woken = wait_queue_wake_one_locked(wq);
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return woken;
+}
+
+uint32_t wait_queue_wake_all(wait_queue_t* wq) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    uint32_t count = wait_queue_wake_all_locked(wq);
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return count;
+}
+
+void wait_queue_remove(thread_t* thread) {
+    wait_queue_t* wq = thread->wait_queue;
+    if (wq == NULL) {
+        return;
+    }
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    if (thread->wait_queue == wq) {
+        wait_queue_unlink(wq, thread);
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+// ============== Мьютекс ==============
+
+void mutex_init(mutex_t* mutex) {
+    mutex->owner = NULL;
+    mutex->waiters = 0;
+    wait_queue_init(&mutex->wq);
+    mutex->acquisitions = 0;
+    mutex->contended = 0;
+    mutex->spin_acquired = 0;
+    mutex->sleeps = 0;
+}
+
+static thread_t* mutex_self(void) {
+    thread_t* current = get_current_thread();
+    return current != NULL ? current : MUTEX_BOOT_OWNER;
+}
+
+static inline bool mutex_try_acquire(mutex_t* mutex, thread_t* self) {
+    thread_t* expected = NULL;
+    return __atomic_compare_exchange_n(&mutex->owner, &expected, self, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+bool mutex_trylock(mutex_t* mutex) {
+    if (mutex_try_acquire(mutex, mutex_self())) {
+        counter_inc(&mutex->acquisitions);
+        return true;
+    }
+    return false;
+}
+
+void mutex_lock(mutex_t* mutex) {
+    thread_t* self = mutex_self();
+    if (mutex_try_acquire(mutex, self)) {
+        counter_inc(&mutex->acquisitions);
+        return;
+    }
+    counter_inc(&mutex->contended);
+
+    // Вращаемся, пока владелец работает на другом процессоре: он скоро
+    // отпустит мьютекс, а засыпание стоит двух переключений
+    for (uint32_t i = 0; i < MUTEX_SPIN_LIMIT; i++) {
+        thread_t* owner = mutex->owner;
+        if (owner == NULL) {
+            if (mutex_try_acquire(mutex, self)) {
+                counter_inc(&mutex->spin_acquired);
+                counter_inc(&mutex->acquisitions);
+                return;
+            }
+        } else if (self != MUTEX_BOOT_OWNER && owner != MUTEX_BOOT_OWNER && !owner->on_cpu) {
+            break;
+        }
+        cpu_relax();
+    }
+
+    // Без планировщика спать нельзя
+    if (self == MUTEX_BOOT_OWNER) {
+        while (!mutex_try_acquire(mutex, self)) {
+            cpu_relax();
+        }
+        counter_inc(&mutex->acquisitions);
+        return;
+    }
+
+    while (1) {
+        uint32_t flags = spin_lock_irqsave(&mutex->wq.lock);
+        // Счетчик ожидающих увеличивается до повторной попытки: либо мы
+        // захватим мьютекс, либо mutex_unlock увидит ожидающего
+        counter_inc(&mutex->waiters);
+        if (mutex_try_acquire(mutex, self)) {
+            counter_dec(&mutex->waiters);
+            spin_unlock_irqrestore(&mutex->wq.lock, flags);
+            break;
+        }
+        wait_queue_add_locked(&mutex->wq);
+        spin_unlock(&mutex->wq.lock);
+        counter_inc(&mutex->sleeps);
+        wait_queue_sleep(&mutex->wq, 0);
+        counter_dec(&mutex->waiters);
+        irq_restore(flags);
+    }
+    counter_inc(&mutex->acquisitions);
+}
+
+void mutex_unlock(mutex_t* mutex) {
+    // xchg - полный барьер: чтение waiters не обгонит освобождение
+    (void)__atomic_exchange_n(&mutex->owner, NULL, __ATOMIC_SEQ_CST);
+    if (mutex->waiters > 0) {
+        wait_queue_wake_one(&mutex->wq);
+    }
+}
+
+// ============== Семафор ==============
+
+void semaphore_init(semaphore_t* sem, int32_t count) {
+    sem->count = count;
+    wait_queue_init(&sem->wq);
+    sem->contended = 0;
+}
+
+bool semaphore_trydown(semaphore_t* sem) {
+    bool taken = false;
+    uint32_t flags = spin_lock_irqsave(&sem->wq.lock);
+    if (sem->count > 0) {
+        sem->count--;
+        taken = true;
+    }
+    spin_unlock_irqrestore(&sem->wq.lock, flags);
+    return taken;
+}
+
+bool semaphore_down_timeout(semaphore_t* sem, uint32_t timeout_ms) {
+    if (semaphore_trydown(sem)) {
+        return true;
+    }
+    counter_inc(&sem->contended);
+
+    if (get_current_thread() == NULL) {
+        uint32_t deadline = get_ticks() + timer_ms_to_ticks(timeout_ms);
+        while (!semaphore_trydown(sem)) {
+            if (timeout_ms != 0 && (int32_t)(get_ticks() - deadline) >= 0) {
+                return false;
+            }
+            cpu_relax();
+        }
+        return true;
+    }
+
+    uint32_t deadline = get_ticks() + timer_ms_to_ticks(timeout_ms);
+    while (1) {
+        uint32_t flags = spin_lock_irqsave(&sem->wq.lock);
+        if (sem->count > 0) {
+            sem->count--;
+            spin_unlock_irqrestore(&sem->wq.lock, flags);
+            return true;
+        }
+        uint32_t wait_ms = 0;
+        if (timeout_ms != 0) {
+            int32_t remaining = (int32_t)(deadline - get_ticks());
+            if (remaining <= 0) {
+                spin_unlock_irqrestore(&sem->wq.lock, flags);
+                return false;
+            }
+            wait_ms = remaining * (1000 / TIMER_HZ);
+        }
+        wait_queue_add_locked(&sem->wq);
+        spin_unlock(&sem->wq.lock);
+        wait_queue_sleep(&sem->wq, wait_ms);
+        irq_restore(flags);
+    }
+}
+
+void semaphore_down(semaphore_t* sem) {
+    semaphore_down_timeout(sem, 0);
+}
+
+void semaphore_up(semaphore_t* sem) {
+    uint32_t flags = spin_lock_irqsave(&sem->wq.lock);
+    sem->count++;
+    wait_queue_wake_one_locked(&sem->wq);
+    spin_unlock_irqrestore(&sem->wq.lock, flags);
+}
+
+// ============== Условная переменная ==============
+
+void condvar_init(condvar_t* cv) {
+    wait_queue_init(&cv->wq);
+    cv->waits = 0;
+}
+
+bool condvar_wait_timeout(condvar_t* cv, mutex_t* mutex, uint32_t timeout_ms) {
+    counter_inc(&cv->waits);
+
+    // До запуска планировщика ждать некому: ложное пробуждение
+    if (get_current_thread() == NULL) {
+        mutex_unlock(mutex);
+        cpu_relax();
+        mutex_lock(mutex);
+        return true;
+    }
+
+    // Поток встает в очередь до освобождения мьютекса, поэтому сигнал,
+    // отправленный сразу после mutex_unlock, не теряется
+    uint32_t flags = spin_lock_irqsave(&cv->wq.lock);
+    wait_queue_add_locked(&cv->wq);
+    spin_unlock(&cv->wq.lock);
+    mutex_unlock(mutex);
+    bool woken = wait_queue_sleep(&cv->wq, timeout_ms);
+    irq_restore(flags);
+
+    mutex_lock(mutex);
+    return woken;
+}
+
+void condvar_wait(condvar_t* cv, mutex_t* mutex) {
+    condvar_wait_timeout(cv, mutex, 0);
+}
+
+void condvar_signal(condvar_t* cv) {
+    wait_queue_wake_one(&cv->wq);
+}
+
+void condvar_broadcast(condvar_t* cv) {
+    wait_queue_wake_all(&cv->wq);
+}
+
+// ============== Нагрузочный тест ==============
+// Потоки (по два на процессор) увеличивают общий счетчик в критической
+// секции под спин-блокировкой, мьютексом и семафором. Проверяется итоговое
+// значение счетчика, выводятся время и счетчики конкуренции.
+
+#define LOCK_BENCH_DEFAULT_ITERATIONS 20000
+#define LOCK_BENCH_PRIORITY 5
+// Длина работы внутри критической секции
+#define LOCK_BENCH_HOLD 20
+
+enum {
+    LOCK_BENCH_SPINLOCK,
+    LOCK_BENCH_MUTEX,
+    LOCK_BENCH_SEMAPHORE,
+    LOCK_BENCH_KINDS
+};
+
+static const char* lock_bench_names[LOCK_BENCH_KINDS] = {
+    "spinlock", "mutex", "semaphore"
+};
+
+static volatile uint32_t bench_kind;
+static volatile uint32_t bench_iterations;
+static volatile uint32_t bench_counter;
+static spinlock_t bench_spinlock;
+static mutex_t bench_mutex;
+static semaphore_t bench_semaphore;
+static semaphore_t bench_done;
+
+static void lock_bench_critical(void) {
+    uint32_t value = bench_counter;
+    for (volatile int i = 0; i < LOCK_BENCH_HOLD; i++);
+    bench_counter = value + 1;
+}
+
+static void lock_bench_worker() {
+    for (uint32_t i = 0; i < bench_iterations; i++) {
+        switch (bench_kind) {
+            case LOCK_BENCH_SPINLOCK: {
+                uint32_t flags = spin_lock_irqsave(&bench_spinlock);
+                lock_bench_critical();
+                spin_unlock_irqrestore(&bench_spinlock, flags);
+                break;
+            }
+            case LOCK_BENCH_MUTEX:
+                mutex_lock(&bench_mutex);
+                lock_bench_critical();
+                mutex_unlock(&bench_mutex);
+                break;
+            default:
+                semaphore_down(&bench_semaphore);
+                lock_bench_critical();
+                semaphore_up(&bench_semaphore);
+                break;
+        }
+    }
+    semaphore_up(&bench_done);
+}
+
+void run_lock_bench(int argc, char** argv) {
+    uint32_t iterations = LOCK_BENCH_DEFAULT_ITERATIONS;
+    if (argc > 1) {
+        int value = atoi(argv[1]);
+        if (value > 0) {
+            iterations = value;
+        }
+    }
+    uint32_t workers = cpu_online_count() * 2;
+    if (workers > MAX_THREADS_PER_PROCESS) {
+        workers = MAX_THREADS_PER_PROCESS;
+    }
+
+    kprintf("\nLock stress: %u threads x %u iterations\n", workers, iterations);
+    print_string("Primitive  Time(us)  ns/op  Result  Contention\n", LIGHT_GREEN_ON_BLACK);
+    print_string("----------------------------------------------\n", DARK_GRAY_ON_BLACK);
+
+    for (uint32_t kind = 0; kind < LOCK_BENCH_KINDS; kind++) {
+        bench_kind = kind;
+        bench_iterations = iterations;
+        bench_counter = 0;
+        bench_spinlock.locked = 0;
+        bench_spinlock.contended = 0;
+        mutex_init(&bench_mutex);
+        semaphore_init(&bench_semaphore, 1);
+        semaphore_init(&bench_done, 0);
+
+        uint64_t start = rdtsc();
+        process_t* proc = create_process(lock_bench_worker, LOCK_BENCH_PRIORITY);
+        uint32_t started = proc != NULL ? 1 : 0;
+        while (proc != NULL && started < workers &&
+               create_thread(proc, lock_bench_worker, LOCK_BENCH_PRIORITY) != NULL) {
+            started++;
+        }
+        for (uint32_t i = 0; i < started; i++) {
+            semaphore_down(&bench_done);
+        }
+        uint32_t us = (uint32_t)timer_cycles_to_us(rdtsc() - start);
+
+        uint32_t ops = started * iterations;
+        uint32_t ns_per_op = ops != 0 ? (uint32_t)udiv64_32((uint64_t)us * 1000, ops, NULL) : 0;
+        kprintf("%-9s  ", lock_bench_names[kind]);
+        kprintf_color(LIGHT_BLUE_ON_BLACK, "%8u  %5u  ", us, ns_per_op);
+        if (bench_counter == ops && started != 0) {
+            print_string("OK      ", LIGHT_GREEN_ON_BLACK);
+        } else {
+            print_string("FAIL    ", LIGHT_RED_ON_BLACK);
+        }
+
+        switch (kind) {
+            case LOCK_BENCH_SPINLOCK:
+                kprintf("spins=%u", bench_spinlock.contended);
+                break;
+            case LOCK_BENCH_MUTEX:
+                kprintf("contended=%u spun=%u slept=%u", bench_mutex.contended,
+                        bench_mutex.spin_acquired, bench_mutex.sleeps);
+                break;
+            default:
+                kprintf("contended=%u", bench_semaphore.contended);
+                break;
+        }
+        print_char('\n', WHITE_ON_BLACK);
+    }
+}
@@ -0,0 +1,149 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../templates/io.h"
+
+struct thread;
+
+// Полный барьер памяти (упорядочивает и запись перед чтением)
+static inline void smp_mb(void) {
+    asm volatile ("lock orl $0, (%%esp)" : : : "memory", "cc");
+}
+
+// ============== Спин-блокировка ==============
+
+typedef struct {
+    volatile uint32_t locked;
+    volatile uint32_t contended;    // Сколько раз захват пришлось ждать
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0, 0 }
+
+static inline bool spin_trylock(spinlock_t* lock) {
+    uint32_t old = 1;
+    asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (lock->locked) : : "memory");
+    return old == 0;
+}
+
+static inline void spin_lock(spinlock_t* lock) {
+    if (spin_trylock(lock)) {
+        return;
+    }
+    asm volatile ("lock incl %0" : "+m" (lock->contended));
+    do {
+        while (lock->locked) {
+            asm volatile ("pause" : : : "memory");
+        }
+    } while (!spin_trylock(lock));
+}
+
+static inline void spin_unlock(spinlock_t* lock) {
+    asm volatile ("" : : : "memory");
+    lock->locked = 0;
+}
+
+// Захват с запретом прерываний (для данных, которые трогают обработчики)
+static inline uint32_t spin_lock_irqsave(spinlock_t* lock) {
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+// ============== Очередь ожидания ==============
+// Потоки связываются через поля wait_next/wait_queue в thread_t.
+
+typedef struct wait_queue {
+    spinlock_t lock;
+    struct thread* head;
+    struct thread* tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { SPINLOCK_INIT, NULL, NULL }
+
+void wait_queue_init(wait_queue_t* wq);
+
+// Постановка текущего потока в очередь (вызывается под wq->lock с
+// запрещенными прерываниями). После этого пробуждение не теряется, даже
+// если оно придет до wait_queue_sleep.
+void wait_queue_add_locked(wait_queue_t* wq);
+
+// Ожидание после wait_queue_add_locked (wq->lock уже отпущен). Возвращает
+// true, если поток разбудил wake, и false по таймауту (timeout_ms = 0 -
+// без ограничения).
+bool wait_queue_sleep(wait_queue_t* wq, uint32_t timeout_ms);
+
+// Пробуждение первого/всех ожидающих. Варианты _locked - под wq->lock.
+bool wait_queue_wake_one(wait_queue_t* wq);
+uint32_t wait_queue_wake_all(wait_queue_t* wq);
+bool wait_queue_wake_one_locked(wait_queue_t* wq);
+uint32_t wait_queue_wake_all_locked(wait_queue_t* wq);
+
+// Удаление потока из очереди, в которой он ждет (при завершении потока)
+void wait_queue_remove(struct thread* thread);
+
+// ============== Мьютекс ==============
+// Адаптивный: пока владелец выполняется на другом процессоре, ожидающий
+// крутится, иначе засыпает в очереди.
+
+typedef struct {
+    struct thread* volatile owner;
+    volatile uint32_t waiters;
+    wait_queue_t wq;
+    // Статистика
+    volatile uint32_t acquisitions;
+    volatile uint32_t contended;    // Захват не удался с первой попытки
+    volatile uint32_t spin_acquired; // Получен после ожидания вращением
+    volatile uint32_t sleeps;       // Сколько раз ожидающий засыпал
+} mutex_t;
+
+#define MUTEX_INIT { NULL, 0, WAIT_QUEUE_INIT, 0, 0, 0, 0 }
+
+void mutex_init(mutex_t* mutex);
+void mutex_lock(mutex_t* mutex);
+bool mutex_trylock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+// ============== Семафор ==============
+
+typedef struct {
+    volatile int32_t count;
+    wait_queue_t wq;
+    volatile uint32_t contended;    // Ожиданий при нулевом счетчике
+} semaphore_t;
+
+#define SEMAPHORE_INIT(n) { (n), WAIT_QUEUE_INIT, 0 }
+
+void semaphore_init(semaphore_t* sem, int32_t count);
+void semaphore_down(semaphore_t* sem);
+// Возвращает false, если за timeout_ms счетчик так и не стал положительным
+bool semaphore_down_timeout(semaphore_t* sem, uint32_t timeout_ms);
+bool semaphore_trydown(semaphore_t* sem);
+void semaphore_up(semaphore_t* sem);
+
+// ============== Условная переменная ==============
+
+typedef struct {
+    wait_queue_t wq;
+    volatile uint32_t waits;
+} condvar_t;
+
+#define CONDVAR_INIT { WAIT_QUEUE_INIT, 0 }
+
+void condvar_init(condvar_t* cv);
+// Атомарно отпускает мьютекс и ждет сигнала; мьютекс захватывается снова
+void condvar_wait(condvar_t* cv, mutex_t* mutex);
+bool condvar_wait_timeout(condvar_t* cv, mutex_t* mutex, uint32_t timeout_ms);
+void condvar_signal(condvar_t* cv);
+void condvar_broadcast(condvar_t* cv);
+
+// Команда lock-bench: нагрузочный тест примитивов синхронизации
+void run_lock_bench(int argc, char** argv);
+
+#endif // SYNC_H
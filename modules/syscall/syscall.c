@@ -0,0 +1,351 @@
+#include "syscall.h"
+#include "../templates/kernel_api.h"
+#include "../templates/io.h"
+#include "../cpu/cpu.h"
+#include "../interrupts/interrupts.h"
+#include "../threads_and_processes/threads_and_processes.h"
+#include "../shell/shell.h"
+#include "../kprintf/kprintf.h"
+#include <stddef.h>
+
+extern int atoi(const char *str);
+
+#define STR_HELPER(x) #x
+#define STR(x) STR_HELPER(x)
+
+// MSR инструкции SYSENTER
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+#define CPUID_FEATURE_SEP (1 << 11)
+
+// Самая длинная строка SYS_WRITE
+#define SYSCALL_WRITE_MAX 256
+// Нижняя граница адресов, которые принимаются от кольца 3
+#define SYSCALL_MIN_USER_ADDRESS 0x1000
+
+// Параметры syscall-bench
+#define SYSCALL_BENCH_DEFAULT_ITERATIONS 100000
+#define SYSCALL_BENCH_TIMEOUT_MS 10000
+
+typedef uint32_t (*syscall_handler_t)(uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+// Читается и из кольца 3: сегменты плоские, страничной защиты нет
+static volatile bool sysenter_supported = false;
+
+// Вход SYSENTER. Процессор загружает CS/SS ядра и ESP из MSR, но не
+// сохраняет ничего из контекста пользователя. MSR_SYSENTER_ESP указывает
+// сразу за полем esp0 в TSS процессора, поэтому первой командой переходим
+// на стек ядра текущего потока. Дальше строится такой же кадр, как у
+// int 0x80 (EIP возврата известен, ESP пользователя передан в EBP), и
+// обработчик у обоих путей общий.
+//
+// Пользовательская заглушка сохраняет EBX и EBP, а ECX и EDX, которые
+// затирает SYSEXIT, по соглашению о вызовах сохранять не нужно.
+asm (
+    ".section .text\n"
+    ".global sysenter_entry\n"
+    "sysenter_entry:\n"
+    "    movl -4(%esp), %esp\n"         // tss.esp0
+    "    pushl $" STR(GDT_USER_DATA_SELECTOR) "\n"
+    "    pushl %ebp\n"                  // ESP пользователя
+    "    pushfl\n"
+    "    orl $0x200, (%esp)\n"          // SYSENTER сбросил IF, у пользователя он был
+    "    pushl $" STR(GDT_USER_CODE_SELECTOR) "\n"
+    "    pushl $sysenter_return\n"
+    "    pushl $0\n"
+    "    pushl $" STR(SYSCALL_VECTOR) "\n"
+    "    pushal\n"
+    "    pushl %ds\n"
+    "    pushl %es\n"
+    "    pushl %fs\n"
+    "    pushl %gs\n"
+    "    movw $" STR(GDT_KERNEL_DATA_SELECTOR) ", %ax\n"
+    "    movw %ax, %ds\n"
+    "    movw %ax, %es\n"
+    "    str %ax\n"
+    "    addw $(" STR(MAX_CPUS) " * 8), %ax\n"
+    "    movw %ax, %gs\n"
+    "    cld\n"
+    "    pushl %esp\n"
+    "    call sysenter_dispatch\n"
+    "    addl $4, %esp\n"
+    "    popl %gs\n"
+    "    popl %fs\n"
+    "    popl %es\n"
+    "    popl %ds\n"
+    "    popal\n"
+    "    addl $8, %esp\n"
+    "    movl (%esp), %edx\n"           // EIP возврата
+    "    movl 12(%esp), %ecx\n"         // ESP пользователя
+    "    sti\n"                         // Прерывание возможно только после SYSEXIT
+    "    sysexit\n"
+);
+
+// Пользовательские заглушки (cdecl): номер и аргументы берутся со стека
+asm (
+    ".section .text\n"
+    ".global syscall_sysenter\n"
+    "syscall_sysenter:\n"
+    "    pushl %ebx\n"
+    "    pushl %ebp\n"
+    "    movl 12(%esp), %eax\n"
+    "    movl 16(%esp), %ebx\n"
+    "    movl 20(%esp), %ecx\n"
+    "    movl 24(%esp), %edx\n"
+    "    movl %esp, %ebp\n"
+    "    sysenter\n"
+    ".global sysenter_return\n"
+    "sysenter_return:\n"
+    "    popl %ebp\n"
+    "    popl %ebx\n"
+    "    ret\n"
+    "\n"
+    ".global syscall_int80\n"
+    "syscall_int80:\n"
+    "    pushl %ebx\n"
+    "    movl 8(%esp), %eax\n"
+    "    movl 12(%esp), %ebx\n"
+    "    movl 16(%esp), %ecx\n"
+    "    movl 20(%esp), %edx\n"
+    "    int $" STR(SYSCALL_VECTOR) "\n"
+    "    popl %ebx\n"
+    "    ret\n"
+);
+
+extern char sysenter_entry[];
+
+void sysenter_dispatch(interrupt_frame_t* frame);
+
+// ============== Обработчики ==============
+
+static uint32_t sys_null(uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    (void)arg1; (void)arg2; (void)arg3;
+    return 0;
+}
+
+static uint32_t sys_exit(uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    (void)arg1; (void)arg2; (void)arg3;
+    thread_exit();
+    return 0;
+}
+
+static uint32_t sys_yield(uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    (void)arg1; (void)arg2; (void)arg3;
+    thread_yield();
+    return 0;
+}
+
+static uint32_t sys_sleep(uint32_t ms, uint32_t arg2, uint32_t arg3) {
+    (void)arg2; (void)arg3;
+    thread_sleep(ms);
+    return 0;
+}
+
+// Строка копируется в ядро: вывод идет под блокировкой консоли, и
+// пользователь не должен менять ее во время вывода
+static uint32_t sys_write(uint32_t str, uint32_t color, uint32_t arg3) {
+    (void)arg3;
+    char buffer[SYSCALL_WRITE_MAX];
+    if (str < SYSCALL_MIN_USER_ADDRESS) {
+        return (uint32_t)-1;
+    }
+    const char* src = (const char*)str;
+    uint32_t len = 0;
+    while (len < SYSCALL_WRITE_MAX - 1 && src[len] != '\0') {
+        buffer[len] = src[len];
+        len++;
+    }
+    buffer[len] = '\0';
+    print_string(buffer, (uint8_t)color);
+    return len;
+}
+
+static uint32_t sys_getpid(uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    (void)arg1; (void)arg2; (void)arg3;
+    process_t* process = get_current_process();
+    return process != NULL ? process->id : 0;
+}
+
+static const syscall_handler_t syscall_table[SYSCALL_COUNT] = {
+    [SYS_NULL] = sys_null,
+    [SYS_EXIT] = sys_exit,
+    [SYS_YIELD] = sys_yield,
+    [SYS_SLEEP] = sys_sleep,
+    [SYS_WRITE] = sys_write,
+    [SYS_GETPID] = sys_getpid,
+};
+
+// Уровень привилегий последнего вызова (проверяется в syscall-bench)
+static volatile uint32_t last_caller_cpl = 0;
+
+// Общий обработчик: вызывается с разрешенными прерываниями
+static void syscall_dispatch(interrupt_frame_t* frame) {
+    uint32_t number = frame->eax;
+    last_caller_cpl = frame->cs & 3;
+    if (number >= SYSCALL_COUNT) {
+        frame->eax = (uint32_t)-1;
+        return;
+    }
+    frame->eax = syscall_table[number](frame->ebx, frame->ecx, frame->edx);
+}
+
+// Путь int 0x80 (через interrupt_dispatch, шлюз прерывания сбросил IF)
+static void syscall_interrupt(interrupt_frame_t* frame) {
+    irq_enable();
+    syscall_dispatch(frame);
+    irq_disable();
+}
+
+// Путь SYSENTER. Вытеснение проверяем здесь же: interrupt_dispatch
+// на этом пути не участвует.
+void sysenter_dispatch(interrupt_frame_t* frame) {
+    irq_enable();
+    syscall_dispatch(frame);
+    irq_disable();
+    preempt_if_needed();
+}
+
+// ============== Инициализация ==============
+
+static void sysenter_setup_msrs(void) {
+    wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_CODE_SELECTOR);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)&this_cpu()->tss->esp0 + sizeof(uint32_t));
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+}
+
+// Команды оболочки
+static const shell_command_t syscall_commands[] = {
+    { "syscall-bench", "[N]", "Null system call cost: SYSENTER vs int 0x80", run_syscall_bench },
+};
+
+void init_syscalls(void) {
+    shell_register_all(syscall_commands, sizeof(syscall_commands) / sizeof(syscall_commands[0]));
+    register_interrupt_handler(SYSCALL_VECTOR, syscall_interrupt);
+    interrupt_allow_user(SYSCALL_VECTOR);
+
+    // Флаг SEP у Pentium Pro (семейство 6, модель < 3, степпинг < 3)
+    // выставлен, но SYSENTER не работает
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    uint32_t family = (eax >> 8) & 0xF;
+    uint32_t model = (eax >> 4) & 0xF;
+    uint32_t stepping = eax & 0xF;
+    sysenter_supported = (edx & CPUID_FEATURE_SEP) &&
+                         !(family == 6 && model < 3 && stepping < 3);
+
+    if (sysenter_supported) {
+        sysenter_setup_msrs();
+        print_string("System calls initialized (SYSENTER, int 0x80)\n", LIGHT_GREEN_ON_BLACK);
+    } else {
+        print_string("System calls initialized (int 0x80)\n", LIGHT_GREEN_ON_BLACK);
+    }
+}
+
+void syscall_init_ap(void) {
+    if (sysenter_supported) {
+        sysenter_setup_msrs();
+    }
+}
+
+bool syscall_sysenter_supported(void) {
+    return sysenter_supported;
+}
+
+// ============== Пользовательская сторона ==============
+
+uint32_t syscall(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    if (sysenter_supported) {
+        return syscall_sysenter(number, arg1, arg2, arg3);
+    }
+    return syscall_int80(number, arg1, arg2, arg3);
+}
+
+void syscall_user_exit(void) {
+    syscall(SYS_EXIT, 0, 0, 0);
+}
+
+// ============== syscall-bench ==============
+// Тело измерения выполняется в кольце 3 и пишет результат в общие
+// переменные (без страничной защиты они доступны пользователю).
+
+static volatile uint32_t bench_iterations;
+static volatile uint32_t bench_sysenter_cycles;
+static volatile uint32_t bench_int80_cycles;
+static volatile uint32_t bench_cpl;
+static volatile bool bench_done;
+
+static uint32_t bench_measure(uint32_t (*call)(uint32_t, uint32_t, uint32_t, uint32_t)) {
+    uint32_t iterations = bench_iterations;
+    // Прогрев: кэши и предсказатель переходов
+    for (uint32_t i = 0; i < 1000; i++) {
+        call(SYS_NULL, 0, 0, 0);
+    }
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < iterations; i++) {
+        call(SYS_NULL, 0, 0, 0);
+    }
+    return (uint32_t)udiv64_32(rdtsc() - start, iterations, NULL);
+}
+
+static void syscall_bench_user() {
+    syscall(SYS_WRITE, (uint32_t)"Hello from ring 3\n", LIGHT_CYAN_ON_BLACK, 0);
+    bench_int80_cycles = bench_measure(syscall_int80);
+    bench_cpl = last_caller_cpl;
+    if (sysenter_supported) {
+        bench_sysenter_cycles = bench_measure(syscall_sysenter);
+    }
+    bench_done = true;
+}
+
+static void print_cycles(const char* label, uint32_t cycles) {
+    kprintf("%-11s", label);
+    kprintf_color(LIGHT_BLUE_ON_BLACK, "%6u", cycles);
+    kprintf(" cycles/call\n");
+}
+
+void run_syscall_bench(int argc, char** argv) {
+    uint32_t iterations = SYSCALL_BENCH_DEFAULT_ITERATIONS;
+    if (argc > 1) {
+        int value = atoi(argv[1]);
+        if (value > 0) {
+            iterations = value;
+        }
+    }
+
+    kprintf("\nNull system call: %u calls per path\n", iterations);
+
+    bench_iterations = iterations;
+    bench_sysenter_cycles = 0;
+    bench_int80_cycles = 0;
+    bench_cpl = 0;
+    bench_done = false;
+    if (create_user_process(syscall_bench_user, 10) == NULL) {
+        print_string("Failed to create user process\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+
+    uint32_t waited = 0;
+    while (!bench_done && waited < SYSCALL_BENCH_TIMEOUT_MS) {
+        thread_sleep(10);
+        waited += 10;
+    }
+    if (!bench_done) {
+        print_string("Benchmark timed out\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+
+    print_cycles("int 0x80:", bench_int80_cycles);
+    if (sysenter_supported) {
+        print_cycles("SYSENTER:", bench_sysenter_cycles);
+    } else {
+        print_string("SYSENTER:  not supported\n", DARK_GRAY_ON_BLACK);
+    }
+    print_string("Caller ring: ", WHITE_ON_BLACK);
+    if (bench_cpl == 3) {
+        print_string("3 OK\n", LIGHT_GREEN_ON_BLACK);
+    } else {
+        print_string("not 3, FAIL\n", LIGHT_RED_ON_BLACK);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Вектор системных вызовов через int (запасной путь)
+#define SYSCALL_VECTOR 0x80
+
+// Номера системных вызовов. Номер передается в EAX, аргументы - в EBX,
+// ECX, EDX; результат возвращается в EAX.
+#define SYS_NULL 0          // Пустой вызов (для измерений)
+#define SYS_EXIT 1          // Завершение потока
+#define SYS_YIELD 2         // Передача процессора
+#define SYS_SLEEP 3         // Сон: ms
+#define SYS_WRITE 4         // Вывод строки: str, color
+#define SYS_GETPID 5        // Идентификатор процесса
+#define SYSCALL_COUNT 6
+
+// Установка шлюза int 0x80 и, если процессор поддерживает SYSENTER,
+// MSR быстрого входа на загрузочном процессоре
+void init_syscalls(void);
+
+// Настройка MSR SYSENTER на дополнительном процессоре
+void syscall_init_ap(void);
+
+// Процессор поддерживает SYSENTER/SYSEXIT
+bool syscall_sysenter_supported(void);
+
+// ---- Пользовательская сторона (выполняется в кольце 3) ----
+
+// Системный вызов: SYSENTER, если доступен, иначе int 0x80
+uint32_t syscall(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+// Явный выбор пути входа (для измерений)
+uint32_t syscall_sysenter(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+uint32_t syscall_int80(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+// Адрес возврата функции потока в кольце 3: завершает поток через SYS_EXIT
+void syscall_user_exit(void);
+
+// Команда syscall-bench: стоимость пустого вызова через SYSENTER и int 0x80
+void run_syscall_bench(int argc, char** argv);
+
+#endif // SYSCALL_H
@@ -1,191 +1,646 @@
 #include "threads_and_processes.h"
 #include "../templates/kernel_api.h"
+#include "../templates/io.h"
+#include "../cpu/cpu.h"
+#include "../smp/smp.h"
+#include "../timer/timer.h"
+#include "../syscall/syscall.h"
+#include "../klog/klog.h"
+#include "../shell/shell.h"
+#include "../kprintf/kprintf.h"
+#include "../kstring/kstring.h"
 #include <stddef.h>
-#include <string.h>
+
+extern int atoi(const char *str);
+
+#define STR_HELPER(x) #x
+#define STR(x) STR_HELPER(x)
+
+// Параметры spawn-bench
+#define SPAWN_BENCH_DEFAULT_COUNT 1000
+#define SPAWN_BENCH_FILLERS 16
+#define SPAWN_BENCH_LOOKUPS 10000
+
+// Параметры top
+#define TOP_INTERVAL_MS 1000
+#define TOP_POLL_MS 50
+#define TOP_MAX_THREADS (MAX_PROCESSES * MAX_THREADS_PER_PROCESS)
+#define TOP_LINE_SIZE 256
+
+// Приоритет процесса ядра (поток оболочки kmain)
+#define KERNEL_PROCESS_PRIORITY 10
+
+// Параметры rt-test
+#define RT_TEST_DEFAULT_COUNT 100
+#define RT_TEST_SLEEP_MS 2
+#define RT_TEST_FIFO_PRIORITY 50
+#define RT_TEST_DL_RUNTIME_US 2000
+#define RT_TEST_DL_PERIOD_US 10000
+#define RT_TEST_LOAD_PRIORITY 20
 
 // Глобальные переменные
 // Убираем static отсюда!
 process_t processes[MAX_PROCESSES];
 thread_t threads[MAX_PROCESSES * MAX_THREADS_PER_PROCESS];
 uint8_t thread_stacks[MAX_PROCESSES * MAX_THREADS_PER_PROCESS][THREAD_STACK_SIZE];
+// Стеки кольца 3 для потоков пользовательских процессов
+static uint8_t user_stacks[MAX_PROCESSES * MAX_THREADS_PER_PROCESS][USER_STACK_SIZE]
+    __attribute__((aligned(16)));
+
+// Очередь готовых потоков одного процессора. Обычные потоки стоят в
+// порядке FIFO; потоки реального времени - в отдельных отсортированных
+// списках: dl_head по крайнему сроку, rt_head по убыванию приоритета.
+typedef struct {
+    spinlock_t lock;
+    thread_t* head;
+    thread_t* tail;
+    thread_t* rt_head;
+    thread_t* dl_head;
+    volatile uint32_t length;       // Все готовые потоки очереди
+    volatile uint32_t rt_length;    // Из них SCHED_FIFO и SCHED_DEADLINE
+} run_queue_t;
 
 // Эти переменные могут оставаться static, так как они используются только внутри модуля
-static process_t* current_process = NULL;
-static thread_t* current_thread = NULL;
+static run_queue_t run_queues[MAX_CPUS];
+static process_t* idle_process = NULL;
+// Списки свободных слотов и хеш-таблицы поиска по идентификатору
+// (изменяются под alloc_lock)
+static spinlock_t alloc_lock = SPINLOCK_INIT;
+static process_t* free_processes = NULL;
+static thread_t* free_threads = NULL;
+static process_t* pid_hash[ID_HASH_SIZE];
+static thread_t* tid_hash[ID_HASH_SIZE];
 static uint32_t next_pid = 1;
 static uint32_t next_tid = 1;
+// Сумма долей, зарезервированных потоками SCHED_DEADLINE
+static spinlock_t dl_lock = SPINLOCK_INIT;
+static uint32_t dl_reserved = 0;
+
+// vruntime процессов общее для всех процессоров. Запись идет под
+// vruntime_lock, чтение - без блокировки по счетчику vruntime_seq,
+// чтобы не получить «разорванное» 64-битное значение. Так же защищены
+// 64-битные счетчики времени в sched_stats_t.
+static spinlock_t vruntime_lock = SPINLOCK_INIT;
+static volatile uint32_t vruntime_seq = 0;
+// Минимальное vruntime среди выполнявшихся процессов (не убывает)
+static uint64_t min_vruntime = 0;
 
 // Внутренние функции
 static process_t* allocate_process();
 static thread_t* allocate_thread();
+static thread_t* create_idle_thread(uint32_t cpu_index);
 static void setup_thread_stack(thread_t* thread, void (*entry_point)());
 static void idle_thread();
+static void user_thread_start();
+static void enqueue_thread(run_queue_t* rq, thread_t* thread);
+static void dequeue_thread(run_queue_t* rq, thread_t* thread);
+static thread_t* pick_next_thread(run_queue_t* rq);
+static thread_t* steal_thread(cpu_t* cpu);
+static run_queue_t* lock_thread_queue(thread_t* thread);
+static uint32_t select_cpu();
+static void kick_cpu(uint32_t cpu_index);
+static void check_preempt(thread_t* thread);
+static bool thread_preempts(thread_t* thread, thread_t* current);
+static void rt_insert(run_queue_t* rq, thread_t* thread, bool head);
+static bool cpu_has_work(cpu_t* cpu);
+static void account_thread(thread_t* thread, uint64_t now);
+static void account_switch(thread_t* prev, thread_t* next, bool preempted, uint64_t now);
+static uint64_t vruntime_read(const uint64_t* value);
+static void vruntime_raise(process_t* process, uint64_t floor);
+static bool wake_thread(thread_t* thread, bool timeout);
+static void free_process(process_t* process);
+static void thread_terminated(thread_t* thread);
+static void thread_release(thread_t* thread);
+
+// Команды оболочки
+static const shell_command_t process_commands[] = {
+    { "top", NULL, "Live CPU usage per thread (q to quit)", run_top },
+    { "spawn-bench", "[N]", "Measure process create/exit cost (N processes)", run_spawn_bench },
+    { "rt-test", "[N]", "Wakeup latency of normal/FIFO/EDF threads under load", run_rt_test },
+};
 
 // Инициализация подсистемы процессов и потоков
 void init_process_manager() {
+    shell_register_all(process_commands, sizeof(process_commands) / sizeof(process_commands[0]));
     memset(processes, 0, sizeof(processes));
     memset(threads, 0, sizeof(threads));
-    
-    // Создаем idle-процесс
-    process_t* idle_proc = create_process(idle_thread, 0);
-    if (idle_proc == NULL) {
-        print_string("Failed to create idle process!\n", LIGHT_RED_ON_BLACK);
+    memset(run_queues, 0, sizeof(run_queues));
+    memset(pid_hash, 0, sizeof(pid_hash));
+    memset(tid_hash, 0, sizeof(tid_hash));
+
+    // Все слоты свободны; первыми выдаются слоты с меньшими номерами
+    free_processes = NULL;
+    for (int i = MAX_PROCESSES - 1; i >= 0; i--) {
+        processes[i].state = PROCESS_TERMINATED;
+        processes[i].next_free = free_processes;
+        free_processes = &processes[i];
+    }
+    free_threads = NULL;
+    for (int i = MAX_PROCESSES * MAX_THREADS_PER_PROCESS - 1; i >= 0; i--) {
+        threads[i].state = PROCESS_TERMINATED;
+        threads[i].stack = thread_stacks[i];
+        threads[i].user_stack = user_stacks[i];
+        threads[i].next_free = free_threads;
+        free_threads = &threads[i];
+    }
+
+    // Создаем idle-процесс: по одному потоку бездействия на процессор.
+    // Эти потоки не стоят в очередях и выбираются, когда очередь пуста.
+    idle_process = allocate_process();
+    if (idle_process == NULL || create_idle_thread(0) == NULL) {
+        klog(KLOG_ERR, "sched: failed to create idle process");
+        return;
+    }
+    idle_process->priority = 0;
+
+    // Процесс ядра: текущий поток выполнения (kmain) становится его главным потоком
+    process_t* kernel_proc = allocate_process();
+    thread_t* boot_thread = allocate_thread();
+    if (kernel_proc == NULL || boot_thread == NULL) {
+        klog(KLOG_ERR, "sched: failed to create kernel process");
         return;
     }
-    
-    current_process = idle_proc;
-    current_thread = idle_proc->threads[0];
-    
+    kernel_proc->priority = KERNEL_PROCESS_PRIORITY;
+    boot_thread->priority = KERNEL_PROCESS_PRIORITY;
+    boot_thread->time_slice = KERNEL_PROCESS_PRIORITY + 1;
+    boot_thread->state = PROCESS_RUNNING;
+    boot_thread->process = kernel_proc;
+    boot_thread->run_start = rdtsc();
+    boot_thread->cpu = 0;
+    boot_thread->on_cpu = true;
+    kernel_proc->threads[kernel_proc->thread_count++] = boot_thread;
+    kernel_proc->alive_threads = 1;
+
+    this_cpu()->current_thread = boot_thread;
+
     print_string("Process manager initialized\n", LIGHT_GREEN_ON_BLACK);
 }
 
 // Создание нового процесса
-process_t* create_process(void (*entry_point)(), uint32_t priority) {
+static process_t* spawn_process(void (*entry_point)(), uint32_t priority, bool user) {
     process_t* proc = allocate_process();
     if (proc == NULL) {
         return NULL;
     }
-    
+
+    proc->user = user;
     proc->priority = priority;
     proc->state = PROCESS_READY;
-    
+    // Новый процесс начинает с текущего минимума, чтобы не вытеснить всех надолго
+    vruntime_raise(proc, vruntime_read(&min_vruntime));
+
     // TODO: Инициализация таблицы страниц и кучи
-    
+
     // Создаем главный поток процесса
     thread_t* main_thread = create_thread(proc, entry_point, priority);
     if (main_thread == NULL) {
-        proc->state = PROCESS_TERMINATED;
+        uint32_t flags = irq_save();
+        spin_lock(&alloc_lock);
+        free_process(proc);
+        spin_unlock(&alloc_lock);
+        irq_restore(flags);
         return NULL;
     }
-    
+
     return proc;
 }
 
+process_t* create_process(void (*entry_point)(), uint32_t priority) {
+    return spawn_process(entry_point, priority, false);
+}
+
+process_t* create_user_process(void (*entry_point)(), uint32_t priority) {
+    return spawn_process(entry_point, priority, true);
+}
+
 // Создание нового потока в процессе
 thread_t* create_thread(process_t* process, void (*entry_point)(), uint32_t priority) {
-    if (process == NULL || process->thread_count >= MAX_THREADS_PER_PROCESS) {
+    if (process == NULL) {
         return NULL;
     }
-    
+
+    uint32_t flags = irq_save();
     thread_t* thread = allocate_thread();
     if (thread == NULL) {
+        irq_restore(flags);
         return NULL;
     }
-    
+
     thread->priority = priority;
-    thread->state = PROCESS_READY;
     thread->time_slice = priority + 1; // Чем выше приоритет, тем больше квант времени
-    
+    thread->process = process;
+
     // Настраиваем стек потока
     setup_thread_stack(thread, entry_point);
-    
-    // Добавляем поток в процесс
-    process->threads[process->thread_count++] = thread;
-    
+
+    // Добавляем поток в процесс (если процесс еще жив и в нем есть место)
+    spin_lock(&alloc_lock);
+    bool attached = process->state != PROCESS_TERMINATED &&
+                    process->thread_count < MAX_THREADS_PER_PROCESS;
+    if (attached) {
+        process->threads[process->thread_count++] = thread;
+        process->alive_threads++;
+    }
+    spin_unlock(&alloc_lock);
+    if (!attached) {
+        thread->process = NULL;
+        thread_release(thread);
+        irq_restore(flags);
+        return NULL;
+    }
+
+    // Новый поток ставится в очередь наименее загруженного процессора
+    uint32_t cpu_index = select_cpu();
+    run_queue_t* rq = &run_queues[cpu_index];
+    spin_lock(&rq->lock);
+    thread->cpu = cpu_index;
+    thread->state = PROCESS_READY;
+    enqueue_thread(rq, thread);
+    spin_unlock(&rq->lock);
+
+    kick_cpu(cpu_index);
+    irq_restore(flags);
+
     return thread;
 }
 
-// Переключение на следующий поток
+// Переключение на следующий поток.
+// Сначала выбираются потоки реального времени (SCHED_DEADLINE, затем
+// SCHED_FIFO). Иначе из очереди своего процессора выбирается готовый
+// поток процесса с наименьшим vruntime, поэтому процессы получают
+// процессорное время пропорционально (priority + 1), а потоки внутри
+// процесса чередуются по кругу. Если своя очередь пуста, поток
+// забирается у другого процессора.
 void schedule() {
-    // TODO: Реализация планировщика (Round Robin с приоритетами)
-    // Пока просто переключаемся на следующий поток в текущем процессе
-    
-    if (current_process == NULL || current_process->thread_count == 0) {
+    uint32_t flags = irq_save();
+    cpu_t* cpu = this_cpu();
+    thread_t* prev = cpu->current_thread;
+    if (prev == NULL) {
+        irq_restore(flags);
         return;
     }
-    
-    uint32_t next_thread_idx = 0;
-    if (current_thread != NULL) {
-        // Ищем следующий поток в процессе
-        for (uint32_t i = 0; i < current_process->thread_count; i++) {
-            if (current_process->threads[i] == current_thread) {
-                next_thread_idx = (i + 1) % current_process->thread_count;
-                break;
-            }
+
+    run_queue_t* rq = &run_queues[cpu->index];
+    uint64_t now = rdtsc();
+
+    spin_lock(&rq->lock);
+    bool forced = cpu->need_resched;
+    cpu->need_resched = false;
+    account_thread(prev, now);
+
+    // Вытесненный поток возвращается в конец очереди. Поток SCHED_FIFO,
+    // вытесненный более приоритетным, встает первым среди равных себе:
+    // в конец своего приоритета он уходит только по thread_yield.
+    bool preempted = prev->state == PROCESS_RUNNING;
+    if (preempted) {
+        prev->state = PROCESS_READY;
+        if (prev == cpu->idle_thread) {
+            // Поток бездействия в очередь не ставится
+        } else if (prev->policy == SCHED_FIFO && forced) {
+            prev->ready_since = now;
+            rt_insert(rq, prev, true);
+        } else {
+            enqueue_thread(rq, prev);
+        }
+    }
+
+    thread_t* next = pick_next_thread(rq);
+    spin_unlock(&rq->lock);
+
+    if (next == NULL) {
+        next = steal_thread(cpu);
+    }
+    if (next == NULL) {
+        next = cpu->idle_thread;
+        next->state = PROCESS_RUNNING;
+    }
+
+    // Рабочему потоку нужен периодический тик для отсчета кванта
+    if (next != cpu->idle_thread) {
+        timer_idle_exit();
+    }
+
+    next->time_slice = next->priority + 1;
+    next->run_start = now;
+    next->cpu = cpu->index;
+    next->on_cpu = true;
+    cpu->current_thread = next;
+    if (next->user_entry != NULL) {
+        cpu_set_kernel_stack((uint32_t)next->stack + THREAD_STACK_SIZE);
+    }
+
+    if (prev != next) {
+        account_switch(prev, next, preempted, now);
+        fpu_switch_out(prev);
+        cpu->prev_thread = prev;
+        switch_context(&prev->context, &next->context);
+        // Здесь продолжает работу поток, на который когда-то переключились
+        // (возможно, уже на другом процессоре)
+        scheduler_finish_switch();
+    }
+
+    irq_restore(flags);
+}
+
+// Завершение переключения: предыдущий поток сохранен и может быть
+// выбран другим процессором
+void scheduler_finish_switch() {
+    cpu_t* cpu = this_cpu();
+    thread_t* prev = cpu->prev_thread;
+    if (prev != NULL) {
+        cpu->prev_thread = NULL;
+        prev->on_cpu = false;
+        // Стек завершенного потока больше не используется: слот свободен.
+        // Барьер в паре с process_exit: слот освободит хотя бы одна сторона.
+        smp_mb();
+        if (prev->state == PROCESS_TERMINATED) {
+            thread_release(prev);
         }
     }
-    
-    thread_t* next_thread = current_process->threads[next_thread_idx];
-    if (next_thread->state != PROCESS_READY && next_thread->state != PROCESS_RUNNING) {
+}
+
+// Добровольная передача процессора
+void thread_yield() {
+    schedule();
+}
+
+// Обработка тика таймера (вызывается с запрещенными прерываниями)
+void scheduler_tick() {
+    cpu_t* cpu = this_cpu();
+    thread_t* current = cpu->current_thread;
+    if (current == NULL) {
+        return;
+    }
+
+    // Простаивающий процессор проверяет свою и чужие очереди
+    if (current == cpu->idle_thread) {
+        if (cpu_has_work(cpu)) {
+            cpu->need_resched = true;
+        }
+        return;
+    }
+
+    if (current->state == PROCESS_TERMINATED) {
+        cpu->need_resched = true;
+        return;
+    }
+
+    // Пока в своей очереди есть потоки, будим простаивающие процессоры
+    run_queue_t* rq = &run_queues[cpu->index];
+    if (rq->length > 0) {
+        kick_cpu(cpu->index);
+    }
+
+    // Поток SCHED_FIFO кванта не имеет; поток SCHED_DEADLINE уступает
+    // процессор, когда исчерпан бюджет периода (schedule() перенесет его
+    // крайний срок на следующий период)
+    if (current->policy == SCHED_FIFO) {
+        return;
+    }
+    if (current->policy == SCHED_DEADLINE) {
+        if ((int64_t)(rdtsc() - current->run_start) >= current->dl_remaining) {
+            cpu->need_resched = true;
+        }
         return;
     }
-    
-    // Сохраняем контекст текущего потока
-    save_context(&current_thread->context);
-    
-    // Переключаемся на следующий поток
-    thread_t* prev_thread = current_thread;
-    current_thread = next_thread;
-    current_thread->state = PROCESS_RUNNING;
-    
-    if (prev_thread != current_thread) {
-        restore_context(&current_thread->context);
+
+    // Обычный поток уступает готовому потоку реального времени
+    if (rq->rt_length > 0) {
+        cpu->need_resched = true;
+        return;
+    }
+
+    if (current->time_slice > 0) {
+        current->time_slice--;
+    }
+    if (current->time_slice == 0) {
+        cpu->need_resched = true;
+    }
+}
+
+// Переключение при выходе из прерывания, если истек квант
+void preempt_if_needed() {
+    if (this_cpu()->need_resched) {
+        schedule();
     }
 }
 
 // Завершение текущего потока
 void thread_exit() {
-    if (current_thread == NULL) {
+    if (get_current_thread() == NULL) {
         return;
     }
-    
-    current_thread->state = PROCESS_TERMINATED;
-    
-    // TODO: Освобождение ресурсов потока
-    
-    // Переключаемся на другой поток
+    irq_disable();
+    thread_t* current = this_cpu()->current_thread;
+
+    // Поток мог быть уже завершен через process_exit
+    run_queue_t* rq = lock_thread_queue(current);
+    bool first_exit = current->state != PROCESS_TERMINATED;
+    current->state = PROCESS_TERMINATED;
+    spin_unlock(&rq->lock);
+    if (first_exit) {
+        thread_terminated(current);
+    }
+
+    // Слот и стек освобождаются в scheduler_finish_switch, когда процессор
+    // уйдет с этого стека
+    // Переключаемся на другой поток (обратно управление не вернется)
     schedule();
 }
 
 // Завершение процесса и всех его потоков
 void process_exit(process_t* process) {
-    if (process == NULL) {
+    if (process == NULL || process == idle_process) {
         return;
     }
-    
+
+    uint32_t flags = irq_save();
+    cpu_t* cpu = this_cpu();
+    thread_t* victims[MAX_THREADS_PER_PROCESS];
+    uint32_t victim_ids[MAX_THREADS_PER_PROCESS];
+    uint32_t count;
+
+    // Снимок списка потоков: завершившиеся потоки удаляются из него
+    spin_lock(&alloc_lock);
     process->state = PROCESS_TERMINATED;
-    
+    count = process->thread_count;
+    for (uint32_t i = 0; i < count; i++) {
+        victims[i] = process->threads[i];
+        victim_ids[i] = victims[i]->id;
+    }
+    spin_unlock(&alloc_lock);
+
     // Завершаем все потоки процесса
-    for (uint32_t i = 0; i < process->thread_count; i++) {
-        if (process->threads[i] != NULL) {
-            process->threads[i]->state = PROCESS_TERMINATED;
-        }
-    }
-    
-    // TODO: Освобождение ресурсов процесса
-    
-    // Если завершается текущий процесс, переключаемся на другой
-    if (process == current_process) {
-        current_process = NULL;
-        current_thread = NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        thread_t* thread = victims[i];
+        run_queue_t* rq = lock_thread_queue(thread);
+        // Слот мог освободиться и достаться другому потоку
+        if (thread->id != victim_ids[i] || thread->process != process ||
+            thread->state == PROCESS_TERMINATED) {
+            spin_unlock(&rq->lock);
+            continue;
+        }
+        if (thread->state == PROCESS_READY) {
+            dequeue_thread(rq, thread);
+        }
+        bool running_elsewhere = thread->state == PROCESS_RUNNING &&
+                                 thread != cpu->current_thread;
+        bool was_blocked = thread->state == PROCESS_BLOCKED;
+        thread->state = PROCESS_TERMINATED;
+        spin_unlock(&rq->lock);
+
+        // Таймер ожидания лежит на стеке потока, который больше не проснется
+        if (was_blocked && thread->wait_timer != NULL) {
+            timer_cancel(thread->wait_timer);
+            thread->wait_timer = NULL;
+        }
+        if (was_blocked) {
+            wait_queue_remove(thread);
+        }
+        thread_terminated(thread);
+
+        // Поток на другом процессоре снимается с него межпроцессорным
+        // прерыванием, не дожидаясь конца кванта
+        if (running_elsewhere) {
+            cpus[thread->cpu].need_resched = true;
+            smp_send_reschedule(thread->cpu);
+        }
+
+        // Поток, который нигде не выполняется, освобождается сразу; иначе
+        // это сделает scheduler_finish_switch на его процессоре
+        smp_mb();
+        if (!thread->on_cpu) {
+            thread_release(thread);
+        }
+    }
+
+    // Если завершается текущий процесс, переключаемся на поток другого процесса
+    if (cpu->current_thread->process == process) {
         schedule();
     }
+    irq_restore(flags);
 }
 
 // Получение текущего процесса
 process_t* get_current_process() {
-    return current_process;
+    thread_t* current = get_current_thread();
+    return current != NULL ? current->process : NULL;
 }
 
 // Получение текущего потока
 thread_t* get_current_thread() {
-    return current_thread;
+    uint32_t flags = irq_save();
+    thread_t* current = this_cpu()->current_thread;
+    irq_restore(flags);
+    return current;
 }
 
 // Блокировка потока
 void block_thread(thread_t* thread) {
     if (thread != NULL) {
-        thread->state = PROCESS_BLOCKED;
-        if (thread == current_thread) {
+        uint32_t flags = irq_save();
+        run_queue_t* rq = lock_thread_queue(thread);
+        // Завершенный через process_exit поток не блокируется: иначе его
+        // слот не освободится, а пробуждение вернет его в работу
+        if (thread->state == PROCESS_READY) {
+            dequeue_thread(rq, thread);
+        }
+        if (thread->state != PROCESS_TERMINATED) {
+            thread->state = PROCESS_BLOCKED;
+        }
+        spin_unlock(&rq->lock);
+        if (thread == this_cpu()->current_thread) {
             schedule();
         }
+        irq_restore(flags);
     }
 }
 
-// Разблокировка потока
+// Разблокировка потока: он возвращается в очередь процессора, на котором
+// выполнялся последним (там теплее кэш)
 void unblock_thread(thread_t* thread) {
-    if (thread != NULL && thread->state == PROCESS_BLOCKED) {
-        thread->state = PROCESS_READY;
+    wake_thread(thread, false);
+}
+
+// Срабатывание таймаута ожидания (из обработчика таймера)
+static void thread_timeout(void* data) {
+    wake_thread((thread_t*)data, true);
+}
+
+void thread_prepare_block() {
+    uint32_t flags = irq_save();
+    thread_t* current = this_cpu()->current_thread;
+    run_queue_t* rq = lock_thread_queue(current);
+    // Поток завершен через process_exit: уходим с процессора сразу,
+    // scheduler_finish_switch освободит слот и стек
+    if (current->state == PROCESS_TERMINATED) {
+        spin_unlock(&rq->lock);
+        schedule();
+    }
+    current->state = PROCESS_BLOCKED;
+    current->timed_out = false;
+    spin_unlock(&rq->lock);
+    irq_restore(flags);
+}
+
+bool thread_wait(uint32_t timeout_ms) {
+    uint32_t flags = irq_save();
+    thread_t* current = this_cpu()->current_thread;
+    ktimer_t timer;
+
+    // Завершение между thread_prepare_block и thread_wait: таймер на стеке,
+    // который сейчас освободится, ставить нельзя
+    run_queue_t* rq = lock_thread_queue(current);
+    bool terminated = current->state == PROCESS_TERMINATED;
+    spin_unlock(&rq->lock);
+    if (terminated) {
+        schedule();
+    }
+
+    if (timeout_ms != 0) {
+        timer_init(&timer, thread_timeout, current);
+        current->wait_timer = &timer;
+        timer_add(&timer, timer_ms_to_ticks(timeout_ms));
+    }
+    // Если поток уже разбужен, schedule() просто вернет его в работу
+    schedule();
+    if (timeout_ms != 0) {
+        timer_cancel(&timer);
+        current->wait_timer = NULL;
+    }
+
+    bool woken = !current->timed_out;
+    irq_restore(flags);
+    return woken;
+}
+
+bool thread_block_timeout(uint32_t timeout_ms) {
+    // Состояние меняется до запуска таймера: пробуждение, пришедшее до
+    // schedule(), вернет поток в очередь и не потеряется
+    uint32_t flags = irq_save();
+    thread_prepare_block();
+    bool woken = thread_wait(timeout_ms);
+    irq_restore(flags);
+    return woken;
+}
+
+void thread_sleep(uint32_t ms) {
+    uint32_t deadline = get_ticks() + timer_ms_to_ticks(ms);
+
+    // Планировщик еще не запущен: ждем прерываний таймера
+    if (get_current_thread() == NULL) {
+        while ((int32_t)(get_ticks() - deadline) < 0) {
+            asm volatile("hlt");
+        }
+        return;
+    }
+
+    while (1) {
+        int32_t remaining = (int32_t)(deadline - get_ticks());
+        if (remaining <= 0) {
+            break;
+        }
+        thread_block_timeout(remaining * (1000 / TIMER_HZ));
     }
 }
 
@@ -210,108 +665,1325 @@ void set_process_priority(process_t* process, uint32_t priority) {
     }
 }
 
+// Смена класса планирования. Готовый поток переставляется в очередь
+// своего класса; выполняющийся пересматривается на следующем тике.
+static void sched_change(thread_t* thread, sched_policy_t policy, uint32_t rt_priority,
+                         uint64_t runtime, uint64_t period) {
+    uint32_t flags = irq_save();
+    run_queue_t* rq = lock_thread_queue(thread);
+    bool queued = thread->state == PROCESS_READY && thread != cpus[thread->cpu].idle_thread;
+    if (queued) {
+        dequeue_thread(rq, thread);
+    }
+    thread->policy = policy;
+    thread->rt_priority = rt_priority;
+    thread->dl_runtime = runtime;
+    thread->dl_period = period;
+    thread->dl_deadline = rdtsc() + period;
+    thread->dl_remaining = (int64_t)runtime;
+    if (queued) {
+        enqueue_thread(rq, thread);
+    }
+    bool running = thread->state == PROCESS_RUNNING;
+    if (running) {
+        cpus[thread->cpu].need_resched = true;
+    }
+    spin_unlock(&rq->lock);
+
+    if (queued) {
+        check_preempt(thread);
+    }
+    irq_restore(flags);
+}
+
+// Возврат доли SCHED_DEADLINE потока в общий резерв
+static void dl_release(thread_t* thread) {
+    uint32_t flags = spin_lock_irqsave(&dl_lock);
+    dl_reserved -= thread->dl_bandwidth;
+    thread->dl_bandwidth = 0;
+    spin_unlock_irqrestore(&dl_lock, flags);
+}
+
+bool sched_set_fifo(thread_t* thread, uint32_t rt_priority) {
+    if (thread == NULL || thread->process == idle_process ||
+        rt_priority < SCHED_FIFO_MIN_PRIORITY || rt_priority > SCHED_FIFO_MAX_PRIORITY) {
+        return false;
+    }
+    dl_release(thread);
+    sched_change(thread, SCHED_FIFO, rt_priority, 0, 0);
+    return true;
+}
+
+bool sched_set_deadline(thread_t* thread, uint32_t runtime_us, uint32_t period_us) {
+    if (thread == NULL || thread->process == idle_process ||
+        runtime_us == 0 || runtime_us > period_us) {
+        return false;
+    }
+
+    // Контроль допуска: новая доля вместе с уже выданными не должна
+    // превышать DL_BANDWIDTH_LIMIT на каждый запущенный процессор
+    uint32_t bandwidth = (uint32_t)udiv64_32((uint64_t)runtime_us << DL_BANDWIDTH_SHIFT,
+                                             period_us, NULL);
+    uint32_t limit = cpu_online_count() * DL_BANDWIDTH_LIMIT;
+    uint32_t flags = spin_lock_irqsave(&dl_lock);
+    uint32_t others = dl_reserved - thread->dl_bandwidth;
+    bool admitted = others + bandwidth <= limit;
+    if (admitted) {
+        dl_reserved = others + bandwidth;
+        thread->dl_bandwidth = bandwidth;
+    }
+    spin_unlock_irqrestore(&dl_lock, flags);
+    if (!admitted) {
+        return false;
+    }
+
+    uint32_t tsc_per_ms = timer_tsc_per_ms();
+    uint64_t runtime = udiv64_32((uint64_t)runtime_us * tsc_per_ms, 1000, NULL);
+    uint64_t period = udiv64_32((uint64_t)period_us * tsc_per_ms, 1000, NULL);
+    if (runtime == 0) {
+        runtime = 1;
+    }
+    sched_change(thread, SCHED_DEADLINE, 0, runtime, period);
+    return true;
+}
+
+void sched_set_normal(thread_t* thread) {
+    if (thread == NULL) {
+        return;
+    }
+    dl_release(thread);
+    sched_change(thread, SCHED_NORMAL, 0, 0, 0);
+}
+
+uint32_t sched_dl_reserved(void) {
+    return dl_reserved;
+}
+
+bool sched_wait_next_period(void) {
+    uint32_t flags = irq_save();
+    thread_t* current = this_cpu()->current_thread;
+    if (current->policy != SCHED_DEADLINE) {
+        irq_restore(flags);
+        return false;
+    }
+
+    // Остаток бюджета сгорает; следующий период начинается с крайнего
+    // срока текущего (если бюджет был превышен, срок уже перенесен)
+    run_queue_t* rq = lock_thread_queue(current);
+    account_thread(current, rdtsc());
+    uint64_t release = current->dl_deadline;
+    current->dl_deadline += current->dl_period;
+    current->dl_remaining = (int64_t)current->dl_runtime;
+    spin_unlock(&rq->lock);
+    irq_restore(flags);
+
+    uint64_t now = rdtsc();
+    if (now >= release) {
+        current->woken_at = now;
+        return false;
+    }
+    uint32_t us = (uint32_t)timer_cycles_to_us(release - now);
+    thread_sleep((us + 999) / 1000);
+    return true;
+}
+
+// Создание потока бездействия для дополнительного процессора
+bool scheduler_prepare_cpu(uint32_t cpu_index) {
+    return create_idle_thread(cpu_index) != NULL;
+}
+
+// Первый вход планировщика на дополнительном процессоре
+void scheduler_start_cpu() {
+    irq_disable();
+    cpu_t* cpu = this_cpu();
+    thread_t* idle = cpu->idle_thread;
+    cpu_context_t boot_context;
+
+    idle->state = PROCESS_RUNNING;
+    idle->on_cpu = true;
+    idle->run_start = rdtsc();
+    cpu->current_thread = idle;
+    cpu->online = true;
+
+    // Загрузочный стек процессора больше не нужен
+    switch_context(&boot_context, &idle->context);
+}
+
+uint32_t scheduler_queue_length(uint32_t cpu_index) {
+    return run_queues[cpu_index].length;
+}
+
 // ========== Внутренние функции ==========
 
-// Выделение структуры процесса
+// Выделение структуры процесса из списка свободных
 static process_t* allocate_process() {
-    for (uint32_t i = 0; i < MAX_PROCESSES; i++) {
-        if (processes[i].state == PROCESS_TERMINATED || processes[i].state == PROCESS_NEW) {
-            processes[i].id = next_pid++;
-            processes[i].state = PROCESS_READY;
-            processes[i].thread_count = 0;
-            return &processes[i];
-        }
+    uint32_t flags = irq_save();
+    spin_lock(&alloc_lock);
+    process_t* result = free_processes;
+    if (result != NULL) {
+        free_processes = result->next_free;
+        result->id = next_pid++;
+        result->state = PROCESS_READY;
+        result->thread_count = 0;
+        result->alive_threads = 0;
+        result->user = false;
+        result->vruntime = 0;
+        memset(&result->stats, 0, sizeof(result->stats));
+        result->next_free = NULL;
+        result->hash_next = pid_hash[result->id & (ID_HASH_SIZE - 1)];
+        pid_hash[result->id & (ID_HASH_SIZE - 1)] = result;
     }
-    return NULL;
+    spin_unlock(&alloc_lock);
+    irq_restore(flags);
+    return result;
+}
+
+// Возврат процесса в список свободных (под alloc_lock)
+static void free_process(process_t* process) {
+    process_t** link = &pid_hash[process->id & (ID_HASH_SIZE - 1)];
+    while (*link != NULL && *link != process) {
+        link = &(*link)->hash_next;
+    }
+    if (*link == process) {
+        *link = process->hash_next;
+    }
+    process->hash_next = NULL;
+    process->state = PROCESS_TERMINATED;
+    process->next_free = free_processes;
+    free_processes = process;
 }
 
-// Выделение структуры потока
+// Выделение структуры потока из списка свободных. Слот попадает в список
+// только после того, как процессор ушел с его стека.
 static thread_t* allocate_thread() {
-    for (uint32_t i = 0; i < MAX_PROCESSES * MAX_THREADS_PER_PROCESS; i++) {
-        if (threads[i].state == PROCESS_TERMINATED || threads[i].state == PROCESS_NEW) {
-            threads[i].id = next_tid++;
-            threads[i].state = PROCESS_READY;
-            threads[i].stack = thread_stacks[i];
-            return &threads[i];
+    uint32_t flags = irq_save();
+    spin_lock(&alloc_lock);
+    thread_t* result = free_threads;
+    if (result != NULL) {
+        free_threads = result->next_free;
+        result->id = next_tid++;
+        result->state = PROCESS_NEW;
+        result->next_ready = NULL;
+        result->next_free = NULL;
+        result->on_cpu = false;
+        result->reaped = 0;
+        result->pending_wait = 0;
+        memset(&result->stats, 0, sizeof(result->stats));
+        result->wait_timer = NULL;
+        result->wait_queue = NULL;
+        result->wait_next = NULL;
+        result->policy = SCHED_NORMAL;
+        result->rt_priority = 0;
+        result->dl_bandwidth = 0;
+        result->woken_at = 0;
+        fpu_thread_init(result);
+        result->hash_next = tid_hash[result->id & (ID_HASH_SIZE - 1)];
+        tid_hash[result->id & (ID_HASH_SIZE - 1)] = result;
+    }
+    spin_unlock(&alloc_lock);
+    irq_restore(flags);
+    return result;
+}
+
+// Учет завершения потока (вызывается ровно один раз - тем, кто перевел
+// поток в PROCESS_TERMINATED). Процесс завершается с последним потоком.
+static void thread_terminated(thread_t* thread) {
+    process_t* process = thread->process;
+    if (thread->dl_bandwidth != 0) {
+        dl_release(thread);
+    }
+    uint32_t flags = irq_save();
+    spin_lock(&alloc_lock);
+    if (process->alive_threads > 0 && --process->alive_threads == 0) {
+        process->state = PROCESS_TERMINATED;
+    }
+    spin_unlock(&alloc_lock);
+    irq_restore(flags);
+}
+
+// Возврат слота и стека завершенного потока. Могут вызвать и
+// process_exit, и scheduler_finish_switch: освобождает первый.
+static void thread_release(thread_t* thread) {
+    if (__atomic_exchange_n(&thread->reaped, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    spin_lock(&alloc_lock);
+    thread_t** link = &tid_hash[thread->id & (ID_HASH_SIZE - 1)];
+    while (*link != NULL && *link != thread) {
+        link = &(*link)->hash_next;
+    }
+    if (*link == thread) {
+        *link = thread->hash_next;
+    }
+    thread->hash_next = NULL;
+
+    process_t* process = thread->process;
+    if (process != NULL) {
+        for (uint32_t i = 0; i < process->thread_count; i++) {
+            if (process->threads[i] == thread) {
+                process->threads[i] = process->threads[--process->thread_count];
+                process->threads[process->thread_count] = NULL;
+                break;
+            }
+        }
+        // Последний поток завершенного процесса освобождает и процесс
+        if (process->thread_count == 0 && process->state == PROCESS_TERMINATED) {
+            free_process(process);
+        }
+    }
+
+    thread->state = PROCESS_TERMINATED;
+    thread->next_free = free_threads;
+    free_threads = thread;
+    spin_unlock(&alloc_lock);
+    irq_restore(flags);
+}
+
+process_t* find_process(uint32_t pid) {
+    uint32_t flags = irq_save();
+    spin_lock(&alloc_lock);
+    process_t* process = pid_hash[pid & (ID_HASH_SIZE - 1)];
+    while (process != NULL && process->id != pid) {
+        process = process->hash_next;
+    }
+    spin_unlock(&alloc_lock);
+    irq_restore(flags);
+    return process;
+}
+
+thread_t* find_thread(uint32_t tid) {
+    uint32_t flags = irq_save();
+    spin_lock(&alloc_lock);
+    thread_t* thread = tid_hash[tid & (ID_HASH_SIZE - 1)];
+    while (thread != NULL && thread->id != tid) {
+        thread = thread->hash_next;
+    }
+    spin_unlock(&alloc_lock);
+    irq_restore(flags);
+    return thread;
+}
+
+// Поток бездействия процессора: принадлежит idle-процессу, в очередь не ставится
+static thread_t* create_idle_thread(uint32_t cpu_index) {
+    if (idle_process->thread_count >= MAX_THREADS_PER_PROCESS) {
+        return NULL;
+    }
+    thread_t* thread = allocate_thread();
+    if (thread == NULL) {
+        return NULL;
+    }
+    thread->priority = 0;
+    thread->time_slice = 1;
+    thread->process = idle_process;
+    thread->cpu = cpu_index;
+    thread->state = PROCESS_READY;
+    setup_thread_stack(thread, idle_thread);
+    uint32_t flags = spin_lock_irqsave(&alloc_lock);
+    idle_process->threads[idle_process->thread_count++] = thread;
+    idle_process->alive_threads++;
+    spin_unlock_irqrestore(&alloc_lock, flags);
+    cpus[cpu_index].idle_thread = thread;
+    return thread;
+}
+
+// Вставка потока реального времени в отсортированный список своего
+// класса (под rq->lock). head - перед равными, иначе после них.
+static void rt_insert(run_queue_t* rq, thread_t* thread, bool head) {
+    bool deadline = thread->policy == SCHED_DEADLINE;
+    thread_t** link = deadline ? &rq->dl_head : &rq->rt_head;
+    while (*link != NULL) {
+        thread_t* t = *link;
+        bool before;
+        if (deadline) {
+            before = head ? (int64_t)(thread->dl_deadline - t->dl_deadline) <= 0
+                          : (int64_t)(thread->dl_deadline - t->dl_deadline) < 0;
+        } else {
+            before = head ? thread->rt_priority >= t->rt_priority
+                          : thread->rt_priority > t->rt_priority;
+        }
+        if (before) {
+            break;
+        }
+        link = &t->next_ready;
+    }
+    thread->next_ready = *link;
+    *link = thread;
+    rq->length++;
+    rq->rt_length++;
+}
+
+// Постановка потока в конец очереди готовых (под rq->lock)
+static void enqueue_thread(run_queue_t* rq, thread_t* thread) {
+    thread->ready_since = rdtsc();
+    if (thread->policy != SCHED_NORMAL) {
+        rt_insert(rq, thread, false);
+        return;
+    }
+    thread->next_ready = NULL;
+    if (rq->tail != NULL) {
+        rq->tail->next_ready = thread;
+    } else {
+        rq->head = thread;
+    }
+    rq->tail = thread;
+    rq->length++;
+}
+
+// Удаление потока из очереди готовых (под rq->lock)
+static void dequeue_thread(run_queue_t* rq, thread_t* thread) {
+    if (thread->policy != SCHED_NORMAL) {
+        thread_t** link = thread->policy == SCHED_DEADLINE ? &rq->dl_head : &rq->rt_head;
+        while (*link != NULL && *link != thread) {
+            link = &(*link)->next_ready;
+        }
+        if (*link == thread) {
+            *link = thread->next_ready;
+            thread->next_ready = NULL;
+            rq->length--;
+            rq->rt_length--;
+        }
+        return;
+    }
+
+    thread_t* prev = NULL;
+    for (thread_t* t = rq->head; t != NULL; prev = t, t = t->next_ready) {
+        if (t == thread) {
+            if (prev != NULL) {
+                prev->next_ready = t->next_ready;
+            } else {
+                rq->head = t->next_ready;
+            }
+            if (rq->tail == t) {
+                rq->tail = prev;
+            }
+            t->next_ready = NULL;
+            rq->length--;
+            return;
+        }
+    }
+}
+
+// Выбор следующего потока (под rq->lock): поток с ближайшим крайним
+// сроком, затем самый приоритетный SCHED_FIFO, затем первый в очереди
+// поток процесса с наименьшим vruntime
+static thread_t* pick_next_thread(run_queue_t* rq) {
+    thread_t* rt = rq->dl_head != NULL ? rq->dl_head : rq->rt_head;
+    if (rt != NULL) {
+        dequeue_thread(rq, rt);
+        rt->state = PROCESS_RUNNING;
+        return rt;
+    }
+
+    thread_t* best = NULL;
+    uint64_t best_vruntime = 0;
+    for (thread_t* t = rq->head; t != NULL; t = t->next_ready) {
+        uint64_t vruntime = vruntime_read(&t->process->vruntime);
+        if (best == NULL || vruntime < best_vruntime) {
+            best = t;
+            best_vruntime = vruntime;
+        }
+    }
+    if (best != NULL) {
+        dequeue_thread(rq, best);
+        best->state = PROCESS_RUNNING;
+
+        spin_lock(&vruntime_lock);
+        vruntime_seq++;
+        if (best_vruntime > min_vruntime) {
+            min_vruntime = best_vruntime;
+        }
+        vruntime_seq++;
+        spin_unlock(&vruntime_lock);
+    }
+    return best;
+}
+
+// Перенос потока из очереди другого процессора. Первыми забираются
+// ждущие потоки реального времени (в порядке их списков); из обычных
+// берется последний поток очереди (его кэш наиболее «остыл»). Потоки,
+// еще не сохраненные при переключении (on_cpu), пропускаются.
+static thread_t* steal_thread(cpu_t* cpu) {
+    for (uint32_t n = 1; n < MAX_CPUS; n++) {
+        uint32_t victim = (cpu->index + n) % MAX_CPUS;
+        run_queue_t* rq = &run_queues[victim];
+        if (!cpus[victim].online || rq->length == 0) {
+            continue;
+        }
+
+        spin_lock(&rq->lock);
+        thread_t* candidate = NULL;
+        for (thread_t* t = rq->dl_head; t != NULL && candidate == NULL; t = t->next_ready) {
+            if (!t->on_cpu) {
+                candidate = t;
+            }
+        }
+        for (thread_t* t = rq->rt_head; t != NULL && candidate == NULL; t = t->next_ready) {
+            if (!t->on_cpu) {
+                candidate = t;
+            }
+        }
+        if (candidate == NULL) {
+            for (thread_t* t = rq->head; t != NULL; t = t->next_ready) {
+                if (!t->on_cpu) {
+                    candidate = t;
+                }
+            }
+        }
+        if (candidate != NULL) {
+            dequeue_thread(rq, candidate);
+            candidate->state = PROCESS_RUNNING;
+            candidate->cpu = cpu->index;
+        }
+        spin_unlock(&rq->lock);
+
+        if (candidate != NULL) {
+            return candidate;
         }
     }
     return NULL;
 }
 
+// Блокировка очереди, которой принадлежит поток (поток может переехать,
+// пока мы ждем блокировку, поэтому проверяем еще раз)
+static run_queue_t* lock_thread_queue(thread_t* thread) {
+    while (1) {
+        uint32_t cpu_index = thread->cpu;
+        run_queue_t* rq = &run_queues[cpu_index];
+        spin_lock(&rq->lock);
+        if (thread->cpu == cpu_index) {
+            return rq;
+        }
+        spin_unlock(&rq->lock);
+    }
+}
+
+// Наименее загруженный из запущенных процессоров
+static uint32_t select_cpu() {
+    uint32_t best = this_cpu()->index;
+    uint32_t best_load = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (!cpus[i].online) {
+            continue;
+        }
+        uint32_t load = run_queues[i].length;
+        if (cpus[i].current_thread != cpus[i].idle_thread) {
+            load++;
+        }
+        if (load < best_load) {
+            best = i;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+// Возврат заблокированного потока в очередь готовых
+static bool wake_thread(thread_t* thread, bool timeout) {
+    if (thread == NULL) {
+        return false;
+    }
+
+    uint32_t flags = irq_save();
+    bool woken = false;
+    run_queue_t* rq = lock_thread_queue(thread);
+    // Будится только заблокированный поток: завершенный (PROCESS_TERMINATED)
+    // в очередь не возвращается
+    if (thread->state == PROCESS_BLOCKED) {
+        uint64_t now = rdtsc();
+        // Простаивавший процесс не получает «накопленного» времени
+        vruntime_raise(thread->process, vruntime_read(&min_vruntime));
+        // Поток SCHED_DEADLINE, проспавший свой крайний срок, начинает
+        // новый период с полным бюджетом
+        if (thread->policy == SCHED_DEADLINE && (int64_t)(now - thread->dl_deadline) >= 0) {
+            thread->dl_deadline = now + thread->dl_period;
+            thread->dl_remaining = (int64_t)thread->dl_runtime;
+        }
+        thread->woken_at = now;
+        thread->timed_out = timeout;
+        thread->state = PROCESS_READY;
+        enqueue_thread(rq, thread);
+        woken = true;
+    }
+    spin_unlock(&rq->lock);
+
+    if (woken) {
+        check_preempt(thread);
+    }
+    irq_restore(flags);
+    return woken;
+}
+
+// Сообщить процессору, что в его очереди появилась работа. Если он занят,
+// будим простаивающий процессор, чтобы тот забрал поток себе.
+static void kick_cpu(uint32_t cpu_index) {
+    uint32_t self = this_cpu()->index;
+    uint32_t target = cpu_index;
+
+    if (cpus[target].current_thread != cpus[target].idle_thread) {
+        for (uint32_t i = 0; i < MAX_CPUS; i++) {
+            if (cpus[i].online && cpus[i].current_thread == cpus[i].idle_thread) {
+                target = i;
+                break;
+            }
+        }
+    }
+    if (cpus[target].current_thread != cpus[target].idle_thread) {
+        return;
+    }
+
+    cpus[target].need_resched = true;
+    if (target != self) {
+        smp_send_reschedule(target);
+    }
+}
+
+// Вытесняет ли готовый поток thread выполняющийся поток current
+static bool thread_preempts(thread_t* thread, thread_t* current) {
+    if (current == NULL || current->process == idle_process ||
+        thread->policy > current->policy) {
+        return true;
+    }
+    if (thread->policy != current->policy) {
+        return false;
+    }
+    if (thread->policy == SCHED_DEADLINE) {
+        return (int64_t)(thread->dl_deadline - current->dl_deadline) < 0;
+    }
+    if (thread->policy == SCHED_FIFO) {
+        return thread->rt_priority > current->rt_priority;
+    }
+    return false;
+}
+
+// Поток встал в очередь своего процессора. Поток реального времени
+// вытесняет менее важный поток этого процессора сразу (через IPI, а не по
+// тику); обычный только будит простаивающий процессор. Текущий поток
+// чужого процессора читается без блокировки: ошибка приведет лишь к
+// лишнему или запоздавшему на тик переключению.
+static void check_preempt(thread_t* thread) {
+    uint32_t target = thread->cpu;
+    if (thread->policy == SCHED_NORMAL ||
+        !thread_preempts(thread, cpus[target].current_thread)) {
+        kick_cpu(target);
+        return;
+    }
+    cpus[target].need_resched = true;
+    if (target != this_cpu()->index) {
+        smp_send_reschedule(target);
+    }
+}
+
+// Есть ли готовые потоки в своей или чужих очередях
+static bool cpu_has_work(cpu_t* cpu) {
+    if (run_queues[cpu->index].length > 0) {
+        return true;
+    }
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (cpus[i].online && run_queues[i].length > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Согласованное чтение 64-битного vruntime без блокировки
+static uint64_t vruntime_read(const uint64_t* value) {
+    uint32_t seq;
+    uint64_t result;
+    do {
+        while ((seq = vruntime_seq) & 1) {
+            cpu_relax();
+        }
+        asm volatile ("" : : : "memory");
+        result = *(const volatile uint64_t*)value;
+        asm volatile ("" : : : "memory");
+    } while (seq != vruntime_seq);
+    return result;
+}
+
+// Подтягивание vruntime процесса не ниже floor
+static void vruntime_raise(process_t* process, uint64_t floor) {
+    uint32_t flags = irq_save();
+    spin_lock(&vruntime_lock);
+    vruntime_seq++;
+    if (process->vruntime < floor) {
+        process->vruntime = floor;
+    }
+    vruntime_seq++;
+    spin_unlock(&vruntime_lock);
+    irq_restore(flags);
+}
+
+// Начисление потоку и процессу времени работы, а процессу - еще и
+// виртуального времени. Здесь же в статистику переносится время, которое
+// поток провел в очереди перед этим запуском.
+static void account_thread(thread_t* thread, uint64_t now) {
+    uint64_t delta = now - thread->run_start;
+    // Ограничиваем дельту 32 битами, чтобы обойтись без 64-битного деления
+    uint32_t cycles = delta > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)delta;
+    process_t* process = thread->process;
+
+    spin_lock(&vruntime_lock);
+    vruntime_seq++;
+    if (process != idle_process) {
+        process->vruntime += cycles / (process->priority + 1);
+    }
+    thread->stats.run_cycles += cycles;
+    process->stats.run_cycles += cycles;
+    thread->stats.wait_cycles += thread->pending_wait;
+    process->stats.wait_cycles += thread->pending_wait;
+    vruntime_seq++;
+    spin_unlock(&vruntime_lock);
+
+    // Бюджет SCHED_DEADLINE: при перерасходе крайний срок переносится на
+    // следующий период с новым бюджетом, и поток уступает тем, чей срок
+    // теперь ближе (поля dl_* меняются под блокировкой очереди потока)
+    if (thread->policy == SCHED_DEADLINE) {
+        thread->dl_remaining -= cycles;
+        while (thread->dl_remaining <= 0) {
+            thread->dl_deadline += thread->dl_period;
+            thread->dl_remaining += (int64_t)thread->dl_runtime;
+        }
+    }
+
+    thread->pending_wait = 0;
+    thread->run_start = now;
+}
+
+// Счетчики переключений и время ожидания следующего потока в очереди.
+// Поля потока пишет только процессор, на котором поток выполняется;
+// счетчики процесса общие, поэтому увеличиваются атомарно.
+static void account_switch(thread_t* prev, thread_t* next, bool preempted, uint64_t now) {
+    if (preempted) {
+        prev->stats.involuntary_switches++;
+        __atomic_fetch_add(&prev->process->stats.involuntary_switches, 1, __ATOMIC_RELAXED);
+    } else {
+        prev->stats.voluntary_switches++;
+        __atomic_fetch_add(&prev->process->stats.voluntary_switches, 1, __ATOMIC_RELAXED);
+    }
+
+    // Поток бездействия в очередь не ставится
+    if (next != this_cpu()->idle_thread && now > next->ready_since) {
+        uint64_t waited = now - next->ready_since;
+        next->pending_wait = waited > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)waited;
+    }
+    next->stats.last_cpu = next->cpu;
+    next->process->stats.last_cpu = next->cpu;
+}
+
+void sched_stats_read(const sched_stats_t* stats, sched_stats_t* out) {
+    uint32_t seq;
+    do {
+        while ((seq = vruntime_seq) & 1) {
+            cpu_relax();
+        }
+        asm volatile ("" : : : "memory");
+        *out = *(const volatile sched_stats_t*)stats;
+        asm volatile ("" : : : "memory");
+    } while (seq != vruntime_seq);
+}
+
+// Точка входа нового потока: завершаем переключение, разрешаем прерывания
+// и вызываем функцию потока
+asm (
+    ".section .text\n"
+    "thread_trampoline:\n"
+    "    call scheduler_finish_switch\n"
+    "    sti\n"
+    "    call *%ebx\n"
+    "    call thread_exit\n"
+    "1:  hlt\n"
+    "    jmp 1b\n"
+);
+
+extern char thread_trampoline[];
+
 // Настройка стека потока
 static void setup_thread_stack(thread_t* thread, void (*entry_point)()) {
     if (thread == NULL || entry_point == NULL) {
         return;
     }
-    
+
     // Инициализируем стек потока
     uint8_t* stack_top = thread->stack + THREAD_STACK_SIZE;
-    
+
     // Выравниваем стек по 16 байтам
     stack_top = (uint8_t*)((uint32_t)stack_top & ~0xF);
-    
-    // Сохраняем адрес возврата (точку входа в поток)
-    *((uint32_t*)stack_top - 1) = (uint32_t)entry_point;
-    
-    // Настраиваем контекст потока
-    thread->context.esp = (uint32_t)stack_top - sizeof(uint32_t);
-    thread->context.ebp = thread->context.esp;
-    thread->context.eip = (uint32_t)entry_point;
+
+    // Настраиваем контекст потока: первый запуск идет через thread_trampoline,
+    // адрес функции потока передается в EBX
+    memset(&thread->context, 0, sizeof(thread->context));
+    thread->context.esp = (uint32_t)stack_top;
+    thread->context.ebp = 0;
+    thread->context.ebx = (uint32_t)entry_point;
+    thread->context.eip = (uint32_t)thread_trampoline;
+
+    // Поток пользовательского процесса стартует в ядре и переходит в кольцо 3
+    thread->user_entry = NULL;
+    if (thread->process != NULL && thread->process->user) {
+        thread->user_entry = entry_point;
+        thread->context.ebx = (uint32_t)user_thread_start;
+    }
     thread->context.eflags = 0x202; // IF=1, остальные флаги по умолчанию
 }
 
-// Поток бездействия (заглушка)
+// Переход в кольцо 3: iret на точку входа со стеком пользователя. Когда
+// функция потока вернется, она попадет в syscall_user_exit (кольцо 3),
+// которая завершит поток системным вызовом.
+void enter_user_mode(uint32_t eip, uint32_t esp);
+asm (
+    ".section .text\n"
+    ".global enter_user_mode\n"
+    "enter_user_mode:\n"
+    "    cli\n"
+    "    movl 4(%esp), %ecx\n"         // eip
+    "    movl 8(%esp), %edx\n"         // esp
+    "    movw $" STR(GDT_USER_DATA_SELECTOR) ", %ax\n"
+    "    movw %ax, %ds\n"
+    "    movw %ax, %es\n"
+    "    movw %ax, %fs\n"
+    "    movw %ax, %gs\n"
+    "    pushl $" STR(GDT_USER_DATA_SELECTOR) "\n"
+    "    pushl %edx\n"
+    "    pushl $0x202\n"               // IF=1, IOPL=0
+    "    pushl $" STR(GDT_USER_CODE_SELECTOR) "\n"
+    "    pushl %ecx\n"
+    "    iret\n"
+);
+
+static void user_thread_start() {
+    thread_t* current = get_current_thread();
+    uint32_t* user_esp = (uint32_t*)(current->user_stack + USER_STACK_SIZE);
+    *--user_esp = (uint32_t)syscall_user_exit;      // Адрес возврата
+    enter_user_mode((uint32_t)current->user_entry, (uint32_t)user_esp);
+}
+
+// Поток бездействия: проверка работы и hlt выполняются с запрещенными
+// прерываниями, «sti; hlt» атомарны, поэтому пробуждение не теряется.
+// На время простоя периодический тик заменяется однократным таймером;
+// тик возобновляет schedule() при переключении на рабочий поток.
 static void idle_thread() {
     while (1) {
-        asm volatile("hlt");
+        irq_disable();
+        cpu_t* cpu = this_cpu();
+        if (cpu->need_resched || cpu_has_work(cpu)) {
+            irq_enable();
+            schedule();
+        } else {
+            timer_idle_enter();
+            asm volatile("sti; hlt");
+        }
+    }
+}
+
+// ============== top ==============
+// Загрузка считается по разнице run_cycles между двумя снимками; поток,
+// который выполняется прямо сейчас, получает еще и время с run_start.
+// Экран перерисовывается построчно через console_goto, без прокрутки.
+
+typedef struct {
+    thread_t* thread;
+    uint32_t id;
+    uint64_t cycles;        // run_cycles на момент снимка
+    uint32_t delta;         // Загрузка за интервал (в десятых долях процента)
+} top_entry_t;
+
+static top_entry_t top_prev[TOP_MAX_THREADS];
+static top_entry_t top_rows[TOP_MAX_THREADS];
+
+// Доля part от whole в десятых долях процента (без 64-битного деления)
+static uint32_t top_per_mille(uint64_t part, uint64_t whole) {
+    while (whole > 0xFFFFFFFFull) {
+        part >>= 1;
+        whole >>= 1;
+    }
+    if (whole == 0) {
+        return 0;
+    }
+    if (part > whole) {
+        part = whole;
+    }
+    return (uint32_t)udiv64_32(part * 1000, (uint32_t)whole, NULL);
+}
+
+// Полное время работы потока, включая текущий запуск
+static uint64_t top_thread_cycles(thread_t* thread, uint64_t now, sched_stats_t* stats) {
+    sched_stats_read(&thread->stats, stats);
+    uint64_t cycles = stats->run_cycles;
+    uint64_t start = thread->run_start;
+    if (thread->on_cpu && thread->state == PROCESS_RUNNING && now > start) {
+        cycles += now - start;
+    }
+    return cycles;
+}
+
+// Добавление поля к строке с выравниванием по ширине
+static void top_append(char* line, uint32_t* len, const char* text, uint32_t width) {
+    uint32_t start = *len;
+    while (*text != '\0' && *len < TOP_LINE_SIZE - 1) {
+        line[(*len)++] = *text++;
+    }
+    while (*len < start + width && *len < TOP_LINE_SIZE - 1) {
+        line[(*len)++] = ' ';
+    }
+    line[*len] = '\0';
+}
+
+static void top_append_number(char* line, uint32_t* len, uint32_t value, uint32_t width) {
+    char num_str[12];
+    ksnprintf(num_str, sizeof(num_str), "%u", value);
+    top_append(line, len, num_str, width);
+}
+
+static void top_append_percent(char* line, uint32_t* len, uint32_t per_mille, uint32_t width) {
+    char num_str[16];
+    ksnprintf(num_str, sizeof(num_str), "%u.%u%%", per_mille / 10, per_mille % 10);
+    top_append(line, len, num_str, width);
+}
+
+// Вывод строки экрана с затиранием остатка предыдущего содержимого.
+// Последний столбец не трогаем, чтобы курсор не перешел на новую строку.
+static void top_print_line(int screen_row, char* line, uint32_t len, char color) {
+    uint32_t columns = console_columns() - 1;
+    if (columns > TOP_LINE_SIZE - 1) {
+        columns = TOP_LINE_SIZE - 1;
+    }
+    while (len < columns) {
+        line[len++] = ' ';
+    }
+    line[columns] = '\0';
+    console_goto(screen_row, 0);
+    print_string(line, color);
+}
+
+// Снимок всех живых потоков; возвращает число строк в top_rows
+static uint32_t top_sample(uint64_t now, uint64_t interval) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < TOP_MAX_THREADS; i++) {
+        thread_t* thread = &threads[i];
+        sched_stats_t stats;
+        if (thread->state == PROCESS_TERMINATED || thread->state == PROCESS_NEW ||
+            thread->process == NULL) {
+            top_prev[i].thread = NULL;
+            continue;
+        }
+        uint64_t cycles = top_thread_cycles(thread, now, &stats);
+        uint64_t delta = cycles;
+        if (top_prev[i].thread == thread && top_prev[i].id == thread->id &&
+            cycles >= top_prev[i].cycles) {
+            delta = cycles - top_prev[i].cycles;
+        }
+        top_prev[i].thread = thread;
+        top_prev[i].id = thread->id;
+        top_prev[i].cycles = cycles;
+
+        top_rows[count] = top_prev[i];
+        top_rows[count].delta = top_per_mille(delta, interval);
+        count++;
+    }
+
+    // Сортировка вставками по убыванию загрузки
+    for (uint32_t i = 1; i < count; i++) {
+        top_entry_t entry = top_rows[i];
+        uint32_t j = i;
+        while (j > 0 && top_rows[j - 1].delta < entry.delta) {
+            top_rows[j] = top_rows[j - 1];
+            j--;
+        }
+        top_rows[j] = entry;
+    }
+    return count;
+}
+
+static void top_draw(uint32_t count, uint64_t interval) {
+    char line[TOP_LINE_SIZE];
+    uint32_t len = 0;
+    int screen_row = 0;
+    int rows = console_rows();
+
+    top_append(line, &len, "top - ", 0);
+    top_append_number(line, &len, get_ticks() / TIMER_HZ, 0);
+    top_append(line, &len, "s up, ", 0);
+    top_append_number(line, &len, cpu_online_count(), 0);
+    top_append(line, &len, " CPU(s), ", 0);
+    top_append_number(line, &len, udiv64_32(timer_cycles_to_us(interval), 1000, NULL), 0);
+    top_append(line, &len, " ms interval, q to quit", 0);
+    top_print_line(screen_row++, line, len, WHITE_ON_BLACK);
+
+    // Загрузка процессоров: все, кроме времени потока бездействия
+    len = 0;
+    line[0] = '\0';
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        if (!cpus[c].online) {
+            continue;
+        }
+        uint32_t idle = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (top_rows[i].thread == cpus[c].idle_thread) {
+                idle = top_rows[i].delta;
+            }
+        }
+        top_append(line, &len, "CPU", 0);
+        top_append_number(line, &len, c, 0);
+        top_append(line, &len, " ", 0);
+        top_append_percent(line, &len, 1000 - idle, 8);
+    }
+    top_print_line(screen_row++, line, len, LIGHT_BLUE_ON_BLACK);
+    top_print_line(screen_row++, line, 0, WHITE_ON_BLACK);
+
+    len = 0;
+    top_append(line, &len, "TID", 6);
+    top_append(line, &len, "PID", 6);
+    top_append(line, &len, "CPU%", 8);
+    top_append(line, &len, "Time(ms)", 10);
+    top_append(line, &len, "Wait(ms)", 10);
+    top_append(line, &len, "Vol", 8);
+    top_append(line, &len, "Invol", 8);
+    top_append(line, &len, "CPU", 5);
+    top_append(line, &len, "State", 0);
+    top_print_line(screen_row++, line, len, LIGHT_GREEN_ON_BLACK);
+
+    for (uint32_t i = 0; i < count && screen_row < rows; i++) {
+        thread_t* thread = top_rows[i].thread;
+        if (thread->process == idle_process) {
+            continue;
+        }
+        sched_stats_t stats;
+        sched_stats_read(&thread->stats, &stats);
+
+        const char* state;
+        switch (thread->state) {
+            case PROCESS_READY: state = "READY"; break;
+            case PROCESS_RUNNING: state = "RUNNING"; break;
+            case PROCESS_BLOCKED: state = "BLOCKED"; break;
+            default: state = "EXITING";
+        }
+
+        len = 0;
+        top_append_number(line, &len, top_rows[i].id, 6);
+        top_append_number(line, &len, thread->process->id, 6);
+        top_append_percent(line, &len, top_rows[i].delta, 8);
+        top_append_number(line, &len,
+                          udiv64_32(timer_cycles_to_us(top_rows[i].cycles), 1000, NULL), 10);
+        top_append_number(line, &len,
+                          udiv64_32(timer_cycles_to_us(stats.wait_cycles), 1000, NULL), 10);
+        top_append_number(line, &len, stats.voluntary_switches, 8);
+        top_append_number(line, &len, stats.involuntary_switches, 8);
+        top_append_number(line, &len, stats.last_cpu, 5);
+        top_append(line, &len, state, 0);
+        top_print_line(screen_row++, line, len, WHITE_ON_BLACK);
+    }
+
+    // Стираем строки, оставшиеся от предыдущего кадра
+    while (screen_row < rows) {
+        top_print_line(screen_row++, line, 0, WHITE_ON_BLACK);
+    }
+}
+
+void run_top(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    memset(top_prev, 0, sizeof(top_prev));
+    clear_screen();
+
+    uint64_t last = rdtsc();
+    top_sample(last, 1);
+    // Первый кадр рисуем быстро, дальше - раз в TOP_INTERVAL_MS
+    uint32_t wait_ms = TOP_POLL_MS * 4;
+    while (1) {
+        bool quit = false;
+        for (uint32_t ms = 0; ms < wait_ms && !quit; ms += TOP_POLL_MS) {
+            char c = get_char_nonblock();
+            quit = c == 'q' || c == 'Q';
+            if (!quit) {
+                thread_sleep(TOP_POLL_MS);
+            }
+        }
+        if (quit) {
+            break;
+        }
+        uint64_t now = rdtsc();
+        uint64_t interval = now - last;
+        last = now;
+        top_draw(top_sample(now, interval), interval);
+        wait_ms = TOP_INTERVAL_MS;
+    }
+
+    clear_screen();
+}
+
+// ============== spawn-bench ==============
+// Цикл «создать процесс - дождаться его завершения»: стоимость выделения
+// слотов, постановки в очередь и освобождения. Второй прогон идет при
+// занятой таблице процессов, чтобы убедиться, что стоимость не зависит
+// от числа живых процессов.
+
+static semaphore_t spawn_done = SEMAPHORE_INIT(0);
+
+static void spawn_bench_worker() {
+    semaphore_up(&spawn_done);
+}
+
+static void spawn_bench_filler() {
+    while (1) {
+        thread_sleep(1000);
+    }
+}
+
+// Средняя стоимость одного цикла создания/завершения в тактах TSC
+static uint32_t spawn_bench_run(uint32_t count) {
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < count; i++) {
+        // Слот завершившегося процесса освобождается после переключения
+        // с его стека - при нехватке слотов даем этому случиться
+        while (create_process(spawn_bench_worker, 1) == NULL) {
+            thread_yield();
+        }
+        semaphore_down(&spawn_done);
+    }
+    return (uint32_t)udiv64_32(rdtsc() - start, count, NULL);
+}
+
+static void spawn_bench_print(const char* label, uint32_t cycles) {
+    print_string(label, WHITE_ON_BLACK);
+    kprintf_color(LIGHT_BLUE_ON_BLACK, "%u", cycles);
+    kprintf(" cycles (%u us)\n", (uint32_t)timer_cycles_to_us(cycles));
+}
+
+void run_spawn_bench(int argc, char** argv) {
+    uint32_t count = SPAWN_BENCH_DEFAULT_COUNT;
+    if (argc > 1) {
+        int value = atoi(argv[1]);
+        if (value > 0) {
+            count = value;
+        }
+    }
+
+    kprintf("\nSpawn/exit benchmark: %u processes\n", count);
+
+    spawn_bench_print("Idle table:    ", spawn_bench_run(count));
+
+    // Заполняем таблицу спящими процессами
+    uint32_t filler_pids[SPAWN_BENCH_FILLERS];
+    uint32_t fillers = 0;
+    while (fillers < SPAWN_BENCH_FILLERS) {
+        process_t* proc = create_process(spawn_bench_filler, 1);
+        if (proc == NULL) {
+            break;
+        }
+        filler_pids[fillers++] = proc->id;
+    }
+
+    kprintf("Busy table (%u sleeping): ", fillers);
+    spawn_bench_print("", spawn_bench_run(count));
+
+    // Поиск по хешу PID
+    uint32_t found = 0;
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < SPAWN_BENCH_LOOKUPS; i++) {
+        if (fillers != 0 && find_process(filler_pids[i % fillers]) != NULL) {
+            found++;
+        }
+    }
+    uint32_t lookup = (uint32_t)udiv64_32(rdtsc() - start, SPAWN_BENCH_LOOKUPS, NULL);
+
+    for (uint32_t i = 0; i < fillers; i++) {
+        process_t* proc = find_process(filler_pids[i]);
+        if (proc != NULL) {
+            process_exit(proc);
+        }
+    }
+
+    print_string("PID lookup:    ", WHITE_ON_BLACK);
+    kprintf_color(LIGHT_BLUE_ON_BLACK, "%u", lookup);
+    print_string(" cycles", WHITE_ON_BLACK);
+    if (found == (fillers != 0 ? SPAWN_BENCH_LOOKUPS : 0)) {
+        print_string(" OK\n", LIGHT_GREEN_ON_BLACK);
+    } else {
+        print_string(" FAIL\n", LIGHT_RED_ON_BLACK);
+    }
+}
+
+// ============== rt-test ==============
+// Задержка запуска: время от пробуждения потока (wake_thread) до его
+// выполнения. На каждом процессоре крутится фоновый обычный поток;
+// измеряющий поток спит и просыпается по таймеру сначала как обычный,
+// затем как SCHED_FIFO и как SCHED_DEADLINE. После измерений проверяется
+// контроль допуска: фоновые потоки по очереди просят по 50% процессора.
+
+typedef struct {
+    uint32_t samples;
+    uint64_t total;
+    uint64_t worst;
+} rt_test_result_t;
+
+static volatile bool rt_test_stop;
+static volatile sched_policy_t rt_test_policy;
+static volatile uint32_t rt_test_count;
+static rt_test_result_t rt_test_result;
+static semaphore_t rt_test_done = SEMAPHORE_INIT(0);
+
+static void rt_test_load() {
+    while (!rt_test_stop) {
+        cpu_relax();
+    }
+}
+
+static void rt_test_measure() {
+    thread_t* self = get_current_thread();
+    rt_test_result_t result = {0, 0, 0};
+    bool ready = true;
+
+    if (rt_test_policy == SCHED_FIFO) {
+        ready = sched_set_fifo(self, RT_TEST_FIFO_PRIORITY);
+    } else if (rt_test_policy == SCHED_DEADLINE) {
+        ready = sched_set_deadline(self, RT_TEST_DL_RUNTIME_US, RT_TEST_DL_PERIOD_US);
+    }
+
+    for (uint32_t i = 0; ready && i < rt_test_count; i++) {
+        bool slept;
+        if (rt_test_policy == SCHED_DEADLINE) {
+            slept = sched_wait_next_period();
+        } else {
+            thread_sleep(RT_TEST_SLEEP_MS);
+            slept = true;
+        }
+        if (!slept) {
+            continue;
+        }
+        uint64_t delay = rdtsc() - self->woken_at;
+        result.samples++;
+        result.total += delay;
+        if (delay > result.worst) {
+            result.worst = delay;
+        }
+    }
+
+    rt_test_result = result;
+    semaphore_up(&rt_test_done);
+}
+
+static void rt_test_print_us(uint64_t cycles) {
+    kprintf_color(LIGHT_BLUE_ON_BLACK, "%u", (uint32_t)timer_cycles_to_us(cycles));
+    print_string(" us", WHITE_ON_BLACK);
+}
+
+static void rt_test_run(const char* label, sched_policy_t policy) {
+    rt_test_policy = policy;
+    print_string(label, WHITE_ON_BLACK);
+    if (create_process(rt_test_measure, KERNEL_PROCESS_PRIORITY) == NULL) {
+        print_string("cannot create thread\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+    semaphore_down(&rt_test_done);
+
+    rt_test_result_t result = rt_test_result;
+    if (result.samples == 0) {
+        print_string("no samples\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+    print_string("avg ", WHITE_ON_BLACK);
+    rt_test_print_us(udiv64_32(result.total, result.samples, NULL));
+    print_string(", worst ", WHITE_ON_BLACK);
+    rt_test_print_us(result.worst);
+    kprintf(" (%u wakeups)\n", result.samples);
+}
+
+void run_rt_test(int argc, char** argv) {
+    uint32_t count = RT_TEST_DEFAULT_COUNT;
+    if (argc > 1) {
+        int value = atoi(argv[1]);
+        if (value > 0) {
+            count = value;
+        }
+    }
+    rt_test_count = count;
+    rt_test_stop = false;
+
+    // Фоновая нагрузка: по обычному потоку на каждый процессор
+    uint32_t cpu_count = cpu_online_count();
+    uint32_t load_pids[MAX_CPUS];
+    uint32_t loads = 0;
+    while (loads < cpu_count) {
+        process_t* proc = create_process(rt_test_load, RT_TEST_LOAD_PRIORITY);
+        if (proc == NULL) {
+            break;
+        }
+        load_pids[loads++] = proc->id;
+    }
+
+    kprintf("\nWakeup latency under load: %u busy thread(s), %u wakeups per class\n",
+            loads, count);
+
+    rt_test_run("SCHED_NORMAL:   ", SCHED_NORMAL);
+    rt_test_run("SCHED_FIFO:     ", SCHED_FIFO);
+    rt_test_run("SCHED_DEADLINE: ", SCHED_DEADLINE);
+
+    // Контроль допуска: фоновые потоки получают по 90% (на каждый процессор
+    // приходится не больше одного), после чего запрос еще 50% для потока
+    // оболочки должен быть отклонен
+    uint32_t admitted = 0;
+    for (uint32_t i = 0; i < loads; i++) {
+        process_t* proc = find_process(load_pids[i]);
+        if (proc != NULL && proc->threads[0] != NULL &&
+            sched_set_deadline(proc->threads[0], 900, 1000)) {
+            admitted++;
+        }
+    }
+    thread_t* self = get_current_thread();
+    bool rejected = !sched_set_deadline(self, 500, 1000);
+    if (!rejected) {
+        sched_set_normal(self);
+    }
+    uint32_t reserved = sched_dl_reserved();
+    rt_test_stop = true;
+    for (uint32_t i = 0; i < loads; i++) {
+        process_t* proc = find_process(load_pids[i]);
+        if (proc != NULL) {
+            process_exit(proc);
+        }
+    }
+
+    print_string("Admission:      ", WHITE_ON_BLACK);
+    kprintf_color(LIGHT_BLUE_ON_BLACK, "%u", admitted);
+    kprintf(" of %u x 90%% admitted, extra 50%% rejected: %s", loads, rejected ? "yes" : "no");
+    // После завершения потоков резерв должен вернуться к нулю
+    bool ok = admitted == loads && rejected && sched_dl_reserved() == 0 &&
+              reserved <= cpu_count * DL_BANDWIDTH_LIMIT;
+    if (ok) {
+        print_string(" OK\n", LIGHT_GREEN_ON_BLACK);
+    } else {
+        print_string(" FAIL\n", LIGHT_RED_ON_BLACK);
     }
 }
 
 // ============== Функции переключения контекста ==============
 // Реализация функций из threads_and_processes.h
 
-void save_context(cpu_context_t* context) {
-    asm volatile (
-        "movl %%eax, 0(%0)\n\t"
-        "movl %%ebx, 4(%0)\n\t"
-        "movl %%ecx, 8(%0)\n\t"
-        "movl %%edx, 12(%0)\n\t"
-        "movl %%esi, 16(%0)\n\t"
-        "movl %%edi, 20(%0)\n\t"
-        "movl %%esp, 24(%0)\n\t"
-        "movl %%ebp, 28(%0)\n\t"
-        "movl (%%esp), %%eax\n\t"
-        "movl %%eax, 32(%0)\n\t"  // eip
-        "pushfl\n\t"
-        "popl %%eax\n\t"
-        "movl %%eax, 36(%0)\n\t"  // eflags
-        "movl %%cr3, %%eax\n\t"
-        "movl %%eax, 40(%0)\n\t"  // cr3
-        :
-        : "r" (context)
-        : "eax", "memory"
-    );
-}
-
-void restore_context(cpu_context_t* context) {
-    asm volatile (
-        "movl 40(%0), %%eax\n\t"
-        "movl %%eax, %%cr3\n\t"
-        "movl 24(%0), %%esp\n\t"
-        "movl 28(%0), %%ebp\n\t"
-        "movl 36(%0), %%eax\n\t"
-        "pushl %%eax\n\t"
-        "popfl\n\t"
-        "movl 0(%0), %%eax\n\t"
-        "movl 4(%0), %%ebx\n\t"
-        "movl 8(%0), %%ecx\n\t"
-        "movl 12(%0), %%edx\n\t"
-        "movl 16(%0), %%esi\n\t"
-        "movl 20(%0), %%edi\n\t"
-        "pushl 32(%0)\n\t"  // push eip
-        "ret\n\t"
-        :
-        : "r" (context)
-        : "memory"
-    );
-}
\ No newline at end of file
+// switch_context(from, to): сохраняет регистры, которые вызываемая функция
+// обязана сохранять (EBX, ESI, EDI, EBP, ESP), и адрес возврата в from,
+// затем загружает их из to. EFLAGS каждого потока хранится на его стеке
+// (schedule() вызывается с irq_save/irq_restore).
+asm (
+    ".section .text\n"
+    ".global switch_context\n"
+    "switch_context:\n"
+    "    movl 4(%esp), %eax\n"      // from
+    "    movl 8(%esp), %edx\n"      // to
+    "    movl %ebx, 4(%eax)\n"
+    "    movl %esi, 16(%eax)\n"
+    "    movl %edi, 20(%eax)\n"
+    "    movl %ebp, 28(%eax)\n"
+    "    movl (%esp), %ecx\n"
+    "    movl %ecx, 32(%eax)\n"     // eip = адрес возврата
+    "    leal 4(%esp), %ecx\n"
+    "    movl %ecx, 24(%eax)\n"     // esp после возврата
+    "    movl 4(%edx), %ebx\n"
+    "    movl 16(%edx), %esi\n"
+    "    movl 20(%edx), %edi\n"
+    "    movl 28(%edx), %ebp\n"
+    "    movl 24(%edx), %esp\n"
+    "    jmp *32(%edx)\n"
+);
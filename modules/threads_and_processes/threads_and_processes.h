@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "../fpu/fpu.h"
 
 // Максимальное количество процессов
 #define MAX_PROCESSES 32
@@ -10,6 +11,18 @@
 #define MAX_THREADS_PER_PROCESS 8
 // Размер стека потока (4KB)
 #define THREAD_STACK_SIZE 4096
+// Размер стека кольца 3 у потока пользовательского процесса
+#define USER_STACK_SIZE 4096
+// Размер хеш-таблиц поиска по PID/TID (степень двойки)
+#define ID_HASH_SIZE 64
+// Приоритеты потоков SCHED_FIFO: 1 (низший) - 99 (высший)
+#define SCHED_FIFO_MIN_PRIORITY 1
+#define SCHED_FIFO_MAX_PRIORITY 99
+// Доля процессора в фиксированной точке: 1 << DL_BANDWIDTH_SHIFT = 100%
+#define DL_BANDWIDTH_SHIFT 20
+// Сколько времени каждого процессора можно отдать потокам SCHED_DEADLINE
+// (95%: остаток гарантированно достается обычным потокам)
+#define DL_BANDWIDTH_LIMIT ((95u << DL_BANDWIDTH_SHIFT) / 100)
 
 // Состояния процесса/потока
 typedef enum {
@@ -30,18 +43,68 @@ typedef struct {
     uint32_t cr3; // Указатель на таблицу страниц
 } cpu_context_t;
 
-// Дескриптор потока
+// Статистика планировщика (для потока и суммарно для процесса)
 typedef struct {
+    uint64_t run_cycles;            // Время выполнения (такты TSC)
+    uint64_t wait_cycles;           // Время ожидания в очереди готовых (такты TSC)
+    uint32_t voluntary_switches;    // Переключения из-за блокировки или завершения
+    uint32_t involuntary_switches;  // Вытеснения и thread_yield
+    uint32_t last_cpu;              // Процессор, на котором поток выполнялся последним
+} sched_stats_t;
+
+// Класс планирования потока. Готовый поток класса реального времени
+// всегда выбирается раньше обычных: сначала SCHED_DEADLINE (по ближайшему
+// крайнему сроку), затем SCHED_FIFO (по приоритету), затем SCHED_NORMAL.
+typedef enum {
+    SCHED_NORMAL,       // Доли времени по vruntime процесса
+    SCHED_FIFO,         // Фиксированный приоритет, без кванта
+    SCHED_DEADLINE      // EDF: бюджет runtime в каждом периоде period
+} sched_policy_t;
+
+struct process;
+struct ktimer;
+struct wait_queue;
+
+// Дескриптор потока
+typedef struct thread {
     uint32_t id;                // Идентификатор потока
     cpu_context_t context;      // Контекст процессора
     uint8_t* stack;             // Указатель на стек потока
     process_state_t state;      // Состояние потока
     uint32_t priority;          // Приоритет потока (0-255)
-    uint32_t time_slice;        // Оставшееся время выполнения
+    uint32_t time_slice;        // Оставшееся время выполнения (в тиках)
+    struct process* process;    // Процесс, которому принадлежит поток
+    struct thread* next_ready;  // Следующий поток в очереди готовых
+    uint64_t run_start;         // TSC в момент последнего запуска
+    uint64_t ready_since;       // TSC постановки в очередь готовых
+    uint32_t pending_wait;      // Ожидание в очереди, еще не учтенное в stats
+    sched_stats_t stats;        // Статистика планировщика
+    uint32_t cpu;               // Процессор, в очереди которого находится поток
+    volatile bool on_cpu;       // Поток выполняется или еще не сохранен при переключении
+    bool timed_out;             // Последнее ожидание завершилось по таймауту
+    struct ktimer* wait_timer;  // Таймер текущего ожидания (лежит на стеке потока)
+    struct wait_queue* wait_queue; // Очередь ожидания, в которой стоит поток
+    struct thread* wait_next;   // Следующий поток в очереди ожидания
+    bool fpu_used;              // Поток выполнял FPU/SSE-инструкции
+    uint32_t fpu_cpu;           // Процессор, куда состояние FPU загружалось последним
+    struct thread* next_free;   // Следующий свободный слот
+    struct thread* hash_next;   // Следующий поток в цепочке хеша TID
+    volatile uint32_t reaped;   // Слот уже возвращен в список свободных
+    void (*user_entry)();       // Точка входа в кольце 3 (потоки пользовательских процессов)
+    uint8_t* user_stack;        // Стек кольца 3 (thread->stack служит стеком ядра)
+    sched_policy_t policy;      // Класс планирования
+    uint32_t rt_priority;       // Приоритет SCHED_FIFO
+    uint64_t dl_runtime;        // SCHED_DEADLINE: бюджет на период (такты TSC)
+    uint64_t dl_period;         // SCHED_DEADLINE: период (такты TSC)
+    uint64_t dl_deadline;       // Абсолютный крайний срок текущего периода (TSC)
+    int64_t dl_remaining;       // Остаток бюджета текущего периода (такты TSC)
+    uint32_t dl_bandwidth;      // Зарезервированная доля процессора
+    uint64_t woken_at;          // TSC последнего пробуждения (задержка запуска)
+    uint8_t fpu_state[FPU_STATE_SIZE] __attribute__((aligned(16))); // FXSAVE
 } thread_t;
 
 // Дескриптор процесса
-typedef struct {
+typedef struct process {
     uint32_t id;                // Идентификатор процесса
     thread_t* threads[MAX_THREADS_PER_PROCESS]; // Потоки процесса
     uint32_t thread_count;      // Количество потоков
@@ -50,6 +113,12 @@ typedef struct {
     uint32_t* page_directory;   // Таблица страниц процесса
     uint32_t heap_start;        // Начало кучи процесса
     uint32_t heap_end;          // Конец кучи процесса
+    uint64_t vruntime;          // Виртуальное время: такты TSC / (priority + 1)
+    uint32_t alive_threads;     // Потоки, еще не завершившиеся
+    bool user;                  // Потоки процесса выполняются в кольце 3
+    sched_stats_t stats;        // Суммарная статистика всех потоков процесса
+    struct process* next_free;  // Следующий свободный слот
+    struct process* hash_next;  // Следующий процесс в цепочке хеша PID
 } process_t;
 
 // Инициализация подсистемы процессов и потоков
@@ -58,18 +127,57 @@ void init_process_manager();
 // Создание нового процесса
 process_t* create_process(void (*entry_point)(), uint32_t priority);
 
+// Создание процесса, потоки которого выполняются в кольце 3. Страничной
+// защиты нет: entry_point - функция образа ядра, которая обращается к ядру
+// только через системные вызовы (modules/syscall).
+process_t* create_user_process(void (*entry_point)(), uint32_t priority);
+
 // Создание нового потока в процессе
 thread_t* create_thread(process_t* process, void (*entry_point)(), uint32_t priority);
 
 // Переключение на следующий поток
 void schedule();
 
+// Добровольная передача процессора другому потоку
+void thread_yield();
+
+// Вызывается из обработчика таймера на каждом тике
+void scheduler_tick();
+
+// Вызывается при выходе из прерывания: переключение, если истек квант
+void preempt_if_needed();
+
+// Создание потока бездействия для дополнительного процессора (на BSP)
+bool scheduler_prepare_cpu(uint32_t cpu_index);
+
+// Запуск планировщика на дополнительном процессоре (не возвращается)
+void scheduler_start_cpu();
+
+// Завершение переключения контекста (после switch_context и в начале нового потока)
+void scheduler_finish_switch();
+
+// Количество потоков в очереди процессора (для балансировки и статистики)
+uint32_t scheduler_queue_length(uint32_t cpu_index);
+
 // Завершение текущего потока
 void thread_exit();
 
 // Завершение процесса и всех его потоков
 void process_exit(process_t* process);
 
+// Поиск процесса/потока по идентификатору (O(1), NULL - не найден)
+process_t* find_process(uint32_t pid);
+thread_t* find_thread(uint32_t tid);
+
+// Согласованная копия статистики потока или процесса
+void sched_stats_read(const sched_stats_t* stats, sched_stats_t* out);
+
+// Команда top: загрузка процессоров и потоков с обновлением на месте
+void run_top(int argc, char** argv);
+
+// Команда spawn-bench: стоимость создания и завершения процесса
+void run_spawn_bench(int argc, char** argv);
+
 // Получение текущего процесса
 process_t* get_current_process();
 
@@ -82,15 +190,57 @@ void block_thread(thread_t* thread);
 // Разблокировка потока
 void unblock_thread(thread_t* thread);
 
+// Перевод текущего потока в состояние ожидания без переключения. Вызывается
+// под блокировкой ресурса с запрещенными прерываниями; затем блокировка
+// отпускается и вызывается thread_wait. Пробуждение между этими вызовами
+// не теряется.
+void thread_prepare_block();
+
+// Переключение после thread_prepare_block с ожиданием не дольше timeout_ms
+// (0 - без ограничения). Возвращает false по таймауту.
+bool thread_wait(uint32_t timeout_ms);
+
+// Блокировка текущего потока не дольше timeout_ms (0 - без ограничения).
+// Возвращает false, если ожидание прервано таймаутом. Возможны ложные
+// пробуждения: вызывающий должен заново проверить свое условие.
+bool thread_block_timeout(uint32_t timeout_ms);
+
+// Приостановка текущего потока на ms миллисекунд. До запуска планировщика
+// ожидание идет на hlt.
+void thread_sleep(uint32_t ms);
+
 // Установка приоритета потока
 void set_thread_priority(thread_t* thread, uint32_t priority);
 
 // Установка приоритета процесса
 void set_process_priority(process_t* process, uint32_t priority);
 
-// Объявления функций для переключения контекста
-void save_context(cpu_context_t* context);
-void restore_context(cpu_context_t* context);
+// Перевод потока в класс SCHED_FIFO с приоритетом rt_priority (1-99).
+// Такой поток выполняется, пока не заблокируется, не уступит процессор
+// или не будет вытеснен потоком с более высоким приоритетом.
+bool sched_set_fifo(thread_t* thread, uint32_t rt_priority);
+
+// Перевод потока в класс SCHED_DEADLINE: runtime_us микросекунд каждые
+// period_us. Возвращает false, если сумма зарезервированных долей превысит
+// DL_BANDWIDTH_LIMIT на каждый запущенный процессор (контроль допуска).
+bool sched_set_deadline(thread_t* thread, uint32_t runtime_us, uint32_t period_us);
+
+// Возврат потока в обычный класс (резерв SCHED_DEADLINE освобождается)
+void sched_set_normal(thread_t* thread);
+
+// Поток SCHED_DEADLINE: ожидание начала следующего периода с новым
+// бюджетом. Возвращает false, если период уже начался и ждать не пришлось.
+bool sched_wait_next_period(void);
+
+// Суммарная доля процессоров, зарезервированная потоками SCHED_DEADLINE
+// (в единицах 1 << DL_BANDWIDTH_SHIFT)
+uint32_t sched_dl_reserved(void);
+
+// Команда rt-test: задержка запуска после пробуждения под фоновой нагрузкой
+void run_rt_test(int argc, char** argv);
+
+// Переключение контекста: сохраняет текущий поток в from и продолжает to
+void switch_context(cpu_context_t* from, cpu_context_t* to);
 
 // Объявление глобального массива процессов
 extern process_t processes[MAX_PROCESSES];
@@ -0,0 +1,365 @@
+#include "timer.h"
+#include "../templates/kernel_api.h"
+#include "../templates/io.h"
+#include "../interrupts/interrupts.h"
+#include "../threads_and_processes/threads_and_processes.h"
+#include "../cpu/cpu.h"
+#include "../apic/apic.h"
+
+// Порты программируемого таймера 8253/8254
+#define PIT_CHANNEL0 0x40
+#define PIT_CHANNEL2 0x42
+#define PIT_COMMAND 0x43
+#define PIT_GATE_PORT 0x61
+#define PIT_BASE_FREQUENCY 1193182
+
+// Интервал калибровки TSC
+#define TSC_CALIBRATION_MS 10
+// Наибольший интервал однократного счета канала 0 PIT (~54 мс)
+#define PIT_MAX_COUNT 0xFFFF
+
+// Время считается по TSC, а не по числу прерываний: при остановленном
+// тике прерывания таймера приходят нерегулярно
+static uint64_t tsc_boot = 0;
+static uint32_t tsc_per_ms = 0;
+static uint32_t tsc_per_tick = 0;
+
+// ============== Иерархическое колесо таймеров ==============
+// 4 уровня по 64 ячейки: уровень L хранит таймеры, до срабатывания
+// которых от 64^L до 64^(L+1) тиков. Когда младший уровень проходит
+// полный оборот, ячейка старшего уровня «осыпается» на младшие.
+// Вставка и отмена - O(1) (двусвязный список в ячейке).
+
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+// Наибольшая задержка, которую можно записать в колесо
+#define WHEEL_MAX_DELAY ((1u << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+static ktimer_t* wheel[WHEEL_LEVELS][WHEEL_SIZE];
+// Занятые ячейки каждого уровня (для поиска ближайшего события)
+static uint64_t wheel_pending[WHEEL_LEVELS];
+// Тик, до которого колесо обработано
+static uint32_t wheel_clock = 0;
+static spinlock_t wheel_lock = SPINLOCK_INIT;
+// Обработку истекших таймеров ведет один процессор за раз
+static spinlock_t wheel_run_lock = SPINLOCK_INIT;
+// Таймер, обработчик которого выполняется сейчас, и процессор, где он выполняется
+static ktimer_t* volatile wheel_running_timer = NULL;
+static volatile uint32_t wheel_running_cpu = 0;
+
+static void wheel_unlink(ktimer_t* timer) {
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    *timer->pprev = timer->next;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+static void wheel_insert(ktimer_t** slot, ktimer_t* timer) {
+    timer->next = *slot;
+    if (*slot != NULL) {
+        (*slot)->pprev = &timer->next;
+    }
+    timer->pprev = slot;
+    *slot = timer;
+}
+
+// Выбор ячейки по сроку срабатывания (под wheel_lock)
+static void wheel_add(ktimer_t* timer) {
+    uint32_t delta = timer->expires - wheel_clock;
+    // Срок уже прошел: сработает на следующем тике
+    if ((int32_t)delta <= 0) {
+        timer->expires = wheel_clock + 1;
+        delta = 1;
+    } else if (delta > WHEEL_MAX_DELAY) {
+        timer->expires = wheel_clock + WHEEL_MAX_DELAY;
+        delta = WHEEL_MAX_DELAY;
+    }
+
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (1u << (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    uint32_t index = (timer->expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    wheel_insert(&wheel[level][index], timer);
+    wheel_pending[level] |= 1ull << index;
+}
+
+// Перенос содержимого ячейки в локальный список (под wheel_lock)
+static void wheel_detach(int level, uint32_t index, ktimer_t** list) {
+    *list = wheel[level][index];
+    wheel[level][index] = NULL;
+    wheel_pending[level] &= ~(1ull << index);
+    if (*list != NULL) {
+        (*list)->pprev = list;
+    }
+}
+
+static void wheel_cascade(int level) {
+    ktimer_t* list;
+    uint32_t index = (wheel_clock >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    wheel_detach(level, index, &list);
+    while (list != NULL) {
+        ktimer_t* timer = list;
+        wheel_unlink(timer);
+        wheel_add(timer);
+    }
+}
+
+// Вызов обработчиков истекших таймеров (в контексте прерывания)
+static void timer_run_expired(void) {
+    uint32_t now = get_ticks();
+    if ((int32_t)(now - wheel_clock) <= 0 || !spin_trylock(&wheel_run_lock)) {
+        return;
+    }
+
+    spin_lock(&wheel_lock);
+    while ((int32_t)(now - wheel_clock) > 0) {
+        wheel_clock++;
+        uint32_t index = wheel_clock & WHEEL_MASK;
+        for (int level = 1; level < WHEEL_LEVELS && index == 0; level++) {
+            wheel_cascade(level);
+            index = (wheel_clock >> (WHEEL_BITS * level)) & WHEEL_MASK;
+        }
+
+        // Пока обработчик работает без блокировки, остальные таймеры
+        // списка можно отменить: они остаются связанными через expired
+        ktimer_t* expired;
+        wheel_detach(0, wheel_clock & WHEEL_MASK, &expired);
+        while (expired != NULL) {
+            ktimer_t* timer = expired;
+            wheel_unlink(timer);
+            timer_callback_t callback = timer->callback;
+            void* data = timer->data;
+            wheel_running_cpu = this_cpu()->index;
+            wheel_running_timer = timer;
+            spin_unlock(&wheel_lock);
+
+            callback(data);
+
+            spin_lock(&wheel_lock);
+            wheel_running_timer = NULL;
+        }
+    }
+    spin_unlock(&wheel_lock);
+    spin_unlock(&wheel_run_lock);
+}
+
+// Число тиков до ближайшего события колеса, не более limit (под wheel_lock).
+// Для старших уровней берется момент осыпания ячейки - он не позже срока.
+static uint32_t wheel_next_event(uint32_t limit) {
+    uint32_t best = limit;
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        if (wheel_pending[level] == 0) {
+            continue;
+        }
+        uint32_t shift = WHEEL_BITS * level;
+        uint32_t current = (wheel_clock >> shift) & WHEEL_MASK;
+        for (uint32_t d = 1; d <= WHEEL_SIZE; d++) {
+            if ((wheel_pending[level] >> ((current + d) & WHEEL_MASK)) & 1) {
+                uint32_t when = (((wheel_clock >> shift) + d) << shift) - wheel_clock;
+                if (when < best) {
+                    best = when;
+                }
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+// Ближайшее событие таймера, мкс от текущего момента
+static uint32_t timer_next_event_us(void) {
+    uint32_t limit = TIMER_IDLE_MAX_MS * TIMER_HZ / 1000;
+
+    spin_lock(&wheel_lock);
+    uint32_t ticks = wheel_next_event(limit);
+    uint32_t behind = get_ticks() - wheel_clock;
+    spin_unlock(&wheel_lock);
+
+    if (ticks <= behind) {
+        return 1000000 / TIMER_HZ / 10;
+    }
+    return (ticks - behind) * (1000000 / TIMER_HZ);
+}
+
+void timer_init(ktimer_t* timer, timer_callback_t callback, void* data) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->callback = callback;
+    timer->data = data;
+}
+
+void timer_add(ktimer_t* timer, uint32_t delay_ticks) {
+    uint32_t flags = irq_save();
+    spin_lock(&wheel_lock);
+    if (timer->pprev != NULL) {
+        wheel_unlink(timer);
+    }
+    timer->expires = get_ticks() + delay_ticks;
+    wheel_add(timer);
+    spin_unlock(&wheel_lock);
+    irq_restore(flags);
+}
+
+bool timer_cancel(ktimer_t* timer) {
+    uint32_t flags = irq_save();
+    spin_lock(&wheel_lock);
+    bool pending = timer->pprev != NULL;
+    if (pending) {
+        wheel_unlink(timer);
+    }
+    spin_unlock(&wheel_lock);
+
+    // Обработчик мог уже начаться на другом процессоре: ждем его окончания,
+    // чтобы после возврата таймер можно было освободить
+    uint32_t self = this_cpu()->index;
+    while (wheel_running_timer == timer && wheel_running_cpu != self) {
+        cpu_relax();
+    }
+    irq_restore(flags);
+    return pending;
+}
+
+uint32_t timer_ms_to_ticks(uint32_t ms) {
+    // Округляем вверх: задержка не короче запрошенной
+    return (uint32_t)udiv64_32((uint64_t)ms * TIMER_HZ + 999, 1000, NULL);
+}
+
+void timer_tick(void) {
+    timer_run_expired();
+    scheduler_tick();
+}
+
+static void pit_start_periodic(void) {
+    uint32_t divisor = PIT_BASE_FREQUENCY / TIMER_HZ;
+    // Канал 0, младший/старший байт, режим 3 (генератор меандра)
+    outb(PIT_COMMAND, 0x36);
+    outb(PIT_CHANNEL0, divisor & 0xFF);
+    outb(PIT_CHANNEL0, (divisor >> 8) & 0xFF);
+}
+
+static void pit_start_oneshot(uint32_t us) {
+    uint32_t count = PIT_MAX_COUNT;
+    if (us < PIT_MAX_COUNT * 1000 / (PIT_BASE_FREQUENCY / 1000)) {
+        count = (PIT_BASE_FREQUENCY / 1000) * us / 1000;
+    }
+    if (count == 0) {
+        count = 1;
+    }
+    // Канал 0, младший/старший байт, режим 0 (прерывание по окончании счета)
+    outb(PIT_COMMAND, 0x30);
+    outb(PIT_CHANNEL0, count & 0xFF);
+    outb(PIT_CHANNEL0, (count >> 8) & 0xFF);
+}
+
+// Вызывается потоком бездействия с запрещенными прерываниями перед hlt
+void timer_idle_enter(void) {
+    cpu_t* cpu = this_cpu();
+    uint32_t us = timer_next_event_us();
+
+    if (apic_enabled) {
+        apic_timer_oneshot(us);
+    } else {
+        pit_start_oneshot(us);
+    }
+    cpu->tick_stopped = true;
+}
+
+// Вызывается планировщиком перед переключением на рабочий поток
+void timer_idle_exit(void) {
+    cpu_t* cpu = this_cpu();
+    if (!cpu->tick_stopped) {
+        return;
+    }
+    cpu->tick_stopped = false;
+
+    if (apic_enabled) {
+        apic_timer_periodic();
+    } else {
+        pit_start_periodic();
+    }
+}
+
+static void timer_interrupt(interrupt_frame_t* frame) {
+    (void)frame;
+    timer_tick();
+}
+
+void timer_pit_wait_ms(uint32_t ms) {
+    uint32_t count = PIT_BASE_FREQUENCY * ms / 1000;
+
+    // Вход GATE канала 2 включен, динамик выключен
+    uint8_t gate = (inb(PIT_GATE_PORT) & ~0x02) | 0x01;
+    outb(PIT_GATE_PORT, gate & ~0x01);
+
+    // Канал 2, младший/старший байт, режим 0 (прерывание по окончании счета)
+    outb(PIT_COMMAND, 0xB0);
+    outb(PIT_CHANNEL2, count & 0xFF);
+    outb(PIT_CHANNEL2, (count >> 8) & 0xFF);
+
+    // Фронт на GATE запускает счет; бит 5 порта 0x61 - выход канала 2
+    outb(PIT_GATE_PORT, gate);
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        cpu_relax();
+    }
+}
+
+static void calibrate_tsc(void) {
+    uint64_t start = rdtsc();
+    timer_pit_wait_ms(TSC_CALIBRATION_MS);
+    uint64_t elapsed = rdtsc() - start;
+    tsc_per_ms = (uint32_t)udiv64_32(elapsed, TSC_CALIBRATION_MS, NULL);
+    if (tsc_per_ms == 0) {
+        tsc_per_ms = 1;
+    }
+    tsc_per_tick = tsc_per_ms * (1000 / TIMER_HZ);
+}
+
+void init_timer(void) {
+    calibrate_tsc();
+    tsc_boot = rdtsc();
+    wheel_clock = 0;
+    pit_start_periodic();
+
+    register_interrupt_handler(IRQ_BASE + IRQ_TIMER, timer_interrupt);
+    irq_unmask(IRQ_TIMER);
+}
+
+void timer_stop_pit(void) {
+    irq_mask(IRQ_TIMER);
+}
+
+uint32_t get_ticks(void) {
+    if (tsc_per_tick == 0) {
+        return 0;
+    }
+    return (uint32_t)udiv64_32(rdtsc() - tsc_boot, tsc_per_tick, NULL);
+}
+
+uint32_t timer_tsc_per_ms(void) {
+    return tsc_per_ms;
+}
+
+uint64_t timer_boot_tsc(void) {
+    return tsc_boot;
+}
+
+uint64_t timer_cycles_to_us(uint64_t cycles) {
+    uint32_t tsc_per_us = tsc_per_ms / 1000;
+    if (tsc_per_us == 0) {
+        tsc_per_us = 1;
+    }
+    return udiv64_32(cycles, tsc_per_us, NULL);
+}
+
+void timer_udelay(uint32_t us) {
+    uint64_t end = rdtsc() + (uint64_t)us * (tsc_per_ms / 1000);
+    while (rdtsc() < end) {
+        cpu_relax();
+    }
+}
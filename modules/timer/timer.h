@@ -0,0 +1,72 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Частота системного таймера (тиков в секунду)
+#define TIMER_HZ 100
+
+// Наибольшая длительность простоя без прерываний таймера
+#define TIMER_IDLE_MAX_MS 1000
+
+typedef void (*timer_callback_t)(void* data);
+
+// Отложенный вызов. Структура принадлежит вызывающему и может лежать на
+// стеке: после timer_cancel колесо к ней не обращается.
+typedef struct ktimer {
+    struct ktimer* next;        // Следующий таймер в ячейке колеса
+    struct ktimer** pprev;      // Ссылка на этот таймер (NULL - не запущен)
+    uint32_t expires;           // Тик срабатывания
+    timer_callback_t callback;  // Вызывается в контексте прерывания
+    void* data;
+} ktimer_t;
+
+// Калибровка TSC и запуск PIT в периодическом режиме с частотой TIMER_HZ
+void init_timer(void);
+
+// Количество тиков с момента запуска таймера (по TSC)
+uint32_t get_ticks(void);
+
+// Обработка тика (PIT или таймер локального APIC)
+void timer_tick(void);
+
+// Подготовка таймера к запуску
+void timer_init(ktimer_t* timer, timer_callback_t callback, void* data);
+
+// Запуск (или перезапуск) таймера через delay_ticks тиков
+void timer_add(ktimer_t* timer, uint32_t delay_ticks);
+
+// Отмена таймера. Возвращает true, если он еще не сработал. Если обработчик
+// уже выполняется на другом процессоре, ждет его завершения.
+bool timer_cancel(ktimer_t* timer);
+
+// Перевод миллисекунд в тики (с округлением вверх)
+uint32_t timer_ms_to_ticks(uint32_t ms);
+
+// Остановка периодического тика на простаивающем процессоре: следующее
+// прерывание таймера придет к ближайшему событию
+void timer_idle_enter(void);
+
+// Возобновление периодического тика, когда появились готовые потоки
+void timer_idle_exit(void);
+
+// Остановка периодических прерываний PIT (тик переходит на APIC)
+void timer_stop_pit(void);
+
+// Ожидание опросом канала 2 PIT (не более 50 мс), не требует прерываний
+void timer_pit_wait_ms(uint32_t ms);
+
+// Тактов TSC в миллисекунду
+uint32_t timer_tsc_per_ms(void);
+
+// Значение TSC в момент запуска таймера (0 до init_timer)
+uint64_t timer_boot_tsc(void);
+
+// Перевод тактов TSC в микросекунды
+uint64_t timer_cycles_to_us(uint64_t cycles);
+
+// Активное ожидание по TSC
+void timer_udelay(uint32_t us);
+
+#endif // TIMER_H
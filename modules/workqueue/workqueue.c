@@ -0,0 +1,359 @@
+#include "workqueue.h"
+#include "../templates/kernel_api.h"
+#include "../templates/io.h"
+#include "../cpu/cpu.h"
+#include "../threads_and_processes/threads_and_processes.h"
+#include "../shell/shell.h"
+#include "../kprintf/kprintf.h"
+#include <stddef.h>
+
+extern int atoi(const char *str);
+
+// Приоритеты рабочих потоков общих очередей
+#define SYSTEM_WQ_PRIORITY 10
+#define SYSTEM_HIGHPRI_WQ_PRIORITY 40
+#define SYSTEM_HIGHPRI_WQ_WORKERS 2
+
+// Параметры wq-bench
+#define WQ_BENCH_MAX_WORKS 1024
+#define WQ_BENCH_DELAYED_WORKS 64
+#define WQ_BENCH_DELAY_MS 20
+#define WQ_BENCH_TIMEOUT_MS 5000
+// Сколько ждать задания прошлого прогона, оставшиеся после таймаута
+#define WQ_BENCH_DRAIN_MS 5000
+#define WQ_BENCH_DRAIN_POLL_MS 10
+
+workqueue_t* system_wq = NULL;
+workqueue_t* system_highpri_wq = NULL;
+
+static workqueue_t workqueues[MAX_WORKQUEUES];
+static uint32_t workqueue_count = 0;
+
+// Создание очередей идет по одной: новый рабочий поток забирает указатель
+// на свою очередь из spawning_wq и подтверждает это через spawn_ack
+static mutex_t create_lock = MUTEX_INIT;
+static workqueue_t* volatile spawning_wq = NULL;
+static semaphore_t spawn_ack = SEMAPHORE_INIT(0);
+
+static void counter_add(volatile uint32_t* counter, uint32_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+// Постановка в конец списка и пробуждение рабочего потока. Будим только
+// при появлении работы в пустой очереди и при каждых WORKQUEUE_BATCH
+// новых заданиях: остальные задания рабочий поток заберет пакетом.
+static void insert_work(workqueue_t* wq, work_t* work) {
+    work->next = NULL;
+    work->queued_at = rdtsc();
+
+    uint32_t flags = spin_lock_irqsave(&wq->idle.lock);
+    if (wq->tail != NULL) {
+        wq->tail->next = work;
+    } else {
+        wq->head = work;
+    }
+    wq->tail = work;
+    wq->length++;
+    if (wq->length == 1 || wq->length % WORKQUEUE_BATCH == 0) {
+        wait_queue_wake_one_locked(&wq->idle);
+    }
+    spin_unlock_irqrestore(&wq->idle.lock, flags);
+    counter_add(&wq->queued, 1);
+}
+
+static void update_max_latency(workqueue_t* wq, uint32_t us) {
+    uint32_t old = wq->max_latency_us;
+    while (us > old &&
+           !__atomic_compare_exchange_n(&wq->max_latency_us, &old, us, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Рабочий поток: забирает до WORKQUEUE_BATCH заданий за один захват
+// блокировки и выполняет их без блокировки
+static void worker_main() {
+    workqueue_t* wq = spawning_wq;
+    semaphore_up(&spawn_ack);
+
+    work_t* batch[WORKQUEUE_BATCH];
+    while (1) {
+        uint32_t flags = spin_lock_irqsave(&wq->idle.lock);
+        while (wq->head == NULL) {
+            wait_queue_add_locked(&wq->idle);
+            spin_unlock(&wq->idle.lock);
+            wait_queue_sleep(&wq->idle, 0);
+            spin_lock(&wq->idle.lock);
+        }
+        uint32_t count = 0;
+        while (count < WORKQUEUE_BATCH && wq->head != NULL) {
+            work_t* work = wq->head;
+            wq->head = work->next;
+            batch[count++] = work;
+        }
+        if (wq->head == NULL) {
+            wq->tail = NULL;
+        } else {
+            // Остаток отдаем другому рабочему потоку
+            wait_queue_wake_one_locked(&wq->idle);
+        }
+        wq->length -= count;
+        spin_unlock_irqrestore(&wq->idle.lock, flags);
+
+        counter_add(&wq->batches, 1);
+        uint64_t now = rdtsc();
+        for (uint32_t i = 0; i < count; i++) {
+            work_t* work = batch[i];
+            work_func_t func = work->func;
+            update_max_latency(wq, (uint32_t)timer_cycles_to_us(now - work->queued_at));
+            // Флаг снимается до вызова: функция может поставить задание снова
+            __atomic_store_n(&work->pending, 0, __ATOMIC_RELEASE);
+            func(work);
+        }
+        counter_add(&wq->executed, count);
+    }
+}
+
+workqueue_t* create_workqueue(const char* name, uint32_t priority, uint32_t workers) {
+    if (workers == 0) {
+        workers = 1;
+    }
+    if (workers > WORKQUEUE_MAX_WORKERS) {
+        workers = WORKQUEUE_MAX_WORKERS;
+    }
+    if (workers > MAX_THREADS_PER_PROCESS) {
+        workers = MAX_THREADS_PER_PROCESS;
+    }
+
+    mutex_lock(&create_lock);
+    if (workqueue_count >= MAX_WORKQUEUES) {
+        mutex_unlock(&create_lock);
+        return NULL;
+    }
+    workqueue_t* wq = &workqueues[workqueue_count];
+    wq->name = name;
+    wait_queue_init(&wq->idle);
+    wq->head = NULL;
+    wq->tail = NULL;
+    wq->length = 0;
+    wq->priority = priority;
+    wq->workers = 0;
+    wq->queued = 0;
+    wq->executed = 0;
+    wq->batches = 0;
+    wq->max_latency_us = 0;
+
+    // Рабочие потоки - потоки отдельного процесса с приоритетом очереди
+    spawning_wq = wq;
+    wq->process = create_process(worker_main, priority);
+    if (wq->process != NULL) {
+        semaphore_down(&spawn_ack);
+        wq->workers = 1;
+        while (wq->workers < workers &&
+               create_thread(wq->process, worker_main, priority) != NULL) {
+            semaphore_down(&spawn_ack);
+            wq->workers++;
+        }
+    }
+    if (wq->workers == 0) {
+        mutex_unlock(&create_lock);
+        return NULL;
+    }
+    workqueue_count++;
+    mutex_unlock(&create_lock);
+    return wq;
+}
+
+// Команды оболочки
+static const shell_command_t workqueue_commands[] = {
+    { "wq-bench", "[N]", "Workqueue latency and batching (N works)", run_workqueue_bench },
+};
+
+void init_workqueues(void) {
+    shell_register_all(workqueue_commands, sizeof(workqueue_commands) / sizeof(workqueue_commands[0]));
+    system_wq = create_workqueue("events", SYSTEM_WQ_PRIORITY, cpu_online_count());
+    system_highpri_wq = create_workqueue("events_highpri", SYSTEM_HIGHPRI_WQ_PRIORITY,
+                                         SYSTEM_HIGHPRI_WQ_WORKERS);
+    if (system_wq == NULL || system_highpri_wq == NULL) {
+        print_string("Failed to create system workqueues!\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+    kprintf_color(LIGHT_GREEN_ON_BLACK, "Workqueues initialized (%u workers)\n",
+                  system_wq->workers + system_highpri_wq->workers);
+}
+
+void init_work(work_t* work, work_func_t func) {
+    work->func = func;
+    work->next = NULL;
+    work->pending = 0;
+    work->queued_at = 0;
+}
+
+void init_delayed_work(delayed_work_t* dwork, work_func_t func) {
+    init_work(&dwork->work, func);
+    dwork->wq = NULL;
+    timer_init(&dwork->timer, NULL, dwork);
+}
+
+bool queue_work(workqueue_t* wq, work_t* work) {
+    if (__atomic_exchange_n(&work->pending, 1, __ATOMIC_ACQ_REL) != 0) {
+        return false;
+    }
+    insert_work(wq, work);
+    return true;
+}
+
+// Срабатывание таймера задания (контекст прерывания)
+static void delayed_work_timer(void* data) {
+    delayed_work_t* dwork = (delayed_work_t*)data;
+    insert_work(dwork->wq, &dwork->work);
+}
+
+bool queue_delayed_work(workqueue_t* wq, delayed_work_t* dwork, uint32_t delay_ms) {
+    if (__atomic_exchange_n(&dwork->work.pending, 1, __ATOMIC_ACQ_REL) != 0) {
+        return false;
+    }
+    if (delay_ms == 0) {
+        insert_work(wq, &dwork->work);
+        return true;
+    }
+    dwork->wq = wq;
+    timer_init(&dwork->timer, delayed_work_timer, dwork);
+    timer_add(&dwork->timer, timer_ms_to_ticks(delay_ms));
+    return true;
+}
+
+bool cancel_delayed_work(delayed_work_t* dwork) {
+    if (timer_cancel(&dwork->timer)) {
+        __atomic_store_n(&dwork->work.pending, 0, __ATOMIC_RELEASE);
+        return true;
+    }
+    return false;
+}
+
+// ============== wq-bench ==============
+// Первый прогон: поток оболочки ставит пачку заданий в system_wq.
+// Второй: задания ставятся в system_highpri_wq из обработчика таймера,
+// как это делал бы обработчик прерывания устройства.
+
+static work_t bench_works[WQ_BENCH_MAX_WORKS];
+static delayed_work_t bench_delayed[WQ_BENCH_DELAYED_WORKS];
+static volatile uint32_t bench_done_count;
+static volatile uint32_t bench_target;
+static volatile uint32_t bench_running;     // Функций заданий выполняется сейчас
+static semaphore_t bench_finished = SEMAPHORE_INIT(0);
+
+static void bench_work(work_t* work) {
+    (void)work;
+    __atomic_add_fetch(&bench_running, 1, __ATOMIC_ACQ_REL);
+    if (__atomic_add_fetch(&bench_done_count, 1, __ATOMIC_ACQ_REL) == bench_target) {
+        semaphore_up(&bench_finished);
+    }
+    __atomic_sub_fetch(&bench_running, 1, __ATOMIC_ACQ_REL);
+}
+
+// Остались ли задания прогона в очереди, на таймере или в исполнении
+static bool bench_busy(void) {
+    if (__atomic_load_n(&bench_running, __ATOMIC_ACQUIRE) != 0) {
+        return true;
+    }
+    for (uint32_t i = 0; i < WQ_BENCH_MAX_WORKS; i++) {
+        if (bench_works[i].pending) {
+            return true;
+        }
+    }
+    for (uint32_t i = 0; i < WQ_BENCH_DELAYED_WORKS; i++) {
+        if (bench_delayed[i].work.pending) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// После таймаута задания нельзя инициализировать заново, пока они связаны
+// в список очереди или взведены в колесе таймеров: отложенные снимаются с
+// таймера, остальные дожидаются исполнения. false - задания так и остались.
+static bool bench_drain(void) {
+    for (uint32_t i = 0; i < WQ_BENCH_DELAYED_WORKS; i++) {
+        cancel_delayed_work(&bench_delayed[i]);
+    }
+    for (uint32_t waited = 0; bench_busy() && waited < WQ_BENCH_DRAIN_MS;
+         waited += WQ_BENCH_DRAIN_POLL_MS) {
+        thread_sleep(WQ_BENCH_DRAIN_POLL_MS);
+    }
+    return !bench_busy();
+}
+
+static void bench_report(const char* label, workqueue_t* wq, uint32_t executed_before,
+                         uint32_t batches_before, uint32_t us, bool ok) {
+    uint32_t executed = wq->executed - executed_before;
+    uint32_t batches = wq->batches - batches_before;
+    kprintf("%-26s", label);
+    kprintf_color(LIGHT_BLUE_ON_BLACK, "%8u", us);
+    kprintf(" us, batch avg %u, max latency %u us", batches != 0 ? executed / batches : 0,
+            wq->max_latency_us);
+    if (ok) {
+        print_string("  OK\n", LIGHT_GREEN_ON_BLACK);
+    } else {
+        print_string("  FAIL\n", LIGHT_RED_ON_BLACK);
+    }
+}
+
+void run_workqueue_bench(int argc, char** argv) {
+    uint32_t count = WQ_BENCH_MAX_WORKS;
+    if (argc > 1) {
+        int value = atoi(argv[1]);
+        if (value > 0 && value < WQ_BENCH_MAX_WORKS) {
+            count = value;
+        }
+    }
+    if (system_wq == NULL || system_highpri_wq == NULL) {
+        print_string("\nWorkqueues are not initialized\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+
+    kprintf("\nWorkqueue benchmark: %u works, %u workers\n", count, system_wq->workers);
+
+    if (bench_busy() && !bench_drain()) {
+        print_string("Works of a previous run are still pending, try again later\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+
+    // Пачка заданий из потока
+    semaphore_init(&bench_finished, 0);
+    bench_done_count = 0;
+    bench_target = count;
+    system_wq->max_latency_us = 0;
+    uint32_t executed = system_wq->executed;
+    uint32_t batches = system_wq->batches;
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < count; i++) {
+        init_work(&bench_works[i], bench_work);
+        queue_work(system_wq, &bench_works[i]);
+    }
+    bool ok = semaphore_down_timeout(&bench_finished, WQ_BENCH_TIMEOUT_MS);
+    uint32_t us = (uint32_t)timer_cycles_to_us(rdtsc() - start);
+    bench_report("Thread -> events:", system_wq, executed, batches, us, ok);
+    if (!ok && !bench_drain()) {
+        print_string("Works are still pending, skipping the timer run\n", LIGHT_RED_ON_BLACK);
+        return;
+    }
+
+    // Задания из обработчика таймера
+    semaphore_init(&bench_finished, 0);
+    bench_done_count = 0;
+    bench_target = WQ_BENCH_DELAYED_WORKS;
+    system_highpri_wq->max_latency_us = 0;
+    executed = system_highpri_wq->executed;
+    batches = system_highpri_wq->batches;
+    start = rdtsc();
+    for (uint32_t i = 0; i < WQ_BENCH_DELAYED_WORKS; i++) {
+        init_delayed_work(&bench_delayed[i], bench_work);
+        queue_delayed_work(system_highpri_wq, &bench_delayed[i], WQ_BENCH_DELAY_MS);
+    }
+    ok = semaphore_down_timeout(&bench_finished, WQ_BENCH_TIMEOUT_MS);
+    us = (uint32_t)timer_cycles_to_us(rdtsc() - start);
+    bench_report("Timer IRQ -> highpri:", system_highpri_wq, executed, batches, us, ok);
+    if (!ok) {
+        bench_drain();
+    }
+}
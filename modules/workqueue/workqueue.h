@@ -0,0 +1,87 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../sync/sync.h"
+#include "../timer/timer.h"
+
+// Наибольшее число очередей и рабочих потоков одной очереди
+#define MAX_WORKQUEUES 8
+#define WORKQUEUE_MAX_WORKERS 8
+// Сколько заданий рабочий поток забирает из очереди за один захват
+#define WORKQUEUE_BATCH 16
+
+struct work;
+struct workqueue;
+
+typedef void (*work_func_t)(struct work* work);
+
+// Задание. Принадлежит вызывающему; пока задание стоит в очереди
+// (pending), его нельзя освобождать или ставить в очередь повторно.
+typedef struct work {
+    work_func_t func;
+    struct work* next;
+    volatile uint32_t pending;  // Задание в очереди или ждет таймера
+    uint64_t queued_at;         // TSC постановки в очередь (статистика)
+} work_t;
+
+// Задание с задержкой: по истечении таймера ставится в очередь
+typedef struct {
+    work_t work;
+    ktimer_t timer;
+    struct workqueue* wq;
+} delayed_work_t;
+
+// Очередь отложенных заданий с пулом рабочих потоков. Список заданий
+// защищен блокировкой очереди ожидания рабочих потоков.
+typedef struct workqueue {
+    const char* name;
+    wait_queue_t idle;          // Рабочие потоки без заданий
+    work_t* head;
+    work_t* tail;
+    uint32_t length;
+    uint32_t priority;          // Приоритет рабочих потоков
+    uint32_t workers;
+    struct process* process;    // Процесс, которому принадлежат рабочие потоки
+    // Статистика
+    volatile uint32_t queued;
+    volatile uint32_t executed;
+    volatile uint32_t batches;  // Сколько раз рабочий поток забирал задания
+    volatile uint32_t max_latency_us;
+} workqueue_t;
+
+// Общие очереди: обычная и высокоприоритетная (для работы из обработчиков
+// прерываний, которую нельзя долго откладывать)
+extern workqueue_t* system_wq;
+extern workqueue_t* system_highpri_wq;
+
+// Создание общих очередей (после запуска планировщика и процессоров)
+void init_workqueues(void);
+
+// Создание очереди с workers рабочими потоками приоритета priority
+workqueue_t* create_workqueue(const char* name, uint32_t priority, uint32_t workers);
+
+// Подготовка задания
+void init_work(work_t* work, work_func_t func);
+void init_delayed_work(delayed_work_t* dwork, work_func_t func);
+
+// Постановка задания в очередь. Можно вызывать из обработчика прерывания.
+// Возвращает false, если задание уже стоит в очереди.
+bool queue_work(workqueue_t* wq, work_t* work);
+
+// Постановка в очередь через delay_ms миллисекунд (0 - сразу)
+bool queue_delayed_work(workqueue_t* wq, delayed_work_t* dwork, uint32_t delay_ms);
+
+// Отмена задания, которое еще ждет таймера. Возвращает true, если отменено.
+bool cancel_delayed_work(delayed_work_t* dwork);
+
+// Задание с задержкой, из которого получено work_t (внутри функции задания)
+static inline delayed_work_t* to_delayed_work(work_t* work) {
+    return (delayed_work_t*)work;
+}
+
+// Команда wq-bench: задержка выполнения и пакетная обработка заданий
+void run_workqueue_bench(int argc, char** argv);
+
+#endif // WORKQUEUE_H
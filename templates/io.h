@@ -0,0 +1,83 @@
+#ifndef IO_H
+#define IO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Общие низкоуровневые функции для модулей ядра (порты, TSC, флаги прерываний)
+
+// Чтение байта из порта ввода/вывода
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    asm volatile ("inb %1, %0" : "=a" (ret) : "dN" (port));
+    return ret;
+}
+
+// Запись байта в порт ввода/вывода
+static inline void outb(uint16_t port, uint8_t data) {
+    asm volatile ("outb %1, %0" : : "dN" (port), "a" (data));
+}
+
+// Чтение слова (16 бит) из порта ввода/вывода
+static inline uint16_t inw(uint16_t port) {
+    uint16_t ret;
+    asm volatile ("inw %w1, %w0" : "=a" (ret) : "Nd" (port));
+    return ret;
+}
+
+// Запись слова (16 бит) в порт ввода/вывода
+static inline void outw(uint16_t port, uint16_t data) {
+    asm volatile ("outw %w0, %w1" : : "a" (data), "Nd" (port));
+}
+
+// Короткая задержка после обращения к медленным устройствам (PIC, PIT)
+static inline void io_wait(void) {
+    outb(0x80, 0);
+}
+
+// Чтение счетчика тактов процессора
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Деление 64-битного числа на 32-битное без libgcc (__udivdi3 нам недоступна)
+static inline uint64_t udiv64_32(uint64_t n, uint32_t d, uint32_t* rem) {
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t lo = (uint32_t)n;
+    uint32_t q_hi = hi / d;
+    uint32_t r = hi % d;
+    uint32_t q_lo;
+    asm ("divl %4" : "=a" (q_lo), "=d" (r) : "a" (lo), "d" (r), "rm" (d));
+    if (rem != NULL) {
+        *rem = r;
+    }
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+// Сохранение EFLAGS и запрет прерываний
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    asm volatile ("pushfl\n\tpopl %0\n\tcli" : "=r" (flags) : : "memory");
+    return flags;
+}
+
+// Восстановление EFLAGS (флаг IF возвращается в прежнее состояние)
+static inline void irq_restore(uint32_t flags) {
+    asm volatile ("pushl %0\n\tpopfl" : : "r" (flags) : "memory", "cc");
+}
+
+static inline void irq_enable(void) {
+    asm volatile ("sti" : : : "memory");
+}
+
+static inline void irq_disable(void) {
+    asm volatile ("cli" : : : "memory");
+}
+
+static inline void cpu_relax(void) {
+    asm volatile ("pause" : : : "memory");
+}
+
+#endif // IO_H
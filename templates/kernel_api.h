@@ -8,5 +8,10 @@
 void print_string(const char *str, uint8_t color);
 void print_char(char c, uint8_t color);
 void* memset(void* ptr, int value, size_t num);  // Теперь size_t определен
+void clear_screen();
+void console_goto(int row, int col);
+int console_columns();
+int console_rows();
+char get_char_nonblock();
 
 #endif // KERNEL_API_H
\ No newline at end of file